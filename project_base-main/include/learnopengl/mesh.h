@@ -7,7 +7,10 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <rg/Bounds.h>
+#include <rg/FrameStats.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 using namespace std;
@@ -23,10 +26,19 @@ struct Vertex {
     glm::vec3 Tangent;
     // bitangent
     glm::vec3 Bitangent;
+    // lightmapCoords, in the model's own lightmap square; zero until SetLightmapLayout
+    glm::vec2 LightmapCoords;
 };
 
 
 
+// one level of detail: a range of the mesh's element buffer and its geometric error in model units
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float error;
+};
+
 struct Texture {
     unsigned int id;
     string type;
@@ -39,6 +51,15 @@ public:
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
+    // object-space bounds, filled in by the model loader
+    AABB                 bounds;
+    BoundingSphere       sphere;
+    // the material's opacity; below 1 the mesh is left out of the opaque passes and drawn translucent
+    float                opacity = 1.0f;
+    // levels of detail, finest first; empty until SetLods is called
+    vector<MeshLod>      lods;
+    // the element buffer contents: every level back to back, indexed by lods
+    vector<unsigned int> lodIndices;
 
     unsigned int VAO;
     std::string glslIdentifierPrefix;
@@ -53,8 +74,59 @@ public:
         setupMesh();
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    // stores the simplified index lists behind the full-detail indices in the element buffer
+    void SetLods(const vector<vector<unsigned int>> &levels, const vector<float> &errors)
+    {
+        vector<unsigned int> &elements = lodIndices;
+        elements = indices;
+        lods.clear();
+        lods.push_back(MeshLod{0, (unsigned int) indices.size(), 0.0f});
+        for (unsigned int i = 0; i < levels.size(); i++)
+        {
+            lods.push_back(MeshLod{(unsigned int) elements.size(), (unsigned int) levels[i].size(), errors[i]});
+            elements.insert(elements.end(), levels[i].begin(), levels[i].end());
+        }
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements.size() * sizeof(unsigned int), &elements[0], GL_STATIC_DRAW);
+        glBindVertexArray(0);
+    }
+
+    // gives every vertex a lightmap coordinate: vertices listed by source (copies of existing vertices,
+    // the first vertices.size() in order) with coords each, and the full-detail indices rewritten to
+    // them; the simplified levels keep drawing the original vertices
+    void SetLightmapLayout(const vector<unsigned int> &source, const vector<glm::vec2> &coords,
+                           const vector<unsigned int> &layoutIndices)
+    {
+        vector<Vertex> laidOut(source.size());
+        for (unsigned int i = 0; i < source.size(); i++)
+        {
+            laidOut[i] = vertices[source[i]];
+            laidOut[i].LightmapCoords = coords[i];
+        }
+        vertices.swap(laidOut);
+        indices = layoutIndices;
+        if (lodIndices.empty())
+            lodIndices = indices;
+        else
+            std::copy(indices.begin(), indices.end(), lodIndices.begin());
+
+        vector<glm::vec3> positions;
+        for (const Vertex &vertex : vertices)
+            positions.push_back(vertex.Position);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, lodIndices.size() * sizeof(unsigned int), &lodIndices[0], GL_STATIC_DRAW);
+        glBindVertexArray(0);
+    }
+
+    // render the mesh, lod selects a simplified level when the mesh has one
+    void Draw(Shader &shader, unsigned int lod = 0)
     {
         // bind appropriate textures
         unsigned int diffuseNr  = 1;
@@ -85,17 +157,43 @@ public:
 
 
         // draw mesh
+        unsigned int first = 0, count = indices.size();
+        if (!lods.empty())
+        {
+            const MeshLod &level = lods[std::min<size_t>(lod, lods.size() - 1)];
+            first = level.firstIndex;
+            count = level.indexCount;
+        }
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (void*)(first * sizeof(unsigned int)));
+        rg::countDrawCall(count / 3);
         glBindVertexArray(0);
 
         // always good practice to set everything back to defaults once configured.
         glActiveTexture(GL_TEXTURE0);
     }
 
+    // depth-only draw from the position-only stream, no textures bound
+    void DrawDepth(unsigned int lod = 0)
+    {
+        unsigned int first = 0, count = indices.size();
+        if (!lods.empty())
+        {
+            const MeshLod &level = lods[std::min<size_t>(lod, lods.size() - 1)];
+            first = level.firstIndex;
+            count = level.indexCount;
+        }
+        glBindVertexArray(depthVAO);
+        glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (void*)(first * sizeof(unsigned int)));
+        rg::countDrawCall(count / 3);
+        glBindVertexArray(0);
+    }
+
 private:
     // render data
     unsigned int VBO, EBO;
+    // tightly packed positions sharing EBO, for depth-only passes
+    unsigned int depthVAO, positionVBO;
 
     // initializes all the buffer objects/arrays
     void setupMesh()
@@ -132,6 +230,22 @@ private:
         // vertex bitangent
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        // vertex lightmap coords
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, LightmapCoords));
+
+        // position-only stream
+        vector<glm::vec3> positions;
+        for (const Vertex &vertex : vertices)
+            positions.push_back(vertex.Position);
+        glGenVertexArrays(1, &depthVAO);
+        glGenBuffers(1, &positionVBO);
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
 
         glBindVertexArray(0);
     }
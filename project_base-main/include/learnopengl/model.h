@@ -12,7 +12,11 @@
 
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
+#include <rg/MeshSimplifier.h>
 
+#include <sys/stat.h>
+
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -23,6 +27,13 @@ using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// simplified levels generated per mesh, each keeping this fraction of the previous level's triangles
+const unsigned int MODEL_LOD_LEVELS = 3;
+const float MODEL_LOD_REDUCTION = 0.5f;
+const char MODEL_LOD_MAGIC[4] = {'R', 'G', 'L', 'D'};
+// 2: border constraints counted once in the simplifier's errors
+const uint32_t MODEL_LOD_VERSION = 2;
+
 
 
 class Model
@@ -33,6 +44,12 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    // object-space bounds of all meshes
+    AABB bounds;
+    // per level of detail, the largest geometric error of any mesh (level 0 is exact)
+    vector<float> lodErrors;
+    // side of the square the meshes' LightmapCoords were laid out in (Lightmaps.h), 0 before, -1 if they didn't fit
+    int lightmapResolution = 0;
 
     // constructor, expects a filepath to a 3D model.
     Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
@@ -41,10 +58,19 @@ public:
     }
 
     // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    void Draw(Shader &shader, unsigned int lod = 0)
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].Draw(shader, lod);
+    }
+
+    // whether any mesh is translucent and drawn in the translucent pass
+    bool Translucent() const
+    {
+        for (const Mesh &mesh : meshes)
+            if (mesh.opacity < 1.0f)
+                return true;
+        return false;
     }
 
     void SetShaderTextureNamePrefix(std::string prefix) {
@@ -70,6 +96,138 @@ private:
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+
+        for (const Mesh &mesh : meshes)
+            bounds.Expand(mesh.bounds);
+
+        buildLods(path);
+    }
+
+    // Simplified levels are cooked once into <model>.lod next to the model and reused until the
+    // model file changes; meshes keep their vertices, only the element buffer grows.
+    void buildLods(string const &path)
+    {
+        string cachePath = path + ".lod";
+        vector<vector<vector<unsigned int>>> levels(meshes.size());
+        vector<vector<float>> errors(meshes.size());
+        if (!loadLodCache(cachePath, fileModificationTime(path), levels, errors))
+        {
+            for (unsigned int i = 0; i < meshes.size(); i++)
+            {
+                const Mesh &mesh = meshes[i];
+                levels[i].clear();
+                levels[i].reserve(MODEL_LOD_LEVELS);
+                errors[i].clear();
+                vector<glm::vec3> positions, normals;
+                vector<glm::vec2> texCoords;
+                for (const Vertex &v : mesh.vertices)
+                {
+                    positions.push_back(v.Position);
+                    normals.push_back(v.Normal);
+                    texCoords.push_back(v.TexCoords);
+                }
+                const vector<unsigned int> *source = &mesh.indices;
+                for (unsigned int level = 0; level < MODEL_LOD_LEVELS; level++)
+                {
+                    size_t target = (size_t) (source->size() / 3 * MODEL_LOD_REDUCTION) * 3;
+                    float error = 0.0f;
+                    levels[i].push_back(MeshSimplifier::Simplify(positions, normals, texCoords, *source, target, &error));
+                    errors[i].push_back(std::max(error, level ? errors[i][level - 1] : 0.0f));
+                    source = &levels[i].back();
+                }
+            }
+            saveLodCache(cachePath, levels, errors);
+        }
+
+        lodErrors.assign(MODEL_LOD_LEVELS + 1, 0.0f);
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            meshes[i].SetLods(levels[i], errors[i]);
+            for (unsigned int level = 0; level < MODEL_LOD_LEVELS; level++)
+                lodErrors[level + 1] = std::max(lodErrors[level + 1], errors[i][level]);
+        }
+    }
+
+    static long long fileModificationTime(const string &path)
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return 0;
+        return (long long) info.st_mtime;
+    }
+
+    // the cache is stale when it is older than the model or was written for a different mesh layout
+    bool loadLodCache(const string &cachePath, long long modelTime, vector<vector<vector<unsigned int>>> &levels,
+                      vector<vector<float>> &errors)
+    {
+        if (fileModificationTime(cachePath) < modelTime)
+            return false;
+        std::ifstream in(cachePath, std::ios::binary);
+        char magic[4] = {};
+        uint32_t version = 0, meshCount = 0;
+        in.read(magic, 4);
+        in.read((char *) &version, sizeof(version));
+        in.read((char *) &meshCount, sizeof(meshCount));
+        if (!in || std::memcmp(magic, MODEL_LOD_MAGIC, 4) != 0 || version != MODEL_LOD_VERSION
+            || meshCount != meshes.size())
+            return false;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            uint32_t vertexCount = 0, levelCount = 0;
+            in.read((char *) &vertexCount, sizeof(vertexCount));
+            in.read((char *) &levelCount, sizeof(levelCount));
+            if (!in || vertexCount != meshes[i].vertices.size() || levelCount != MODEL_LOD_LEVELS)
+                return false;
+            levels[i].resize(levelCount);
+            errors[i].resize(levelCount);
+            for (unsigned int level = 0; level < levelCount; level++)
+            {
+                uint32_t indexCount = 0;
+                in.read((char *) &errors[i][level], sizeof(float));
+                in.read((char *) &indexCount, sizeof(indexCount));
+                if (!in || indexCount > meshes[i].indices.size())
+                    return false;
+                levels[i][level].resize(indexCount);
+                in.read((char *) levels[i][level].data(), indexCount * sizeof(unsigned int));
+                for (unsigned int index : levels[i][level])
+                    if (index >= vertexCount)
+                        return false;
+            }
+        }
+        if (!in)
+        {
+            cout << "ERROR::MODEL::TRUNCATED_LOD_CACHE " << cachePath << endl;
+            return false;
+        }
+        return true;
+    }
+
+    void saveLodCache(const string &cachePath, const vector<vector<vector<unsigned int>>> &levels,
+                      const vector<vector<float>> &errors)
+    {
+        std::ofstream out(cachePath, std::ios::binary);
+        if (!out)
+        {
+            cout << "ERROR::MODEL::LOD_CACHE_NOT_WRITABLE " << cachePath << endl;
+            return;
+        }
+        uint32_t meshCount = meshes.size();
+        out.write(MODEL_LOD_MAGIC, 4);
+        out.write((const char *) &MODEL_LOD_VERSION, sizeof(MODEL_LOD_VERSION));
+        out.write((const char *) &meshCount, sizeof(meshCount));
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            uint32_t vertexCount = meshes[i].vertices.size(), levelCount = levels[i].size();
+            out.write((const char *) &vertexCount, sizeof(vertexCount));
+            out.write((const char *) &levelCount, sizeof(levelCount));
+            for (unsigned int level = 0; level < levelCount; level++)
+            {
+                uint32_t indexCount = levels[i][level].size();
+                out.write((const char *) &errors[i][level], sizeof(float));
+                out.write((const char *) &indexCount, sizeof(indexCount));
+                out.write((const char *) levels[i][level].data(), indexCount * sizeof(unsigned int));
+            }
+        }
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -97,6 +255,7 @@ private:
         vector<Vertex> vertices;
         vector<unsigned int> indices;
         vector<Texture> textures;
+        AABB bounds;
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -108,6 +267,7 @@ private:
             vector.y = mesh->mVertices[i].y;
             vector.z = mesh->mVertices[i].z;
             vertex.Position = vector;
+            bounds.Expand(vector);
             // normals
             if (mesh->HasNormals())
             {
@@ -138,6 +298,7 @@ private:
             }
             else
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+            vertex.LightmapCoords = glm::vec2(0.0f, 0.0f);
 
             vertices.push_back(vertex);
 
@@ -161,6 +322,11 @@ private:
         // normal: texture_normalN
         aiColor3D color(0.0f, 0.0f, 0.0f);
         material->Get(AI_MATKEY_COLOR_AMBIENT, color);
+        // the .mtl's d; exporters write 0 for clear glass, which still has to show a little. Only untextured
+        // materials count as glass: a textured one with d below 1, like the trees' leaves, is drawn opaque,
+        // texture and all, and stays in the shadow passes
+        float opacity = 1.0f;
+        material->Get(AI_MATKEY_OPACITY, opacity);
 
 
         // 1. diffuse maps
@@ -178,8 +344,19 @@ private:
 
 
 
+        // bounding sphere around the box center, tight enough for culling without a Ritter pass
+        BoundingSphere sphere;
+        sphere.center = bounds.Center();
+        for (const Vertex &v : vertices)
+            sphere.radius = std::max(sphere.radius, glm::length(v.Position - sphere.center));
+
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        Mesh result(vertices, indices, textures);
+        result.bounds = bounds;
+        result.sphere = sphere;
+        if (opacity < 1.0f && diffuseMaps.empty())
+            result.opacity = std::max(opacity, 0.2f);
+        return result;
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -8,17 +8,25 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <set>
+#include <vector>
 #include <common.h>
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly; every stage is compiled with a #define for each of
+    // defines, and #include "file" lines are replaced by the file, relative to the including one
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string> &defines)
+            : Shader(vertexPath, fragmentPath, nullptr, defines) {}
+
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+           const std::vector<std::string> &defines = std::vector<std::string>())
     {
         std::string vertexPathString(vertexPath);
         std::string fragmentPathString(fragmentPath);
+        std::string geometryPathString(geometryPath != nullptr ? geometryPath : "");
 
         vertexPath = vertexPathString.c_str();
         fragmentPath= fragmentPathString.c_str();
@@ -51,9 +59,7 @@ public:
             // if geometry shader path is present, also load a geometry shader
             if(geometryPath != nullptr)
             {
-                std::string geometryPathString(geometryPath);
-                geometryPath = geometryPathString.c_str();
-                gShaderFile.open(geometryPath);
+                gShaderFile.open(geometryPathString.c_str());
                 std::stringstream gShaderStream;
                 gShaderStream << gShaderFile.rdbuf();
                 gShaderFile.close();
@@ -64,6 +70,10 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        vertexCode = preprocess(vertexCode, vertexPathString, defines);
+        fragmentCode = preprocess(fragmentCode, fragmentPathString, defines);
+        if(geometryPath != nullptr)
+            geometryCode = preprocess(geometryCode, geometryPathString, defines);
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
         // 2. compile shaders
@@ -169,6 +179,62 @@ public:
     }
 
 private:
+    // expands the includes and puts the defines right after the #version line
+    // ------------------------------------------------------------------------
+    static std::string preprocess(const std::string &code, const std::string &path,
+                                  const std::vector<std::string> &defines)
+    {
+        std::set<std::string> included;
+        std::string expanded = expandIncludes(code, path, included);
+        std::string::size_type version = expanded.find("#version");
+        std::string::size_type lineEnd = version == std::string::npos ? 0 : expanded.find('\n', version);
+        if (lineEnd == std::string::npos)
+            lineEnd = expanded.size();
+        else if (version != std::string::npos)
+            lineEnd++;
+        std::string defineLines;
+        for (const std::string &define : defines)
+            defineLines += "#define " + define + "\n";
+        return expanded.insert(lineEnd, defineLines);
+    }
+
+    // every file is pasted once, later includes of it are dropped
+    static std::string expandIncludes(const std::string &code, const std::string &path,
+                                      std::set<std::string> &included)
+    {
+        std::string directory = path.substr(0, path.find_last_of('/') + 1);
+        std::istringstream lines(code);
+        std::string line, result;
+        while (std::getline(lines, line))
+        {
+            std::string::size_type start = line.find_first_not_of(" \t");
+            if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+            {
+                std::string::size_type open = line.find('"', start), close = line.rfind('"');
+                if (open == std::string::npos || close <= open)
+                {
+                    std::cout << "ERROR::SHADER::MALFORMED_INCLUDE: " << path << ": " << line << std::endl;
+                    continue;
+                }
+                std::string includePath = directory + line.substr(open + 1, close - open - 1);
+                if (!included.insert(includePath).second)
+                    continue;
+                std::ifstream file(includePath);
+                if (!file)
+                {
+                    std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND: " << includePath << std::endl;
+                    continue;
+                }
+                std::stringstream source;
+                source << file.rdbuf();
+                result += expandIncludes(source.str(), includePath, included);
+                continue;
+            }
+            result += line + "\n";
+        }
+        return result;
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
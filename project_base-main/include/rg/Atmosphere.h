@@ -0,0 +1,179 @@
+//
+// Earth's atmosphere for the time of day, the CPU half: Rayleigh and Mie scattering and ozone absorption
+// as in Hillaire's "A Scalable and Production Ready Sky and Atmosphere Rendering Technique", single
+// scattering only. It gives the sun's course, the sunlight left after crossing the air and the sky's
+// ambient light. The sky itself is drawn on the GPU from the same model (Sky.h,
+// resources/shaders/include/atmosphere.glsl). Distances are in kilometres, and the sun has unit
+// illuminance.
+//
+
+#ifndef PROJECT_BASE_ATMOSPHERE_H
+#define PROJECT_BASE_ATMOSPHERE_H
+
+#include <glm/glm.hpp>
+
+#include <rg/SphericalHarmonics.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+class Atmosphere {
+public:
+    static constexpr float GROUND_RADIUS = 6360.0f;
+    static constexpr float TOP_RADIUS = 6460.0f;
+    // the viewer stays at this altitude, the village is far too small to move it
+    static constexpr float VIEW_ALTITUDE = 0.2f;
+    static constexpr float RAYLEIGH_HEIGHT = 8.0f;
+    static constexpr float MIE_SCATTERING = 3.996e-3f, MIE_EXTINCTION = 4.40e-3f, MIE_HEIGHT = 1.2f;
+    static constexpr float MIE_G = 0.8f;
+    static constexpr float GROUND_ALBEDO = 0.1f;
+    // cube faces of the ambient projection are this many texels across, plenty for nine coefficients
+    static const int AMBIENT_FACE_SIZE = 4;
+
+    // noonSun points to the sun at noon. The sun circles the pole at right angles to it, so noon and
+    // midnight are twelve hours apart and the day lasts as long as the night.
+    explicit Atmosphere(const glm::vec3 &noonSun)
+            : noonSun(glm::normalize(noonSun)) {
+        glm::vec3 up(0.0f, 1.0f, 0.0f);
+        glm::vec3 pole = up - this->noonSun * glm::dot(up, this->noonSun);
+        this->pole = glm::dot(pole, pole) > 1e-8f ? glm::normalize(pole) : glm::vec3(1.0f, 0.0f, 0.0f);
+    }
+
+    // towards the sun at the given hour, 12 being noon
+    glm::vec3 SunAt(float hours) const {
+        float angle = (hours - 12.0f) / 24.0f * 2.0f * PI;
+        // Rodrigues' rotation about the pole, which is at right angles to the noon sun
+        return noonSun * std::cos(angle) + glm::cross(pole, noonSun) * std::sin(angle);
+    }
+
+    // share of the sunlight from toSun that reaches the viewer
+    glm::vec3 Transmittance(const glm::vec3 &toSun) const {
+        return transmittance(viewPoint(), toSun);
+    }
+
+    // light scattered towards the viewer from the sky in direction
+    glm::vec3 Radiance(const glm::vec3 &direction, const glm::vec3 &toSun) const {
+        const int STEPS = 16;
+        const glm::vec3 origin = viewPoint();
+        float ground = groundDistance(origin, direction);
+        float distance = ground > 0.0f ? ground : topDistance(origin, direction);
+        float cosTheta = glm::dot(direction, toSun);
+        float rayleighPhase = 3.0f / (16.0f * PI) * (1.0f + cosTheta * cosTheta);
+        float miePhase = MiePhase(cosTheta);
+        float dt = distance / STEPS;
+        glm::vec3 light(0.0f), throughput(1.0f);
+        for (int i = 0; i < STEPS; i++) {
+            glm::vec3 point = origin + direction * ((i + 0.5f) * dt);
+            glm::vec3 rayleigh, extinction;
+            float mie;
+            medium(glm::length(point) - GROUND_RADIUS, rayleigh, mie, extinction);
+            glm::vec3 scattering = (rayleigh * rayleighPhase + glm::vec3(mie * miePhase)) * transmittance(point, toSun);
+            glm::vec3 step = glm::exp(-extinction * dt);
+            // integrated over the step, as the GPU does
+            light += throughput * (scattering - scattering * step) / glm::max(extinction, glm::vec3(1e-9f));
+            throughput *= step;
+        }
+        if (ground > 0.0f) {
+            glm::vec3 point = origin + direction * ground;
+            glm::vec3 up = glm::normalize(point);
+            light += throughput * transmittance(point, toSun) *
+                     (std::max(glm::dot(up, toSun), 0.0f) * GROUND_ALBEDO / PI);
+        }
+        return light;
+    }
+
+    // the whole sky's light, for the lighting shaders' ambient term
+    SphericalHarmonics Ambient(const glm::vec3 &toSun) const {
+        static const float axes[6][3][3] = {
+                {{1, 0, 0},  {0, 0, -1}, {0, -1, 0}},
+                {{-1, 0, 0}, {0, 0, 1},  {0, -1, 0}},
+                {{0, 1, 0},  {1, 0, 0},  {0, 0, 1}},
+                {{0, -1, 0}, {1, 0, 0},  {0, 0, -1}},
+                {{0, 0, 1},  {1, 0, 0},  {0, -1, 0}},
+                {{0, 0, -1}, {-1, 0, 0}, {0, -1, 0}}};
+        const int size = AMBIENT_FACE_SIZE;
+        std::vector<float> face(size * size * 3);
+        SphericalHarmonics::Projection projection;
+        for (int f = 0; f < 6; f++) {
+            glm::vec3 center(axes[f][0][0], axes[f][0][1], axes[f][0][2]);
+            glm::vec3 right(axes[f][1][0], axes[f][1][1], axes[f][1][2]);
+            glm::vec3 down(axes[f][2][0], axes[f][2][1], axes[f][2][2]);
+            for (int y = 0; y < size; y++)
+                for (int x = 0; x < size; x++) {
+                    glm::vec3 direction = glm::normalize(center + right * (2.0f * (x + 0.5f) / size - 1.0f) +
+                                                         down * (2.0f * (y + 0.5f) / size - 1.0f));
+                    glm::vec3 light = Radiance(direction, toSun);
+                    float *texel = &face[(y * size + x) * 3];
+                    texel[0] = light.x;
+                    texel[1] = light.y;
+                    texel[2] = light.z;
+                }
+            projection.AddFace(f, face.data(), size, size, 3);
+        }
+        return projection.Result();
+    }
+
+    // Cornette-Shanks, the sky shader's
+    static float MiePhase(float cosTheta) {
+        const float g = MIE_G;
+        float k = 3.0f / (8.0f * PI) * (1.0f - g * g) / (2.0f + g * g);
+        return k * (1.0f + cosTheta * cosTheta) / std::pow(1.0f + g * g - 2.0f * g * cosTheta, 1.5f);
+    }
+
+private:
+    static constexpr float PI = 3.14159265f;
+
+    glm::vec3 noonSun;
+    glm::vec3 pole;
+
+    static glm::vec3 viewPoint() {
+        return glm::vec3(0.0f, GROUND_RADIUS + VIEW_ALTITUDE, 0.0f);
+    }
+
+    static void medium(float altitude, glm::vec3 &rayleigh, float &mie, glm::vec3 &extinction) {
+        const glm::vec3 rayleighScattering(5.802e-3f, 13.558e-3f, 33.1e-3f);
+        const glm::vec3 ozoneAbsorption(0.650e-3f, 1.881e-3f, 0.085e-3f);
+        float mieDensity = std::exp(-altitude / MIE_HEIGHT);
+        float ozoneDensity = std::max(0.0f, 1.0f - std::fabs(altitude - 25.0f) / 15.0f);
+        rayleigh = rayleighScattering * std::exp(-altitude / RAYLEIGH_HEIGHT);
+        mie = MIE_SCATTERING * mieDensity;
+        extinction = rayleigh + glm::vec3(MIE_EXTINCTION * mieDensity) + ozoneAbsorption * ozoneDensity;
+    }
+
+    // along the ray from inside the atmosphere to its top
+    static float topDistance(const glm::vec3 &origin, const glm::vec3 &direction) {
+        float b = glm::dot(origin, direction);
+        float c = glm::dot(origin, origin) - TOP_RADIUS * TOP_RADIUS;
+        return -b + std::sqrt(std::max(b * b - c, 0.0f));
+    }
+
+    // along the ray to the ground, -1 when it misses
+    static float groundDistance(const glm::vec3 &origin, const glm::vec3 &direction) {
+        float b = glm::dot(origin, direction);
+        float c = glm::dot(origin, origin) - GROUND_RADIUS * GROUND_RADIUS;
+        float discriminant = b * b - c;
+        if (discriminant < 0.0f)
+            return -1.0f;
+        float t = -b - std::sqrt(discriminant);
+        return t > 0.0f ? t : -1.0f;
+    }
+
+    // from a point to the top of the atmosphere, zero behind the planet
+    static glm::vec3 transmittance(const glm::vec3 &origin, const glm::vec3 &direction) {
+        const int STEPS = 12;
+        if (groundDistance(origin, direction) > 0.0f)
+            return glm::vec3(0.0f);
+        float dt = topDistance(origin, direction) / STEPS;
+        glm::vec3 depth(0.0f);
+        for (int i = 0; i < STEPS; i++) {
+            glm::vec3 rayleigh, extinction;
+            float mie;
+            medium(glm::length(origin + direction * ((i + 0.5f) * dt)) - GROUND_RADIUS, rayleigh, mie, extinction);
+            depth += extinction;
+        }
+        return glm::exp(-depth * dt);
+    }
+};
+
+#endif //PROJECT_BASE_ATMOSPHERE_H
@@ -0,0 +1,353 @@
+//
+// Bounding volume hierarchy over axis aligned boxes: binned SAH build, incremental refit,
+// and frustum, sphere and ray queries.
+//
+
+#ifndef PROJECT_BASE_BVH_H
+#define PROJECT_BASE_BVH_H
+
+#include <rg/Bounds.h>
+#include <rg/Frustum.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+struct BVHNode {
+    AABB bounds;
+    // children of an inner node, -1 for leaves
+    int32_t left = -1;
+    int32_t right = -1;
+    int32_t parent = -1;
+    // items of the whole subtree are items[first, first + count)
+    uint32_t first = 0;
+    uint32_t count = 0;
+
+    bool Leaf() const {
+        return left < 0;
+    }
+};
+
+class BVH {
+public:
+    static const unsigned int MAX_LEAF_ITEMS = 4;
+    static const unsigned int SAH_BINS = 12;
+
+    std::vector<BVHNode> nodes;
+    // item indices ordered so that every node owns a contiguous range
+    std::vector<uint32_t> items;
+    std::vector<AABB> itemBounds;
+    // number of nodes visited by the last query
+    mutable unsigned int nodesVisited = 0;
+
+    void Build(const std::vector<AABB> &boxes) {
+        itemBounds = boxes;
+        items.resize(boxes.size());
+        itemLeaf.assign(boxes.size(), 0);
+        centroids.resize(boxes.size());
+        for (uint32_t i = 0; i < boxes.size(); i++) {
+            items[i] = i;
+            centroids[i] = boxes[i].Empty() ? glm::vec3(0.0f) : boxes[i].Center();
+        }
+        nodes.clear();
+        if (boxes.empty())
+            return;
+        nodes.reserve(2 * boxes.size() / MAX_LEAF_ITEMS + 1);
+        nodes.push_back(BVHNode());
+        nodes[0].first = 0;
+        nodes[0].count = boxes.size();
+        build(0);
+        centroids.clear();
+        centroids.shrink_to_fit();
+    }
+
+    // updates the box of one item and the nodes above it, for objects that moved
+    void Refit(uint32_t item, const AABB &box) {
+        itemBounds[item] = box;
+        int32_t node = itemLeaf[item];
+        while (node >= 0) {
+            BVHNode &n = nodes[node];
+            AABB bounds;
+            if (n.Leaf()) {
+                for (uint32_t i = n.first; i < n.first + n.count; i++)
+                    bounds.Expand(itemBounds[items[i]]);
+            } else {
+                bounds = nodes[n.left].bounds;
+                bounds.Expand(nodes[n.right].bounds);
+            }
+            // ancestors only change while the box does
+            if (bounds.min == n.bounds.min && bounds.max == n.bounds.max)
+                break;
+            n.bounds = bounds;
+            node = n.parent;
+        }
+    }
+
+    // callback(item) for every item whose box intersects the frustum
+    template<typename Callback>
+    void QueryFrustum(const Frustum &frustum, Callback callback) const {
+        nodesVisited = 0;
+        if (nodes.empty())
+            return;
+        struct Entry {
+            int32_t node;
+            unsigned int planeMask;
+        };
+        Entry stack[64];
+        int top = 0;
+        stack[top++] = Entry{0, 0x3Fu};
+        while (top > 0) {
+            Entry entry = stack[--top];
+            const BVHNode &node = nodes[entry.node];
+            nodesVisited++;
+            unsigned int planeMask = entry.planeMask;
+            int classification = frustum.ClassifyAABB(node.bounds, planeMask);
+            if (classification == Frustum::OUTSIDE)
+                continue;
+            if (classification == Frustum::INSIDE) {
+                // the whole subtree is visible, its items are contiguous
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                    callback(items[i]);
+                continue;
+            }
+            if (node.Leaf()) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                    if (frustum.IntersectsAABB(itemBounds[items[i]]))
+                        callback(items[i]);
+                continue;
+            }
+            if (top + 2 > 64) {
+                // pathological depth: fall back to testing the subtree's items directly
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                    if (frustum.IntersectsAABB(itemBounds[items[i]]))
+                        callback(items[i]);
+                continue;
+            }
+            stack[top++] = Entry{node.left, planeMask};
+            stack[top++] = Entry{node.right, planeMask};
+        }
+    }
+
+    // callback(item) for every item whose box intersects the sphere
+    template<typename Callback>
+    void QuerySphere(const glm::vec3 &center, float radius, Callback callback) const {
+        nodesVisited = 0;
+        if (nodes.empty())
+            return;
+        std::vector<int32_t> stack;
+        stack.push_back(0);
+        float radiusSquared = radius * radius;
+        while (!stack.empty()) {
+            const BVHNode &node = nodes[stack.back()];
+            stack.pop_back();
+            nodesVisited++;
+            if (distanceSquared(node.bounds, center) > radiusSquared)
+                continue;
+            if (node.Leaf()) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                    if (distanceSquared(itemBounds[items[i]], center) <= radiusSquared)
+                        callback(items[i]);
+                continue;
+            }
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+
+    // Closest item hit by the ray within maxDistance, or -1. hitTest(item, boxDistance) may refine the
+    // hit against the item's real geometry and returns the hit distance, or a negative value for a miss.
+    template<typename HitTest>
+    int64_t Raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, HitTest hitTest,
+                    float *hitDistance = nullptr) const {
+        nodesVisited = 0;
+        if (nodes.empty())
+            return -1;
+        glm::vec3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        float closest = maxDistance;
+        int64_t closestItem = -1;
+        std::vector<int32_t> stack;
+        stack.push_back(0);
+        while (!stack.empty()) {
+            const BVHNode &node = nodes[stack.back()];
+            stack.pop_back();
+            nodesVisited++;
+            float entry;
+            if (!intersectRay(node.bounds, origin, inverse, closest, entry))
+                continue;
+            if (node.Leaf()) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    uint32_t item = items[i];
+                    if (!intersectRay(itemBounds[item], origin, inverse, closest, entry))
+                        continue;
+                    float distance = hitTest(item, entry);
+                    if (distance >= 0.0f && distance < closest) {
+                        closest = distance;
+                        closestItem = item;
+                    }
+                }
+                continue;
+            }
+            // visit the nearer child first so the far one is often rejected by the shortened ray
+            float leftEntry, rightEntry;
+            bool hitLeft = intersectRay(nodes[node.left].bounds, origin, inverse, closest, leftEntry);
+            bool hitRight = intersectRay(nodes[node.right].bounds, origin, inverse, closest, rightEntry);
+            if (hitLeft && hitRight) {
+                bool leftFirst = leftEntry <= rightEntry;
+                stack.push_back(leftFirst ? node.right : node.left);
+                stack.push_back(leftFirst ? node.left : node.right);
+            } else if (hitLeft) {
+                stack.push_back(node.left);
+            } else if (hitRight) {
+                stack.push_back(node.right);
+            }
+        }
+        if (hitDistance)
+            *hitDistance = closest;
+        return closestItem;
+    }
+
+private:
+    std::vector<int32_t> itemLeaf;
+    std::vector<glm::vec3> centroids;
+
+    static float surfaceArea(const AABB &box) {
+        if (box.Empty())
+            return 0.0f;
+        glm::vec3 size = box.max - box.min;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    static float distanceSquared(const AABB &box, const glm::vec3 &point) {
+        glm::vec3 closest = glm::clamp(point, box.min, box.max);
+        glm::vec3 offset = closest - point;
+        return glm::dot(offset, offset);
+    }
+
+    static bool intersectRay(const AABB &box, const glm::vec3 &origin, const glm::vec3 &inverse, float maxDistance,
+                             float &entry) {
+        float tMin = 0.0f, tMax = maxDistance;
+        for (int axis = 0; axis < 3; axis++) {
+            float t0 = (box.min[axis] - origin[axis]) * inverse[axis];
+            float t1 = (box.max[axis] - origin[axis]) * inverse[axis];
+            if (t0 > t1)
+                std::swap(t0, t1);
+            tMin = std::max(tMin, t0);
+            tMax = std::min(tMax, t1);
+            if (tMin > tMax)
+                return false;
+        }
+        entry = tMin;
+        return true;
+    }
+
+    void makeLeaf(int32_t index) {
+        BVHNode &node = nodes[index];
+        for (uint32_t i = node.first; i < node.first + node.count; i++)
+            itemLeaf[items[i]] = index;
+    }
+
+    void build(int32_t index) {
+        BVHNode &node = nodes[index];
+        AABB bounds, centroidBounds;
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            bounds.Expand(itemBounds[items[i]]);
+            centroidBounds.Expand(centroids[items[i]]);
+        }
+        node.bounds = bounds;
+        if (node.count <= MAX_LEAF_ITEMS) {
+            makeLeaf(index);
+            return;
+        }
+
+        // binned surface area heuristic over the centroid bounds
+        int bestAxis = -1;
+        unsigned int bestSplit = 0;
+        float bestCost = FLT_MAX;
+        glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+        for (int axis = 0; axis < 3; axis++) {
+            if (extent[axis] <= 1e-6f)
+                continue;
+            AABB binBounds[SAH_BINS];
+            unsigned int binCounts[SAH_BINS] = {0};
+            float scale = SAH_BINS / extent[axis];
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                unsigned int bin = binIndex(centroids[items[i]][axis], centroidBounds.min[axis], scale);
+                binCounts[bin]++;
+                binBounds[bin].Expand(itemBounds[items[i]]);
+            }
+            // right-to-left sweep stores the cost terms of every split's right side
+            float rightArea[SAH_BINS];
+            unsigned int rightCount[SAH_BINS];
+            AABB accumulated;
+            unsigned int count = 0;
+            for (unsigned int bin = SAH_BINS - 1; bin > 0; bin--) {
+                accumulated.Expand(binBounds[bin]);
+                count += binCounts[bin];
+                rightArea[bin] = surfaceArea(accumulated);
+                rightCount[bin] = count;
+            }
+            accumulated = AABB();
+            count = 0;
+            for (unsigned int split = 1; split < SAH_BINS; split++) {
+                accumulated.Expand(binBounds[split - 1]);
+                count += binCounts[split - 1];
+                float cost = count * surfaceArea(accumulated) + rightCount[split] * rightArea[split];
+                if (count > 0 && rightCount[split] > 0 && cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        uint32_t *begin = items.data() + node.first;
+        uint32_t *end = begin + node.count;
+        uint32_t *middle;
+        float leafCost = node.count * surfaceArea(bounds);
+        if (bestAxis >= 0 && bestCost < leafCost) {
+            float scale = SAH_BINS / extent[bestAxis];
+            float minimum = centroidBounds.min[bestAxis];
+            middle = std::partition(begin, end, [&](uint32_t item) {
+                return binIndex(centroids[item][bestAxis], minimum, scale) < bestSplit;
+            });
+        } else if (node.count <= 4 * MAX_LEAF_ITEMS) {
+            makeLeaf(index);
+            return;
+        } else {
+            // no useful split (e.g. coincident centroids): halve along the longest axis
+            int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+            middle = begin + node.count / 2;
+            std::nth_element(begin, middle, end, [&](uint32_t a, uint32_t b) {
+                return centroids[a][axis] < centroids[b][axis];
+            });
+        }
+
+        uint32_t leftCount = middle - begin;
+        uint32_t first = node.first;
+        uint32_t total = node.count;
+        int32_t left = nodes.size();
+        nodes.push_back(BVHNode());
+        nodes.push_back(BVHNode());
+        // push_back may have moved the node
+        nodes[index].left = left;
+        nodes[index].right = left + 1;
+        nodes[left].parent = index;
+        nodes[left].first = first;
+        nodes[left].count = leftCount;
+        nodes[left + 1].parent = index;
+        nodes[left + 1].first = first + leftCount;
+        nodes[left + 1].count = total - leftCount;
+        build(left);
+        build(left + 1);
+    }
+
+    static unsigned int binIndex(float value, float minimum, float scale) {
+        int bin = (int) ((value - minimum) * scale);
+        return (unsigned int) std::min(std::max(bin, 0), (int) SAH_BINS - 1);
+    }
+};
+
+#endif //PROJECT_BASE_BVH_H
@@ -0,0 +1,121 @@
+//
+// Bounding volumes used for visibility tests.
+//
+
+#ifndef PROJECT_BASE_BOUNDS_H
+#define PROJECT_BASE_BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool Empty() const {
+        return min.x > max.x;
+    }
+
+    void Expand(const glm::vec3 &point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void Expand(const AABB &other) {
+        if (other.Empty())
+            return;
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    bool Contains(const glm::vec3 &point) const {
+        return point.x >= min.x && point.y >= min.y && point.z >= min.z &&
+               point.x <= max.x && point.y <= max.y && point.z <= max.z;
+    }
+
+    glm::vec3 Center() const {
+        return (min + max) * 0.5f;
+    }
+
+    glm::vec3 Extents() const {
+        return (max - min) * 0.5f;
+    }
+
+    // box of the transformed box (Arvo), still axis aligned
+    AABB Transformed(const glm::mat4 &transform) const {
+        if (Empty())
+            return *this;
+        glm::vec3 center = glm::vec3(transform * glm::vec4(Center(), 1.0f));
+        glm::vec3 extents = Extents();
+        glm::vec3 worldExtents;
+        for (int i = 0; i < 3; i++)
+            worldExtents[i] = std::fabs(transform[0][i]) * extents.x
+                              + std::fabs(transform[1][i]) * extents.y
+                              + std::fabs(transform[2][i]) * extents.z;
+        AABB result;
+        result.min = center - worldExtents;
+        result.max = center + worldExtents;
+        return result;
+    }
+};
+
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    // sphere of the transformed sphere; non-uniform scale is covered by the largest axis scale
+    BoundingSphere Transformed(const glm::mat4 &transform) const {
+        BoundingSphere result;
+        result.center = glm::vec3(transform * glm::vec4(center, 1.0f));
+        float scale = std::max(glm::dot(glm::vec3(transform[0]), glm::vec3(transform[0])),
+                               std::max(glm::dot(glm::vec3(transform[1]), glm::vec3(transform[1])),
+                                        glm::dot(glm::vec3(transform[2]), glm::vec3(transform[2]))));
+        result.radius = radius * std::sqrt(scale);
+        return result;
+    }
+};
+
+// boxes stored as separate center/extent arrays so they can be tested four at a time
+struct BoundsArray {
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+
+    size_t Size() const {
+        return centerX.size();
+    }
+
+    void Resize(size_t count) {
+        centerX.resize(count);
+        centerY.resize(count);
+        centerZ.resize(count);
+        extentX.resize(count);
+        extentY.resize(count);
+        extentZ.resize(count);
+    }
+
+    void Set(size_t i, const AABB &box) {
+        glm::vec3 center = box.Center();
+        glm::vec3 extents = box.Extents();
+        centerX[i] = center.x;
+        centerY[i] = center.y;
+        centerZ[i] = center.z;
+        extentX[i] = extents.x;
+        extentY[i] = extents.y;
+        extentZ[i] = extents.z;
+    }
+
+    AABB Get(size_t i) const {
+        glm::vec3 center(centerX[i], centerY[i], centerZ[i]);
+        glm::vec3 extents(extentX[i], extentY[i], extentZ[i]);
+        AABB box;
+        box.min = center - extents;
+        box.max = center + extents;
+        return box;
+    }
+};
+
+#endif //PROJECT_BASE_BOUNDS_H
@@ -0,0 +1,130 @@
+//
+// Cone step map for parallax occlusion mapping: a downsampled copy of a height map as depth, with the
+// widest cone above every texel that no other texel pokes into. A ray marched through the depth map
+// can step as far as it stays outside the cone of the texel below it without skipping the surface.
+//
+
+#ifndef PROJECT_BASE_CONESTEPMAP_H
+#define PROJECT_BASE_CONESTEPMAP_H
+
+#include <glad/glad.h>
+
+#include <stb_image.h>
+
+#include <rg/JobSystem.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+class ConeStepMap {
+public:
+    // Loads the height map (white is high), averages it down to size x size and computes the cones in
+    // texture coordinates per unit of depth. Texels farther than radius are not searched: their
+    // cone is limited to what the farthest searched ring allows, which keeps it conservative.
+    ConeStepMap(const char *heightMapPath, JobSystem &jobs, int size = 256, int radius = 32)
+            : size(size) {
+        int width, height, components;
+        unsigned char *data = stbi_load(heightMapPath, &width, &height, &components, 1);
+        if (!data) {
+            std::cout << "ERROR::CONE_STEP_MAP::LOAD_FAILED " << heightMapPath << std::endl;
+            depth.assign(size * size, 0.0f);
+        } else {
+            downsample(data, width, height);
+            stbi_image_free(data);
+        }
+        computeCones(jobs, radius);
+        upload();
+    }
+
+    ~ConeStepMap() {
+        glDeleteTextures(1, &texture);
+    }
+
+    ConeStepMap(const ConeStepMap &) = delete;
+    ConeStepMap &operator=(const ConeStepMap &) = delete;
+
+    // RG16F: depth in red, cone ratio in green
+    unsigned int Texture() const {
+        return texture;
+    }
+
+private:
+    int size;
+    std::vector<float> depth;
+    std::vector<float> ratio;
+    unsigned int texture = 0;
+
+    void downsample(const unsigned char *data, int width, int height) {
+        depth.assign(size * size, 0.0f);
+        for (int y = 0; y < size; y++) {
+            int y0 = y * height / size, y1 = std::max(y0 + 1, (y + 1) * height / size);
+            for (int x = 0; x < size; x++) {
+                int x0 = x * width / size, x1 = std::max(x0 + 1, (x + 1) * width / size);
+                unsigned int sum = 0;
+                for (int sy = y0; sy < y1; sy++)
+                    for (int sx = x0; sx < x1; sx++)
+                        sum += data[sy * width + sx];
+                depth[y * size + x] = 1.0f - sum / (255.0f * (x1 - x0) * (y1 - y0));
+            }
+        }
+    }
+
+    // the road's textures repeat mirrored, so the search does too
+    int mirror(int i) const {
+        if (i < 0)
+            return -1 - i;
+        if (i >= size)
+            return 2 * size - 1 - i;
+        return i;
+    }
+
+    void computeCones(JobSystem &jobs, int radius) {
+        // the widest a cone may open, bounds the ratio above texels at the top of the map
+        const float maxRatio = 4.0f;
+        radius = std::min(radius, size - 1);
+        ratio.assign(size * size, maxRatio);
+        const float reach = (float) radius / size;
+        jobs.ParallelFor(size, 4, [&](size_t begin, size_t end) {
+            for (int y = (int) begin; y < (int) end; y++) {
+                for (int x = 0; x < size; x++) {
+                    float texelDepth = depth[y * size + x];
+                    // anything past the search radius might be at the very top
+                    float best = texelDepth > 0.0f ? std::min(maxRatio, reach / texelDepth) : maxRatio;
+                    for (int dy = -radius; dy <= radius; dy++) {
+                        const float *row = &depth[mirror(y + dy) * size];
+                        for (int dx = -radius; dx <= radius; dx++) {
+                            // only texels above this one constrain its cone
+                            float rise = texelDepth - row[mirror(x + dx)];
+                            if (rise <= 0.0f)
+                                continue;
+                            float distance = std::sqrt((float) (dx * dx + dy * dy)) / size;
+                            best = std::min(best, distance / rise);
+                        }
+                    }
+                    ratio[y * size + x] = best;
+                }
+            }
+        });
+    }
+
+    void upload() {
+        std::vector<float> texels(size * size * 2);
+        for (int i = 0; i < size * size; i++) {
+            texels[2 * i] = depth[i];
+            texels[2 * i + 1] = ratio[i];
+        }
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, size, size, 0, GL_RG, GL_FLOAT, &texels[0]);
+        // no mipmaps: averaged cones would no longer be safe to step through
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+};
+
+#endif //PROJECT_BASE_CONESTEPMAP_H
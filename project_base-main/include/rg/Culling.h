@@ -0,0 +1,218 @@
+//
+// World-space bounds of everything the scene places, a BVH over them, and their visibility for the
+// current view.
+//
+
+#ifndef PROJECT_BASE_CULLING_H
+#define PROJECT_BASE_CULLING_H
+
+#include <rg/BVH.h>
+#include <rg/Bounds.h>
+#include <rg/Frustum.h>
+#include <rg/Scene.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// half-size of a ground and road tile (the ground plane is a 10 x 10 quad scaled by 10)
+const glm::vec3 TILE_EXTENTS = glm::vec3(50.0f, 0.1f, 50.0f);
+
+class SceneCulling {
+public:
+    BoundsArray instanceBounds;
+    BoundsArray lightBounds;
+    BoundsArray vegetationBounds;
+    BoundsArray tileBounds;
+
+    std::vector<uint8_t> instanceVisible;
+    std::vector<uint8_t> lightVisible;
+    std::vector<uint8_t> vegetationVisible;
+    std::vector<uint8_t> tileVisible;
+
+    size_t visibleInstances = 0;
+    size_t visibleLights = 0;
+    size_t visibleVegetation = 0;
+    size_t visibleTiles = 0;
+
+    // one tree over all four kinds; item ids are laid out as instances, lights, vegetation, tiles
+    BVH tree;
+
+    // recomputes every world-space bound; modelBounds holds the object-space box of each scene model
+    void Build(const Scene &scene, const std::vector<AABB> &modelBounds, float lightRadius) {
+        instanceBounds.Resize(scene.instances.size());
+        for (size_t i = 0; i < scene.instances.size(); i++)
+            UpdateInstance(scene, modelBounds, i);
+
+        lightBounds.Resize(scene.lights.size());
+        for (size_t i = 0; i < scene.lights.size(); i++) {
+            AABB box;
+            box.min = scene.lights[i] - glm::vec3(lightRadius);
+            box.max = scene.lights[i] + glm::vec3(lightRadius);
+            lightBounds.Set(i, box);
+        }
+
+        vegetationBounds.Resize(scene.vegetation.size());
+        for (size_t i = 0; i < scene.vegetation.size(); i++) {
+            // bush quads span [0, 1] x [-0.5, 0.5] in the xy plane before scaling
+            const SceneVegetation &plant = scene.vegetation[i];
+            AABB box;
+            box.min = plant.position + glm::vec3(0.0f, -0.5f, 0.0f) * plant.scale;
+            box.max = plant.position + glm::vec3(1.0f, 0.5f, 0.0f) * plant.scale;
+            vegetationBounds.Set(i, box);
+        }
+
+        tileBounds.Resize(scene.tiles.size());
+        for (size_t i = 0; i < scene.tiles.size(); i++) {
+            glm::vec3 center(scene.tiles[i].x, 0.0f, scene.tiles[i].y);
+            AABB box;
+            box.min = center - TILE_EXTENTS;
+            box.max = center + TILE_EXTENTS;
+            tileBounds.Set(i, box);
+        }
+
+        // until the first Cull everything counts as visible
+        instanceVisible.assign(instanceBounds.Size(), 1);
+        lightVisible.assign(lightBounds.Size(), 1);
+        vegetationVisible.assign(vegetationBounds.Size(), 1);
+        tileVisible.assign(tileBounds.Size(), 1);
+
+        std::vector<AABB> boxes;
+        boxes.reserve(instanceBounds.Size() + lightBounds.Size() + vegetationBounds.Size() + tileBounds.Size());
+        for (const BoundsArray *bounds : {&instanceBounds, &lightBounds, &vegetationBounds, &tileBounds})
+            for (size_t i = 0; i < bounds->Size(); i++)
+                boxes.push_back(bounds->Get(i));
+        tree.Build(boxes);
+    }
+
+    // refreshes one instance after its transform changed
+    void UpdateInstance(const Scene &scene, const std::vector<AABB> &modelBounds, size_t i) {
+        const AABB &local = modelBounds[scene.instances[i].model];
+        AABB world = local.Empty() ? AABB() : local.Transformed(scene.transforms[i]);
+        if (world.Empty())
+            world.min = world.max = scene.instances[i].position;
+        instanceBounds.Set(i, world);
+        if (tree.itemBounds.size() > i)
+            tree.Refit(i, world);
+    }
+
+    // visibility through the BVH: whole subtrees are accepted or rejected at once
+    void Cull(const Frustum &frustum) {
+        std::fill(instanceVisible.begin(), instanceVisible.end(), 0);
+        std::fill(lightVisible.begin(), lightVisible.end(), 0);
+        std::fill(vegetationVisible.begin(), vegetationVisible.end(), 0);
+        std::fill(tileVisible.begin(), tileVisible.end(), 0);
+        visibleInstances = visibleLights = visibleVegetation = visibleTiles = 0;
+        const size_t lightsBegin = instanceVisible.size();
+        const size_t vegetationBegin = lightsBegin + lightVisible.size();
+        const size_t tilesBegin = vegetationBegin + vegetationVisible.size();
+        tree.QueryFrustum(frustum, [&](uint32_t item) {
+            if (item < lightsBegin) {
+                instanceVisible[item] = 1;
+                visibleInstances++;
+            } else if (item < vegetationBegin) {
+                lightVisible[item - lightsBegin] = 1;
+                visibleLights++;
+            } else if (item < tilesBegin) {
+                vegetationVisible[item - vegetationBegin] = 1;
+                visibleVegetation++;
+            } else {
+                tileVisible[item - tilesBegin] = 1;
+                visibleTiles++;
+            }
+        });
+    }
+
+    // brute-force visibility, every box tested four at a time
+    void CullLinear(const Frustum &frustum) {
+        visibleInstances = frustum.CullBoxes(instanceBounds, instanceVisible);
+        visibleLights = frustum.CullBoxes(lightBounds, lightVisible);
+        visibleVegetation = frustum.CullBoxes(vegetationBounds, vegetationVisible);
+        visibleTiles = frustum.CullBoxes(tileBounds, tileVisible);
+    }
+
+    // marks everything visible, used when culling is switched off
+    void ShowAll() {
+        std::fill(instanceVisible.begin(), instanceVisible.end(), 1);
+        std::fill(lightVisible.begin(), lightVisible.end(), 1);
+        std::fill(vegetationVisible.begin(), vegetationVisible.end(), 1);
+        std::fill(tileVisible.begin(), tileVisible.end(), 1);
+        visibleInstances = instanceVisible.size();
+        visibleLights = lightVisible.size();
+        visibleVegetation = vegetationVisible.size();
+        visibleTiles = tileVisible.size();
+    }
+
+    // closest instance whose bounds the ray hits, or -1
+    int PickInstance(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+                     float *hitDistance = nullptr) const {
+        const size_t instanceCount = instanceVisible.size();
+        int64_t item = tree.Raycast(origin, direction, maxDistance, [&](uint32_t candidate, float boxDistance) {
+            return candidate < instanceCount ? boxDistance : -1.0f;
+        }, hitDistance);
+        return (int) item;
+    }
+
+    // indices of the lights whose range reaches into the sphere
+    void LightsInSphere(const glm::vec3 &center, float radius, std::vector<uint32_t> &lights) const {
+        lights.clear();
+        const size_t lightsBegin = instanceVisible.size();
+        const size_t lightsEnd = lightsBegin + lightVisible.size();
+        tree.QuerySphere(center, radius, [&](uint32_t item) {
+            if (item >= lightsBegin && item < lightsEnd)
+                lights.push_back(item - lightsBegin);
+        });
+    }
+
+    // indices of the instances and plants whose bounds reach into the sphere
+    void CastersInSphere(const glm::vec3 &center, float radius, std::vector<uint32_t> &instances,
+                         std::vector<uint32_t> &plants) const {
+        instances.clear();
+        plants.clear();
+        const size_t instanceCount = instanceVisible.size();
+        const size_t vegetationBegin = instanceCount + lightVisible.size();
+        const size_t vegetationEnd = vegetationBegin + vegetationVisible.size();
+        tree.QuerySphere(center, radius, [&](uint32_t item) {
+            if (item < instanceCount)
+                instances.push_back(item);
+            else if (item >= vegetationBegin && item < vegetationEnd)
+                plants.push_back(item - vegetationBegin);
+        });
+    }
+
+    // indices of the instances and plants whose bounds reach into the frustum
+    void CastersInFrustum(const Frustum &frustum, std::vector<uint32_t> &instances,
+                          std::vector<uint32_t> &plants) const {
+        instances.clear();
+        plants.clear();
+        const size_t instanceCount = instanceVisible.size();
+        const size_t vegetationBegin = instanceCount + lightVisible.size();
+        const size_t vegetationEnd = vegetationBegin + vegetationVisible.size();
+        tree.QueryFrustum(frustum, [&](uint32_t item) {
+            if (item < instanceCount)
+                instances.push_back(item);
+            else if (item >= vegetationBegin && item < vegetationEnd)
+                plants.push_back(item - vegetationBegin);
+        });
+    }
+
+    // box around every instance, plant and tile, the lights' reach left out
+    AABB SceneBounds() const {
+        AABB bounds;
+        for (const BoundsArray *array : {&instanceBounds, &vegetationBounds, &tileBounds})
+            for (size_t i = 0; i < array->Size(); i++)
+                bounds.Expand(array->Get(i));
+        return bounds;
+    }
+
+    // distance at which constant/linear/quadratic attenuation falls below the given fraction
+    static float AttenuationRadius(float constant, float linear, float quadratic, float threshold = 5.0f / 256.0f) {
+        float c = constant - 1.0f / threshold;
+        if (quadratic <= 0.0f)
+            return linear > 0.0f ? -c / linear : 1e6f;
+        return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * c)) / (2.0f * quadratic);
+    }
+};
+
+#endif //PROJECT_BASE_CULLING_H
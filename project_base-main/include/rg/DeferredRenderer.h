@@ -0,0 +1,247 @@
+//
+// Deferred shading: opaque surfaces are written once into a G-buffer (albedo and specular, normal
+// and specular tint, depth), then lit by a full-screen pass for the sun and one more per lamp,
+// restricted by scissor to the screen rectangle of the lamp's attenuation sphere. The targets follow the
+// default framebuffer's size, see Resize.
+//
+
+#ifndef PROJECT_BASE_DEFERREDRENDERER_H
+#define PROJECT_BASE_DEFERREDRENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+
+#include <rg/FrameStats.h>
+#include <rg/ShaderPermutations.h>
+#include <rg/SunShadows.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class DeferredRenderer {
+public:
+    // models and grass, the VegetationField's plants and the normal-mapped road; the road is compiled
+    // per parallax mode and the caller sets its projection and view
+    Shader geometryShader;
+    Shader vegetationShader;
+    ShaderPermutations roadShaders;
+    // the caller sets dirLight and the lamp's pointLight/spotLight uniforms on it before Light, and
+    // binds the SunShadows or disables them; it is always compiled with SUN_SHADOWS
+    Shader lightShader;
+
+    DeferredRenderer(int width, int height)
+            : geometryShader("resources/shaders/gbuffer.vs", "resources/shaders/gbuffer.fs"),
+              vegetationShader("resources/shaders/vegetation.vs", "resources/shaders/gbuffer_vegetation.fs"),
+              roadShaders("resources/shaders/normal_mapping.vs", "resources/shaders/gbuffer_normal_mapping.fs",
+                          SHADER_PARALLAX | SHADER_PARALLAX_OCCLUSION | SHADER_CONE_STEP, [](Shader &shader) {
+                              shader.setInt("diffuseMap", 0);
+                              shader.setInt("normalMap", 1);
+                              shader.setInt("depthMap", 2);
+                              shader.setInt("coneStepMap", 3);
+                          }),
+              lightShader("resources/shaders/deferred_light.vs", "resources/shaders/deferred_light.fs",
+                          std::vector<std::string>{"SUN_SHADOWS"}),
+              width(width), height(height) {
+        glGenFramebuffers(1, &framebuffer);
+        allocateTargets();
+
+        // the full-screen triangle is generated from gl_VertexID, the core profile still wants a VAO
+        glGenVertexArrays(1, &emptyVAO);
+
+        geometryShader.use();
+        geometryShader.setInt("material.texture_diffuse1", 0);
+        geometryShader.setInt("material.texture_specular1", 1);
+        vegetationShader.use();
+        vegetationShader.setInt("texture1", 0);
+        lightShader.use();
+        lightShader.setInt("gAlbedoSpecular", 0);
+        lightShader.setInt("gNormalTint", 1);
+        lightShader.setInt("gDepth", 2);
+        SunShadows::Disable(lightShader);
+    }
+
+    ~DeferredRenderer() {
+        deleteTargets();
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteVertexArrays(1, &emptyVAO);
+        glDeleteProgram(geometryShader.ID);
+        glDeleteProgram(vegetationShader.ID);
+        glDeleteProgram(lightShader.ID);
+    }
+
+    // reallocates the G-buffer for a default framebuffer of width x height pixels
+    void Resize(int newWidth, int newHeight) {
+        if (newWidth == width && newHeight == height)
+            return;
+        width = newWidth;
+        height = newHeight;
+        deleteTargets();
+        allocateTargets();
+    }
+
+    // binds and clears the G-buffer; the caller draws with the geometry shaders, setting model per draw
+    void BeginGeometry(const glm::mat4 &projection, const glm::mat4 &view) {
+        glGetIntegerv(GL_VIEWPORT, savedViewport);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        for (Shader *shader : {&geometryShader, &vegetationShader}) {
+            shader->use();
+            shader->setMat4("projection", projection);
+            shader->setMat4("view", view);
+        }
+    }
+
+    void EndGeometry() {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+    }
+
+    // Lights the G-buffer into the bound framebuffer: ambient and sun everywhere, then every lamp
+    // additively inside its scissor rectangle. Leaves the G-buffer depth in the default framebuffer
+    // so forward geometry and the sky can be drawn on top.
+    void Light(const glm::mat4 &viewProjection, const glm::vec3 &viewPosition, const std::vector<glm::vec3> &lamps,
+               float lampRadius) {
+        glDisable(GL_DEPTH_TEST);
+        glDepthMask(GL_FALSE);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, albedoSpecular);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, normalTint);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, depth);
+        glBindVertexArray(emptyVAO);
+
+        lightShader.use();
+        lightShader.setMat4("inverseViewProjection", glm::inverse(viewProjection));
+        lightShader.setVec3("viewPosition", viewPosition);
+        lightShader.setBool("sun", true);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        rg::countDrawCall(1);
+
+        lightShader.setBool("sun", false);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glEnable(GL_SCISSOR_TEST);
+        lampsLit = 0;
+        for (const glm::vec3 &lamp : lamps) {
+            int rect[4];
+            if (!ScissorRect(lamp, lampRadius, viewProjection, width, height, rect))
+                continue;
+            glScissor(rect[0], rect[1], rect[2], rect[3]);
+            lightShader.setVec3("pointLight.position", lamp);
+            lightShader.setVec3("spotLight.position", lamp);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            rg::countDrawCall(1);
+            lampsLit++;
+        }
+        glDisable(GL_SCISSOR_TEST);
+        glDisable(GL_BLEND);
+
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        glDepthMask(GL_TRUE);
+        glEnable(GL_DEPTH_TEST);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // lamps whose rectangle was on screen in the last Light
+    unsigned int LampsLit() const {
+        return lampsLit;
+    }
+
+    // Screen rectangle (x, y, width, height) covering a sphere, from its projected bounding box;
+    // false when it is entirely off screen. A box straddling the camera plane covers the whole screen.
+    static bool ScissorRect(const glm::vec3 &center, float radius, const glm::mat4 &viewProjection, int width,
+                            int height, int rect[4]) {
+        glm::vec2 low(1.0f), high(-1.0f);
+        int behind = 0;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 offset((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius,
+                             (corner & 4) ? radius : -radius);
+            glm::vec4 clip = viewProjection * glm::vec4(center + offset, 1.0f);
+            if (clip.w <= 1e-4f) {
+                behind++;
+                continue;
+            }
+            glm::vec2 ndc = glm::vec2(clip.x, clip.y) / clip.w;
+            low = glm::min(low, ndc);
+            high = glm::max(high, ndc);
+        }
+        if (behind == 8)
+            return false;
+        if (behind > 0) {
+            low = glm::vec2(-1.0f);
+            high = glm::vec2(1.0f);
+        }
+        low = glm::max(low, glm::vec2(-1.0f));
+        high = glm::min(high, glm::vec2(1.0f));
+        if (low.x >= high.x || low.y >= high.y)
+            return false;
+        int x0 = (int) std::floor((low.x * 0.5f + 0.5f) * width);
+        int y0 = (int) std::floor((low.y * 0.5f + 0.5f) * height);
+        int x1 = (int) std::ceil((high.x * 0.5f + 0.5f) * width);
+        int y1 = (int) std::ceil((high.y * 0.5f + 0.5f) * height);
+        rect[0] = x0;
+        rect[1] = y0;
+        rect[2] = std::max(x1 - x0, 1);
+        rect[3] = std::max(y1 - y0, 1);
+        return true;
+    }
+
+private:
+    int width, height;
+    unsigned int framebuffer = 0;
+    unsigned int albedoSpecular = 0, normalTint = 0, depth = 0;
+    unsigned int emptyVAO = 0;
+    unsigned int lampsLit = 0;
+    GLint savedViewport[4] = {};
+
+    void allocateTargets() {
+        albedoSpecular = gbufferTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        normalTint = gbufferTexture(GL_RGBA16F, GL_RGBA, GL_FLOAT);
+        // same format as the default framebuffer's depth, so it can be blitted there for the forward passes
+        depth = gbufferTexture(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoSpecular, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTint, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        GLenum buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glDrawBuffers(2, buffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::DEFERRED::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void deleteTargets() {
+        glDeleteTextures(1, &albedoSpecular);
+        glDeleteTextures(1, &normalTint);
+        glDeleteTextures(1, &depth);
+    }
+
+    unsigned int gbufferTexture(GLint internalFormat, GLenum format, GLenum type) {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+};
+
+#endif //PROJECT_BASE_DEFERREDRENDERER_H
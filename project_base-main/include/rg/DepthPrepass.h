@@ -0,0 +1,137 @@
+//
+// Depth pre-pass: opaque geometry is first drawn depth-only, then shaded with GL_EQUAL and depth
+// writes off, so the lighting shaders run once per visible pixel. Also measures the overdraw of the
+// shading passes with a samples-passed query, and the GPU time of the opaque passes of every path.
+//
+
+#ifndef PROJECT_BASE_DEPTHPREPASS_H
+#define PROJECT_BASE_DEPTHPREPASS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+
+#include <rg/ShaderPermutations.h>
+
+class DepthPrepass {
+public:
+    // query results are read a few frames late so the CPU never waits for them
+    static const int QUERIES = 3;
+
+    // opaque geometry, and the alpha-tested (SHADER_ALPHA_TEST) variant for the bushes
+    ShaderPermutations shaders;
+
+    DepthPrepass()
+            : shaders("resources/shaders/depth_prepass.vs", "resources/shaders/depth_prepass.fs", SHADER_ALPHA_TEST,
+                      [](Shader &shader) { shader.setInt("texture1", 0); }) {
+        glGenQueries(QUERIES, queries);
+        glGenQueries(QUERIES, timers);
+    }
+
+    ~DepthPrepass() {
+        glDeleteQueries(QUERIES, queries);
+        glDeleteQueries(QUERIES, timers);
+    }
+
+    // depth writes only and the opaque variant in use; the caller sets model (and the dither
+    // uniforms) per draw
+    Shader &Begin(const glm::mat4 &projection, const glm::mat4 &view) {
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+        for (unsigned int features : {0u, (unsigned int) SHADER_ALPHA_TEST}) {
+            Shader &shader = shaders.Use(features);
+            shader.setMat4("projection", projection);
+            shader.setMat4("view", view);
+            shader.setFloat("lodFade", 1.0f);
+        }
+        return shaders.Use(0);
+    }
+
+    // shading of what the pre-pass drew: only the front-most fragment passes
+    void BeginShading() {
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
+
+    // back to the default state, for geometry that is not part of the pre-pass
+    void End() {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+
+    // brackets every shaded opaque draw of the frame
+    void BeginMeasure() {
+        GLuint query = queries[frame % QUERIES];
+        if (frame >= QUERIES) {
+            GLuint available = 0;
+            glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint samples = 0;
+                glGetQueryObjectuiv(query, GL_QUERY_RESULT, &samples);
+                overdraw = pixels[frame % QUERIES] > 0 ? (float) samples / pixels[frame % QUERIES] : 0.0f;
+            }
+        }
+        glBeginQuery(GL_SAMPLES_PASSED, query);
+    }
+
+    void EndMeasure(unsigned int pixelCount) {
+        glEndQuery(GL_SAMPLES_PASSED);
+        pixels[frame % QUERIES] = pixelCount;
+        frame++;
+    }
+
+    // shaded samples per screen pixel in the opaque passes, a few frames old
+    float Overdraw() const {
+        return overdraw;
+    }
+
+    // brackets all the opaque passes of the frame, pre-pass, G-buffer and lighting included; path tags the
+    // rendering path they ran on
+    void BeginTiming(int path) {
+        GLuint timer = timers[timedFrame % QUERIES];
+        if (timedFrame >= QUERIES) {
+            GLuint available = 0;
+            glGetQueryObjectuiv(timer, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(timer, GL_QUERY_RESULT, &nanoseconds);
+                timedMilliseconds = nanoseconds / 1.0e6f;
+                timedResultPath = timedPaths[timedFrame % QUERIES];
+            }
+        }
+        timedPaths[timedFrame % QUERIES] = path;
+        glBeginQuery(GL_TIME_ELAPSED, timer);
+    }
+
+    void EndTiming() {
+        glEndQuery(GL_TIME_ELAPSED);
+        timedFrame++;
+    }
+
+    // The GPU time of the opaque passes of a frame a few frames old and its path; false until a new result
+    // arrived since the last call.
+    bool Timing(int &path, float &milliseconds) {
+        if (timedResultPath < 0)
+            return false;
+        path = timedResultPath;
+        milliseconds = timedMilliseconds;
+        timedResultPath = -1;
+        return true;
+    }
+
+private:
+    GLuint queries[QUERIES];
+    unsigned int pixels[QUERIES] = {};
+    unsigned long long frame = 0;
+    float overdraw = 0.0f;
+    GLuint timers[QUERIES];
+    int timedPaths[QUERIES] = {};
+    unsigned long long timedFrame = 0;
+    int timedResultPath = -1;
+    float timedMilliseconds = 0.0f;
+};
+
+#endif //PROJECT_BASE_DEPTHPREPASS_H
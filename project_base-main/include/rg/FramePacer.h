@@ -0,0 +1,231 @@
+//
+// Frame pacing: the swap interval (none, vsync or adaptive vsync), a frame-rate cap that sleeps to its
+// deadlines on the steady clock, a fixed-step clock for the simulation, whose leftover time the renderer
+// interpolates by, and statistics of the last few seconds of frames.
+//
+
+#ifndef PROJECT_BASE_FRAMEPACER_H
+#define PROJECT_BASE_FRAMEPACER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+enum SwapMode {
+    SWAP_IMMEDIATE,
+    SWAP_VSYNC,
+    // waits for the vertical blank like vsync, but a late frame is shown at once, torn, instead of a
+    // whole refresh later
+    SWAP_ADAPTIVE
+};
+
+class FramePacer {
+public:
+    // frame intervals kept for the statistics and the graph
+    static const int HISTORY = 240;
+    // steps the simulation catches up in one frame; a longer frame drops the rest of its time rather
+    // than making the next frame longer still
+    static const int MAX_STEPS = 8;
+
+    // the simulation advances in steps of 1 / SimulationRate seconds rather than one of a frame's length
+    bool FixedStep = true;
+
+    struct Stats {
+        // the last frame: from its start to the next frame's, the part spent working and sleeping
+        float frameMilliseconds = 0.0f;
+        float workMilliseconds = 0.0f;
+        float sleepMilliseconds = 0.0f;
+        int simulationSteps = 0;
+        // over the history
+        float averageMilliseconds = 0.0f;
+        float worstMilliseconds = 0.0f;
+        float percentile99Milliseconds = 0.0f;
+        // standard deviation of the frame intervals
+        float jitterMilliseconds = 0.0f;
+        // frames that finished after the cap's deadline, simulated time dropped by MAX_STEPS; since start
+        unsigned int missedDeadlines = 0;
+        float droppedSimulationSeconds = 0.0f;
+    };
+
+    FramePacer()
+            : start(Clock::now()), frameStart(start), deadline(start) {
+    }
+
+    // Sets the swap interval for mode, when it changed; the window's context must be current. Adaptive
+    // vsync needs EXT_swap_control_tear and falls back to vsync without it.
+    void SetSwapMode(int mode) {
+        if (mode == swapMode)
+            return;
+        swapMode = mode;
+        adaptiveSupported = glfwExtensionSupported("WGL_EXT_swap_control_tear") ||
+                            glfwExtensionSupported("GLX_EXT_swap_control_tear");
+        if (mode == SWAP_IMMEDIATE)
+            glfwSwapInterval(0);
+        else
+            glfwSwapInterval(mode == SWAP_ADAPTIVE && adaptiveSupported ? -1 : 1);
+    }
+
+    // adaptive vsync was asked for and plain vsync is used instead
+    bool AdaptiveFallback() const {
+        return swapMode == SWAP_ADAPTIVE && !adaptiveSupported;
+    }
+
+    // frames per second at most, 0 for no cap
+    void SetFrameRateCap(int framesPerSecond) {
+        period = framesPerSecond > 0 ? Duration(1.0 / framesPerSecond) : Duration::zero();
+    }
+
+    void SetSimulationRate(int stepsPerSecond) {
+        fixedStep = 1.0 / std::max(stepsPerSecond, 1);
+    }
+
+    // seconds since the pacer was made, in double precision
+    double Now() const {
+        return seconds(Clock::now() - start);
+    }
+
+    // Starts a frame: measures the interval since the last one started, adds it to the time the
+    // simulation has to catch up and returns it in seconds. The first frame takes no time.
+    double BeginFrame() {
+        Clock::time_point now = Clock::now();
+        double delta = frames > 0 ? seconds(now - frameStart) : 0.0;
+        frameStart = now;
+        if (frames > 0)
+            record((float) (delta * 1000.0));
+        frames++;
+        pending += delta;
+        stats.simulationSteps = 0;
+        return delta;
+    }
+
+    // True while the simulation has another step to take this frame, Step() seconds long.
+    bool NextStep() {
+        if (!FixedStep) {
+            // the whole frame in one step
+            step = pending;
+            pending = 0.0;
+            return stats.simulationSteps++ == 0;
+        }
+        if (pending < fixedStep)
+            return false;
+        if (stats.simulationSteps == MAX_STEPS) {
+            double kept = std::fmod(pending, fixedStep);
+            stats.droppedSimulationSeconds += (float) (pending - kept);
+            pending = kept;
+            return false;
+        }
+        step = fixedStep;
+        pending -= fixedStep;
+        stats.simulationSteps++;
+        return true;
+    }
+
+    double Step() const {
+        return step;
+    }
+
+    // how far the frame is between the last two simulation steps, 0 to 1: the renderer draws the state
+    // in between, a step behind the simulation at most
+    float Alpha() const {
+        return FixedStep ? (float) std::min(pending / fixedStep, 1.0) : 1.0f;
+    }
+
+    // Ends the frame once it is swapped: sleeps to the cap's next deadline, the OS sleep stopping short by
+    // the margin it has been seen to oversleep, the last stretch spun. Input polled afterwards is as fresh
+    // as it can be for the next frame.
+    void EndFrame() {
+        Clock::time_point workEnd = Clock::now();
+        stats.workMilliseconds = (float) (seconds(workEnd - frameStart) * 1000.0);
+        stats.sleepMilliseconds = 0.0f;
+        if (period == Duration::zero()) {
+            deadline = workEnd;
+            return;
+        }
+        deadline += std::chrono::duration_cast<Clock::duration>(period);
+        if (deadline <= workEnd) {
+            // late: the next frame is paced from now rather than hurried to catch up
+            stats.missedDeadlines++;
+            deadline = workEnd;
+            return;
+        }
+        Clock::time_point wake = deadline - std::chrono::duration_cast<Clock::duration>(Duration(spinMargin));
+        if (wake > workEnd) {
+            std::this_thread::sleep_until(wake);
+            // a slowly decaying worst case of how late the OS wakes us
+            double late = seconds(Clock::now() - wake);
+            oversleep = std::max(late, oversleep * 0.99);
+            spinMargin = oversleep * 1.25;
+            if (spinMargin < MIN_SPIN_MARGIN)
+                spinMargin = MIN_SPIN_MARGIN;
+            if (spinMargin > MAX_SPIN_MARGIN)
+                spinMargin = MAX_SPIN_MARGIN;
+        }
+        while (Clock::now() < deadline)
+            std::this_thread::yield();
+        stats.sleepMilliseconds = (float) (seconds(Clock::now() - workEnd) * 1000.0);
+    }
+
+    const Stats &Statistics() const {
+        return stats;
+    }
+
+    // the frame intervals in milliseconds, a ring buffer starting at HistoryOffset()
+    const float *History() const {
+        return history;
+    }
+
+    int HistoryOffset() const {
+        return next;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::chrono::duration<double> Duration;
+
+    // seconds spun before a deadline, whatever the OS sleeps have shown
+    static constexpr double MIN_SPIN_MARGIN = 0.0002;
+    static constexpr double MAX_SPIN_MARGIN = 0.004;
+
+    Clock::time_point start, frameStart, deadline;
+    Duration period = Duration::zero();
+    double spinMargin = 0.001, oversleep = 0.0;
+    int swapMode = -1;
+    bool adaptiveSupported = false;
+    double fixedStep = 1.0 / 120.0, step = 0.0, pending = 0.0;
+    unsigned long long frames = 0;
+    float history[HISTORY] = {};
+    int next = 0, recorded = 0;
+    Stats stats;
+
+    static double seconds(Clock::duration duration) {
+        return std::chrono::duration_cast<Duration>(duration).count();
+    }
+
+    void record(float milliseconds) {
+        history[next] = milliseconds;
+        next = (next + 1) % HISTORY;
+        if (recorded < HISTORY)
+            recorded++;
+        stats.frameMilliseconds = milliseconds;
+
+        float sorted[HISTORY];
+        std::copy(history, history + recorded, sorted);
+        std::sort(sorted, sorted + recorded);
+        double sum = 0.0, squares = 0.0;
+        for (int i = 0; i < recorded; i++) {
+            sum += sorted[i];
+            squares += (double) sorted[i] * sorted[i];
+        }
+        double mean = sum / recorded;
+        stats.averageMilliseconds = (float) mean;
+        stats.worstMilliseconds = sorted[recorded - 1];
+        stats.percentile99Milliseconds = sorted[std::min(recorded - 1, (int) std::ceil(recorded * 0.99) - 1)];
+        stats.jitterMilliseconds = (float) std::sqrt(std::max(squares / recorded - mean * mean, 0.0));
+    }
+};
+
+#endif //PROJECT_BASE_FRAMEPACER_H
@@ -0,0 +1,103 @@
+//
+// Per-frame rendering counters shared by the renderer and the debug/stress tooling.
+//
+
+#ifndef PROJECT_BASE_FRAMESTATS_H
+#define PROJECT_BASE_FRAMESTATS_H
+
+#include <unistd.h>
+
+#include <cstdio>
+
+namespace rg {
+
+struct FrameStats {
+    static const unsigned int LOD_LEVELS = 4;
+    static const unsigned int SUN_CASCADES = 4;
+
+    unsigned int drawCalls = 0;
+    unsigned long long triangles = 0;
+    // frustum culling
+    unsigned int instancesDrawn = 0;
+    unsigned int instancesCulled = 0;
+    unsigned int meshesCulled = 0;
+    unsigned int lightsCulled = 0;
+    unsigned int vegetationCulled = 0;
+    // scattered vegetation: cells and plants drawn
+    unsigned int vegetationCells = 0;
+    unsigned int vegetationInstances = 0;
+    unsigned int bvhNodesVisited = 0;
+    // occlusion culling
+    unsigned int instancesOccluded = 0;
+    unsigned int lightsOccluded = 0;
+    // levels of detail, the last entry also counts anything coarser
+    unsigned int instancesPerLod[LOD_LEVELS] = {};
+    unsigned int instancesImpostor = 0;
+    unsigned int instancesHLOD = 0;
+    unsigned int hlodProxiesDrawn = 0;
+    // shaded samples per pixel in the opaque passes (G-buffer writes when deferred)
+    float overdraw = 0.0f;
+    // deferred lighting: lamps whose scissor rectangle was on screen
+    unsigned int lampsShaded = 0;
+    // clustered forward lighting: lamps binned, entries of all cluster lists, longest list
+    unsigned int clusterLamps = 0;
+    unsigned int clusterIndices = 0;
+    unsigned int clusterMaxLamps = 0;
+    // per-object lamp lists: objects given a list, entries of all lists, longest list
+    unsigned int objectLightObjects = 0;
+    unsigned int objectLightIndices = 0;
+    unsigned int objectLightMax = 0;
+    // lamp spot shadows: tiles holding cached static casters, static and dynamic tile renders this frame
+    unsigned int spotShadowsCached = 0;
+    unsigned int spotShadowsStatic = 0;
+    unsigned int spotShadowsDynamic = 0;
+    // sun shadow cascades: static texels and casters rendered this frame, GPU time of the last refresh
+    unsigned int sunCascadeTexels[SUN_CASCADES] = {};
+    unsigned int sunCascadeCasters[SUN_CASCADES] = {};
+    float sunCascadeMilliseconds[SUN_CASCADES] = {};
+    unsigned int sunCascadesUpdated = 0;
+    // baked lighting: the atlas size (0 without one) and the instances drawn with it
+    unsigned int lightmapWidth = 0, lightmapHeight = 0;
+    unsigned int instancesLightmapped = 0;
+    // instances with translucent meshes, drawn after the opaque scene; dithered without the OIT targets
+    unsigned int instancesTranslucent = 0;
+    bool translucentDithered = false;
+    // terrain: chunks drawn and culled, height tiles generated this frame and kept in the cache
+    unsigned int terrainChunks = 0;
+    unsigned int terrainChunksCulled = 0;
+    unsigned int terrainTilesStreamed = 0;
+    unsigned int terrainTilesResident = 0;
+    // lighting and depth shader permutations compiled so far
+    unsigned int shaderPermutations = 0;
+
+    void Reset() {
+        *this = FrameStats();
+    }
+};
+
+// counters of the frame being rendered
+inline FrameStats &frameStats() {
+    static FrameStats stats;
+    return stats;
+}
+
+inline void countDrawCall(unsigned long long triangles) {
+    frameStats().drawCalls++;
+    frameStats().triangles += triangles;
+}
+
+// resident set size of the process in bytes, 0 when /proc is not available
+inline unsigned long long residentMemoryBytes() {
+    FILE *statm = std::fopen("/proc/self/statm", "r");
+    if (!statm)
+        return 0;
+    unsigned long long pages = 0, resident = 0;
+    if (std::fscanf(statm, "%llu %llu", &pages, &resident) != 2)
+        resident = 0;
+    std::fclose(statm);
+    return resident * (unsigned long long) sysconf(_SC_PAGESIZE);
+}
+
+}
+
+#endif //PROJECT_BASE_FRAMESTATS_H
@@ -0,0 +1,133 @@
+//
+// View frustum extracted from a view-projection matrix, with scalar and SSE box tests.
+//
+
+#ifndef PROJECT_BASE_FRUSTUM_H
+#define PROJECT_BASE_FRUSTUM_H
+
+#include <rg/Bounds.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define RG_FRUSTUM_SSE 1
+#endif
+
+class Frustum {
+public:
+    // left, right, bottom, top, near, far; xyz is the inward normal, w the distance
+    glm::vec4 planes[6];
+
+    // Gribb/Hartmann plane extraction
+    static Frustum FromMatrix(const glm::mat4 &viewProjection) {
+        Frustum frustum;
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        frustum.planes[0] = rows[3] + rows[0];
+        frustum.planes[1] = rows[3] - rows[0];
+        frustum.planes[2] = rows[3] + rows[1];
+        frustum.planes[3] = rows[3] - rows[1];
+        frustum.planes[4] = rows[3] + rows[2];
+        frustum.planes[5] = rows[3] - rows[2];
+        for (glm::vec4 &plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    bool IntersectsSphere(const glm::vec3 &center, float radius) const {
+        for (const glm::vec4 &plane : planes)
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        return true;
+    }
+
+    bool IntersectsAABB(const AABB &box) const {
+        glm::vec3 center = box.Center();
+        glm::vec3 extents = box.Extents();
+        for (const glm::vec4 &plane : planes) {
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            float radius = std::fabs(plane.x) * extents.x + std::fabs(plane.y) * extents.y + std::fabs(plane.z) * extents.z;
+            if (distance < -radius)
+                return false;
+        }
+        return true;
+    }
+
+    enum Classification { OUTSIDE, INTERSECTING, INSIDE };
+
+    // Like IntersectsAABB, but also reports boxes that lie fully inside. planeMask has bit p set for
+    // every plane that still has to be tested; planes the box is fully inside of are cleared, so
+    // hierarchy traversals can skip them for children.
+    Classification ClassifyAABB(const AABB &box, unsigned int &planeMask) const {
+        glm::vec3 center = box.Center();
+        glm::vec3 extents = box.Extents();
+        for (int p = 0; p < 6; p++) {
+            if (!(planeMask & (1u << p)))
+                continue;
+            const glm::vec4 &plane = planes[p];
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            float radius = std::fabs(plane.x) * extents.x + std::fabs(plane.y) * extents.y + std::fabs(plane.z) * extents.z;
+            if (distance < -radius)
+                return OUTSIDE;
+            if (distance >= radius)
+                planeMask &= ~(1u << p);
+        }
+        return planeMask == 0 ? INSIDE : INTERSECTING;
+    }
+
+    // writes 1 for every box that intersects the frustum and 0 otherwise; returns the number of visible boxes
+    size_t CullBoxes(const BoundsArray &boxes, std::vector<uint8_t> &visible) const {
+        size_t count = boxes.Size();
+        visible.resize(count);
+        size_t visibleCount = 0;
+        size_t i = 0;
+#ifdef RG_FRUSTUM_SSE
+        __m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        for (int p = 0; p < 6; p++) {
+            planeX[p] = _mm_set1_ps(planes[p].x);
+            planeY[p] = _mm_set1_ps(planes[p].y);
+            planeZ[p] = _mm_set1_ps(planes[p].z);
+            planeW[p] = _mm_set1_ps(planes[p].w);
+            absX[p] = _mm_andnot_ps(signMask, planeX[p]);
+            absY[p] = _mm_andnot_ps(signMask, planeY[p]);
+            absZ[p] = _mm_andnot_ps(signMask, planeZ[p]);
+        }
+        const __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= count; i += 4) {
+            __m128 cx = _mm_loadu_ps(&boxes.centerX[i]);
+            __m128 cy = _mm_loadu_ps(&boxes.centerY[i]);
+            __m128 cz = _mm_loadu_ps(&boxes.centerZ[i]);
+            __m128 ex = _mm_loadu_ps(&boxes.extentX[i]);
+            __m128 ey = _mm_loadu_ps(&boxes.extentY[i]);
+            __m128 ez = _mm_loadu_ps(&boxes.extentZ[i]);
+            __m128 inside = _mm_cmpeq_ps(zero, zero);
+            for (int p = 0; p < 6; p++) {
+                // distance of the center plus the box's projected radius must not be negative
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)),
+                                             _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)),
+                                           _mm_mul_ps(absZ[p], ez));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+            }
+            int mask = _mm_movemask_ps(inside);
+            for (int k = 0; k < 4; k++) {
+                visible[i + k] = (mask >> k) & 1;
+                visibleCount += visible[i + k];
+            }
+        }
+#endif
+        for (; i < count; i++) {
+            visible[i] = IntersectsAABB(boxes.Get(i)) ? 1 : 0;
+            visibleCount += visible[i];
+        }
+        return visibleCount;
+    }
+};
+
+#endif //PROJECT_BASE_FRUSTUM_H
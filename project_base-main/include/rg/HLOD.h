@@ -0,0 +1,365 @@
+//
+// Hierarchical LOD: instances are grouped by a grid on the ground plane, each cell is merged into
+// one simplified proxy mesh, and cells of the level above merge the proxies below again. Far away
+// a whole cell is a single draw sampling a shared atlas of the source textures.
+//
+
+#ifndef PROJECT_BASE_HLOD_H
+#define PROJECT_BASE_HLOD_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+
+#include <rg/Bounds.h>
+#include <rg/FrameStats.h>
+#include <rg/Frustum.h>
+#include <rg/MeshSimplifier.h>
+#include <rg/Scene.h>
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
+
+struct HLODVertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+    // atlas rectangle of the source texture: offset and size
+    glm::vec4 Tile;
+};
+
+struct HLODCluster {
+    unsigned int level = 0;
+    AABB bounds;
+    // every instance the proxy stands for
+    std::vector<uint32_t> instances;
+    // clusters of the level below, empty on level 0
+    std::vector<uint32_t> children;
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    unsigned int indexCount = 0;
+};
+
+class HierarchicalLod {
+public:
+    static const unsigned int LEVELS = 2;
+    // every level's cells are this many times wider, and switch this many times farther away
+    static const int LEVEL_SCALE = 4;
+    static const int TILE_SIZE = 256;
+    static const int ATLAS_TILES = 8;
+
+    // level 0 cells; a cell boundary runs along x = 0, so the two sides of the street never share one
+    float cellSize = 48.0f;
+    // level 0 proxies replace their instances beyond this distance from the cell
+    float switchDistance = 150.0f;
+    // proxy triangles kept from the merged source, per level
+    float reduction = 0.25f;
+
+    std::vector<HLODCluster> clusters;
+    // clusters of the top level, where selection starts
+    std::vector<uint32_t> roots;
+
+    HierarchicalLod()
+            : shader("resources/shaders/hlod_proxy.vs", "resources/shaders/hlod_proxy.fs") {
+        glGenTextures(1, &atlas);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, TILE_SIZE * ATLAS_TILES, TILE_SIZE * ATLAS_TILES, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // the smallest level still keeps every tile apart
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 4);
+
+        glGenFramebuffers(1, &readFramebuffer);
+        glGenFramebuffers(1, &drawFramebuffer);
+        // tile 0 stays white for meshes without a diffuse texture
+        glBindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, atlas, 0);
+        GLfloat white[] = {1.0f, 1.0f, 1.0f, 1.0f};
+        glClearBufferfv(GL_COLOR, 0, white);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    ~HierarchicalLod() {
+        release();
+        glDeleteFramebuffers(1, &readFramebuffer);
+        glDeleteFramebuffers(1, &drawFramebuffer);
+        glDeleteTextures(1, &atlas);
+        glDeleteProgram(shader.ID);
+    }
+
+    // Rebuilds the clusters and their proxies. Sources are each model's coarsest level of detail,
+    // which keeps the build quick enough to rerun on every scene reload.
+    void Build(const Scene &scene, const std::vector<Model *> &sceneModels) {
+        release();
+        std::map<std::pair<int, int>, uint32_t> cells;
+        for (unsigned int i = 0; i < scene.instances.size(); i++) {
+            glm::vec3 position = scene.instances[i].position;
+            std::pair<int, int> key((int) std::floor(position.x / cellSize), (int) std::floor(position.z / cellSize));
+            auto cell = cells.insert(std::make_pair(key, (uint32_t) clusters.size()));
+            if (cell.second)
+                clusters.emplace_back();
+            clusters[cell.first->second].instances.push_back(i);
+        }
+
+        std::vector<std::vector<HLODVertex>> vertices;
+        std::vector<std::vector<unsigned int>> indices;
+        for (HLODCluster &cluster : clusters) {
+            std::vector<HLODVertex> merged;
+            std::vector<unsigned int> mergedIndices;
+            for (uint32_t instance : cluster.instances)
+                appendInstance(*sceneModels[scene.instances[instance].model], scene.transforms[instance], merged,
+                               mergedIndices);
+            vertices.push_back(std::move(merged));
+            indices.push_back(std::move(mergedIndices));
+        }
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        std::vector<uint32_t> level(clusters.size());
+        for (uint32_t i = 0; i < level.size(); i++)
+            level[i] = i;
+        for (unsigned int l = 0; l < LEVELS; l++) {
+            for (uint32_t c : level)
+                upload(clusters[c], vertices[c], indices[c]);
+            if (l + 1 == LEVELS)
+                break;
+
+            // group this level's cells into cells LEVEL_SCALE times wider and merge their proxies
+            float parentSize = cellSize * std::pow((float) LEVEL_SCALE, (float) (l + 1));
+            std::map<std::pair<int, int>, uint32_t> parents;
+            std::vector<uint32_t> next;
+            for (uint32_t c : level) {
+                glm::vec3 center = clusters[c].bounds.Center();
+                std::pair<int, int> key((int) std::floor(center.x / parentSize), (int) std::floor(center.z / parentSize));
+                auto parent = parents.insert(std::make_pair(key, (uint32_t) clusters.size()));
+                if (parent.second) {
+                    clusters.emplace_back();
+                    clusters.back().level = l + 1;
+                    vertices.emplace_back();
+                    indices.emplace_back();
+                    next.push_back(parent.first->second);
+                }
+                uint32_t p = parent.first->second;
+                HLODCluster &parentCluster = clusters[p];
+                parentCluster.children.push_back(c);
+                parentCluster.instances.insert(parentCluster.instances.end(), clusters[c].instances.begin(),
+                                               clusters[c].instances.end());
+                unsigned int base = vertices[p].size();
+                vertices[p].insert(vertices[p].end(), vertices[c].begin(), vertices[c].end());
+                for (unsigned int index : indices[c])
+                    indices[p].push_back(base + index);
+            }
+            level.swap(next);
+        }
+        roots = level;
+    }
+
+    // Picks what to draw: from the top level down, a cluster far enough away is drawn as its proxy
+    // (when in the frustum) and marks its instances covered; nearer ones hand over to their children.
+    void Select(const glm::vec3 &viewPosition, const Frustum *frustum, std::vector<uint8_t> &covered) {
+        covered.assign(covered.size(), 0);
+        selected.clear();
+        for (uint32_t root : roots)
+            select(root, viewPosition, frustum, covered);
+    }
+
+    // draws the selected proxies; the caller sets the light uniforms on shader beforehand
+    void Draw(const glm::mat4 &projection, const glm::mat4 &view) {
+        if (selected.empty())
+            return;
+        shader.use();
+        shader.setMat4("projection", projection);
+        shader.setMat4("view", view);
+        shader.setMat4("model", glm::mat4(1.0f));
+        shader.setInt("atlas", 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        for (uint32_t c : selected) {
+            const HLODCluster &cluster = clusters[c];
+            glBindVertexArray(cluster.VAO);
+            glDrawElements(GL_TRIANGLES, cluster.indexCount, GL_UNSIGNED_INT, 0);
+            rg::countDrawCall(cluster.indexCount / 3);
+        }
+        glBindVertexArray(0);
+    }
+
+    // depth-only draw of the selected proxies with whatever shader is bound, model set to identity
+    void DrawDepth(Shader &depthShader) {
+        depthShader.setMat4("model", glm::mat4(1.0f));
+        for (uint32_t c : selected) {
+            const HLODCluster &cluster = clusters[c];
+            glBindVertexArray(cluster.VAO);
+            glDrawElements(GL_TRIANGLES, cluster.indexCount, GL_UNSIGNED_INT, 0);
+            rg::countDrawCall(cluster.indexCount / 3);
+        }
+        glBindVertexArray(0);
+    }
+
+    size_t SelectedCount() const {
+        return selected.size();
+    }
+
+    Shader shader;
+
+private:
+    unsigned int atlas = 0;
+    unsigned int readFramebuffer = 0, drawFramebuffer = 0;
+    // source texture -> atlas tile, kept across rebuilds because the models are
+    std::map<unsigned int, int> tiles;
+    std::vector<uint32_t> selected;
+
+    void release() {
+        for (HLODCluster &cluster : clusters) {
+            glDeleteVertexArrays(1, &cluster.VAO);
+            glDeleteBuffers(1, &cluster.VBO);
+            glDeleteBuffers(1, &cluster.EBO);
+        }
+        clusters.clear();
+        roots.clear();
+        selected.clear();
+    }
+
+    void select(uint32_t c, const glm::vec3 &viewPosition, const Frustum *frustum, std::vector<uint8_t> &covered) {
+        const HLODCluster &cluster = clusters[c];
+        glm::vec3 nearest = glm::clamp(viewPosition, cluster.bounds.min, cluster.bounds.max);
+        float distance = switchDistance * std::pow((float) LEVEL_SCALE, (float) cluster.level);
+        if (cluster.indexCount > 0 && glm::distance(nearest, viewPosition) > distance) {
+            for (uint32_t instance : cluster.instances)
+                covered[instance] = 1;
+            if (!frustum || frustum->IntersectsAABB(cluster.bounds))
+                selected.push_back(c);
+            return;
+        }
+        for (uint32_t child : cluster.children)
+            select(child, viewPosition, frustum, covered);
+    }
+
+    // atlas tile of a source texture, copied in on first use
+    int tile(unsigned int texture) {
+        auto found = tiles.find(texture);
+        if (found != tiles.end())
+            return found->second;
+        int index = tiles.size() + 1;
+        if (index >= ATLAS_TILES * ATLAS_TILES) {
+            std::cout << "ERROR::HLOD::ATLAS_FULL" << std::endl;
+            tiles[texture] = 0;
+            return 0;
+        }
+        // copy from the smallest mip level that still covers the tile, a blit does not filter down
+        GLint width = 0, height = 0, level = 0;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        while ((width >> 1) >= TILE_SIZE && (height >> 1) >= TILE_SIZE) {
+            width >>= 1;
+            height >>= 1;
+            level++;
+        }
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, level);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+        int x = (index % ATLAS_TILES) * TILE_SIZE, y = (index / ATLAS_TILES) * TILE_SIZE;
+        glBlitFramebuffer(0, 0, width, height, x, y, x + TILE_SIZE, y + TILE_SIZE, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        tiles[texture] = index;
+        return index;
+    }
+
+    static glm::vec4 tileRect(int index) {
+        float size = 1.0f / ATLAS_TILES;
+        return glm::vec4((index % ATLAS_TILES) * size, (index / ATLAS_TILES) * size, size, size);
+    }
+
+    // the coarsest level of every mesh, moved to world space
+    void appendInstance(const Model &model, const glm::mat4 &transform, std::vector<HLODVertex> &vertices,
+                        std::vector<unsigned int> &indices) {
+        for (const Mesh &mesh : model.meshes) {
+            unsigned int diffuse = 0;
+            for (const Texture &texture : mesh.textures)
+                if (texture.type == "texture_diffuse") {
+                    diffuse = texture.id;
+                    break;
+                }
+            glm::vec4 rect = tileRect(diffuse ? tile(diffuse) : 0);
+
+            const unsigned int *source = mesh.indices.data();
+            size_t count = mesh.indices.size();
+            if (!mesh.lods.empty()) {
+                source = mesh.lodIndices.data() + mesh.lods.back().firstIndex;
+                count = mesh.lods.back().indexCount;
+            }
+            std::map<unsigned int, unsigned int> remap;
+            for (size_t i = 0; i < count; i++) {
+                auto found = remap.insert(std::make_pair(source[i], (unsigned int) vertices.size()));
+                if (found.second) {
+                    const Vertex &v = mesh.vertices[source[i]];
+                    // normals stay in model space, the convention of the model lighting shader
+                    vertices.push_back(HLODVertex{glm::vec3(transform * glm::vec4(v.Position, 1.0f)), v.Normal,
+                                                  v.TexCoords, rect});
+                }
+                indices.push_back(found.first->second);
+            }
+        }
+    }
+
+    void upload(HLODCluster &cluster, std::vector<HLODVertex> &vertices, std::vector<unsigned int> &indices) {
+        // simplify the merged mesh; tiles are folded into the texture coordinates so vertices of
+        // different textures never count as the same wedge
+        std::vector<glm::vec3> positions, normals;
+        std::vector<glm::vec2> texCoords;
+        for (const HLODVertex &v : vertices) {
+            positions.push_back(v.Position);
+            normals.push_back(v.Normal);
+            texCoords.push_back(v.TexCoords + glm::vec2(v.Tile.x, v.Tile.y) * 4096.0f);
+        }
+        indices = MeshSimplifier::Simplify(positions, normals, texCoords, indices,
+                                           (size_t) (indices.size() / 3 * reduction) * 3);
+
+        // keep only the vertices the proxy still uses
+        std::vector<HLODVertex> used;
+        std::vector<int> remap(vertices.size(), -1);
+        for (unsigned int &index : indices) {
+            if (remap[index] < 0) {
+                remap[index] = used.size();
+                used.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(used);
+
+        cluster.bounds = AABB();
+        for (const HLODVertex &v : vertices)
+            cluster.bounds.Expand(v.Position);
+        cluster.indexCount = indices.size();
+        if (indices.empty())
+            return;
+
+        glGenVertexArrays(1, &cluster.VAO);
+        glGenBuffers(1, &cluster.VBO);
+        glGenBuffers(1, &cluster.EBO);
+        glBindVertexArray(cluster.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, cluster.VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(HLODVertex), &vertices[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cluster.EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(HLODVertex), (void *) 0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(HLODVertex), (void *) offsetof(HLODVertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(HLODVertex), (void *) offsetof(HLODVertex, TexCoords));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(HLODVertex), (void *) offsetof(HLODVertex, Tile));
+        glBindVertexArray(0);
+    }
+};
+
+#endif //PROJECT_BASE_HLOD_H
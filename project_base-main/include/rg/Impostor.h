@@ -0,0 +1,224 @@
+//
+// Octahedral impostors: every model is rendered once at load into an atlas of views from a
+// hemi-octahedral grid of directions above the ground (albedo in one texture, model-space normal
+// and depth in another). Distant instances become one quad sampling the frame closest to the
+// viewing direction and relit with the scene's lights, drawn instanced per model.
+//
+
+#ifndef PROJECT_BASE_IMPOSTOR_H
+#define PROJECT_BASE_IMPOSTOR_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+
+#include <rg/FrameStats.h>
+
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <vector>
+
+struct ImpostorAtlas {
+    unsigned int albedo = 0;
+    unsigned int normalDepth = 0;
+    // model-space bounding sphere the frames were framed around
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+};
+
+class ImpostorRenderer {
+public:
+    // frames per atlas side and the resolution of one frame
+    static const int FRAMES = 8;
+    static const int FRAME_SIZE = 128;
+    static const int ATLAS_SIZE = FRAMES * FRAME_SIZE;
+
+    ImpostorRenderer()
+            : bakeShader("resources/shaders/impostor_bake.vs", "resources/shaders/impostor_bake.fs"),
+              shader("resources/shaders/impostor.vs", "resources/shaders/impostor.fs") {
+        glGenFramebuffers(1, &framebuffer);
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, ATLAS_SIZE, ATLAS_SIZE);
+
+        float corners[] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+        glGenVertexArrays(1, &quadVAO);
+        glGenBuffers(1, &quadVBO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(quadVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *) 0);
+        // one model matrix per instance, a mat4 attribute takes four locations
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (int column = 0; column < 4; column++) {
+            glEnableVertexAttribArray(1 + column);
+            glVertexAttribPointer(1 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                  (void *) (column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(1 + column, 1);
+        }
+        glBindVertexArray(0);
+    }
+
+    ~ImpostorRenderer() {
+        for (auto &entry : atlases) {
+            glDeleteTextures(1, &entry.second.albedo);
+            glDeleteTextures(1, &entry.second.normalDepth);
+        }
+        glDeleteVertexArrays(1, &quadVAO);
+        glDeleteBuffers(1, &quadVBO);
+        glDeleteBuffers(1, &instanceVBO);
+        glDeleteRenderbuffers(1, &depthBuffer);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteProgram(bakeShader.ID);
+        glDeleteProgram(shader.ID);
+    }
+
+    // direction of frame (x, y) of the grid, the same decoding the impostor vertex shader uses
+    static glm::vec3 FrameDirection(int x, int y) {
+        glm::vec2 e((x + 0.5f) / FRAMES * 2.0f - 1.0f, (y + 0.5f) / FRAMES * 2.0f - 1.0f);
+        glm::vec2 xz = glm::vec2(e.x + e.y, e.x - e.y) * 0.5f;
+        return glm::normalize(glm::vec3(xz.x, 1.0f - std::fabs(xz.x) - std::fabs(xz.y), xz.y));
+    }
+
+    // bakes the atlases of models seen for the first time; they are kept across scene reloads
+    void Prepare(const std::vector<Model *> &models) {
+        for (Model *model : models)
+            if (atlases.find(model) == atlases.end())
+                atlases[model] = bake(*model);
+    }
+
+    bool Has(const Model *model) const {
+        return atlases.find(model) != atlases.end();
+    }
+
+    const ImpostorAtlas &Atlas(const Model *model) const {
+        return atlases.find(model)->second;
+    }
+
+    // queues an instance for this frame's Draw
+    void Add(const Model *model, const glm::mat4 &transform) {
+        queued[model].push_back(transform);
+    }
+
+    // Draws everything queued, one instanced call per model. The caller sets the light uniforms
+    // on shader beforehand.
+    void Draw(const glm::mat4 &viewProjection, const glm::vec3 &viewPosition) {
+        shader.use();
+        shader.setMat4("viewProjection", viewProjection);
+        shader.setVec3("viewPosition", viewPosition);
+        shader.setFloat("frames", (float) FRAMES);
+        shader.setInt("albedoAtlas", 0);
+        shader.setInt("normalDepthAtlas", 1);
+        glBindVertexArray(quadVAO);
+        for (auto &entry : queued) {
+            std::vector<glm::mat4> &transforms = entry.second;
+            if (transforms.empty())
+                continue;
+            const ImpostorAtlas &atlas = Atlas(entry.first);
+            shader.setVec3("center", atlas.center);
+            shader.setFloat("radius", atlas.radius);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, atlas.albedo);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, atlas.normalDepth);
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            glBufferData(GL_ARRAY_BUFFER, transforms.size() * sizeof(glm::mat4), &transforms[0], GL_STREAM_DRAW);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, transforms.size());
+            rg::countDrawCall(2 * transforms.size());
+            transforms.clear();
+        }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    Shader bakeShader;
+    Shader shader;
+
+private:
+    std::map<const Model *, ImpostorAtlas> atlases;
+    std::map<const Model *, std::vector<glm::mat4>> queued;
+    unsigned int framebuffer = 0;
+    unsigned int depthBuffer = 0;
+    unsigned int quadVAO = 0, quadVBO = 0, instanceVBO = 0;
+
+    static unsigned int atlasTexture(GLenum internalFormat) {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, ATLAS_SIZE, ATLAS_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // stop before neighbouring frames bleed into each other
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 4);
+        return texture;
+    }
+
+    ImpostorAtlas bake(Model &model) {
+        ImpostorAtlas atlas;
+        atlas.center = model.bounds.Center();
+        atlas.radius = std::max(glm::length(model.bounds.max - model.bounds.min) * 0.5f, 1e-3f);
+        atlas.albedo = atlasTexture(GL_RGBA8);
+        atlas.normalDepth = atlasTexture(GL_RGBA8);
+
+        GLint savedViewport[4];
+        glGetIntegerv(GL_VIEWPORT, savedViewport);
+        GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+        GLboolean blend = glIsEnabled(GL_BLEND);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, atlas.albedo, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, atlas.normalDepth, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        GLenum buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glDrawBuffers(2, buffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::IMPOSTOR::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glViewport(0, 0, ATLAS_SIZE, ATLAS_SIZE);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        float r = atlas.radius;
+        glm::mat4 projection = glm::ortho(-r, r, -r, r, 0.0f, 4.0f * r);
+        bakeShader.use();
+        bakeShader.setMat4("projection", projection);
+        bakeShader.setVec3("center", atlas.center);
+        bakeShader.setFloat("radius", r);
+        for (int y = 0; y < FRAMES; y++) {
+            for (int x = 0; x < FRAMES; x++) {
+                glm::vec3 direction = FrameDirection(x, y);
+                glm::vec3 up = std::fabs(direction.y) > 0.999f ? glm::vec3(0.0f, 0.0f, -1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+                glm::mat4 view = glm::lookAt(atlas.center + direction * (2.0f * r), atlas.center, up);
+                bakeShader.setMat4("view", view);
+                bakeShader.setVec3("frameDirection", direction);
+                glViewport(x * FRAME_SIZE, y * FRAME_SIZE, FRAME_SIZE, FRAME_SIZE);
+                model.Draw(bakeShader);
+            }
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+        if (cullFace)
+            glEnable(GL_CULL_FACE);
+        if (blend)
+            glEnable(GL_BLEND);
+        for (unsigned int texture : {atlas.albedo, atlas.normalDepth}) {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return atlas;
+    }
+};
+
+#endif //PROJECT_BASE_IMPOSTOR_H
@@ -0,0 +1,110 @@
+//
+// Small pool of persistent worker threads for data-parallel loops.
+//
+
+#ifndef PROJECT_BASE_JOBSYSTEM_H
+#define PROJECT_BASE_JOBSYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem {
+public:
+    // threads counts the calling thread too; 0 uses every hardware thread
+    explicit JobSystem(unsigned int threads = 0) {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int i = 1; i < threads; i++)
+            workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    unsigned int ThreadCount() const {
+        return workers.size() + 1;
+    }
+
+    // Calls function(begin, end) on chunks of [0, count) from the workers and the calling thread and
+    // returns once every chunk is done. Not reentrant: function must not call ParallelFor itself.
+    void ParallelFor(size_t count, size_t chunk, const std::function<void(size_t, size_t)> &function) {
+        if (count == 0)
+            return;
+        chunk = std::max<size_t>(chunk, 1);
+        if (workers.empty() || count <= chunk) {
+            function(0, count);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &function;
+            jobCount = count;
+            jobChunk = chunk;
+            next = 0;
+            busy = workers.size();
+            generation++;
+        }
+        wake.notify_all();
+        runChunks();
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busy == 0; });
+        job = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool stopping = false;
+    unsigned long long generation = 0;
+    size_t busy = 0;
+
+    const std::function<void(size_t, size_t)> *job = nullptr;
+    size_t jobCount = 0;
+    size_t jobChunk = 1;
+    std::atomic<size_t> next{0};
+
+    void runChunks() {
+        for (;;) {
+            size_t begin = next.fetch_add(jobChunk);
+            if (begin >= jobCount)
+                return;
+            (*job)(begin, std::min(begin + jobChunk, jobCount));
+        }
+    }
+
+    void workerLoop() {
+        unsigned long long seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            runChunks();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0)
+                done.notify_one();
+        }
+    }
+};
+
+#endif //PROJECT_BASE_JOBSYSTEM_H
@@ -0,0 +1,272 @@
+//
+// Clustered light assignment: the view frustum is split into screen tiles and exponential depth
+// slices, every lamp's attenuation sphere is binned on the CPU into the clusters it overlaps, and the
+// forward lighting shaders read the lamp list of their fragment's cluster from texture buffers.
+//
+
+#ifndef PROJECT_BASE_LIGHTCLUSTERS_H
+#define PROJECT_BASE_LIGHTCLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define RG_CLUSTER_SSE 1
+#endif
+
+class LightClusters {
+public:
+    static const int TILES_X = 16;
+    static const int TILES_Y = 12;
+    static const int SLICES = 24;
+    static const int CLUSTERS = TILES_X * TILES_Y * SLICES;
+    // lamp data, cluster ranges and lamp indices are bound to these units and the two after it
+    static const int TEXTURE_UNIT = 8;
+
+    LightClusters() {
+        for (int i = 0; i < 3; i++) {
+            glGenBuffers(1, &buffers[i]);
+            glGenTextures(1, &textures[i]);
+        }
+        GLint maxTexels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        maxIndices = std::max(maxTexels, 65536);
+        // every cluster has a range even when nothing was built yet
+        offsets.assign(2 * CLUSTERS, 0);
+        upload(LAMPS, std::vector<glm::vec4>(1, glm::vec4(0.0f)), GL_RGBA32F);
+        upload(GRID, offsets, GL_RG32UI);
+        upload(INDICES, std::vector<uint32_t>(1, 0), GL_R32UI);
+    }
+
+    ~LightClusters() {
+        glDeleteBuffers(3, buffers);
+        glDeleteTextures(3, textures);
+    }
+
+    // Bins every lamp (a sphere of the given radius around each position) into the clusters of the
+    // frustum described by view and the perspective parameters, and uploads the result. shadowTiles,
+    // one per lamp when given, are the lamps' spot shadow tiles (SpotShadows.h) passed on to the shaders.
+    void Build(const std::vector<glm::vec3> &lamps, float radius, const glm::mat4 &view, float fovyRadians,
+               float aspect, float nearPlane, float farPlane, const std::vector<float> *shadowTiles = nullptr) {
+        if (fovyRadians != fovy || aspect != aspectRatio || nearPlane != zNear || farPlane != zFar)
+            buildClusterBounds(fovyRadians, aspect, nearPlane, farPlane);
+
+        clusterOfPair.clear();
+        lampOfPair.clear();
+        lampData.clear();
+        for (uint32_t lamp = 0; lamp < lamps.size(); lamp++) {
+            glm::vec3 center = glm::vec3(view * glm::vec4(lamps[lamp], 1.0f));
+            if (-center.z + radius < zNear || -center.z - radius > zFar)
+                continue;
+            uint32_t index = lampData.size();
+            lampData.push_back(glm::vec4(lamps[lamp], shadowTiles ? (*shadowTiles)[lamp] : -1.0f));
+            binLamp(center, radius, index);
+        }
+
+        // counting sort of the (cluster, lamp) pairs into one list per cluster
+        std::vector<uint32_t> counts(CLUSTERS, 0);
+        for (uint32_t cluster : clusterOfPair)
+            counts[cluster]++;
+        uint32_t total = 0;
+        maxPerCluster = 0;
+        for (int cluster = 0; cluster < CLUSTERS; cluster++) {
+            uint32_t count = std::min<uint32_t>(counts[cluster], maxIndices - std::min(total, maxIndices));
+            if (count < counts[cluster] && !overflowReported) {
+                std::cout << "ERROR::CLUSTERS::LIGHT_LIST_OVERFLOW" << std::endl;
+                overflowReported = true;
+            }
+            offsets[2 * cluster] = total;
+            offsets[2 * cluster + 1] = count;
+            counts[cluster] = total;
+            total += count;
+            maxPerCluster = std::max(maxPerCluster, count);
+        }
+        indices.assign(std::max(total, 1u), 0);
+        for (size_t pair = 0; pair < clusterOfPair.size(); pair++) {
+            uint32_t cluster = clusterOfPair[pair];
+            uint32_t &next = counts[cluster];
+            if (next < offsets[2 * cluster] + offsets[2 * cluster + 1])
+                indices[next++] = lampOfPair[pair];
+        }
+        indexCount = total;
+        lampCount = lampData.size();
+
+        if (lampData.empty())
+            lampData.push_back(glm::vec4(0.0f));
+        upload(LAMPS, lampData, GL_RGBA32F);
+        upload(GRID, offsets, GL_RG32UI);
+        upload(INDICES, indices, GL_R32UI);
+    }
+
+    // binds the texture buffers and sets the cluster uniforms; the shader must be in use
+    void Bind(Shader &shader) const {
+        for (int i = 0; i < 3; i++) {
+            glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT + i);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("clusterLamps", TEXTURE_UNIT + LAMPS);
+        shader.setInt("clusterGrid", TEXTURE_UNIT + GRID);
+        shader.setInt("clusterIndices", TEXTURE_UNIT + INDICES);
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        shader.setVec2("clusterTileSize", glm::vec2((float) viewport[2] / TILES_X, (float) viewport[3] / TILES_Y));
+        shader.setFloat("clusterNear", zNear);
+        shader.setFloat("clusterFar", zFar);
+        // slice = log(depth) * scale + bias
+        float scale = SLICES / std::log(zFar / zNear);
+        shader.setFloat("clusterSliceScale", scale);
+        shader.setFloat("clusterSliceBias", -std::log(zNear) * scale);
+    }
+
+    // lamps inside the depth range of the last Build
+    unsigned int LampCount() const {
+        return lampCount;
+    }
+
+    unsigned int IndexCount() const {
+        return indexCount;
+    }
+
+    unsigned int MaxPerCluster() const {
+        return maxPerCluster;
+    }
+
+    // texture buffers, bound to TEXTURE_UNIT + these
+    enum { LAMPS, GRID, INDICES };
+
+private:
+
+    unsigned int buffers[3];
+    unsigned int textures[3];
+    uint32_t maxIndices = 65536;
+    bool overflowReported = false;
+
+    float fovy = 0.0f, aspectRatio = 0.0f, zNear = 0.1f, zFar = 1.0f;
+    // view-space bounds of every cluster, x fastest, then y, then slice
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+    // depth where each slice starts, SLICES + 1 entries
+    float sliceDepth[SLICES + 1];
+
+    std::vector<glm::vec4> lampData;
+    std::vector<uint32_t> clusterOfPair, lampOfPair;
+    std::vector<uint32_t> offsets, indices;
+    uint32_t lampCount = 0, indexCount = 0, maxPerCluster = 0;
+
+    template <typename T>
+    void upload(int which, const std::vector<T> &data, GLenum format) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[which]);
+        glBufferData(GL_TEXTURE_BUFFER, data.size() * sizeof(T), &data[0], GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[which]);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffers[which]);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void buildClusterBounds(float fovyRadians, float aspect, float nearPlane, float farPlane) {
+        fovy = fovyRadians;
+        aspectRatio = aspect;
+        zNear = nearPlane;
+        zFar = farPlane;
+        for (int slice = 0; slice <= SLICES; slice++)
+            sliceDepth[slice] = zNear * std::pow(zFar / zNear, (float) slice / SLICES);
+        float scaleY = std::tan(fovy * 0.5f), scaleX = scaleY * aspect;
+        for (std::vector<float> *bounds : {&minX, &minY, &minZ, &maxX, &maxY, &maxZ})
+            bounds->resize(CLUSTERS);
+        for (int slice = 0; slice < SLICES; slice++) {
+            float nearDepth = sliceDepth[slice], farDepth = sliceDepth[slice + 1];
+            for (int y = 0; y < TILES_Y; y++) {
+                float y0 = (-1.0f + 2.0f * y / TILES_Y) * scaleY, y1 = (-1.0f + 2.0f * (y + 1) / TILES_Y) * scaleY;
+                for (int x = 0; x < TILES_X; x++) {
+                    float x0 = (-1.0f + 2.0f * x / TILES_X) * scaleX, x1 = (-1.0f + 2.0f * (x + 1) / TILES_X) * scaleX;
+                    int cluster = (slice * TILES_Y + y) * TILES_X + x;
+                    // the side planes fan out with depth, so the box spans both ends of the slice
+                    minX[cluster] = std::min(x0 * nearDepth, x0 * farDepth);
+                    maxX[cluster] = std::max(x1 * nearDepth, x1 * farDepth);
+                    minY[cluster] = std::min(y0 * nearDepth, y0 * farDepth);
+                    maxY[cluster] = std::max(y1 * nearDepth, y1 * farDepth);
+                    minZ[cluster] = -farDepth;
+                    maxZ[cluster] = -nearDepth;
+                }
+            }
+        }
+    }
+
+    int sliceOf(float depth) const {
+        if (depth <= zNear)
+            return 0;
+        int slice = (int) std::floor(std::log(depth / zNear) / std::log(zFar / zNear) * SLICES);
+        return std::max(0, std::min(slice, SLICES - 1));
+    }
+
+    // tile range along one axis covered by the sphere's box, from its projection at the near and far depth
+    static void tileRange(float center, float radius, float nearDepth, float farDepth, float scale, int tiles,
+                          int &first, int &last) {
+        float high = center + radius, low = center - radius;
+        float highNdc = high / ((high > 0.0f ? nearDepth : farDepth) * scale);
+        float lowNdc = low / ((low < 0.0f ? nearDepth : farDepth) * scale);
+        first = std::max(0, (int) std::floor((lowNdc * 0.5f + 0.5f) * tiles));
+        last = std::min(tiles - 1, (int) std::floor((highNdc * 0.5f + 0.5f) * tiles));
+    }
+
+    void binLamp(const glm::vec3 &center, float radius, uint32_t lamp) {
+        float nearDepth = std::max(-center.z - radius, zNear), farDepth = std::min(-center.z + radius, zFar);
+        int firstSlice = sliceOf(nearDepth), lastSlice = sliceOf(farDepth);
+        float scaleY = std::tan(fovy * 0.5f), scaleX = scaleY * aspectRatio;
+        int x0, x1, y0, y1;
+        tileRange(center.x, radius, nearDepth, farDepth, scaleX, TILES_X, x0, x1);
+        tileRange(center.y, radius, nearDepth, farDepth, scaleY, TILES_Y, y0, y1);
+        float radius2 = radius * radius;
+        for (int slice = firstSlice; slice <= lastSlice; slice++) {
+            for (int y = y0; y <= y1; y++) {
+                int row = (slice * TILES_Y + y) * TILES_X;
+                int x = x0;
+#if defined(RG_CLUSTER_SSE)
+                // sphere against four cluster boxes at a time
+                x &= ~3;
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+                const __m128 r2 = _mm_set1_ps(radius2);
+                for (; x <= x1; x += 4) {
+                    int cluster = row + x;
+                    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[cluster]), cx),
+                                                      _mm_sub_ps(cx, _mm_loadu_ps(&maxX[cluster]))), zero);
+                    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[cluster]), cy),
+                                                      _mm_sub_ps(cy, _mm_loadu_ps(&maxY[cluster]))), zero);
+                    __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[cluster]), cz),
+                                                      _mm_sub_ps(cz, _mm_loadu_ps(&maxZ[cluster]))), zero);
+                    __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                    int mask = _mm_movemask_ps(_mm_cmple_ps(distance2, r2));
+                    for (int lane = 0; lane < 4; lane++)
+                        if ((mask & (1 << lane)) && x + lane >= x0 && x + lane <= x1)
+                            addPair(cluster + lane, lamp);
+                }
+#endif
+                for (; x <= x1; x++) {
+                    int cluster = row + x;
+                    float dx = std::max(std::max(minX[cluster] - center.x, center.x - maxX[cluster]), 0.0f);
+                    float dy = std::max(std::max(minY[cluster] - center.y, center.y - maxY[cluster]), 0.0f);
+                    float dz = std::max(std::max(minZ[cluster] - center.z, center.z - maxZ[cluster]), 0.0f);
+                    if (dx * dx + dy * dy + dz * dz <= radius2)
+                        addPair(cluster, lamp);
+                }
+            }
+        }
+    }
+
+    void addPair(uint32_t cluster, uint32_t lamp) {
+        clusterOfPair.push_back(cluster);
+        lampOfPair.push_back(lamp);
+    }
+};
+
+#endif //PROJECT_BASE_LIGHTCLUSTERS_H
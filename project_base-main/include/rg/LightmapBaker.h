@@ -0,0 +1,438 @@
+//
+// CPU lightmap baker: ray traces the static scene through a triangle BVH on every core of the JobSystem.
+// Each lightmap texel gets the ambient term, the direct light of the sun and of the lamps within reach
+// with a shadow ray each, and one bounce: cosine-distributed rays gather the direct light of whatever
+// they hit, times its albedo. The units follow the lighting shaders, which have no 1/pi, so the
+// irradiance multiplies the diffuse texture as is.
+//
+
+#ifndef PROJECT_BASE_LIGHTMAPBAKER_H
+#define PROJECT_BASE_LIGHTMAPBAKER_H
+
+#include <glm/glm.hpp>
+
+#include <rg/JobSystem.h>
+#include <rg/SphericalHarmonics.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+class LightmapBaker {
+public:
+    // rays per texel gathering the bounce
+    int BounceRays = 64;
+    // rays start this far off the surface along its normal, in world units
+    float RayOffset = 0.02f;
+    // uncovered texels filled from covered neighbours, reaching over the gutters and padding
+    int DilationPasses = 4;
+
+    // a light set, as the lighting shaders get it
+    struct Lights {
+        glm::vec3 sunDirection = glm::vec3(0.0f, -1.0f, 0.0f);
+        glm::vec3 sunDiffuse = glm::vec3(0.0f);
+        // ambient light of the sky, per normal
+        SphericalHarmonics sky;
+        // lamp positions, each one a point light and a spot light
+        std::vector<glm::vec3> lamps;
+        // per lamp, the owner of the triangles around it (its own lamp post), which cast no shadow of it;
+        // -1 for none
+        std::vector<int> lampOwners;
+        glm::vec3 pointAmbient = glm::vec3(0.0f), pointDiffuse = glm::vec3(0.0f);
+        glm::vec3 spotAmbient = glm::vec3(0.0f), spotDiffuse = glm::vec3(0.0f);
+        glm::vec3 spotDirection = glm::vec3(0.0f, -1.0f, 0.0f);
+        float constant = 1.0f, linear = 0.0f, quadratic = 0.0f;
+        // cosines of the spot's inner and outer cone
+        float cutOff = 1.0f, outerCutOff = 1.0f;
+        // lamps farther than this don't light a texel, as in the light clusters
+        float radius = 0.0f;
+    };
+
+    // the lightmap is width x height texels
+    LightmapBaker(JobSystem &jobs, int width, int height) : jobs(jobs), width(width), height(height) {
+    }
+
+    // World-space triangles, with their vertex normals and lightmap texel positions; texels empty for
+    // geometry that only blocks light. Owner groups the triangles of one object.
+    void AddTriangles(const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &normals,
+                      const std::vector<glm::vec2> &texels, const std::vector<unsigned int> &indices,
+                      const glm::vec3 &albedo, int owner) {
+        for (unsigned int i = 0; i + 2 < indices.size(); i += 3) {
+            Triangle triangle;
+            for (int k = 0; k < 3; k++) {
+                triangle.p[k] = positions[indices[i + k]];
+                triangle.n[k] = normals[indices[i + k]];
+                triangle.t[k] = texels.empty() ? glm::vec2(0.0f) : texels[indices[i + k]];
+            }
+            triangle.albedo = albedo;
+            triangle.owner = owner;
+            triangle.lightmapped = !texels.empty();
+            triangles.push_back(triangle);
+        }
+        prepared = false;
+    }
+
+    size_t TriangleCount() const {
+        return triangles.size();
+    }
+
+    // texels covered by a lightmapped triangle, known after the first Bake
+    size_t TexelCount() const {
+        return covered.size();
+    }
+
+    // irradiance of every texel, row by row; texels no triangle covers are dilated from their neighbours
+    // or stay black
+    void Bake(const Lights &lights, std::vector<glm::vec3> &irradiance) {
+        if (!prepared)
+            prepare();
+        std::vector<glm::vec3> ambient(covered.size()), direct(covered.size());
+        jobs.ParallelFor(covered.size(), 256, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const Texel &texel = texels[covered[i]];
+                direct[i] = directLight(lights, texel.position, texel.normal, ambient[i]);
+            }
+        });
+        // direct light by texel, for the bounce to look up instead of tracing again
+        std::vector<int> coveredIndex(texels.size(), -1);
+        for (size_t i = 0; i < covered.size(); i++)
+            coveredIndex[covered[i]] = (int) i;
+
+        irradiance.assign(texels.size(), glm::vec3(0.0f));
+        jobs.ParallelFor(covered.size(), 64, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const Texel &texel = texels[covered[i]];
+                glm::vec3 bounce(0.0f);
+                uint32_t random = (uint32_t) covered[i] * 2654435761u + 1u;
+                glm::vec3 tangent, bitangent;
+                basis(texel.normal, tangent, bitangent);
+                glm::vec3 origin = texel.position + texel.normal * RayOffset;
+                for (int ray = 0; ray < BounceRays; ray++) {
+                    float r1 = next(random), r2 = next(random);
+                    float phi = 6.2831853f * r1, r = std::sqrt(r2);
+                    glm::vec3 direction = tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) +
+                                          texel.normal * std::sqrt(std::max(0.0f, 1.0f - r2));
+                    Hit hit;
+                    if (!trace(origin, direction, 1e4f, -1, false, &hit))
+                        continue;
+                    const Triangle &triangle = triangles[hit.triangle];
+                    float w = 1.0f - hit.u - hit.v;
+                    glm::vec3 normal = triangle.n[0] * w + triangle.n[1] * hit.u + triangle.n[2] * hit.v;
+                    // the back of a surface, inside something
+                    if (glm::dot(normal, direction) >= 0.0f)
+                        continue;
+                    glm::vec3 light;
+                    int index = -1;
+                    if (triangle.lightmapped) {
+                        glm::vec2 t = triangle.t[0] * w + triangle.t[1] * hit.u + triangle.t[2] * hit.v;
+                        int x = (int) t.x, y = (int) t.y;
+                        if (x >= 0 && y >= 0 && x < width && y < height)
+                            index = coveredIndex[(size_t) y * width + x];
+                    }
+                    if (index >= 0)
+                        light = direct[index];
+                    else {
+                        glm::vec3 unused;
+                        glm::vec3 position = origin + direction * hit.distance;
+                        light = directLight(lights, position, glm::normalize(normal), unused);
+                    }
+                    bounce += triangle.albedo * light;
+                }
+                irradiance[covered[i]] = ambient[i] + direct[i] + bounce / (float) std::max(BounceRays, 1);
+            }
+        });
+        dilate(irradiance);
+    }
+
+private:
+    struct Triangle {
+        glm::vec3 p[3], n[3];
+        glm::vec2 t[3];
+        glm::vec3 albedo;
+        int owner;
+        bool lightmapped;
+    };
+
+    // interior nodes: the left child follows, offset is the right child; leaves: count triangles
+    // from offset
+    struct Node {
+        glm::vec3 min, max;
+        int offset;
+        int count;
+    };
+
+    struct Texel {
+        glm::vec3 position, normal;
+        int triangle = -1;
+    };
+
+    struct Hit {
+        int triangle = -1;
+        float distance = 0.0f, u = 0.0f, v = 0.0f;
+    };
+
+    JobSystem &jobs;
+    int width, height;
+    std::vector<Triangle> triangles;
+    std::vector<Node> nodes;
+    std::vector<Texel> texels;
+    // indices of the texels a triangle covers
+    std::vector<size_t> covered;
+    bool prepared = false;
+
+    void prepare() {
+        nodes.clear();
+        if (!triangles.empty()) {
+            std::vector<unsigned int> order(triangles.size());
+            std::iota(order.begin(), order.end(), 0u);
+            build(order, 0, order.size());
+            std::vector<Triangle> sorted;
+            sorted.reserve(triangles.size());
+            for (unsigned int index : order)
+                sorted.push_back(triangles[index]);
+            triangles.swap(sorted);
+        }
+        rasterize();
+        prepared = true;
+    }
+
+    // median split along the longest axis of the centroids, down to four triangles
+    int build(std::vector<unsigned int> &order, size_t begin, size_t end) {
+        int index = (int) nodes.size();
+        nodes.push_back(Node());
+        glm::vec3 min(1e30f), max(-1e30f), centroidMin(1e30f), centroidMax(-1e30f);
+        for (size_t i = begin; i < end; i++) {
+            const Triangle &triangle = triangles[order[i]];
+            for (int k = 0; k < 3; k++) {
+                min = glm::min(min, triangle.p[k]);
+                max = glm::max(max, triangle.p[k]);
+            }
+            glm::vec3 centroid = centroidOf(triangle);
+            centroidMin = glm::min(centroidMin, centroid);
+            centroidMax = glm::max(centroidMax, centroid);
+        }
+        nodes[index].min = min;
+        nodes[index].max = max;
+        glm::vec3 extent = centroidMax - centroidMin;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+        if (end - begin <= 4 || extent[axis] <= 0.0f) {
+            nodes[index].offset = (int) begin;
+            nodes[index].count = (int) (end - begin);
+            return index;
+        }
+        size_t middle = (begin + end) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                         [&](unsigned int a, unsigned int b) {
+                             return centroidOf(triangles[a])[axis] < centroidOf(triangles[b])[axis];
+                         });
+        build(order, begin, middle);
+        int right = build(order, middle, end);
+        nodes[index].offset = right;
+        nodes[index].count = 0;
+        return index;
+    }
+
+    static glm::vec3 centroidOf(const Triangle &triangle) {
+        return (triangle.p[0] + triangle.p[1] + triangle.p[2]) / 3.0f;
+    }
+
+    static float edge(const glm::vec2 &a, const glm::vec2 &b, const glm::vec2 &c) {
+        return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    }
+
+    // the surface point under every texel centre inside a lightmapped triangle
+    void rasterize() {
+        texels.assign((size_t) width * height, Texel());
+        covered.clear();
+        for (unsigned int i = 0; i < triangles.size(); i++) {
+            const Triangle &triangle = triangles[i];
+            if (!triangle.lightmapped)
+                continue;
+            float area = edge(triangle.t[0], triangle.t[1], triangle.t[2]);
+            if (std::abs(area) < 1e-8f)
+                continue;
+            glm::vec2 low = glm::min(triangle.t[0], glm::min(triangle.t[1], triangle.t[2]));
+            glm::vec2 high = glm::max(triangle.t[0], glm::max(triangle.t[1], triangle.t[2]));
+            int x0 = std::max(0, (int) std::floor(low.x)), x1 = std::min(width - 1, (int) std::ceil(high.x));
+            int y0 = std::max(0, (int) std::floor(low.y)), y1 = std::min(height - 1, (int) std::ceil(high.y));
+            glm::vec3 face = glm::normalize(glm::cross(triangle.p[1] - triangle.p[0], triangle.p[2] - triangle.p[0]));
+            for (int y = y0; y <= y1; y++)
+                for (int x = x0; x <= x1; x++) {
+                    glm::vec2 centre(x + 0.5f, y + 0.5f);
+                    float w0 = edge(triangle.t[1], triangle.t[2], centre) / area;
+                    float w1 = edge(triangle.t[2], triangle.t[0], centre) / area;
+                    float w2 = edge(triangle.t[0], triangle.t[1], centre) / area;
+                    if (w0 < -1e-4f || w1 < -1e-4f || w2 < -1e-4f)
+                        continue;
+                    Texel &texel = texels[(size_t) y * width + x];
+                    if (texel.triangle >= 0)
+                        continue;
+                    texel.triangle = (int) i;
+                    texel.position = triangle.p[0] * w0 + triangle.p[1] * w1 + triangle.p[2] * w2;
+                    glm::vec3 normal = triangle.n[0] * w0 + triangle.n[1] * w1 + triangle.n[2] * w2;
+                    texel.normal = glm::dot(normal, normal) > 1e-12f ? glm::normalize(normal) : face;
+                    covered.push_back((size_t) y * width + x);
+                }
+        }
+    }
+
+    // diffuse light at a point with its shadows; the unshadowed ambient terms go to ambient
+    glm::vec3 directLight(const Lights &lights, const glm::vec3 &position, const glm::vec3 &normal,
+                          glm::vec3 &ambient) const {
+        glm::vec3 origin = position + normal * RayOffset;
+        ambient = lights.sky.Evaluate(normal);
+        glm::vec3 light(0.0f);
+        glm::vec3 toSun = glm::normalize(-lights.sunDirection);
+        float sun = glm::dot(normal, toSun);
+        if (sun > 0.0f && !trace(origin, toSun, 1e4f, -1, true, nullptr))
+            light += lights.sunDiffuse * sun;
+        glm::vec3 toSpot = glm::normalize(-lights.spotDirection);
+        for (unsigned int i = 0; i < lights.lamps.size(); i++) {
+            glm::vec3 toLamp = lights.lamps[i] - position;
+            float distance = glm::length(toLamp);
+            if (distance >= lights.radius || distance < 1e-4f)
+                continue;
+            toLamp /= distance;
+            float attenuation = 1.0f / (lights.constant + lights.linear * distance +
+                                        lights.quadratic * distance * distance);
+            float spot = glm::clamp((glm::dot(toLamp, toSpot) - lights.outerCutOff) /
+                                    (lights.cutOff - lights.outerCutOff), 0.0f, 1.0f);
+            ambient += (lights.pointAmbient + lights.spotAmbient * spot) * attenuation;
+            float diffuse = glm::dot(normal, toLamp);
+            if (diffuse <= 0.0f)
+                continue;
+            int owner = i < lights.lampOwners.size() ? lights.lampOwners[i] : -1;
+            glm::vec3 ray = lights.lamps[i] - origin;
+            if (trace(origin, glm::normalize(ray), glm::length(ray) - RayOffset, owner, true, nullptr))
+                continue;
+            light += (lights.pointDiffuse + lights.spotDiffuse * spot) * (diffuse * attenuation);
+        }
+        return light;
+    }
+
+    // Closest hit within maxDistance, or with anyHit whether there is one at all. Triangles of
+    // ignoreOwner don't count. Two-sided.
+    bool trace(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, int ignoreOwner, bool anyHit,
+               Hit *hit) const {
+        if (nodes.empty())
+            return false;
+        glm::vec3 inverse = 1.0f / direction;
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        float closest = maxDistance;
+        bool found = false;
+        while (top > 0) {
+            int index = stack[--top];
+            const Node &node = nodes[index];
+            if (!hitsBox(node, origin, inverse, closest))
+                continue;
+            if (node.count == 0) {
+                stack[top++] = node.offset;
+                stack[top++] = index + 1;
+                continue;
+            }
+            for (int i = node.offset; i < node.offset + node.count; i++) {
+                const Triangle &triangle = triangles[i];
+                if (triangle.owner == ignoreOwner && ignoreOwner >= 0)
+                    continue;
+                float distance, u, v;
+                if (!intersect(triangle, origin, direction, distance, u, v) || distance >= closest)
+                    continue;
+                if (anyHit)
+                    return true;
+                closest = distance;
+                found = true;
+                hit->triangle = i;
+                hit->distance = distance;
+                hit->u = u;
+                hit->v = v;
+            }
+        }
+        return found;
+    }
+
+    static bool hitsBox(const Node &node, const glm::vec3 &origin, const glm::vec3 &inverse, float maxDistance) {
+        glm::vec3 t0 = (node.min - origin) * inverse, t1 = (node.max - origin) * inverse;
+        glm::vec3 entries = glm::min(t0, t1), exits = glm::max(t0, t1);
+        float enter = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.0f));
+        float exit = std::min(std::min(exits.x, exits.y), std::min(exits.z, maxDistance));
+        return enter <= exit;
+    }
+
+    // Moller-Trumbore
+    static bool intersect(const Triangle &triangle, const glm::vec3 &origin, const glm::vec3 &direction,
+                          float &distance, float &u, float &v) {
+        glm::vec3 edge1 = triangle.p[1] - triangle.p[0], edge2 = triangle.p[2] - triangle.p[0];
+        glm::vec3 p = glm::cross(direction, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (std::abs(determinant) < 1e-12f)
+            return false;
+        float inverse = 1.0f / determinant;
+        glm::vec3 s = origin - triangle.p[0];
+        u = glm::dot(s, p) * inverse;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        glm::vec3 q = glm::cross(s, edge1);
+        v = glm::dot(direction, q) * inverse;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+        distance = glm::dot(edge2, q) * inverse;
+        return distance > 1e-5f;
+    }
+
+    // any two unit vectors completing normal to an orthonormal basis
+    static void basis(const glm::vec3 &normal, glm::vec3 &tangent, glm::vec3 &bitangent) {
+        glm::vec3 helper = std::abs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        tangent = glm::normalize(glm::cross(helper, normal));
+        bitangent = glm::cross(normal, tangent);
+    }
+
+    // xorshift, uniform in [0, 1)
+    static float next(uint32_t &state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // grows the covered texels outwards, so bilinear filtering at chart borders reads sensible values
+    void dilate(std::vector<glm::vec3> &irradiance) const {
+        std::vector<uint8_t> valid(texels.size(), 0);
+        for (size_t index : covered)
+            valid[index] = 1;
+        for (int pass = 0; pass < DilationPasses; pass++) {
+            std::vector<uint8_t> grownValid = valid;
+            std::vector<glm::vec3> grown = irradiance;
+            for (int y = 0; y < height; y++)
+                for (int x = 0; x < width; x++) {
+                    size_t index = (size_t) y * width + x;
+                    if (valid[index])
+                        continue;
+                    glm::vec3 sum(0.0f);
+                    int count = 0;
+                    for (int dy = -1; dy <= 1; dy++)
+                        for (int dx = -1; dx <= 1; dx++) {
+                            int nx = x + dx, ny = y + dy;
+                            if (nx < 0 || ny < 0 || nx >= width || ny >= height)
+                                continue;
+                            size_t neighbour = (size_t) ny * width + nx;
+                            if (valid[neighbour]) {
+                                sum += irradiance[neighbour];
+                                count++;
+                            }
+                        }
+                    if (count) {
+                        grown[index] = sum / (float) count;
+                        grownValid[index] = 1;
+                    }
+                }
+            valid.swap(grownValid);
+            irradiance.swap(grown);
+        }
+    }
+};
+
+#endif //PROJECT_BASE_LIGHTMAPBAKER_H
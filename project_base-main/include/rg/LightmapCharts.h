@@ -0,0 +1,232 @@
+//
+// Lightmap charts: a second set of texture coordinates for a model, so that no two spots of its surface
+// share a lightmap texel. Triangles facing the same axis and sharing an edge form a chart, every chart
+// is projected flat along its axis and the charts are shelf-packed into one square at the largest scale
+// that fits. Vertices on the border of two charts are split.
+//
+
+#ifndef PROJECT_BASE_LIGHTMAPCHARTS_H
+#define PROJECT_BASE_LIGHTMAPCHARTS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+class LightmapCharts {
+public:
+    // empty texels around every chart, so filtering and the baker's dilation stay inside it
+    static const int GUTTER = 2;
+
+    // one mesh of the model
+    struct Surface {
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> indices;
+    };
+
+    // the mesh laid out: every vertex copies source[i], with coords[i] in [0, 1] of the square, and
+    // indices are the mesh's triangles rewritten to them. The first vertices are the original ones in
+    // order, the split copies follow.
+    struct Layout {
+        std::vector<unsigned int> source;
+        std::vector<glm::vec2> coords;
+        std::vector<unsigned int> indices;
+    };
+
+    // lays the surfaces out in a resolution x resolution square; false when even the smallest
+    // scale leaves charts over
+    static bool Unwrap(const std::vector<Surface> &surfaces, int resolution, std::vector<Layout> &layouts) {
+        std::vector<Chart> charts;
+        // chart of every triangle, per surface
+        std::vector<std::vector<unsigned int>> triangleCharts(surfaces.size());
+        for (unsigned int s = 0; s < surfaces.size(); s++)
+            buildCharts(surfaces[s], charts, triangleCharts[s]);
+        if (charts.empty()) {
+            layouts.assign(surfaces.size(), Layout());
+            return false;
+        }
+
+        // tallest first, the shelves fill up evenly
+        std::vector<unsigned int> order(charts.size());
+        std::iota(order.begin(), order.end(), 0u);
+        std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+            float ha = charts[a].max.y - charts[a].min.y, hb = charts[b].max.y - charts[b].min.y;
+            return ha != hb ? ha > hb : a < b;
+        });
+        float area = 0.0f, extent = 0.0f;
+        for (const Chart &chart : charts) {
+            glm::vec2 size = chart.max - chart.min;
+            area += size.x * size.y;
+            extent = std::max(extent, std::max(size.x, size.y));
+        }
+        // texels per model unit: the largest that packs, found by bisection
+        float low = 0.0f;
+        float high = (float) resolution / std::max(std::sqrt(area), 1e-6f);
+        if (extent > 0.0f)
+            high = std::min(high, (resolution - 1 - 2 * GUTTER) / extent);
+        if (!pack(charts, order, resolution, low))
+            return false;
+        if (pack(charts, order, resolution, high))
+            low = high;
+        else
+            for (int i = 0; i < 24; i++) {
+                float middle = 0.5f * (low + high);
+                if (pack(charts, order, resolution, middle))
+                    low = middle;
+                else
+                    high = middle;
+            }
+        pack(charts, order, resolution, low);
+
+        layouts.assign(surfaces.size(), Layout());
+        for (unsigned int s = 0; s < surfaces.size(); s++)
+            emit(surfaces[s], charts, triangleCharts[s], resolution, low, layouts[s]);
+        return true;
+    }
+
+private:
+    struct Chart {
+        // projection: dropped axis, the other two become u and v
+        int axis;
+        glm::vec2 min = glm::vec2(1e30f), max = glm::vec2(-1e30f);
+        // placement in texels, of the gutter's corner
+        glm::ivec2 origin;
+    };
+
+    static glm::vec2 project(const glm::vec3 &p, int axis) {
+        return axis == 0 ? glm::vec2(p.y, p.z) : axis == 1 ? glm::vec2(p.x, p.z) : glm::vec2(p.x, p.y);
+    }
+
+    static glm::ivec2 slot(const Chart &chart, float scale) {
+        glm::vec2 size = (chart.max - chart.min) * scale;
+        // a span of n texels touches n + 1 of them, plus a gutter on each side
+        return glm::ivec2((int) std::ceil(size.x) + 1 + 2 * GUTTER, (int) std::ceil(size.y) + 1 + 2 * GUTTER);
+    }
+
+    // groups the surface's triangles: same dominant normal axis and sign, connected through edges
+    // between equal positions (the loader doesn't weld vertices)
+    static void buildCharts(const Surface &surface, std::vector<Chart> &charts,
+                            std::vector<unsigned int> &triangleCharts) {
+        const unsigned int triangles = surface.indices.size() / 3;
+        std::map<std::array<long long, 3>, unsigned int> welded;
+        std::vector<unsigned int> weldedIndex(surface.positions.size());
+        for (unsigned int i = 0; i < surface.positions.size(); i++) {
+            const glm::vec3 &p = surface.positions[i];
+            std::array<long long, 3> key = {std::llround(p.x * 1e4), std::llround(p.y * 1e4), std::llround(p.z * 1e4)};
+            weldedIndex[i] = welded.insert(std::make_pair(key, (unsigned int) welded.size())).first->second;
+        }
+
+        std::vector<int> direction(triangles);
+        for (unsigned int t = 0; t < triangles; t++) {
+            const glm::vec3 &a = surface.positions[surface.indices[3 * t]];
+            const glm::vec3 &b = surface.positions[surface.indices[3 * t + 1]];
+            const glm::vec3 &c = surface.positions[surface.indices[3 * t + 2]];
+            glm::vec3 n = glm::cross(b - a, c - a);
+            glm::vec3 size = glm::abs(n);
+            int axis = size.x >= size.y && size.x >= size.z ? 0 : size.y >= size.z ? 1 : 2;
+            direction[t] = axis * 2 + (n[axis] < 0.0f ? 1 : 0);
+        }
+
+        std::vector<unsigned int> parent(triangles);
+        std::iota(parent.begin(), parent.end(), 0u);
+        auto find = [&](unsigned int t) {
+            while (parent[t] != t)
+                t = parent[t] = parent[parent[t]];
+            return t;
+        };
+        // the first triangle seen on every edge, per facing
+        std::map<std::pair<unsigned int, unsigned int>, std::array<int, 6>> edges;
+        for (unsigned int t = 0; t < triangles; t++)
+            for (int e = 0; e < 3; e++) {
+                unsigned int a = weldedIndex[surface.indices[3 * t + e]];
+                unsigned int b = weldedIndex[surface.indices[3 * t + (e + 1) % 3]];
+                auto inserted = edges.insert(std::make_pair(std::make_pair(std::min(a, b), std::max(a, b)),
+                                                            std::array<int, 6>{{-1, -1, -1, -1, -1, -1}}));
+                int &first = inserted.first->second[direction[t]];
+                if (first < 0)
+                    first = (int) t;
+                else
+                    parent[find(t)] = find((unsigned int) first);
+            }
+
+        std::map<unsigned int, unsigned int> rootCharts;
+        triangleCharts.resize(triangles);
+        for (unsigned int t = 0; t < triangles; t++) {
+            auto inserted = rootCharts.insert(std::make_pair(find(t), (unsigned int) charts.size()));
+            if (inserted.second) {
+                Chart chart;
+                chart.axis = direction[t] / 2;
+                charts.push_back(chart);
+            }
+            Chart &chart = charts[inserted.first->second];
+            triangleCharts[t] = inserted.first->second;
+            for (int k = 0; k < 3; k++) {
+                glm::vec2 uv = project(surface.positions[surface.indices[3 * t + k]], chart.axis);
+                chart.min = glm::min(chart.min, uv);
+                chart.max = glm::max(chart.max, uv);
+            }
+        }
+    }
+
+    // shelf packing at the given scale, placing every chart; false when the shelves overflow
+    static bool pack(std::vector<Chart> &charts, const std::vector<unsigned int> &order, int resolution, float scale) {
+        int x = 0, y = 0, shelf = 0;
+        for (unsigned int index : order) {
+            glm::ivec2 size = slot(charts[index], scale);
+            if (size.x > resolution)
+                return false;
+            if (x + size.x > resolution) {
+                y += shelf;
+                x = shelf = 0;
+            }
+            if (y + size.y > resolution)
+                return false;
+            charts[index].origin = glm::ivec2(x, y);
+            x += size.x;
+            shelf = std::max(shelf, size.y);
+        }
+        return true;
+    }
+
+    static void emit(const Surface &surface, const std::vector<Chart> &charts,
+                     const std::vector<unsigned int> &triangleCharts, int resolution, float scale, Layout &layout) {
+        const unsigned int vertexCount = surface.positions.size();
+        layout.source.resize(vertexCount);
+        std::iota(layout.source.begin(), layout.source.end(), 0u);
+        layout.coords.assign(vertexCount, glm::vec2(0.0f));
+        layout.indices.resize(surface.indices.size());
+        // the chart each original vertex was first laid out in, later charts get a copy
+        std::vector<int> vertexChart(vertexCount, -1);
+        std::map<std::pair<unsigned int, unsigned int>, unsigned int> copies;
+        for (unsigned int i = 0; i < surface.indices.size(); i++) {
+            unsigned int vertex = surface.indices[i];
+            unsigned int chartIndex = triangleCharts[i / 3];
+            const Chart &chart = charts[chartIndex];
+            unsigned int target = vertex;
+            if (vertexChart[vertex] < 0)
+                vertexChart[vertex] = (int) chartIndex;
+            else if (vertexChart[vertex] != (int) chartIndex) {
+                auto inserted = copies.insert(std::make_pair(std::make_pair(vertex, chartIndex),
+                                                             (unsigned int) layout.source.size()));
+                if (inserted.second) {
+                    layout.source.push_back(vertex);
+                    layout.coords.push_back(glm::vec2(0.0f));
+                }
+                target = inserted.first->second;
+            }
+            // texel centres sit at +0.5, the chart starts half a texel into its first one
+            glm::vec2 texel = glm::vec2(chart.origin + GUTTER) + 0.5f +
+                              (project(surface.positions[vertex], chart.axis) - chart.min) * scale;
+            layout.coords[target] = texel / (float) resolution;
+            layout.indices[i] = target;
+        }
+    }
+};
+
+#endif //PROJECT_BASE_LIGHTMAPCHARTS_H
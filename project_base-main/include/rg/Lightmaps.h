@@ -0,0 +1,363 @@
+//
+// Baked lighting of the static scene: the models of static instances, the ground and the road of every
+// tile. Each gets a rectangle of one atlas, a model's meshes are unwrapped into it once (LightmapCharts.h),
+// and the atlas holds the irradiance of the day and of the night light set, baked offline by
+// LightmapBaker.h into <scene>.lightmap. A file baked for another layout is refused as stale.
+//
+
+#ifndef PROJECT_BASE_LIGHTMAPS_H
+#define PROJECT_BASE_LIGHTMAPS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+
+#include <rg/LightmapCharts.h>
+#include <rg/Scene.h>
+#include <rg/SunShadows.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// a rectangle of the atlas in texels, empty for what isn't lightmapped
+struct LightmapRect {
+    int x = 0, y = 0, width = 0, height = 0;
+
+    bool Empty() const {
+        return width == 0;
+    }
+
+    // atlas texel of a lightmap coordinate in [0, 1] of the rectangle
+    glm::vec2 Texel(const glm::vec2 &coords) const {
+        return glm::vec2(x, y) + coords * glm::vec2(width, height);
+    }
+};
+
+const char LIGHTMAP_MAGIC[4] = {'R', 'G', 'L', 'M'};
+const uint32_t LIGHTMAP_VERSION = 1;
+
+class Lightmaps {
+public:
+    // right after the sun's shadows
+    static const int TEXTURE_UNIT = SunShadows::TEXTURE_UNIT + 1;
+    // a model's square: texels per unit of the square root of its surface, clamped
+    static const int TEXELS_PER_UNIT = 8;
+    static const int MIN_RESOLUTION = 32;
+    static const int MAX_RESOLUTION = 512;
+    // a tile's ground (100 x 100 units) and road (10 x 100)
+    static const int GROUND_RESOLUTION = 256;
+    static const int ROAD_WIDTH = 32, ROAD_LENGTH = 256;
+    static const int ATLAS_WIDTH = 2048;
+    static const int MAX_ATLAS_HEIGHT = 4096;
+    // empty texels around every rectangle, filled by the baker's dilation
+    static const int PADDING = 2;
+
+    enum LightSet {
+        LIGHTMAP_DAY,
+        LIGHTMAP_NIGHT,
+        LIGHTMAP_SETS
+    };
+
+    // per instance, empty for dynamic ones and those that didn't fit
+    std::vector<LightmapRect> instanceRects;
+    // per tile
+    std::vector<LightmapRect> groundRects, roadRects;
+
+    Lightmaps() = default;
+    ~Lightmaps() {
+        Clear();
+    }
+
+    Lightmaps(const Lightmaps &) = delete;
+    Lightmaps &operator=(const Lightmaps &) = delete;
+
+    static std::string PathFor(const std::string &scenePath) {
+        return scenePath + ".lightmap";
+    }
+
+    static bool Exists(const std::string &path) {
+        return std::ifstream(path, std::ios::binary).good();
+    }
+
+    // Unwraps the models of static instances that weren't yet and packs the atlas: tiles first, then
+    // the instances tallest first. False, with nothing laid out, if the tiles alone don't fit.
+    bool Layout(const Scene &scene, const std::vector<Model *> &models) {
+        Clear();
+        std::vector<float> instanceScales(models.size(), 0.0f);
+        for (const SceneInstance &instance : scene.instances)
+            if (!(scene.models[instance.model].flags & SCENE_MODEL_DYNAMIC))
+                instanceScales[instance.model] = std::max(instanceScales[instance.model],
+                                                          std::max(instance.scale.x, std::max(instance.scale.y,
+                                                                                              instance.scale.z)));
+        for (unsigned int i = 0; i < models.size(); i++)
+            if (instanceScales[i] > 0.0f && models[i]->lightmapResolution == 0)
+                unwrap(*models[i], instanceScales[i]);
+
+        instanceRects.assign(scene.instances.size(), LightmapRect());
+        groundRects.assign(scene.tiles.size(), LightmapRect());
+        roadRects.assign(scene.tiles.size(), LightmapRect());
+        std::vector<LightmapRect *> tileItems, instanceItems;
+        for (unsigned int i = 0; i < scene.tiles.size(); i++) {
+            groundRects[i].width = groundRects[i].height = GROUND_RESOLUTION;
+            roadRects[i].width = ROAD_WIDTH;
+            roadRects[i].height = ROAD_LENGTH;
+            tileItems.push_back(&groundRects[i]);
+            tileItems.push_back(&roadRects[i]);
+        }
+        for (unsigned int i = 0; i < scene.instances.size(); i++) {
+            const Model &model = *models[scene.instances[i].model];
+            if ((scene.models[scene.instances[i].model].flags & SCENE_MODEL_DYNAMIC) || model.lightmapResolution <= 0)
+                continue;
+            instanceRects[i].width = instanceRects[i].height = model.lightmapResolution;
+            instanceItems.push_back(&instanceRects[i]);
+        }
+        std::stable_sort(instanceItems.begin(), instanceItems.end(), [](const LightmapRect *a, const LightmapRect *b) {
+            return a->height > b->height;
+        });
+
+        Shelves shelves;
+        for (LightmapRect *rect : tileItems)
+            if (!shelves.Place(*rect)) {
+                std::cout << "ERROR::LIGHTMAPS::TILES_DO_NOT_FIT " << scene.tiles.size() << " tiles" << std::endl;
+                Clear();
+                return false;
+            }
+        unsigned int left = 0;
+        for (LightmapRect *rect : instanceItems)
+            if (!shelves.Place(*rect))
+                left++;
+        if (left)
+            std::cout << "ERROR::LIGHTMAPS::ATLAS_FULL " << left << " instances stay dynamically lit" << std::endl;
+        width = ATLAS_WIDTH;
+        height = (shelves.Height() + 3) / 4 * 4;
+        layoutHash = hash(scene, models);
+        return true;
+    }
+
+    // the lighting baked for the current layout, false if the file is missing, broken or stale
+    bool Load(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        char magic[4] = {};
+        uint32_t version = 0, fileWidth = 0, fileHeight = 0;
+        uint64_t fileHash = 0;
+        in.read(magic, 4);
+        in.read((char *) &version, sizeof(version));
+        in.read((char *) &fileWidth, sizeof(fileWidth));
+        in.read((char *) &fileHeight, sizeof(fileHeight));
+        in.read((char *) &fileHash, sizeof(fileHash));
+        if (!in || std::memcmp(magic, LIGHTMAP_MAGIC, 4) != 0 || version != LIGHTMAP_VERSION) {
+            std::cout << "ERROR::LIGHTMAPS::INVALID_FILE " << path << std::endl;
+            return false;
+        }
+        if (fileWidth != (uint32_t) width || fileHeight != (uint32_t) height || fileHash != layoutHash) {
+            std::cout << "ERROR::LIGHTMAPS::STALE " << path << ", bake again with --bake-lightmaps" << std::endl;
+            return false;
+        }
+        for (int set = 0; set < LIGHTMAP_SETS; set++) {
+            texels[set].resize((size_t) width * height);
+            in.read((char *) &texels[set][0], texels[set].size() * sizeof(uint32_t));
+            if (!in) {
+                std::cout << "ERROR::LIGHTMAPS::INVALID_FILE " << path << std::endl;
+                return false;
+            }
+            upload((LightSet) set);
+        }
+        return true;
+    }
+
+    bool Save(const std::string &path) const {
+        std::ofstream out(path, std::ios::binary);
+        uint32_t fileWidth = width, fileHeight = height;
+        out.write(LIGHTMAP_MAGIC, 4);
+        out.write((const char *) &LIGHTMAP_VERSION, sizeof(LIGHTMAP_VERSION));
+        out.write((const char *) &fileWidth, sizeof(fileWidth));
+        out.write((const char *) &fileHeight, sizeof(fileHeight));
+        out.write((const char *) &layoutHash, sizeof(layoutHash));
+        for (int set = 0; set < LIGHTMAP_SETS; set++)
+            out.write((const char *) &texels[set][0], texels[set].size() * sizeof(uint32_t));
+        if (!out) {
+            std::cout << "ERROR::LIGHTMAPS::WRITE_FAILED " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // takes a freshly baked light set, width x height irradiance values
+    void Store(LightSet set, const std::vector<glm::vec3> &irradiance) {
+        texels[set].resize(irradiance.size());
+        for (size_t i = 0; i < irradiance.size(); i++)
+            texels[set][i] = packRGB9E5(irradiance[i]);
+        upload(set);
+    }
+
+    // drops the layout and the textures, for a scene that changed
+    void Clear() {
+        glDeleteTextures(LIGHTMAP_SETS, textures);
+        for (int set = 0; set < LIGHTMAP_SETS; set++) {
+            textures[set] = 0;
+            texels[set].clear();
+        }
+        instanceRects.clear();
+        groundRects.clear();
+        roadRects.clear();
+        width = height = 0;
+    }
+
+    // both light sets are there to draw with
+    bool Loaded() const {
+        return textures[LIGHTMAP_DAY] && textures[LIGHTMAP_NIGHT];
+    }
+
+    int Width() const {
+        return width;
+    }
+
+    int Height() const {
+        return height;
+    }
+
+    // shaders compiled with LIGHTMAP
+    void Bind(Shader &shader, LightSet set) const {
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, textures[set]);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("lightmap", TEXTURE_UNIT);
+    }
+
+    // the draw's rectangle, as the scale and offset of its lightmap coordinates
+    void Use(Shader &shader, const LightmapRect &rect) const {
+        shader.setVec4("lightmapRect", glm::vec4(rect.width, rect.height, rect.x, rect.y) /
+                                       glm::vec4(width, height, width, height));
+    }
+
+private:
+    int width = 0, height = 0;
+    uint64_t layoutHash = 0;
+    std::vector<uint32_t> texels[LIGHTMAP_SETS];
+    unsigned int textures[LIGHTMAP_SETS] = {0, 0};
+
+    // left to right in rows as tall as their first rectangle
+    class Shelves {
+    public:
+        bool Place(LightmapRect &rect) {
+            int w = rect.width + 2 * PADDING, h = rect.height + 2 * PADDING;
+            if (x + w > ATLAS_WIDTH) {
+                y += shelf;
+                x = shelf = 0;
+            }
+            if (w > ATLAS_WIDTH || y + h > MAX_ATLAS_HEIGHT) {
+                rect = LightmapRect();
+                return false;
+            }
+            rect.x = x + PADDING;
+            rect.y = y + PADDING;
+            x += w;
+            shelf = std::max(shelf, h);
+            return true;
+        }
+
+        int Height() const {
+            return y + shelf;
+        }
+
+    private:
+        int x = 0, y = 0, shelf = 0;
+    };
+
+    static void unwrap(Model &model, float scale) {
+        std::vector<LightmapCharts::Surface> surfaces(model.meshes.size());
+        float area = 0.0f;
+        for (unsigned int i = 0; i < model.meshes.size(); i++) {
+            const Mesh &mesh = model.meshes[i];
+            for (const Vertex &vertex : mesh.vertices)
+                surfaces[i].positions.push_back(vertex.Position);
+            surfaces[i].indices = mesh.indices;
+            for (unsigned int t = 0; t + 2 < mesh.indices.size(); t += 3) {
+                const glm::vec3 &a = mesh.vertices[mesh.indices[t]].Position;
+                const glm::vec3 &b = mesh.vertices[mesh.indices[t + 1]].Position;
+                const glm::vec3 &c = mesh.vertices[mesh.indices[t + 2]].Position;
+                area += 0.5f * glm::length(glm::cross(b - a, c - a));
+            }
+        }
+        int resolution = (int) (std::sqrt(area) * scale * TEXELS_PER_UNIT);
+        resolution = std::min(std::max((resolution + 7) / 8 * 8, (int) MIN_RESOLUTION), (int) MAX_RESOLUTION);
+        std::vector<LightmapCharts::Layout> layouts;
+        if (!LightmapCharts::Unwrap(surfaces, resolution, layouts)) {
+            std::cout << "ERROR::LIGHTMAPS::UNWRAP_FAILED " << model.directory << std::endl;
+            model.lightmapResolution = -1;
+            return;
+        }
+        for (unsigned int i = 0; i < model.meshes.size(); i++)
+            model.meshes[i].SetLightmapLayout(layouts[i].source, layouts[i].coords, layouts[i].indices);
+        model.lightmapResolution = resolution;
+    }
+
+    // FNV-1a over the rectangles and the models' lightmap coordinates, what a baked file depends on
+    uint64_t hash(const Scene &scene, const std::vector<Model *> &models) const {
+        uint64_t value = 14695981039346656037ull;
+        auto add = [&value](const void *data, size_t size) {
+            const unsigned char *bytes = (const unsigned char *) data;
+            for (size_t i = 0; i < size; i++)
+                value = (value ^ bytes[i]) * 1099511628211ull;
+        };
+        for (const std::vector<LightmapRect> *rects : {&instanceRects, &groundRects, &roadRects})
+            for (const LightmapRect &rect : *rects) {
+                int fields[4] = {rect.x, rect.y, rect.width, rect.height};
+                add(fields, sizeof(fields));
+            }
+        std::vector<bool> hashed(models.size(), false);
+        for (unsigned int i = 0; i < scene.instances.size(); i++) {
+            uint32_t model = scene.instances[i].model;
+            if (instanceRects[i].Empty() || hashed[model])
+                continue;
+            hashed[model] = true;
+            for (const Mesh &mesh : models[model]->meshes)
+                for (const Vertex &vertex : mesh.vertices)
+                    add(&vertex.LightmapCoords, sizeof(vertex.LightmapCoords));
+        }
+        return value;
+    }
+
+    // GL_RGB9_E5: three 9-bit mantissas sharing a 5-bit exponent
+    static uint32_t packRGB9E5(const glm::vec3 &color) {
+        const float maxValue = 511.0f / 512.0f * 65536.0f;
+        glm::vec3 c = glm::clamp(color, glm::vec3(0.0f), glm::vec3(maxValue));
+        float largest = std::max(c.r, std::max(c.g, c.b));
+        if (largest < 1e-9f)
+            return 0;
+        int exponent = std::max(-16, (int) std::floor(std::log2(largest))) + 1 + 15;
+        float step = std::ldexp(1.0f, exponent - 15 - 9);
+        if ((int) std::floor(largest / step + 0.5f) == 512) {
+            exponent++;
+            step *= 2.0f;
+        }
+        uint32_t r = (uint32_t) std::floor(c.r / step + 0.5f);
+        uint32_t g = (uint32_t) std::floor(c.g / step + 0.5f);
+        uint32_t b = (uint32_t) std::floor(c.b / step + 0.5f);
+        return r | (g << 9) | (b << 18) | ((uint32_t) exponent << 27);
+    }
+
+    void upload(LightSet set) {
+        if (!textures[set])
+            glGenTextures(1, &textures[set]);
+        glBindTexture(GL_TEXTURE_2D, textures[set]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB9_E5, width, height, 0, GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV,
+                     &texels[set][0]);
+        // no mipmaps: they would average across the gutters into the neighbouring charts
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+};
+
+#endif //PROJECT_BASE_LIGHTMAPS_H
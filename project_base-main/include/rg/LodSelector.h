@@ -0,0 +1,89 @@
+//
+// Per-instance level of detail selection by projected screen-space error, with hysteresis and a
+// timed dithered cross-fade between the outgoing and incoming level.
+//
+
+#ifndef PROJECT_BASE_LODSELECTOR_H
+#define PROJECT_BASE_LODSELECTOR_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+struct InstanceLod {
+    uint8_t level = 0;
+    uint8_t previous = 0;
+    // 1 once the transition from previous to level has finished
+    float fade = 1.0f;
+
+    bool Fading() const {
+        return fade < 1.0f;
+    }
+};
+
+class LodSelector {
+public:
+    // largest geometric error allowed on screen, in pixels
+    float pixelError = 1.0f;
+    // a coarser level is only taken once its error is this fraction below the limit
+    float hysteresis = 0.3f;
+    float fadeSeconds = 0.25f;
+    bool crossFade = true;
+    std::vector<InstanceLod> instances;
+
+    void Resize(size_t count) {
+        instances.assign(count, InstanceLod());
+    }
+
+    // pixels covered by one world unit at distance one
+    static float ProjectionScale(float fovyRadians, float viewportHeight) {
+        return viewportHeight / (2.0f * std::tan(fovyRadians * 0.5f));
+    }
+
+    // largest axis scale of a transform, turning model-space errors into world units
+    static float MaxScale(const glm::mat4 &transform) {
+        return std::max(glm::length(glm::vec3(transform[0])),
+                        std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+    }
+
+    // lodErrors holds the model-space error of every level, finest first; distance is measured to
+    // the nearest point of the instance so close-up parts never get a coarse level
+    const InstanceLod &Update(size_t instance, const std::vector<float> &lodErrors, float worldScale, float distance,
+                              float projectionScale, float deltaTime) {
+        InstanceLod &state = instances[instance];
+        if (state.Fading())
+            state.fade = fadeSeconds > 0.0f ? std::min(1.0f, state.fade + deltaTime / fadeSeconds) : 1.0f;
+        if (lodErrors.empty())
+            return state;
+
+        float pixelsPerUnit = projectionScale * worldScale / std::max(distance, 1e-3f);
+        unsigned int current = std::min<unsigned int>(state.level, lodErrors.size() - 1);
+        unsigned int level = current;
+        if (lodErrors[current] * pixelsPerUnit > pixelError)
+            level = coarsest(lodErrors, pixelsPerUnit, pixelError);
+        else {
+            unsigned int coarser = coarsest(lodErrors, pixelsPerUnit, pixelError * (1.0f - hysteresis));
+            if (coarser > current)
+                level = coarser;
+        }
+        if (level != state.level) {
+            state.previous = state.level;
+            state.level = (uint8_t) level;
+            state.fade = crossFade ? 0.0f : 1.0f;
+        }
+        return state;
+    }
+
+private:
+    static unsigned int coarsest(const std::vector<float> &lodErrors, float pixelsPerUnit, float limit) {
+        for (unsigned int level = lodErrors.size() - 1; level > 0; level--)
+            if (lodErrors[level] * pixelsPerUnit <= limit)
+                return level;
+        return 0;
+    }
+};
+
+#endif //PROJECT_BASE_LODSELECTOR_H
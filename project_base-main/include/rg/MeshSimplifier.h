@@ -0,0 +1,366 @@
+//
+// Quadric error edge-collapse simplification (Garland-Heckbert) of indexed triangle meshes.
+// Only the index buffer changes: every collapse moves a vertex onto a neighbour, so simplified
+// levels keep referencing the original vertices and can share one vertex buffer.
+//
+
+#ifndef PROJECT_BASE_MESHSIMPLIFIER_H
+#define PROJECT_BASE_MESHSIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+class MeshSimplifier {
+public:
+    // Simplifies until at most targetIndexCount indices remain or nothing else can collapse.
+    // Vertices sharing a position but not their normal or texture coordinates form a seam; seams
+    // only collapse along themselves with every side kept, so UV charts and hard edges survive.
+    // Open borders only collapse along the border. error receives the largest RMS distance (in
+    // model units) between a moved vertex and the surface it collapsed away from.
+    static std::vector<unsigned int> Simplify(const std::vector<glm::vec3> &positions,
+                                              const std::vector<glm::vec3> &normals,
+                                              const std::vector<glm::vec2> &texCoords,
+                                              const std::vector<unsigned int> &indices,
+                                              size_t targetIndexCount, float *error = nullptr) {
+        MeshSimplifier simplifier(positions, normals, texCoords, indices);
+        simplifier.run(targetIndexCount);
+        if (error)
+            *error = (float) std::sqrt(simplifier.maxError);
+        return simplifier.result;
+    }
+
+private:
+    struct Quadric {
+        double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0, weight = 0;
+
+        void AddPlane(const glm::dvec3 &n, double d, double w) {
+            a2 += w * n.x * n.x; ab += w * n.x * n.y; ac += w * n.x * n.z; ad += w * n.x * d;
+            b2 += w * n.y * n.y; bc += w * n.y * n.z; bd += w * n.y * d;
+            c2 += w * n.z * n.z; cd += w * n.z * d;
+            d2 += w * d * d;
+            weight += w;
+        }
+
+        void Add(const Quadric &q) {
+            a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2; bc += q.bc; bd += q.bd;
+            c2 += q.c2; cd += q.cd; d2 += q.d2; weight += q.weight;
+        }
+
+        // weighted mean squared distance of p to the accumulated planes
+        double Evaluate(const glm::dvec3 &p) const {
+            double value = a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+                           + b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+                           + c2 * p.z * p.z + 2 * cd * p.z + d2;
+            return weight > 0 ? std::max(value, 0.0) / weight : 0.0;
+        }
+    };
+
+    enum Kind : uint8_t {
+        MANIFOLD,
+        SEAM,
+        BORDER,
+        LOCKED
+    };
+
+    struct Collapse {
+        uint32_t from, to;
+        double cost;
+    };
+
+    struct KeyHash {
+        size_t operator()(const std::vector<uint32_t> &key) const {
+            size_t hash = 2166136261u;
+            for (uint32_t k : key)
+                hash = (hash ^ k) * 16777619u;
+            return hash;
+        }
+    };
+
+    const std::vector<glm::vec3> &positions;
+    std::vector<uint32_t> remap;        // vertex -> representative with identical attributes
+    std::vector<uint32_t> positionOf;   // vertex -> welded position id
+    std::vector<glm::dvec3> positionValue;
+    std::vector<std::vector<uint32_t>> wedges;  // position id -> representative vertices at it
+    std::vector<Quadric> quadrics;
+    std::vector<unsigned int> result;
+    double maxError = 0.0;
+
+    MeshSimplifier(const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &normals,
+                   const std::vector<glm::vec2> &texCoords, const std::vector<unsigned int> &indices)
+            : positions(positions) {
+        size_t count = positions.size();
+        remap.resize(count);
+        positionOf.resize(count);
+        std::unordered_map<std::vector<uint32_t>, uint32_t, KeyHash> attributeIds, positionIds;
+        std::vector<uint32_t> key;
+        for (uint32_t v = 0; v < count; v++) {
+            key.assign(3, 0);
+            std::memcpy(key.data(), &positions[v], sizeof(glm::vec3));
+            auto position = positionIds.insert(std::make_pair(key, (uint32_t) positionIds.size()));
+            positionOf[v] = position.first->second;
+            if (position.second) {
+                positionValue.push_back(glm::dvec3(positions[v]));
+                wedges.emplace_back();
+            }
+            key.resize(8);
+            std::memcpy(&key[3], &normals[v], sizeof(glm::vec3));
+            std::memcpy(&key[6], &texCoords[v], sizeof(glm::vec2));
+            auto attribute = attributeIds.insert(std::make_pair(key, v));
+            remap[v] = attribute.first->second;
+            if (attribute.second)
+                wedges[positionOf[v]].push_back(v);
+        }
+
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            uint32_t a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+            if (positionOf[a] == positionOf[b] || positionOf[b] == positionOf[c] || positionOf[a] == positionOf[c])
+                continue;
+            result.push_back(a);
+            result.push_back(b);
+            result.push_back(c);
+        }
+
+        // area-weighted plane quadrics of the original surface
+        quadrics.resize(positionValue.size());
+        for (size_t i = 0; i < result.size(); i += 3) {
+            glm::dvec3 p0 = position(result[i]), p1 = position(result[i + 1]), p2 = position(result[i + 2]);
+            glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+            double length = glm::length(normal);
+            if (length <= 0.0)
+                continue;
+            normal /= length;
+            double d = -glm::dot(normal, p0);
+            for (int k = 0; k < 3; k++)
+                quadrics[positionOf[result[i + k]]].AddPlane(normal, d, length * 0.5);
+        }
+
+        // border constraint planes, perpendicular to the surface through every open edge of the original
+        // mesh; added once, collapses carry them along with the rest of the quadric
+        std::unordered_map<uint64_t, uint32_t> edgeUses;
+        edgeUses.reserve(result.size());
+        for (size_t i = 0; i < result.size(); i += 3)
+            for (int k = 0; k < 3; k++)
+                edgeUses[edgeKey(positionOf[result[i + k]], positionOf[result[i + (k + 1) % 3]])]++;
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t a = positionOf[result[i + k]], b = positionOf[result[i + (k + 1) % 3]];
+                if (edgeUses[edgeKey(a, b)] != 1)
+                    continue;
+                glm::dvec3 p0 = position(result[i]), p1 = position(result[i + 1]), p2 = position(result[i + 2]);
+                glm::dvec3 edge = positionValue[b] - positionValue[a];
+                glm::dvec3 normal = glm::cross(glm::cross(p1 - p0, p2 - p0), edge);
+                double length = glm::length(normal);
+                if (length <= 0.0)
+                    continue;
+                normal /= length;
+                double d = -glm::dot(normal, positionValue[a]);
+                double weight = glm::dot(edge, edge) * 10.0;
+                quadrics[a].AddPlane(normal, d, weight);
+                quadrics[b].AddPlane(normal, d, weight);
+            }
+        }
+    }
+
+    glm::dvec3 position(uint32_t vertex) const {
+        return positionValue[positionOf[vertex]];
+    }
+
+    static uint64_t edgeKey(uint32_t a, uint32_t b) {
+        return a < b ? ((uint64_t) a << 32) | b : ((uint64_t) b << 32) | a;
+    }
+
+    void run(size_t targetIndexCount) {
+        while (result.size() > targetIndexCount) {
+            if (!pass(targetIndexCount))
+                break;
+        }
+    }
+
+    // one round of independent collapses, cheapest first
+    bool pass(size_t targetIndexCount) {
+        size_t positionCount = positionValue.size();
+
+        // edge use counts over welded positions
+        std::unordered_map<uint64_t, uint32_t> edgeUses;
+        edgeUses.reserve(result.size());
+        for (size_t i = 0; i < result.size(); i += 3)
+            for (int k = 0; k < 3; k++)
+                edgeUses[edgeKey(positionOf[result[i + k]], positionOf[result[i + (k + 1) % 3]])]++;
+
+        // classify positions by the wedges still in use and by their edges
+        std::vector<uint8_t> wedgesUsed(positionCount, 0);
+        std::vector<uint8_t> vertexUsed(positions.size(), 0);
+        for (unsigned int v : result) {
+            if (!vertexUsed[v]) {
+                vertexUsed[v] = 1;
+                wedgesUsed[positionOf[v]] = (uint8_t) std::min(wedgesUsed[positionOf[v]] + 1, 255);
+            }
+        }
+        std::vector<uint8_t> kind(positionCount, MANIFOLD);
+        for (uint32_t p = 0; p < positionCount; p++)
+            if (wedgesUsed[p] > 1)
+                kind[p] = SEAM;
+        for (const auto &edge : edgeUses) {
+            uint32_t a = (uint32_t) (edge.first >> 32), b = (uint32_t) edge.first;
+            if (edge.second == 1) {
+                for (uint32_t p : {a, b})
+                    kind[p] = kind[p] == SEAM || kind[p] == LOCKED ? LOCKED : BORDER;
+            } else if (edge.second > 2) {
+                kind[a] = kind[b] = LOCKED;
+            }
+        }
+
+        // triangles around every position
+        std::vector<uint32_t> fanStart(positionCount + 1, 0);
+        for (unsigned int v : result)
+            fanStart[positionOf[v] + 1]++;
+        for (size_t p = 0; p < positionCount; p++)
+            fanStart[p + 1] += fanStart[p];
+        std::vector<uint32_t> fan(result.size());
+        std::vector<uint32_t> fill(fanStart.begin(), fanStart.end() - 1);
+        for (size_t i = 0; i < result.size(); i++)
+            fan[fill[positionOf[result[i]]]++] = i / 3;
+
+        std::vector<Collapse> candidates;
+        for (const auto &edge : edgeUses) {
+            uint32_t a = (uint32_t) (edge.first >> 32), b = (uint32_t) edge.first;
+            bool border = edge.second == 1;
+            double costAB = allowed(kind, a, b, border) ? quadrics[a].Evaluate(positionValue[b]) : -1.0;
+            double costBA = allowed(kind, b, a, border) ? quadrics[b].Evaluate(positionValue[a]) : -1.0;
+            if (costAB >= 0.0 && (costBA < 0.0 || costAB <= costBA))
+                candidates.push_back(Collapse{a, b, costAB});
+            else if (costBA >= 0.0)
+                candidates.push_back(Collapse{b, a, costBA});
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const Collapse &x, const Collapse &y) { return x.cost < y.cost; });
+
+        std::vector<uint8_t> touched(positionCount, 0);
+        std::vector<uint32_t> wedgeTarget(positions.size());
+        for (uint32_t v = 0; v < wedgeTarget.size(); v++)
+            wedgeTarget[v] = v;
+        size_t trianglesLeft = result.size() / 3;
+        size_t targetTriangles = targetIndexCount / 3;
+        size_t collapses = 0;
+        std::vector<std::pair<uint32_t, uint32_t>> mapping;
+        for (const Collapse &collapse : candidates) {
+            if (trianglesLeft <= targetTriangles)
+                break;
+            uint32_t a = collapse.from, b = collapse.to;
+            if (touched[a] || touched[b])
+                continue;
+            if (!wedgeMapping(a, b, fanStart, fan, mapping) || flips(a, b, fanStart, fan))
+                continue;
+
+            for (const auto &pair : mapping)
+                wedgeTarget[pair.first] = pair.second;
+            quadrics[b].Add(quadrics[a]);
+            maxError = std::max(maxError, collapse.cost);
+            // the one-ring of a changes shape, keep it out of this pass
+            for (uint32_t t = fanStart[a]; t < fanStart[a + 1]; t++)
+                for (int k = 0; k < 3; k++)
+                    touched[positionOf[result[fan[t] * 3 + k]]] = 1;
+            trianglesLeft -= kind[a] == BORDER ? 1 : 2;
+            collapses++;
+        }
+        if (collapses == 0)
+            return false;
+
+        std::vector<unsigned int> collapsed;
+        collapsed.reserve(result.size());
+        for (size_t i = 0; i < result.size(); i += 3) {
+            uint32_t v0 = wedgeTarget[result[i]], v1 = wedgeTarget[result[i + 1]], v2 = wedgeTarget[result[i + 2]];
+            if (positionOf[v0] == positionOf[v1] || positionOf[v1] == positionOf[v2] || positionOf[v0] == positionOf[v2])
+                continue;
+            collapsed.push_back(v0);
+            collapsed.push_back(v1);
+            collapsed.push_back(v2);
+        }
+        result.swap(collapsed);
+        return true;
+    }
+
+    static bool allowed(const std::vector<uint8_t> &kind, uint32_t from, uint32_t to, bool borderEdge) {
+        switch (kind[from]) {
+            case MANIFOLD:
+                return true;
+            case SEAM:
+                return !borderEdge;
+            case BORDER:
+                return borderEdge && (kind[to] == BORDER || kind[to] == LOCKED);
+            default:
+                return false;
+        }
+    }
+
+    // Pairs every wedge at position a with the wedge at b it has to become: the one sharing a
+    // triangle with it across the edge. Fails when some wedge of a does not touch the edge, which
+    // means the seam through a does not run along it.
+    bool wedgeMapping(uint32_t a, uint32_t b, const std::vector<uint32_t> &fanStart, const std::vector<uint32_t> &fan,
+                      std::vector<std::pair<uint32_t, uint32_t>> &mapping) const {
+        mapping.clear();
+        for (uint32_t t = fanStart[a]; t < fanStart[a + 1]; t++) {
+            const unsigned int *triangle = &result[fan[t] * 3];
+            uint32_t wedgeA = 0, wedgeB = 0;
+            bool hasB = false;
+            for (int k = 0; k < 3; k++) {
+                if (positionOf[triangle[k]] == a)
+                    wedgeA = triangle[k];
+                else if (positionOf[triangle[k]] == b) {
+                    wedgeB = triangle[k];
+                    hasB = true;
+                }
+            }
+            bool known = false;
+            for (auto &pair : mapping) {
+                if (pair.first != wedgeA)
+                    continue;
+                known = true;
+                if (hasB) {
+                    if (pair.second == UINT32_MAX)
+                        pair.second = wedgeB;
+                    else if (pair.second != wedgeB)
+                        return false;
+                }
+            }
+            if (!known)
+                mapping.push_back(std::make_pair(wedgeA, hasB ? wedgeB : UINT32_MAX));
+        }
+        for (const auto &pair : mapping)
+            if (pair.second == UINT32_MAX)
+                return false;
+        return !mapping.empty();
+    }
+
+    // whether moving a onto b turns any remaining triangle around a over or nearly flat
+    bool flips(uint32_t a, uint32_t b, const std::vector<uint32_t> &fanStart, const std::vector<uint32_t> &fan) const {
+        for (uint32_t t = fanStart[a]; t < fanStart[a + 1]; t++) {
+            const unsigned int *triangle = &result[fan[t] * 3];
+            glm::dvec3 before[3], after[3];
+            bool degenerate = false;
+            for (int k = 0; k < 3; k++) {
+                uint32_t p = positionOf[triangle[k]];
+                degenerate = degenerate || p == b;
+                before[k] = positionValue[p];
+                after[k] = p == a ? positionValue[b] : positionValue[p];
+            }
+            // triangles on the collapsed edge disappear
+            if (degenerate)
+                continue;
+            glm::dvec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::dvec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+            double lengths = glm::length(normalBefore) * glm::length(normalAfter);
+            if (lengths <= 0.0 || glm::dot(normalBefore, normalAfter) < 0.25 * lengths)
+                return true;
+        }
+        return false;
+    }
+};
+
+#endif //PROJECT_BASE_MESHSIMPLIFIER_H
@@ -0,0 +1,273 @@
+//
+// GPU benchmark of the road's normal-mapping pipeline: the tangent-space version (three vec3
+// varyings per light) against the world-space one (one tangent frame), at growing light counts.
+// Vertex cost is timed on a dense grid with the rasterizer discarding everything, fragment cost
+// on a coarse grid covering the screen, both with timer queries.
+//
+
+#ifndef PROJECT_BASE_NORMALMAPPINGBENCHMARK_H
+#define PROJECT_BASE_NORMALMAPPINGBENCHMARK_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/shader.h>
+
+#include <rg/LightClusters.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class NormalMappingBenchmark {
+public:
+    // renders with the road textures bound, prints a table and writes it to csvPath
+    static void Run(unsigned int diffuseMap, unsigned int normalMap, unsigned int depthMap, int width, int height,
+                    const char *csvPath = "normal_mapping_benchmark.csv") {
+        Grid dense = grid(512), coarse = grid(8);
+        glm::mat4 projection = glm::perspective(glm::radians(70.0f), (float) width / (float) height, 0.1f, 100.0f);
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 30.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+
+        unsigned int lampBuffers[2], lampTextures[2];
+        glGenBuffers(2, lampBuffers);
+        glGenTextures(2, lampTextures);
+        GLuint query;
+        glGenQueries(1, &query);
+        GLint maxVaryings = 0;
+        glGetIntegerv(GL_MAX_VARYING_COMPONENTS, &maxVaryings);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, diffuseMap);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, normalMap);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, depthMap);
+        glDisable(GL_DEPTH_TEST);
+
+        std::vector<std::string> worldDefines = {"LAMPS", "OBJECT_LIGHT_LISTS", "PARALLAX"};
+        Shader world("resources/shaders/normal_mapping.vs", "resources/shaders/normal_mapping.fs", worldDefines);
+
+        std::printf("[normal-mapping] %dx%d, vertex pass %u triangles, fragment pass %u triangles, "
+                    "GL_MAX_VARYING_COMPONENTS %d\n", width, height, dense.indexCount / 3, coarse.indexCount / 3,
+                    maxVaryings);
+        std::printf("[normal-mapping] lights | tangent space: varyings, vertex ms, fragment ms | world space: "
+                    "varyings, vertex ms, fragment ms\n");
+        FILE *csv = std::fopen(csvPath, "w");
+        if (csv)
+            std::fprintf(csv, "lights,tangent_varyings,tangent_vertex_ms,tangent_fragment_ms,"
+                              "world_varyings,world_vertex_ms,world_fragment_ms\n");
+
+        for (int lights : {1, 2, 4, 6, 8, 12, 16, 24, 32}) {
+            std::vector<glm::vec3> positions = lampPositions(lights);
+
+            // FragPos and TexCoords, then three tangent-space positions per light
+            int tangentVaryings = 5 + 9 * lights;
+            double tangentVertex = -1.0, tangentFragment = -1.0;
+            if (tangentVaryings <= maxVaryings) {
+                std::vector<std::string> defines = {"NUM_LIGHTS " + std::to_string(lights)};
+                Shader tangent("resources/shaders/benchmark/normal_mapping_tangent.vs",
+                               "resources/shaders/benchmark/normal_mapping_tangent.fs", defines);
+                GLint linked = 0;
+                glGetProgramiv(tangent.ID, GL_LINK_STATUS, &linked);
+                if (linked) {
+                    tangent.use();
+                    setCommon(tangent, projection, view);
+                    for (int i = 0; i < lights; i++) {
+                        std::string index = "[" + std::to_string(i) + "]";
+                        tangent.setVec3("lightPos.direction" + index, positions[i]);
+                        setLamp(tangent, "pointLight" + index, "spotLight" + index, positions[i]);
+                    }
+                    tangentVertex = time(query, dense, true);
+                    tangentFragment = time(query, coarse, false);
+                }
+                glDeleteProgram(tangent.ID);
+            }
+
+            // FragPos, TexCoords, Tangent and Normal whatever the light count
+            int worldVaryings = 11;
+            std::vector<glm::vec4> lampData;
+            std::vector<uint32_t> indices;
+            for (int i = 0; i < lights; i++) {
+                lampData.push_back(glm::vec4(positions[i], 0.0f));
+                indices.push_back(i);
+            }
+            upload(lampBuffers[0], lampTextures[0], lampData, GL_RGBA32F);
+            upload(lampBuffers[1], lampTextures[1], indices, GL_R32UI);
+            glActiveTexture(GL_TEXTURE0 + LightClusters::TEXTURE_UNIT + LightClusters::LAMPS);
+            glBindTexture(GL_TEXTURE_BUFFER, lampTextures[0]);
+            glActiveTexture(GL_TEXTURE0 + LightClusters::TEXTURE_UNIT + LightClusters::INDICES);
+            glBindTexture(GL_TEXTURE_BUFFER, lampTextures[1]);
+            glActiveTexture(GL_TEXTURE0);
+            world.use();
+            setCommon(world, projection, view);
+            world.setInt("clusterLamps", LightClusters::TEXTURE_UNIT + LightClusters::LAMPS);
+            world.setInt("clusterIndices", LightClusters::TEXTURE_UNIT + LightClusters::INDICES);
+            glUniform2ui(glGetUniformLocation(world.ID, "objectLights"), 0, lights);
+            setLamp(world, "pointLight", "spotLight", glm::vec3(0.0f));
+            double worldVertex = time(query, dense, true);
+            double worldFragment = time(query, coarse, false);
+
+            std::printf("[normal-mapping] %6d | %3d, %s, %s | %3d, %.3f, %.3f\n", lights, tangentVaryings,
+                        format(tangentVertex).c_str(), format(tangentFragment).c_str(), worldVaryings, worldVertex,
+                        worldFragment);
+            if (csv)
+                std::fprintf(csv, "%d,%d,%.4f,%.4f,%d,%.4f,%.4f\n", lights, tangentVaryings, tangentVertex,
+                             tangentFragment, worldVaryings, worldVertex, worldFragment);
+        }
+        if (csv) {
+            std::fclose(csv);
+            std::printf("[normal-mapping] wrote %s (-1 where the tangent-space shader exceeds the varying limit)\n",
+                        csvPath);
+        }
+
+        glEnable(GL_DEPTH_TEST);
+        glDeleteProgram(world.ID);
+        glDeleteQueries(1, &query);
+        glDeleteBuffers(2, lampBuffers);
+        glDeleteTextures(2, lampTextures);
+        for (Grid *mesh : {&dense, &coarse}) {
+            glDeleteVertexArrays(1, &mesh->VAO);
+            glDeleteBuffers(1, &mesh->VBO);
+            glDeleteBuffers(1, &mesh->EBO);
+        }
+    }
+
+private:
+    struct Grid {
+        unsigned int VAO = 0, VBO = 0, EBO = 0;
+        unsigned int indexCount = 0;
+    };
+
+    // cells x cells quads over 40 x 40 units of the ground, in the vertex layout of Mesh
+    static Grid grid(int cells) {
+        std::vector<float> vertices;
+        for (int z = 0; z <= cells; z++) {
+            for (int x = 0; x <= cells; x++) {
+                float u = (float) x / cells, v = (float) z / cells;
+                float vertex[] = {-20.0f + 40.0f * u, 0.0f, -20.0f + 40.0f * v, 0.0f, 1.0f, 0.0f,
+                                  u * 7.0f, v * 7.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+                vertices.insert(vertices.end(), vertex, vertex + 14);
+            }
+        }
+        std::vector<unsigned int> indices;
+        for (int z = 0; z < cells; z++) {
+            for (int x = 0; x < cells; x++) {
+                unsigned int corner = z * (cells + 1) + x;
+                unsigned int quad[] = {corner, corner + cells + 1, corner + 1,
+                                       corner + 1, corner + cells + 1, corner + cells + 2};
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+        Grid mesh;
+        mesh.indexCount = indices.size();
+        glGenVertexArrays(1, &mesh.VAO);
+        glGenBuffers(1, &mesh.VBO);
+        glGenBuffers(1, &mesh.EBO);
+        glBindVertexArray(mesh.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        const int sizes[] = {3, 3, 2, 3, 3};
+        int offset = 0;
+        for (int attribute = 0; attribute < 5; attribute++) {
+            glEnableVertexAttribArray(attribute);
+            glVertexAttribPointer(attribute, sizes[attribute], GL_FLOAT, GL_FALSE, 14 * sizeof(float),
+                                  (void *) (offset * sizeof(float)));
+            offset += sizes[attribute];
+        }
+        glBindVertexArray(0);
+        return mesh;
+    }
+
+    // spread over the grid a little above it, so every light reaches most of the screen
+    static std::vector<glm::vec3> lampPositions(int count) {
+        std::vector<glm::vec3> positions;
+        for (int i = 0; i < count; i++) {
+            float angle = 6.2831853f * i / count;
+            positions.push_back(glm::vec3(12.0f * std::cos(angle), 3.0f, 12.0f * std::sin(angle)));
+        }
+        return positions;
+    }
+
+    static void setCommon(Shader &shader, const glm::mat4 &projection, const glm::mat4 &view) {
+        shader.setMat4("projection", projection);
+        shader.setMat4("view", view);
+        shader.setMat4("model", glm::mat4(1.0f));
+        shader.setVec3("viewPos", glm::vec3(0.0f, 30.0f, 0.0f));
+        shader.setFloat("heightScale", 0.1f);
+        shader.setInt("diffuseMap", 0);
+        shader.setInt("normalMap", 1);
+        shader.setInt("depthMap", 2);
+        shader.setVec3("dirLight.direction", glm::vec3(-0.3f, -1.0f, -0.2f));
+        // the tangent-space shader's flat ambient, the world-space one's sky ambient with only its constant term
+        shader.setVec3("dirLight.ambient", glm::vec3(0.1f));
+        shader.setVec3("skyAmbient[0]", glm::vec3(0.1f));
+        shader.setVec3("dirLight.diffuse", glm::vec3(0.4f));
+        shader.setVec3("dirLight.specular", glm::vec3(0.2f));
+    }
+
+    static void setLamp(Shader &shader, const std::string &point, const std::string &spot, const glm::vec3 &position) {
+        for (const std::string &light : {point, spot}) {
+            shader.setVec3(light + ".position", position);
+            shader.setVec3(light + ".ambient", glm::vec3(0.05f));
+            shader.setVec3(light + ".diffuse", glm::vec3(0.8f, 0.8f, 0.6f));
+            shader.setVec3(light + ".specular", glm::vec3(0.5f));
+            shader.setFloat(light + ".constant", 1.0f);
+            shader.setFloat(light + ".linear", 0.09f);
+            shader.setFloat(light + ".quadratic", 0.032f);
+        }
+        shader.setVec3(spot + ".direction", glm::vec3(0.0f, -1.0f, 0.0f));
+        shader.setFloat(spot + ".cutOff", glm::cos(glm::radians(7.0f)));
+        shader.setFloat(spot + ".outerCutOff", glm::cos(glm::radians(26.0f)));
+    }
+
+    // median GPU time of drawing the grid a few times per sample; vertexOnly discards every primitive
+    // before rasterization, so only the vertex shader and its varying writes are left
+    static double time(GLuint query, const Grid &mesh, bool vertexOnly, int samples = 15, int draws = 4) {
+        if (vertexOnly)
+            glEnable(GL_RASTERIZER_DISCARD);
+        glBindVertexArray(mesh.VAO);
+        std::vector<double> times;
+        for (int sample = -3; sample < samples; sample++) {
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            for (int draw = 0; draw < draws; draw++)
+                glDrawElements(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, 0);
+            glEndQuery(GL_TIME_ELAPSED);
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+            // the first few warm up the caches and the driver's shader compile
+            if (sample >= 0)
+                times.push_back(nanoseconds / 1e6 / draws);
+        }
+        glBindVertexArray(0);
+        if (vertexOnly)
+            glDisable(GL_RASTERIZER_DISCARD);
+        std::sort(times.begin(), times.end());
+        return times[times.size() / 2];
+    }
+
+    template <typename T>
+    static void upload(unsigned int buffer, unsigned int texture, const std::vector<T> &data, GLenum format) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, data.size() * sizeof(T), &data[0], GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    static std::string format(double milliseconds) {
+        if (milliseconds < 0.0)
+            return "    -";
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", milliseconds);
+        return text;
+    }
+};
+
+#endif //PROJECT_BASE_NORMALMAPPINGBENCHMARK_H
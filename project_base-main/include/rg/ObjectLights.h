@@ -0,0 +1,181 @@
+//
+// Per-object light lists: every visible instance, vegetation cell and tile gets the lamps whose attenuation
+// sphere touches its world bounds, as a range of one index buffer. The forward shaders read it
+// through the same texture units as the light clusters, with the range set as a uniform per draw.
+//
+
+#ifndef PROJECT_BASE_OBJECTLIGHTS_H
+#define PROJECT_BASE_OBJECTLIGHTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+
+#include <rg/Culling.h>
+#include <rg/LightClusters.h>
+#include <rg/Scene.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// offset and count of one object's lamps in the index buffer
+struct LightList {
+    uint32_t offset = 0;
+    uint32_t count = 0;
+};
+
+class ObjectLights {
+public:
+    std::vector<LightList> instanceLists;
+    std::vector<LightList> tileLists;
+    // one per cell of the VegetationField, whose plants share their cell's list
+    std::vector<LightList> vegetationCellLists;
+
+    ObjectLights() {
+        glGenBuffers(2, buffers);
+        glGenTextures(2, textures);
+        upload(LAMPS, std::vector<glm::vec4>(1, glm::vec4(0.0f)), GL_RGBA32F);
+        upload(INDICES, std::vector<uint32_t>(1, 0), GL_R32UI);
+    }
+
+    ~ObjectLights() {
+        glDeleteBuffers(2, buffers);
+        glDeleteTextures(2, textures);
+    }
+
+    // Lists the lamps reaching each visible object. Only lamps that are lit and visible count, and
+    // lit is false during the day, which leaves every list empty. shadowTiles, one per scene lamp
+    // when given, are their spot shadow tiles (SpotShadows.h) passed on to the shaders. cellBounds
+    // and cellVisible, when given, are the vegetation cells.
+    void Build(const Scene &scene, const SceneCulling &culling, float radius, bool lit,
+               const std::vector<float> *shadowTiles = nullptr, const BoundsArray *cellBounds = nullptr,
+               const std::vector<uint8_t> *cellVisible = nullptr) {
+        lampData.clear();
+        lampSlot.assign(scene.lights.size(), UINT32_MAX);
+        if (lit)
+            for (size_t i = 0; i < scene.lights.size(); i++)
+                if (culling.lightVisible[i]) {
+                    lampSlot[i] = lampData.size();
+                    lampData.push_back(glm::vec4(scene.lights[i], shadowTiles ? (*shadowTiles)[i] : -1.0f));
+                }
+        lampRadius = radius;
+
+        indices.clear();
+        maxPerObject = 0;
+        objectCount = 0;
+        buildLists(culling, culling.instanceBounds, culling.instanceVisible, instanceLists);
+        buildLists(culling, culling.tileBounds, culling.tileVisible, tileLists);
+        if (cellBounds && cellVisible)
+            buildLists(culling, *cellBounds, *cellVisible, vegetationCellLists);
+        else
+            vegetationCellLists.clear();
+
+        if (lampData.empty())
+            lampData.push_back(glm::vec4(0.0f));
+        upload(LAMPS, lampData, GL_RGBA32F);
+        indexCount = indices.size();
+        if (indices.empty())
+            indices.push_back(0);
+        upload(INDICES, indices, GL_R32UI);
+    }
+
+    // binds the lamp and index buffers in place of the clusters'; the shader must be in use and
+    // compiled with SHADER_OBJECT_LIGHT_LISTS
+    void Bind(Shader &shader) const {
+        glActiveTexture(GL_TEXTURE0 + LightClusters::TEXTURE_UNIT + LightClusters::LAMPS);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[LAMPS]);
+        glActiveTexture(GL_TEXTURE0 + LightClusters::TEXTURE_UNIT + LightClusters::INDICES);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[INDICES]);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("clusterLamps", LightClusters::TEXTURE_UNIT + LightClusters::LAMPS);
+        shader.setInt("clusterIndices", LightClusters::TEXTURE_UNIT + LightClusters::INDICES);
+    }
+
+    // location of the shader's list uniform for Use, looked up the first time the program is seen; callers
+    // ask once per pass, not per draw
+    GLint ListLocation(const Shader &shader) {
+        auto found = listLocations.find(shader.ID);
+        if (found == listLocations.end())
+            found = listLocations.emplace(shader.ID, glGetUniformLocation(shader.ID, "objectLights")).first;
+        return found->second;
+    }
+
+    // the lamps of the next draw, into the list uniform at location
+    static void Use(GLint location, const LightList &list) {
+        glUniform2ui(location, list.offset, list.count);
+    }
+
+    // entries of all lists of the last Build
+    unsigned int IndexCount() const {
+        return indexCount;
+    }
+
+    unsigned int ObjectCount() const {
+        return objectCount;
+    }
+
+    unsigned int MaxPerObject() const {
+        return maxPerObject;
+    }
+
+private:
+    enum { LAMPS, INDICES };
+
+    unsigned int buffers[2];
+    unsigned int textures[2];
+
+    std::vector<glm::vec4> lampData;
+    // position of each scene lamp in lampData, UINT32_MAX when it is not lit
+    std::vector<uint32_t> lampSlot;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> candidates;
+    std::map<unsigned int, GLint> listLocations;
+    float lampRadius = 0.0f;
+    uint32_t indexCount = 0, objectCount = 0, maxPerObject = 0;
+
+    void buildLists(const SceneCulling &culling, const BoundsArray &bounds, const std::vector<uint8_t> &visible,
+                    std::vector<LightList> &lists) {
+        lists.assign(bounds.Size(), LightList());
+        if (lampData.empty())
+            return;
+        const float radiusSquared = lampRadius * lampRadius;
+        for (size_t i = 0; i < bounds.Size(); i++) {
+            if (!visible[i])
+                continue;
+            AABB box = bounds.Get(i);
+            // the BVH narrows the lamps down to those near the box's bounding sphere, then each
+            // attenuation sphere is tested against the box itself
+            culling.LightsInSphere(box.Center(), glm::length(box.max - box.min) * 0.5f, candidates);
+            LightList &list = lists[i];
+            list.offset = indices.size();
+            for (uint32_t light : candidates) {
+                uint32_t slot = lampSlot[light];
+                if (slot == UINT32_MAX)
+                    continue;
+                glm::vec3 center = glm::vec3(lampData[slot]);
+                glm::vec3 closest = glm::clamp(center, box.min, box.max);
+                glm::vec3 offset = center - closest;
+                if (glm::dot(offset, offset) <= radiusSquared)
+                    indices.push_back(slot);
+            }
+            list.count = indices.size() - list.offset;
+            maxPerObject = std::max(maxPerObject, list.count);
+            objectCount++;
+        }
+    }
+
+    template <typename T>
+    void upload(int which, const std::vector<T> &data, GLenum format) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[which]);
+        glBufferData(GL_TEXTURE_BUFFER, data.size() * sizeof(T), &data[0], GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[which]);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffers[which]);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
+
+#endif //PROJECT_BASE_OBJECTLIGHTS_H
@@ -0,0 +1,401 @@
+//
+// GPU occlusion culling: occluders are drawn to a small depth buffer, which is reduced to a
+// hierarchical-Z pyramid that instance and light bounds are tested against. Hardware occlusion
+// queries with conditional rendering are the fallback mode.
+//
+
+#ifndef PROJECT_BASE_OCCLUSION_H
+#define PROJECT_BASE_OCCLUSION_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+
+#include <rg/Culling.h>
+#include <rg/FrameStats.h>
+#include <rg/Scene.h>
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+enum OcclusionMode {
+    OCCLUSION_OFF,
+    OCCLUSION_HIZ,
+    OCCLUSION_QUERIES,
+    // CPU rasterizer, see SoftwareOcclusion.h
+    OCCLUSION_SOFTWARE
+};
+
+class OcclusionCulling {
+public:
+    // resolution of the occluder depth buffer, the base of the pyramid
+    static const int WIDTH = 512;
+    static const int HEIGHT = 256;
+    // hi-z results are read back a frame or two later, one slot per frame in flight
+    static const int SLOTS = 3;
+
+    OcclusionCulling()
+            : depthShader("resources/shaders/occlusion_depth.vs", "resources/shaders/occlusion_depth.fs"),
+              downsampleShader("resources/shaders/hiz_downsample.vs", "resources/shaders/hiz_downsample.fs"),
+              testShader("resources/shaders/hiz_test.vs", "resources/shaders/hiz_test.fs") {
+        // the test writes its result through transform feedback, which has to be declared before linking
+        const char *varyings[] = {"visible"};
+        glTransformFeedbackVaryings(testShader.ID, 1, varyings, GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(testShader.ID);
+        GLint linked;
+        glGetProgramiv(testShader.ID, GL_LINK_STATUS, &linked);
+        if (!linked)
+            std::cout << "ERROR::OCCLUSION::TEST_PROGRAM_LINKING_FAILED" << std::endl;
+
+        levels = 1;
+        while ((WIDTH >> levels) > 0 || (HEIGHT >> levels) > 0)
+            levels++;
+
+        glGenTextures(1, &depthTexture);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        for (int level = 0; level < levels; level++)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_DEPTH_COMPONENT32F, levelWidth(level), levelHeight(level), 0,
+                         GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::OCCLUSION::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // the downsample pass generates its triangle from gl_VertexID but core profile still needs a VAO
+        glGenVertexArrays(1, &emptyVAO);
+
+        // unit cube drawn for occlusion queries
+        float cube[] = {
+                -1, -1, -1,  1, -1, -1,  1,  1, -1,  1,  1, -1, -1,  1, -1, -1, -1, -1,
+                -1, -1,  1,  1, -1,  1,  1,  1,  1,  1,  1,  1, -1,  1,  1, -1, -1,  1,
+                -1,  1,  1, -1,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  1, -1,  1,  1,
+                 1,  1,  1,  1,  1, -1,  1, -1, -1,  1, -1, -1,  1, -1,  1,  1,  1,  1,
+                -1, -1, -1,  1, -1, -1,  1, -1,  1,  1, -1,  1, -1, -1,  1, -1, -1, -1,
+                -1,  1, -1,  1,  1, -1,  1,  1,  1,  1,  1,  1, -1,  1,  1, -1,  1, -1
+        };
+        glGenVertexArrays(1, &cubeVAO);
+        glGenBuffers(1, &cubeVBO);
+        glBindVertexArray(cubeVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(cube), cube, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *) 0);
+
+        // candidate boxes: center and extents per point
+        glGenVertexArrays(1, &boxVAO);
+        glGenBuffers(1, &boxVBO);
+        glBindVertexArray(boxVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *) 0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *) (3 * sizeof(float)));
+        glBindVertexArray(0);
+
+        for (Slot &slot : slots)
+            glGenBuffers(1, &slot.results);
+    }
+
+    ~OcclusionCulling() {
+        for (Slot &slot : slots) {
+            glDeleteBuffers(1, &slot.results);
+            if (slot.fence)
+                glDeleteSync(slot.fence);
+            if (!slot.queries.empty())
+                glDeleteQueries(slot.queries.size(), slot.queries.data());
+        }
+        glDeleteVertexArrays(1, &emptyVAO);
+        glDeleteVertexArrays(1, &cubeVAO);
+        glDeleteVertexArrays(1, &boxVAO);
+        glDeleteBuffers(1, &cubeVBO);
+        glDeleteBuffers(1, &boxVBO);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &depthTexture);
+        glDeleteProgram(depthShader.ID);
+        glDeleteProgram(downsampleShader.ID);
+        glDeleteProgram(testShader.ID);
+    }
+
+    // Hi-Z mode, before anything is drawn: applies the newest finished test to the frustum-visible
+    // set, draws the remaining occluders, rebuilds the pyramid and tests this frame's candidates.
+    void CullHiZ(const Scene &scene, const std::vector<Model *> &sceneModels, SceneCulling &culling,
+                 const glm::mat4 &viewProjection, const glm::vec3 &viewPosition) {
+        applyResults(culling);
+        renderOccluders(scene, sceneModels, culling, viewProjection);
+        buildPyramid();
+        test(culling, viewProjection, viewPosition);
+        frame++;
+    }
+
+    // Queries mode, before anything is drawn: draws the occluders and issues one query per
+    // visible instance, which the main pass then draws with conditional rendering
+    void IssueQueries(const Scene &scene, const std::vector<Model *> &sceneModels, const SceneCulling &culling,
+                      const glm::mat4 &viewProjection, const glm::vec3 &viewPosition) {
+        Slot &slot = slots[frame % SLOTS];
+        // results of a query issued SLOTS frames ago are available by now without stalling
+        countQueryResults(slot);
+
+        renderOccluders(scene, sceneModels, culling, viewProjection);
+        beginPass();
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_LEQUAL);
+        depthShader.use();
+        depthShader.setMat4("viewProjection", viewProjection);
+        glBindVertexArray(cubeVAO);
+        instanceQuery.assign(culling.instanceVisible.size(), 0);
+        slot.used = 0;
+        for (size_t i = 0; i < culling.instanceVisible.size(); i++) {
+            if (!culling.instanceVisible[i])
+                continue;
+            AABB box = culling.instanceBounds.Get(i);
+            if (contains(box, viewPosition))
+                continue;
+            if (slot.used == slot.queries.size()) {
+                slot.queries.push_back(0);
+                glGenQueries(1, &slot.queries.back());
+            }
+            GLuint query = slot.queries[slot.used++];
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), box.Center());
+            model = glm::scale(model, box.Extents() * 1.01f + glm::vec3(0.01f));
+            depthShader.setMat4("model", model);
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, query);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+            instanceQuery[i] = query;
+        }
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+        endPass();
+        frame++;
+    }
+
+    // wraps the draw of instance i in queries mode; draws without a query are unconditional
+    void BeginConditional(size_t instance) const {
+        if (instance < instanceQuery.size() && instanceQuery[instance])
+            glBeginConditionalRender(instanceQuery[instance], GL_QUERY_WAIT);
+    }
+
+    void EndConditional(size_t instance) const {
+        if (instance < instanceQuery.size() && instanceQuery[instance])
+            glEndConditionalRender();
+    }
+
+    // forgets queries of the last frame when another mode takes over
+    void ClearQueries() {
+        instanceQuery.clear();
+    }
+
+private:
+    struct Slot {
+        // hi-z: candidate items in the order their results were captured
+        std::vector<uint32_t> items;
+        size_t instanceCount = 0;
+        size_t lightCount = 0;
+        GLuint results = 0;
+        GLsync fence = 0;
+        // queries mode
+        std::vector<GLuint> queries;
+        size_t used = 0;
+    };
+
+    Shader depthShader;
+    Shader downsampleShader;
+    Shader testShader;
+    int levels;
+    unsigned int depthTexture, framebuffer;
+    unsigned int emptyVAO, cubeVAO, cubeVBO, boxVAO, boxVBO;
+    Slot slots[SLOTS];
+    unsigned long long frame = 0;
+    std::vector<float> boxData;
+    std::vector<GLuint> instanceQuery;
+    GLint savedViewport[4];
+
+    static int levelWidth(int level) {
+        return std::max(WIDTH >> level, 1);
+    }
+
+    static int levelHeight(int level) {
+        return std::max(HEIGHT >> level, 1);
+    }
+
+    static bool contains(const AABB &box, const glm::vec3 &point) {
+        return point.x >= box.min.x && point.y >= box.min.y && point.z >= box.min.z
+               && point.x <= box.max.x && point.y <= box.max.y && point.z <= box.max.z;
+    }
+
+    void beginPass() {
+        glGetIntegerv(GL_VIEWPORT, savedViewport);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, WIDTH, HEIGHT);
+    }
+
+    void endPass() {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+    }
+
+    // depth of the visible instances whose model is flagged as an occluder
+    void renderOccluders(const Scene &scene, const std::vector<Model *> &sceneModels, const SceneCulling &culling,
+                         const glm::mat4 &viewProjection) {
+        beginPass();
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        depthShader.use();
+        depthShader.setMat4("viewProjection", viewProjection);
+        for (size_t i = 0; i < scene.instances.size(); i++) {
+            if (!culling.instanceVisible[i] || !(scene.models[scene.instances[i].model].flags & SCENE_MODEL_OCCLUDER))
+                continue;
+            depthShader.setMat4("model", scene.transforms[i]);
+            sceneModels[scene.instances[i].model]->Draw(depthShader);
+        }
+        endPass();
+    }
+
+    // every level keeps the farthest depth of the four texels of the level below
+    void buildPyramid() {
+        beginPass();
+        downsampleShader.use();
+        downsampleShader.setInt("depthLevel", 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glBindVertexArray(emptyVAO);
+        glDepthFunc(GL_ALWAYS);
+        for (int level = 1; level < levels; level++) {
+            // sample only the finer level while writing the coarser one
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, level);
+            glViewport(0, 0, levelWidth(level), levelHeight(level));
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        glDepthFunc(GL_LESS);
+        endPass();
+    }
+
+    // tests every frustum-visible instance and light; results are captured into this frame's slot
+    void test(const SceneCulling &culling, const glm::mat4 &viewProjection, const glm::vec3 &viewPosition) {
+        Slot &slot = slots[frame % SLOTS];
+        if (slot.fence) {
+            glDeleteSync(slot.fence);
+            slot.fence = 0;
+        }
+        slot.items.clear();
+        slot.instanceCount = culling.instanceVisible.size();
+        slot.lightCount = culling.lightVisible.size();
+        boxData.clear();
+        auto addBox = [&](uint32_t item, const AABB &box) {
+            if (contains(box, viewPosition))
+                return;
+            glm::vec3 center = box.Center();
+            glm::vec3 extents = box.Extents();
+            slot.items.push_back(item);
+            boxData.insert(boxData.end(), {center.x, center.y, center.z, extents.x, extents.y, extents.z});
+        };
+        for (size_t i = 0; i < culling.instanceVisible.size(); i++)
+            if (culling.instanceVisible[i])
+                addBox(i, culling.instanceBounds.Get(i));
+        for (size_t i = 0; i < culling.lightVisible.size(); i++)
+            if (culling.lightVisible[i])
+                addBox(slot.instanceCount + i, culling.lightBounds.Get(i));
+        if (slot.items.empty())
+            return;
+
+        glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+        glBufferData(GL_ARRAY_BUFFER, boxData.size() * sizeof(float), boxData.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, slot.results);
+        glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, slot.items.size() * sizeof(GLint), NULL, GL_STREAM_READ);
+
+        testShader.use();
+        testShader.setMat4("viewProjection", viewProjection);
+        testShader.setInt("hiZ", 0);
+        testShader.setInt("hiZLevels", levels);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glBindVertexArray(boxVAO);
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, slot.results);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, slot.items.size());
+        glEndTransformFeedback();
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glDisable(GL_RASTERIZER_DISCARD);
+        glBindVertexArray(0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // Hides whatever the newest finished test found occluded. Results lag the camera by a frame or
+    // two; nothing is hidden while no test has finished yet.
+    void applyResults(SceneCulling &culling) {
+        for (int age = 1; age < SLOTS; age++) {
+            if (frame < (unsigned long long) age)
+                break;
+            Slot &slot = slots[(frame - age) % SLOTS];
+            if (!slot.fence)
+                continue;
+            GLenum status = glClientWaitSync(slot.fence, age == 1 ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                continue;
+            // a reloaded scene makes older results meaningless
+            if (slot.instanceCount != culling.instanceVisible.size() || slot.lightCount != culling.lightVisible.size())
+                return;
+
+            glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, slot.results);
+            const GLint *visible = (const GLint *) glMapBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0,
+                                                                    slot.items.size() * sizeof(GLint), GL_MAP_READ_BIT);
+            if (!visible)
+                return;
+            for (size_t k = 0; k < slot.items.size(); k++) {
+                if (visible[k])
+                    continue;
+                uint32_t item = slot.items[k];
+                if (item < slot.instanceCount) {
+                    if (culling.instanceVisible[item]) {
+                        culling.instanceVisible[item] = 0;
+                        culling.visibleInstances--;
+                        rg::frameStats().instancesOccluded++;
+                    }
+                } else if (culling.lightVisible[item - slot.instanceCount]) {
+                    culling.lightVisible[item - slot.instanceCount] = 0;
+                    culling.visibleLights--;
+                    rg::frameStats().lightsOccluded++;
+                }
+            }
+            glUnmapBuffer(GL_TRANSFORM_FEEDBACK_BUFFER);
+            glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+            return;
+        }
+    }
+
+    // statistics only: conditional rendering already skipped the occluded draws on the GPU
+    void countQueryResults(const Slot &slot) {
+        for (size_t i = 0; i < slot.used; i++) {
+            GLuint available = 0;
+            glGetQueryObjectuiv(slot.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint passed = 1;
+            glGetQueryObjectuiv(slot.queries[i], GL_QUERY_RESULT, &passed);
+            if (!passed)
+                rg::frameStats().instancesOccluded++;
+        }
+    }
+};
+
+#endif //PROJECT_BASE_OCCLUSION_H
@@ -0,0 +1,112 @@
+//
+// Headless micro-benchmark of the software occlusion rasterizer: raster and box test throughput
+// on a synthetic street, single threaded and on every hardware thread.
+//
+
+#ifndef PROJECT_BASE_OCCLUSIONBENCHMARK_H
+#define PROJECT_BASE_OCCLUSIONBENCHMARK_H
+
+#include <rg/Frustum.h>
+#include <rg/SoftwareOcclusion.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+class OcclusionBenchmark {
+public:
+    // houses line both sides of a road running down -z, test boxes are scattered over the whole block
+    static void Run(uint32_t seed, unsigned int houses = 400, unsigned int testBoxes = 20000,
+                    unsigned int iterations = 200) {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        std::vector<AABB> occluders;
+        for (unsigned int i = 0; i < houses; i++) {
+            float side = (i % 2) ? 1.0f : -1.0f;
+            float z = -10.0f - (i / 2) * 12.0f;
+            glm::vec3 size(8.0f + 4.0f * unit(random), 6.0f + 3.0f * unit(random), 8.0f + 2.0f * unit(random));
+            glm::vec3 front(side * (8.0f + 3.0f * unit(random)), 0.0f, z);
+            AABB box;
+            box.Expand(front);
+            box.Expand(front + glm::vec3(side * size.x, size.y, -size.z));
+            occluders.push_back(box);
+        }
+        float streetLength = 10.0f + (houses / 2) * 12.0f;
+        BoundsArray boxes;
+        boxes.Resize(testBoxes);
+        for (unsigned int i = 0; i < testBoxes; i++) {
+            AABB box;
+            box.min = glm::vec3(-60.0f + 120.0f * unit(random), 0.0f, -streetLength * unit(random));
+            box.max = box.min + glm::vec3(0.5f + 3.5f * unit(random), 0.5f + 3.5f * unit(random), 0.5f + 3.5f * unit(random));
+            boxes.Set(i, box);
+        }
+
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 3000.0f);
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 1.7f, 10.0f), glm::vec3(0.0f, 1.7f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 viewProjection = projection * view;
+
+        // as in the renderer, only boxes in the view frustum reach the occlusion test: TestAABB also
+        // reports the ones off screen as hidden, which would count them as occluded
+        Frustum frustum = Frustum::FromMatrix(viewProjection);
+        std::vector<uint8_t> inFrustum(testBoxes);
+        unsigned int tested = 0;
+        for (unsigned int i = 0; i < testBoxes; i++) {
+            inFrustum[i] = frustum.IntersectsAABB(boxes.Get(i)) ? 1 : 0;
+            tested += inFrustum[i];
+        }
+
+#if defined(RG_RASTER_AVX2)
+        const char *path = "AVX2";
+#elif defined(RG_RASTER_SSE)
+        const char *path = "SSE";
+#else
+        const char *path = "scalar";
+#endif
+        std::printf("[occlusion] %s, %dx%d depth buffer, %u occluder triangles, %u test boxes (%u in the frustum), "
+                    "%u iterations\n", path, SoftwareOcclusion::WIDTH, SoftwareOcclusion::HEIGHT, houses * 12, testBoxes,
+                    tested, iterations);
+
+        std::vector<unsigned int> threadCounts = {1};
+        unsigned int hardware = std::thread::hardware_concurrency();
+        if (hardware > 1)
+            threadCounts.push_back(hardware);
+        for (unsigned int threads : threadCounts) {
+            JobSystem jobs(threads);
+            SoftwareOcclusion occlusion(jobs);
+            for (const AABB &occluder : occluders)
+                occlusion.AddOccluderBox(occluder, glm::mat4(1.0f));
+
+            auto start = std::chrono::steady_clock::now();
+            for (unsigned int i = 0; i < iterations; i++)
+                occlusion.Rasterize(viewProjection);
+            double rasterMs = milliseconds(start) / iterations;
+
+            std::vector<uint8_t> visible;
+            size_t hidden = 0;
+            start = std::chrono::steady_clock::now();
+            for (unsigned int i = 0; i < iterations; i++) {
+                visible = inFrustum;
+                hidden = occlusion.Cull(boxes, visible);
+            }
+            double testMs = milliseconds(start) / iterations;
+
+            std::printf("[occlusion] %2u threads: raster %.3f ms (%.1f Mtri/s), test %.3f ms (%.1f Mbox/s), "
+                        "%.1f%% of the boxes in the frustum occluded\n", threads, rasterMs,
+                        occlusion.TriangleCount() / rasterMs / 1000.0, testMs, tested / testMs / 1000.0,
+                        tested > 0 ? 100.0 * hidden / tested : 0.0);
+        }
+    }
+
+private:
+    static double milliseconds(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+#endif //PROJECT_BASE_OCCLUSIONBENCHMARK_H
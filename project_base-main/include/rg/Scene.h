@@ -0,0 +1,362 @@
+//
+// Scene description: model instances, lamp lights and vegetation placements.
+//
+
+#ifndef PROJECT_BASE_SCENE_H
+#define PROJECT_BASE_SCENE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// SceneModel::flags
+const uint32_t SCENE_MODEL_OCCLUDER = 1;    // large and solid enough to hide what is behind it
+const uint32_t SCENE_MODEL_DYNAMIC = 2;     // may move, its shadows are redrawn instead of cached
+
+struct SceneModel {
+    std::string name;
+    std::string path;
+    uint32_t flags;
+};
+
+// one placed copy of a model; rotation is in degrees and applied as yaw (Y), pitch (X), roll (Z)
+struct SceneInstance {
+    uint32_t model;
+    glm::vec3 position;
+    glm::vec3 rotation;
+    glm::vec3 scale;
+};
+
+struct SceneVegetation {
+    glm::vec3 position;
+    float scale;
+};
+
+// Two on-disk forms are supported:
+//  - text: one entry per line, '#' starts a comment
+//        model <name> <path>
+//        occluder <model name>
+//        dynamic <model name>
+//        instance <model name> <x y z> <rotX rotY rotZ> <scaleX scaleY scaleZ>
+//        light <x y z>
+//        vegetation <x y z> <scale>
+//        tile <x z>                  (offset of a ground and road segment)
+//  - binary: SceneFileHeader, string table, model flags, then the raw instance, light, vegetation and
+//    tile arrays.
+//    It is a straight memory image (native endianness), so loading is a handful of reads.
+struct SceneFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t modelCount;
+    uint32_t instanceCount;
+    uint32_t lightCount;
+    uint32_t vegetationCount;
+    uint32_t tileCount;
+    uint32_t stringBytes;
+};
+
+const char SCENE_BINARY_MAGIC[4] = {'R', 'G', 'S', 'C'};
+const uint32_t SCENE_BINARY_VERSION = 3;
+
+class Scene {
+public:
+    std::vector<SceneModel> models;
+    std::vector<SceneInstance> instances;
+    std::vector<glm::vec3> lights;
+    std::vector<SceneVegetation> vegetation;
+    std::vector<glm::vec2> tiles;
+    // model matrices of instances, rebuilt on every load
+    std::vector<glm::mat4> transforms;
+
+    // loads either form, decided by the file's leading magic bytes
+    bool LoadFromFile(const std::string &path) {
+        std::ifstream probe(path, std::ios::binary);
+        if (!probe) {
+            std::cout << "ERROR::SCENE::FILE_NOT_FOUND " << path << std::endl;
+            return false;
+        }
+        char magic[4] = {0, 0, 0, 0};
+        probe.read(magic, 4);
+        probe.close();
+
+        bool loaded = std::memcmp(magic, SCENE_BINARY_MAGIC, 4) == 0 ? loadBinary(path) : loadText(path);
+        if (loaded)
+            UpdateTransforms();
+        return loaded;
+    }
+
+    // loads the compiled form when it is newer than the text source, otherwise parses the text
+    // and refreshes the compiled form next to it
+    bool LoadCompiled(const std::string &textPath) {
+        std::string binaryPath = textPath + ".bin";
+        if (FileModificationTime(binaryPath) >= FileModificationTime(textPath) && LoadFromFile(binaryPath))
+            return true;
+        if (!LoadFromFile(textPath))
+            return false;
+        SaveBinary(binaryPath);
+        return true;
+    }
+
+    bool SaveBinary(const std::string &path) const {
+        std::string strings;
+        std::vector<uint32_t> flags;
+        for (const SceneModel &model : models) {
+            flags.push_back(model.flags);
+            strings += model.name;
+            strings += '\0';
+            strings += model.path;
+            strings += '\0';
+        }
+
+        SceneFileHeader header;
+        std::memcpy(header.magic, SCENE_BINARY_MAGIC, 4);
+        header.version = SCENE_BINARY_VERSION;
+        header.modelCount = models.size();
+        header.instanceCount = instances.size();
+        header.lightCount = lights.size();
+        header.vegetationCount = vegetation.size();
+        header.tileCount = tiles.size();
+        header.stringBytes = strings.size();
+
+        FILE *file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            std::cout << "ERROR::SCENE::CANNOT_WRITE " << path << std::endl;
+            return false;
+        }
+        std::fwrite(&header, sizeof(header), 1, file);
+        std::fwrite(strings.data(), 1, strings.size(), file);
+        std::fwrite(flags.data(), sizeof(uint32_t), flags.size(), file);
+        std::fwrite(instances.data(), sizeof(SceneInstance), instances.size(), file);
+        std::fwrite(lights.data(), sizeof(glm::vec3), lights.size(), file);
+        std::fwrite(vegetation.data(), sizeof(SceneVegetation), vegetation.size(), file);
+        std::fwrite(tiles.data(), sizeof(glm::vec2), tiles.size(), file);
+        std::fclose(file);
+        return true;
+    }
+
+    bool SaveText(const std::string &path) const {
+        FILE *file = std::fopen(path.c_str(), "w");
+        if (!file) {
+            std::cout << "ERROR::SCENE::CANNOT_WRITE " << path << std::endl;
+            return false;
+        }
+        for (const SceneModel &model : models)
+            std::fprintf(file, "model %s %s\n", model.name.c_str(), model.path.c_str());
+        for (const SceneModel &model : models)
+            if (model.flags & SCENE_MODEL_OCCLUDER)
+                std::fprintf(file, "occluder %s\n", model.name.c_str());
+        for (const SceneModel &model : models)
+            if (model.flags & SCENE_MODEL_DYNAMIC)
+                std::fprintf(file, "dynamic %s\n", model.name.c_str());
+        for (const SceneInstance &i : instances)
+            std::fprintf(file, "instance %s %g %g %g %g %g %g %g %g %g\n", models[i.model].name.c_str(),
+                         i.position.x, i.position.y, i.position.z,
+                         i.rotation.x, i.rotation.y, i.rotation.z,
+                         i.scale.x, i.scale.y, i.scale.z);
+        for (const glm::vec3 &light : lights)
+            std::fprintf(file, "light %g %g %g\n", light.x, light.y, light.z);
+        for (const SceneVegetation &v : vegetation)
+            std::fprintf(file, "vegetation %g %g %g %g\n", v.position.x, v.position.y, v.position.z, v.scale);
+        for (const glm::vec2 &tile : tiles)
+            std::fprintf(file, "tile %g %g\n", tile.x, tile.y);
+        std::fclose(file);
+        return true;
+    }
+
+    void UpdateTransforms() {
+        transforms.resize(instances.size());
+        for (unsigned int i = 0; i < instances.size(); i++)
+            transforms[i] = InstanceTransform(instances[i]);
+    }
+
+    static glm::mat4 InstanceTransform(const SceneInstance &instance) {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, instance.position);
+        if (instance.rotation.y != 0.0f)
+            model = glm::rotate(model, glm::radians(instance.rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+        if (instance.rotation.x != 0.0f)
+            model = glm::rotate(model, glm::radians(instance.rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+        if (instance.rotation.z != 0.0f)
+            model = glm::rotate(model, glm::radians(instance.rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+        model = glm::scale(model, instance.scale);
+        return model;
+    }
+
+    // bytes held by the placement arrays
+    size_t MemoryBytes() const {
+        return instances.capacity() * sizeof(SceneInstance) + transforms.capacity() * sizeof(glm::mat4)
+               + lights.capacity() * sizeof(glm::vec3) + vegetation.capacity() * sizeof(SceneVegetation)
+               + tiles.capacity() * sizeof(glm::vec2);
+    }
+
+    int FindModel(const std::string &name) const {
+        for (unsigned int i = 0; i < models.size(); i++)
+            if (models[i].name == name)
+                return i;
+        return -1;
+    }
+
+    // returns 0 when the file does not exist
+    static long long FileModificationTime(const std::string &path) {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return 0;
+        return (long long) info.st_mtime;
+    }
+
+private:
+    void clear() {
+        models.clear();
+        instances.clear();
+        lights.clear();
+        vegetation.clear();
+        tiles.clear();
+    }
+
+    bool loadText(const std::string &path) {
+        std::ifstream in(path);
+        if (!in) {
+            std::cout << "ERROR::SCENE::FILE_NOT_FOUND " << path << std::endl;
+            return false;
+        }
+        clear();
+
+        std::string line;
+        unsigned int lineNumber = 0;
+        while (std::getline(in, line)) {
+            lineNumber++;
+            const char *text = line.c_str();
+            while (*text == ' ' || *text == '\t')
+                text++;
+            if (*text == '\0' || *text == '#' || *text == '\r')
+                continue;
+
+            char keyword[32];
+            char name[128];
+            int consumed = 0;
+            if (std::sscanf(text, "%31s %n", keyword, &consumed) != 1)
+                continue;
+            const char *args = text + consumed;
+
+            bool ok = false;
+            if (std::strcmp(keyword, "model") == 0) {
+                if (std::sscanf(args, "%127s %n", name, &consumed) == 1) {
+                    // the path is the rest of the line, since asset paths may contain spaces
+                    std::string modelPath(args + consumed);
+                    while (!modelPath.empty() && (modelPath.back() == '\r' || modelPath.back() == ' '))
+                        modelPath.pop_back();
+                    ok = !modelPath.empty();
+                    if (ok)
+                        models.push_back(SceneModel{name, modelPath, 0});
+                }
+            } else if (std::strcmp(keyword, "occluder") == 0) {
+                int model = std::sscanf(args, "%127s", name) == 1 ? FindModel(name) : -1;
+                ok = model >= 0;
+                if (ok)
+                    models[model].flags |= SCENE_MODEL_OCCLUDER;
+            } else if (std::strcmp(keyword, "dynamic") == 0) {
+                int model = std::sscanf(args, "%127s", name) == 1 ? FindModel(name) : -1;
+                ok = model >= 0;
+                if (ok)
+                    models[model].flags |= SCENE_MODEL_DYNAMIC;
+            } else if (std::strcmp(keyword, "instance") == 0) {
+                SceneInstance instance;
+                ok = std::sscanf(args, "%127s %f %f %f %f %f %f %f %f %f", name,
+                                 &instance.position.x, &instance.position.y, &instance.position.z,
+                                 &instance.rotation.x, &instance.rotation.y, &instance.rotation.z,
+                                 &instance.scale.x, &instance.scale.y, &instance.scale.z) == 10;
+                int model = ok ? FindModel(name) : -1;
+                ok = model >= 0;
+                if (ok) {
+                    instance.model = model;
+                    instances.push_back(instance);
+                }
+            } else if (std::strcmp(keyword, "light") == 0) {
+                glm::vec3 light;
+                ok = std::sscanf(args, "%f %f %f", &light.x, &light.y, &light.z) == 3;
+                if (ok)
+                    lights.push_back(light);
+            } else if (std::strcmp(keyword, "vegetation") == 0) {
+                SceneVegetation v;
+                ok = std::sscanf(args, "%f %f %f %f", &v.position.x, &v.position.y, &v.position.z, &v.scale) == 4;
+                if (ok)
+                    vegetation.push_back(v);
+            } else if (std::strcmp(keyword, "tile") == 0) {
+                glm::vec2 tile;
+                ok = std::sscanf(args, "%f %f", &tile.x, &tile.y) == 2;
+                if (ok)
+                    tiles.push_back(tile);
+            }
+
+            if (!ok)
+                std::cout << "ERROR::SCENE::PARSE " << path << ":" << lineNumber << ": " << line << std::endl;
+        }
+        return true;
+    }
+
+    bool loadBinary(const std::string &path) {
+        FILE *file = std::fopen(path.c_str(), "rb");
+        if (!file) {
+            std::cout << "ERROR::SCENE::FILE_NOT_FOUND " << path << std::endl;
+            return false;
+        }
+        SceneFileHeader header;
+        bool ok = std::fread(&header, sizeof(header), 1, file) == 1
+                  && std::memcmp(header.magic, SCENE_BINARY_MAGIC, 4) == 0
+                  && header.version == SCENE_BINARY_VERSION;
+        if (!ok) {
+            std::cout << "ERROR::SCENE::BAD_BINARY_HEADER " << path << std::endl;
+            std::fclose(file);
+            return false;
+        }
+        clear();
+
+        std::string strings(header.stringBytes, '\0');
+        std::vector<uint32_t> flags(header.modelCount);
+        instances.resize(header.instanceCount);
+        lights.resize(header.lightCount);
+        vegetation.resize(header.vegetationCount);
+        tiles.resize(header.tileCount);
+        ok = std::fread(&strings[0], 1, strings.size(), file) == strings.size()
+             && std::fread(flags.data(), sizeof(uint32_t), flags.size(), file) == flags.size()
+             && std::fread(instances.data(), sizeof(SceneInstance), instances.size(), file) == instances.size()
+             && std::fread(lights.data(), sizeof(glm::vec3), lights.size(), file) == lights.size()
+             && std::fread(vegetation.data(), sizeof(SceneVegetation), vegetation.size(), file) == vegetation.size()
+             && std::fread(tiles.data(), sizeof(glm::vec2), tiles.size(), file) == tiles.size();
+        std::fclose(file);
+
+        const char *cursor = strings.c_str();
+        const char *end = cursor + strings.size();
+        for (uint32_t i = 0; ok && i < header.modelCount; i++) {
+            SceneModel model;
+            model.name = cursor;
+            cursor += model.name.size() + 1;
+            ok = cursor < end;
+            if (!ok)
+                break;
+            model.path = cursor;
+            cursor += model.path.size() + 1;
+            model.flags = flags[i];
+            models.push_back(model);
+        }
+        for (const SceneInstance &instance : instances)
+            ok = ok && instance.model < models.size();
+
+        if (!ok) {
+            std::cout << "ERROR::SCENE::TRUNCATED_BINARY " << path << std::endl;
+            clear();
+        }
+        return ok;
+    }
+};
+
+#endif //PROJECT_BASE_SCENE_H
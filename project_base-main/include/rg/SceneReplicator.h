@@ -0,0 +1,101 @@
+//
+// Tiles a village scene into a grid of neighborhoods for scaling experiments.
+//
+
+#ifndef PROJECT_BASE_SCENEREPLICATOR_H
+#define PROJECT_BASE_SCENEREPLICATOR_H
+
+#include <rg/Scene.h>
+
+#include <cstdint>
+#include <random>
+
+struct ReplicatorSettings {
+    int columns = 1;
+    int rows = 1;
+    uint32_t seed = 1;
+    // distance between neighboring copies (x, z); the village's ground plane is 100 x 100
+    glm::vec2 tileSize = glm::vec2(100.0f, 100.0f);
+    // x of the road's center line, copies are mirrored across it
+    float mirrorAxis = -1.25f;
+    // largest random yaw added to every instance, in degrees
+    float yawJitter = 3.0f;
+    // largest random offset of a bush on the ground plane
+    float vegetationJitter = 0.6f;
+    // largest relative change of a bush's size
+    float vegetationScaleJitter = 0.15f;
+};
+
+class SceneReplicator {
+public:
+    // Every copy gets its own generator seeded from the settings' seed and its grid coordinates,
+    // so a given tile looks the same whatever the size of the grid it is part of.
+    static Scene Replicate(const Scene &village, const ReplicatorSettings &settings) {
+        Scene result;
+        result.models = village.models;
+        size_t tiles = (size_t) settings.columns * settings.rows;
+        result.instances.reserve(village.instances.size() * tiles);
+        result.lights.reserve(village.lights.size() * tiles);
+        result.vegetation.reserve(village.vegetation.size() * tiles);
+        result.tiles.reserve(village.tiles.size() * tiles);
+
+        for (int row = 0; row < settings.rows; row++) {
+            for (int column = 0; column < settings.columns; column++) {
+                // the grid is centered on the original village
+                int x = column - (settings.columns - 1) / 2;
+                int z = row - (settings.rows - 1) / 2;
+                glm::vec3 offset(x * settings.tileSize.x, 0.0f, z * settings.tileSize.y);
+                std::mt19937 random(tileSeed(settings.seed, x, z));
+                bool mirrored = unit(random) < 0.5f;
+
+                for (SceneInstance instance : village.instances) {
+                    if (mirrored) {
+                        instance.position.x = mirror(instance.position.x, settings);
+                        instance.rotation.y += 180.0f;
+                    }
+                    instance.rotation.y += signedUnit(random) * settings.yawJitter;
+                    instance.position += offset;
+                    result.instances.push_back(instance);
+                }
+                for (glm::vec3 light : village.lights) {
+                    if (mirrored)
+                        light.x = mirror(light.x, settings);
+                    result.lights.push_back(light + offset);
+                }
+                for (SceneVegetation plant : village.vegetation) {
+                    if (mirrored)
+                        plant.position.x = mirror(plant.position.x, settings);
+                    plant.position.x += signedUnit(random) * settings.vegetationJitter;
+                    plant.position.z += signedUnit(random) * settings.vegetationJitter;
+                    plant.scale *= 1.0f + signedUnit(random) * settings.vegetationScaleJitter;
+                    plant.position += offset;
+                    result.vegetation.push_back(plant);
+                }
+                for (const glm::vec2 &tile : village.tiles)
+                    result.tiles.push_back(tile + glm::vec2(offset.x, offset.z));
+            }
+        }
+        result.UpdateTransforms();
+        return result;
+    }
+
+private:
+    static uint32_t tileSeed(uint32_t seed, int x, int z) {
+        return seed * 2654435761u ^ (uint32_t) x * 73856093u ^ (uint32_t) z * 19349663u;
+    }
+
+    static float mirror(float x, const ReplicatorSettings &settings) {
+        return 2.0f * settings.mirrorAxis - x;
+    }
+
+    // [0, 1); built from the raw engine output because std distributions differ between standard libraries
+    static float unit(std::mt19937 &random) {
+        return (random() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    static float signedUnit(std::mt19937 &random) {
+        return unit(random) * 2.0f - 1.0f;
+    }
+};
+
+#endif //PROJECT_BASE_SCENEREPLICATOR_H
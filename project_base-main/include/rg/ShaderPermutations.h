@@ -0,0 +1,99 @@
+//
+// Shader permutations: one vertex/fragment pair compiled with different sets of #defines, one
+// program per combination of features, compiled the first time it is asked for and kept.
+//
+
+#ifndef PROJECT_BASE_SHADERPERMUTATIONS_H
+#define PROJECT_BASE_SHADERPERMUTATIONS_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/shader.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// features a permutation can be compiled with, one bit and one #define each
+enum ShaderFeature {
+    // the lamp loop, only needed at night
+    SHADER_LAMPS = 1 << 0,
+    // lamps from the draw's own list instead of the light clusters
+    SHADER_OBJECT_LIGHT_LISTS = 1 << 1,
+    SHADER_PARALLAX = 1 << 2,
+    SHADER_ALPHA_TEST = 1 << 3,
+    // with SHADER_PARALLAX: march the view ray through the depth map instead of one offset
+    SHADER_PARALLAX_OCCLUSION = 1 << 4,
+    // with SHADER_PARALLAX_OCCLUSION: step by the cones of a ConeStepMap instead of in layers
+    SHADER_CONE_STEP = 1 << 5,
+    // with SHADER_LAMPS: the lamps' spot lights sample their SpotShadows tile
+    SHADER_SPOT_SHADOWS = 1 << 6,
+    // the sun's light samples the SunShadows cascades
+    SHADER_SUN_SHADOWS = 1 << 7,
+    // static geometry: baked light from the Lightmaps atlas replaces the diffuse terms and the lamp loop
+    SHADER_LIGHTMAP = 1 << 8,
+    // translucent meshes into the WeightedBlendedOIT targets, or with SHADER_ALPHA_TEST dithered instead
+    SHADER_TRANSLUCENT = 1 << 9
+};
+
+class ShaderPermutations {
+public:
+    // supported masks the features the shader knows about, the others never make a new permutation;
+    // setup runs on every new permutation, with the program in use, to set its constant uniforms
+    ShaderPermutations(const std::string &vertexPath, const std::string &fragmentPath, unsigned int supported,
+                       std::function<void(Shader &)> setup = nullptr)
+            : vertexPath(vertexPath), fragmentPath(fragmentPath), supported(supported), setup(setup) {
+    }
+
+    ~ShaderPermutations() {
+        for (auto &entry : permutations)
+            glDeleteProgram(entry.second->ID);
+    }
+
+    // the permutation compiled with the given features, without making it current
+    Shader &Get(unsigned int features) {
+        features &= supported;
+        std::unique_ptr<Shader> &shader = permutations[features];
+        if (!shader) {
+            std::vector<std::string> defines;
+            for (int bit = 0; (1u << bit) <= features; bit++)
+                if (features & (1u << bit))
+                    defines.push_back(defineName(bit));
+            shader.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), defines));
+            if (setup) {
+                shader->use();
+                setup(*shader);
+            }
+        }
+        return *shader;
+    }
+
+    // the permutation with the given features, in use
+    Shader &Use(unsigned int features) {
+        Shader &shader = Get(features);
+        shader.use();
+        return shader;
+    }
+
+    // permutations compiled so far
+    unsigned int Count() const {
+        return permutations.size();
+    }
+
+private:
+    std::string vertexPath, fragmentPath;
+    unsigned int supported;
+    std::function<void(Shader &)> setup;
+    std::map<unsigned int, std::unique_ptr<Shader>> permutations;
+
+    static const char *defineName(int bit) {
+        static const char *names[] = {"LAMPS", "OBJECT_LIGHT_LISTS", "PARALLAX", "ALPHA_TEST", "PARALLAX_OCCLUSION",
+                                      "CONE_STEP", "SPOT_SHADOWS", "SUN_SHADOWS", "LIGHTMAP",
+                                      "TRANSLUCENT"};
+        return names[bit];
+    }
+};
+
+#endif //PROJECT_BASE_SHADERPERMUTATIONS_H
@@ -0,0 +1,141 @@
+//
+// The sky drawn from the atmosphere of Atmosphere.h, after Hillaire: a transmittance table rendered
+// once, a small sky-view table of the scattered light around the viewer rendered again only when the
+// sun moves, and a full-screen pass at the far plane that reads the sky-view table and adds the sun's
+// disc, and at night the moon and the stars.
+//
+
+#ifndef PROJECT_BASE_SKY_H
+#define PROJECT_BASE_SKY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+
+#include <iostream>
+
+class Sky {
+public:
+    // transmittance by cos(zenith) and altitude, scattered light by azimuth and elevation
+    static const int TRANSMITTANCE_WIDTH = 256, TRANSMITTANCE_HEIGHT = 64;
+    static const int SKY_VIEW_WIDTH = 192, SKY_VIEW_HEIGHT = 108;
+
+    // scales the sky's light before the tone curve, the sun has unit illuminance
+    float Exposure = 25.0f;
+
+    Sky()
+            : transmittanceShader("resources/shaders/sky.vs", "resources/shaders/sky_transmittance.fs"),
+              skyViewShader("resources/shaders/sky.vs", "resources/shaders/sky_view.fs"),
+              skyShader("resources/shaders/sky.vs", "resources/shaders/sky.fs") {
+        transmittance = tableTexture(TRANSMITTANCE_WIDTH, TRANSMITTANCE_HEIGHT, GL_CLAMP_TO_EDGE);
+        // the azimuth wraps around
+        skyView = tableTexture(SKY_VIEW_WIDTH, SKY_VIEW_HEIGHT, GL_REPEAT);
+        glGenFramebuffers(1, &framebuffer);
+        // the full-screen triangle is generated from gl_VertexID, the core profile still wants a VAO
+        glGenVertexArrays(1, &emptyVAO);
+
+        transmittanceShader.use();
+        transmittanceShader.setVec2("tableSize", glm::vec2(TRANSMITTANCE_WIDTH, TRANSMITTANCE_HEIGHT));
+        skyViewShader.use();
+        skyViewShader.setInt("transmittanceTable", 0);
+        skyViewShader.setVec2("tableSize", glm::vec2(SKY_VIEW_WIDTH, SKY_VIEW_HEIGHT));
+        skyShader.use();
+        skyShader.setInt("skyViewTable", 0);
+        skyShader.setInt("transmittanceTable", 1);
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        renderTable(transmittance, TRANSMITTANCE_WIDTH, TRANSMITTANCE_HEIGHT, transmittanceShader);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    ~Sky() {
+        glDeleteTextures(1, &transmittance);
+        glDeleteTextures(1, &skyView);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteVertexArrays(1, &emptyVAO);
+        glDeleteProgram(transmittanceShader.ID);
+        glDeleteProgram(skyViewShader.ID);
+        glDeleteProgram(skyShader.ID);
+    }
+
+    // renders the sky-view table for the sun in toSun, leaving the default framebuffer bound
+    void Update(const glm::vec3 &toSun) {
+        sunDirection = glm::normalize(toSun);
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        skyViewShader.use();
+        skyViewShader.setVec3("sunDirection", sunDirection);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, transmittance);
+        renderTable(skyView, SKY_VIEW_WIDTH, SKY_VIEW_HEIGHT, skyViewShader);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    // Draws behind everything already in the depth buffer. night, from 0 to 1, fades in the moon, the
+    // stars and nightColor, the moonlit sky the scattering leaves out.
+    void Draw(const glm::mat4 &projection, const glm::mat4 &view, float night, const glm::vec3 &nightColor) {
+        // the sky is infinitely far away, the camera's position does not matter
+        glm::mat4 rotation = glm::mat4(glm::mat3(view));
+        skyShader.use();
+        skyShader.setMat4("inverseViewProjection", glm::inverse(projection * rotation));
+        skyShader.setVec3("sunDirection", sunDirection);
+        skyShader.setFloat("exposure", Exposure);
+        skyShader.setFloat("night", night);
+        skyShader.setVec3("nightColor", nightColor);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, skyView);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, transmittance);
+        glActiveTexture(GL_TEXTURE0);
+
+        // the triangle sits at the far plane, where the cleared depth is
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+
+private:
+    Shader transmittanceShader;
+    Shader skyViewShader;
+    Shader skyShader;
+    unsigned int transmittance = 0, skyView = 0;
+    unsigned int framebuffer = 0;
+    unsigned int emptyVAO = 0;
+    glm::vec3 sunDirection = glm::vec3(0.0f, 1.0f, 0.0f);
+
+    static unsigned int tableTexture(int width, int height, GLint wrapS) {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    void renderTable(unsigned int table, int width, int height, Shader &shader) {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, table, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::SKY::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glViewport(0, 0, width, height);
+        glDisable(GL_DEPTH_TEST);
+        shader.use();
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
+
+#endif //PROJECT_BASE_SKY_H
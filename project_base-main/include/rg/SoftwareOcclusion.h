@@ -0,0 +1,310 @@
+//
+// CPU occlusion culling: low-poly occluder proxies are rasterized into a small SIMD depth buffer
+// on the worker threads, and bounding boxes are tested against it before anything reaches GL.
+//
+
+#ifndef PROJECT_BASE_SOFTWAREOCCLUSION_H
+#define PROJECT_BASE_SOFTWAREOCCLUSION_H
+
+#include <rg/Bounds.h>
+#include <rg/JobSystem.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RG_RASTER_AVX2 1
+#endif
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define RG_RASTER_SSE 1
+#endif
+
+class SoftwareOcclusion {
+public:
+    // depth buffer size; tiles of TILE x TILE pixels keep their farthest depth for early rejection
+    static const int WIDTH = 256;
+    static const int HEIGHT = 192;
+    static const int TILE = 8;
+    static const int TILES_X = WIDTH / TILE;
+    static const int TILES_Y = HEIGHT / TILE;
+    // triangles with a vertex closer than this (clip w) are skipped rather than clipped
+    static constexpr float NEAR_W = 0.1f;
+
+    explicit SoftwareOcclusion(JobSystem &jobs)
+            : jobs(jobs), depth(WIDTH * HEIGHT, 1.0f), tileMax(TILES_X * TILES_Y, 1.0f) {
+    }
+
+    // forgets the occluders of the previous frame
+    void Clear() {
+        vertices.clear();
+    }
+
+    // box occluder given in the space of transform, 12 triangles
+    void AddOccluderBox(const AABB &box, const glm::mat4 &transform) {
+        glm::vec3 corners[8];
+        for (int i = 0; i < 8; i++)
+            corners[i] = glm::vec3(transform * glm::vec4((i & 1) ? box.max.x : box.min.x,
+                                                         (i & 2) ? box.max.y : box.min.y,
+                                                         (i & 4) ? box.max.z : box.min.z, 1.0f));
+        static const int faces[36] = {
+                0, 1, 3, 0, 3, 2,  4, 6, 7, 4, 7, 5,  0, 4, 5, 0, 5, 1,
+                2, 3, 7, 2, 7, 6,  0, 2, 6, 0, 6, 4,  1, 5, 7, 1, 7, 3
+        };
+        for (int index : faces)
+            vertices.push_back(corners[index]);
+    }
+
+    // world-space triangle list, three vertices per triangle
+    void AddTriangles(const glm::vec3 *positions, size_t vertexCount) {
+        vertices.insert(vertices.end(), positions, positions + vertexCount);
+    }
+
+    size_t TriangleCount() const {
+        return vertices.size() / 3;
+    }
+
+    // Occluder proxy of a model: its bounds shrunk to a core that the walls of a house are expected
+    // to cover, so the proxy hides less than the model rather than more.
+    static AABB ProxyBox(const AABB &modelBounds, float widthScale = 0.8f, float heightScale = 0.7f) {
+        AABB proxy;
+        if (modelBounds.Empty())
+            return proxy;
+        glm::vec3 center = modelBounds.Center();
+        glm::vec3 extents = modelBounds.Extents();
+        proxy.min = glm::vec3(center.x - extents.x * widthScale, modelBounds.min.y, center.z - extents.z * widthScale);
+        proxy.max = glm::vec3(center.x + extents.x * widthScale, modelBounds.min.y + 2.0f * extents.y * heightScale,
+                              center.z + extents.z * widthScale);
+        return proxy;
+    }
+
+    // projects every queued triangle and rasterizes them, one band of tile rows per job
+    void Rasterize(const glm::mat4 &viewProjection) {
+        this->viewProjection = viewProjection;
+        size_t triangleCount = TriangleCount();
+        triangles.resize(triangleCount);
+        jobs.ParallelFor(triangleCount, 256, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                setup(i);
+        });
+        jobs.ParallelFor(TILES_Y, 1, [&](size_t begin, size_t end) {
+            for (size_t band = begin; band < end; band++)
+                rasterizeBand(band);
+        });
+    }
+
+    // false when the box is certainly hidden behind the rasterized occluders
+    bool TestAABB(const AABB &box) const {
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+        for (int i = 0; i < 8; i++) {
+            glm::vec4 clip = viewProjection * glm::vec4((i & 1) ? box.max.x : box.min.x,
+                                                        (i & 2) ? box.max.y : box.min.y,
+                                                        (i & 4) ? box.max.z : box.min.z, 1.0f);
+            // boxes reaching the near plane are never occluded
+            if (clip.w <= NEAR_W)
+                return true;
+            float x = (clip.x / clip.w * 0.5f + 0.5f) * WIDTH;
+            float y = (clip.y / clip.w * 0.5f + 0.5f) * HEIGHT;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            nearest = std::min(nearest, clip.z / clip.w * 0.5f + 0.5f);
+        }
+        int x0 = std::max(0, (int) std::floor(minX));
+        int y0 = std::max(0, (int) std::floor(minY));
+        int x1 = std::min(WIDTH - 1, (int) std::floor(maxX));
+        int y1 = std::min(HEIGHT - 1, (int) std::floor(maxY));
+        if (x0 > x1 || y0 > y1)
+            return false;
+
+        for (int ty = y0 / TILE; ty <= y1 / TILE; ty++) {
+            for (int tx = x0 / TILE; tx <= x1 / TILE; tx++) {
+                // every pixel of the tile is closer than the box
+                if (tileMax[ty * TILES_X + tx] < nearest)
+                    continue;
+                int rowBegin = std::max(y0, ty * TILE), rowEnd = std::min(y1, ty * TILE + TILE - 1);
+                int columnBegin = std::max(x0, tx * TILE), columnEnd = std::min(x1, tx * TILE + TILE - 1);
+                for (int y = rowBegin; y <= rowEnd; y++)
+                    if (anyFarther(&depth[y * WIDTH], columnBegin, columnEnd, nearest))
+                        return true;
+            }
+        }
+        return false;
+    }
+
+    // clears visible[i] for every visible box found occluded; returns how many were hidden
+    size_t Cull(const BoundsArray &boxes, std::vector<uint8_t> &visible) const {
+        std::atomic<size_t> hidden{0};
+        jobs.ParallelFor(boxes.Size(), 64, [&](size_t begin, size_t end) {
+            size_t count = 0;
+            for (size_t i = begin; i < end; i++) {
+                if (visible[i] && !TestAABB(boxes.Get(i))) {
+                    visible[i] = 0;
+                    count++;
+                }
+            }
+            hidden += count;
+        });
+        return hidden;
+    }
+
+    const std::vector<float> &Depth() const {
+        return depth;
+    }
+
+private:
+    // screen-space triangle as edge functions and a depth plane, all linear in pixel coordinates
+    struct Triangle {
+        float edgeA[3], edgeB[3], edgeC[3];
+        float depthX, depthY, depthC;
+        int minX, maxX, minY, maxY;
+        bool valid;
+    };
+
+    JobSystem &jobs;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    std::vector<glm::vec3> vertices;
+    std::vector<Triangle> triangles;
+    std::vector<float> depth;
+    std::vector<float> tileMax;
+
+    void setup(size_t index) {
+        Triangle &triangle = triangles[index];
+        triangle.valid = false;
+        float x[3], y[3], z[3];
+        for (int v = 0; v < 3; v++) {
+            glm::vec4 clip = viewProjection * glm::vec4(vertices[index * 3 + v], 1.0f);
+            // skipping is conservative: a missing occluder can only hide less
+            if (clip.w <= NEAR_W)
+                return;
+            x[v] = (clip.x / clip.w * 0.5f + 0.5f) * WIDTH;
+            y[v] = (clip.y / clip.w * 0.5f + 0.5f) * HEIGHT;
+            z[v] = clip.z / clip.w * 0.5f + 0.5f;
+        }
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+        if (std::fabs(area) < 1e-6f)
+            return;
+        // both windings are occluders, make the edge functions positive inside
+        if (area < 0.0f) {
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            std::swap(z[1], z[2]);
+            area = -area;
+        }
+        triangle.minX = std::max(0, (int) std::floor(std::min(x[0], std::min(x[1], x[2]))));
+        triangle.maxX = std::min(WIDTH - 1, (int) std::ceil(std::max(x[0], std::max(x[1], x[2]))));
+        triangle.minY = std::max(0, (int) std::floor(std::min(y[0], std::min(y[1], y[2]))));
+        triangle.maxY = std::min(HEIGHT - 1, (int) std::ceil(std::max(y[0], std::max(y[1], y[2]))));
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+            return;
+
+        // edge e is opposite vertex e: E(x, y) = A x + B y + C
+        for (int e = 0; e < 3; e++) {
+            int a = (e + 1) % 3, b = (e + 2) % 3;
+            triangle.edgeA[e] = y[a] - y[b];
+            triangle.edgeB[e] = x[b] - x[a];
+            triangle.edgeC[e] = -triangle.edgeA[e] * x[a] - triangle.edgeB[e] * y[a];
+        }
+        // z = z0 + E1 (z1 - z0) / area + E2 (z2 - z0) / area
+        float dz1 = (z[1] - z[0]) / area, dz2 = (z[2] - z[0]) / area;
+        triangle.depthX = triangle.edgeA[1] * dz1 + triangle.edgeA[2] * dz2;
+        triangle.depthY = triangle.edgeB[1] * dz1 + triangle.edgeB[2] * dz2;
+        triangle.depthC = z[0] + triangle.edgeC[1] * dz1 + triangle.edgeC[2] * dz2;
+        triangle.valid = true;
+    }
+
+    void rasterizeBand(size_t band) {
+        int bandMinY = band * TILE, bandMaxY = bandMinY + TILE - 1;
+        std::fill(depth.begin() + bandMinY * WIDTH, depth.begin() + (bandMaxY + 1) * WIDTH, 1.0f);
+        for (const Triangle &triangle : triangles) {
+            if (!triangle.valid || triangle.maxY < bandMinY || triangle.minY > bandMaxY)
+                continue;
+            int rowBegin = std::max(triangle.minY, bandMinY), rowEnd = std::min(triangle.maxY, bandMaxY);
+            for (int y = rowBegin; y <= rowEnd; y++)
+                rasterizeRow(triangle, y);
+        }
+        for (int tx = 0; tx < TILES_X; tx++) {
+            float farthest = 0.0f;
+            for (int y = bandMinY; y <= bandMaxY; y++)
+                for (int x = tx * TILE; x < tx * TILE + TILE; x++)
+                    farthest = std::max(farthest, depth[y * WIDTH + x]);
+            tileMax[band * TILES_X + tx] = farthest;
+        }
+    }
+
+    // keeps the nearest depth of every covered pixel center of one row
+    void rasterizeRow(const Triangle &t, int y) {
+        float py = y + 0.5f;
+        float row[3];
+        for (int e = 0; e < 3; e++)
+            row[e] = t.edgeB[e] * py + t.edgeC[e];
+        float depthRow = t.depthY * py + t.depthC;
+        float *pixels = &depth[y * WIDTH];
+        int x = t.minX;
+#if defined(RG_RASTER_AVX2)
+        x &= ~7;
+        const __m256 lane = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+        const __m256 zero8 = _mm256_setzero_ps();
+        for (; x <= t.maxX; x += 8) {
+            __m256 px = _mm256_add_ps(_mm256_set1_ps((float) x), lane);
+            __m256 inside = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t.edgeA[0]), px), _mm256_set1_ps(row[0])), zero8, _CMP_GT_OQ);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t.edgeA[1]), px), _mm256_set1_ps(row[1])), zero8, _CMP_GT_OQ));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t.edgeA[2]), px), _mm256_set1_ps(row[2])), zero8, _CMP_GT_OQ));
+            if (_mm256_movemask_ps(inside) == 0)
+                continue;
+            __m256 z = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t.depthX), px), _mm256_set1_ps(depthRow));
+            __m256 stored = _mm256_loadu_ps(pixels + x);
+            _mm256_storeu_ps(pixels + x, _mm256_blendv_ps(stored, _mm256_min_ps(stored, z), inside));
+        }
+#elif defined(RG_RASTER_SSE)
+        x &= ~3;
+        const __m128 lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 a0 = _mm_set1_ps(t.edgeA[0]), a1 = _mm_set1_ps(t.edgeA[1]), a2 = _mm_set1_ps(t.edgeA[2]);
+        const __m128 r0 = _mm_set1_ps(row[0]), r1 = _mm_set1_ps(row[1]), r2 = _mm_set1_ps(row[2]);
+        const __m128 dzx = _mm_set1_ps(t.depthX), dzRow = _mm_set1_ps(depthRow);
+        for (; x <= t.maxX; x += 4) {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float) x), lane);
+            __m128 inside = _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(a0, px), r0), zero);
+            inside = _mm_and_ps(inside, _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(a1, px), r1), zero));
+            inside = _mm_and_ps(inside, _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(a2, px), r2), zero));
+            if (_mm_movemask_ps(inside) == 0)
+                continue;
+            __m128 z = _mm_add_ps(_mm_mul_ps(dzx, px), dzRow);
+            __m128 stored = _mm_loadu_ps(pixels + x);
+            __m128 nearer = _mm_min_ps(stored, z);
+            _mm_storeu_ps(pixels + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, stored)));
+        }
+#endif
+        for (; x <= t.maxX; x++) {
+            float px = x + 0.5f;
+            if (t.edgeA[0] * px + row[0] > 0.0f && t.edgeA[1] * px + row[1] > 0.0f && t.edgeA[2] * px + row[2] > 0.0f)
+                pixels[x] = std::min(pixels[x], t.depthX * px + depthRow);
+        }
+    }
+
+    // whether any pixel of row[begin, end] lies at or behind depth
+    static bool anyFarther(const float *row, int begin, int end, float nearest) {
+        int x = begin;
+#if defined(RG_RASTER_SSE)
+        const __m128 limit = _mm_set1_ps(nearest);
+        for (; x + 4 <= end + 1; x += 4)
+            if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), limit)))
+                return true;
+#endif
+        for (; x <= end; x++)
+            if (row[x] >= nearest)
+                return true;
+        return false;
+    }
+};
+
+#endif //PROJECT_BASE_SOFTWAREOCCLUSION_H
@@ -0,0 +1,194 @@
+//
+// Ambient light of the sky as order-2 (nine coefficient) spherical harmonics. The sky is rendered into
+// the faces of a small cube (Atmosphere::Ambient) and projected four texels at a time with SSE; the
+// coefficients are convolved with the cosine lobe and premultiplied by the basis constants, so the
+// shaders (include/sky_ambient.glsl) evaluate the ambient for a normal with a handful of multiply-adds
+// and no texture fetch.
+//
+
+#ifndef PROJECT_BASE_SPHERICALHARMONICS_H
+#define PROJECT_BASE_SPHERICALHARMONICS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define RG_SPHERICAL_HARMONICS_SSE 1
+#endif
+
+class SphericalHarmonics {
+public:
+    static const int COEFFICIENTS = 9;
+
+    // in the order the shader reads them, multiplying 1, y, z, x, xy, yz, 3z^2 - 1, xz and x^2 - y^2
+    glm::vec3 coefficients[COEFFICIENTS];
+
+    SphericalHarmonics() {
+        for (glm::vec3 &coefficient : coefficients)
+            coefficient = glm::vec3(0.0f);
+    }
+
+    // the same light from every direction
+    static SphericalHarmonics Uniform(const glm::vec3 &color) {
+        SphericalHarmonics sky;
+        sky.coefficients[0] = color;
+        return sky;
+    }
+
+    // light reaching a surface facing the unit normal, as a fraction of the sky's: a sky of one color
+    // gives that color. Ringing can undershoot opposite a bright sun, that is clamped.
+    glm::vec3 Evaluate(const glm::vec3 &n) const {
+        const glm::vec3 *c = coefficients;
+        glm::vec3 light = c[0] + c[1] * n.y + c[2] * n.z + c[3] * n.x + c[4] * (n.x * n.y) + c[5] * (n.y * n.z) +
+                          c[6] * (3.0f * n.z * n.z - 1.0f) + c[7] * (n.x * n.z) + c[8] * (n.x * n.x - n.y * n.y);
+        return glm::max(light, glm::vec3(0.0f));
+    }
+
+    SphericalHarmonics Scaled(float factor) const {
+        SphericalHarmonics scaled = *this;
+        for (glm::vec3 &coefficient : scaled.coefficients)
+            coefficient *= factor;
+        return scaled;
+    }
+
+    // the light of both skies together
+    void Add(const SphericalHarmonics &other) {
+        for (int k = 0; k < COEFFICIENTS; k++)
+            coefficients[k] += other.coefficients[k];
+    }
+
+    // of the light averaged over every direction
+    float AverageLuminance() const {
+        return Luminance(coefficients[0]);
+    }
+
+    static float Luminance(const glm::vec3 &color) {
+        return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+    }
+
+    // sums the faces of a cubemap, rows top first as for glTexImage2D
+    class Projection {
+    public:
+        // face in GL order: +X, -X, +Y, -Y, +Z, -Z; channels of any type, times scale (1 / 255 for bytes)
+        template <typename Channel>
+        void AddFace(int face, const Channel *data, int width, int height, int channels, float scale = 1.0f) {
+            if (face < 0 || face >= 6 || !data || width <= 0 || height <= 0 || channels <= 0)
+                return;
+            // the direction through texel (s, t) of the face, s and t in [-1, 1] from its top left
+            static const float axes[6][3][3] = {
+                    {{1, 0, 0},  {0, 0, -1}, {0, -1, 0}},
+                    {{-1, 0, 0}, {0, 0, 1},  {0, -1, 0}},
+                    {{0, 1, 0},  {1, 0, 0},  {0, 0, 1}},
+                    {{0, -1, 0}, {1, 0, 0},  {0, 0, -1}},
+                    {{0, 0, 1},  {1, 0, 0},  {0, -1, 0}},
+                    {{0, 0, -1}, {-1, 0, 0}, {0, -1, 0}}};
+            const glm::vec3 center(axes[face][0][0], axes[face][0][1], axes[face][0][2]);
+            const glm::vec3 right(axes[face][1][0], axes[face][1][1], axes[face][1][2]);
+            const glm::vec3 down(axes[face][2][0], axes[face][2][1], axes[face][2][2]);
+            // grey images feed their one channel to all three
+            const int green = channels >= 3 ? 1 : 0, blue = channels >= 3 ? 2 : 0;
+
+            for (int y = 0; y < height; y++) {
+                const float t = 2.0f * (y + 0.5f) / height - 1.0f;
+                const glm::vec3 rowStart = center + down * t;
+                const Channel *row = data + (size_t) y * width * channels;
+                // a row's texels are summed in floats, rows in doubles
+                float rowSums[COEFFICIENTS][3] = {};
+                float rowWeight = 0.0f;
+                int x = 0;
+#ifdef RG_SPHERICAL_HARMONICS_SSE
+                const __m128 one = _mm_set1_ps(1.0f), three = _mm_set1_ps(3.0f);
+                const __m128 toUnit = _mm_set1_ps(scale);
+                __m128 accumulators[COEFFICIENTS][3], weights = _mm_setzero_ps();
+                for (int k = 0; k < COEFFICIENTS; k++)
+                    accumulators[k][0] = accumulators[k][1] = accumulators[k][2] = _mm_setzero_ps();
+                for (; x + 4 <= width; x += 4) {
+                    __m128 s = _mm_set_ps(2.0f * (x + 3.5f) / width - 1.0f, 2.0f * (x + 2.5f) / width - 1.0f,
+                                          2.0f * (x + 1.5f) / width - 1.0f, 2.0f * (x + 0.5f) / width - 1.0f);
+                    __m128 dx = _mm_add_ps(_mm_set1_ps(rowStart.x), _mm_mul_ps(_mm_set1_ps(right.x), s));
+                    __m128 dy = _mm_add_ps(_mm_set1_ps(rowStart.y), _mm_mul_ps(_mm_set1_ps(right.y), s));
+                    __m128 dz = _mm_add_ps(_mm_set1_ps(rowStart.z), _mm_mul_ps(_mm_set1_ps(right.z), s));
+                    __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                    // exact rather than _mm_rsqrt_ps, the texels near the face centre dominate the sum
+                    __m128 inverse = _mm_div_ps(one, _mm_sqrt_ps(length2));
+                    dx = _mm_mul_ps(dx, inverse);
+                    dy = _mm_mul_ps(dy, inverse);
+                    dz = _mm_mul_ps(dz, inverse);
+                    // solid angle of the texel, up to a constant
+                    __m128 weight = _mm_mul_ps(inverse, _mm_mul_ps(inverse, inverse));
+                    weights = _mm_add_ps(weights, weight);
+
+                    const Channel *p = row + x * channels;
+                    __m128 color[3];
+                    for (int c = 0; c < 3; c++) {
+                        int offset = c == 0 ? 0 : c == 1 ? green : blue;
+                        color[c] = _mm_mul_ps(_mm_mul_ps(_mm_set_ps(p[3 * channels + offset], p[2 * channels + offset],
+                                                                    p[channels + offset], p[offset]), toUnit), weight);
+                    }
+                    __m128 basis[COEFFICIENTS] = {
+                            one, dy, dz, dx, _mm_mul_ps(dx, dy), _mm_mul_ps(dy, dz),
+                            _mm_sub_ps(_mm_mul_ps(three, _mm_mul_ps(dz, dz)), one), _mm_mul_ps(dx, dz),
+                            _mm_sub_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))};
+                    for (int k = 0; k < COEFFICIENTS; k++)
+                        for (int c = 0; c < 3; c++)
+                            accumulators[k][c] = _mm_add_ps(accumulators[k][c], _mm_mul_ps(basis[k], color[c]));
+                }
+                float lanes[4];
+                for (int k = 0; k < COEFFICIENTS; k++)
+                    for (int c = 0; c < 3; c++) {
+                        _mm_storeu_ps(lanes, accumulators[k][c]);
+                        rowSums[k][c] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+                    }
+                _mm_storeu_ps(lanes, weights);
+                rowWeight = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+                for (; x < width; x++) {
+                    glm::vec3 direction = rowStart + right * (2.0f * (x + 0.5f) / width - 1.0f);
+                    float inverse = 1.0f / glm::length(direction);
+                    glm::vec3 d = direction * inverse;
+                    float weight = inverse * inverse * inverse;
+                    rowWeight += weight;
+                    const Channel *p = row + x * channels;
+                    glm::vec3 color = glm::vec3(p[0], p[green], p[blue]) * (weight * scale);
+                    float basis[COEFFICIENTS] = {1.0f, d.y, d.z, d.x, d.x * d.y, d.y * d.z, 3.0f * d.z * d.z - 1.0f,
+                                                 d.x * d.z, d.x * d.x - d.y * d.y};
+                    for (int k = 0; k < COEFFICIENTS; k++)
+                        for (int c = 0; c < 3; c++)
+                            rowSums[k][c] += basis[k] * color[c];
+                }
+                for (int k = 0; k < COEFFICIENTS; k++)
+                    for (int c = 0; c < 3; c++)
+                        sums[k][c] += rowSums[k][c];
+                weightSum += rowWeight;
+            }
+        }
+
+        SphericalHarmonics Result() const {
+            SphericalHarmonics sky;
+            if (weightSum <= 0.0)
+                return sky;
+            // per coefficient: the basis constant squared (projection and evaluation) times the cosine
+            // lobe's band factor over pi, so a constant sky comes back unchanged
+            const double pi = 3.14159265358979323846;
+            const double band0 = 0.282095 * 0.282095, band1 = 0.488603 * 0.488603 * 2.0 / 3.0;
+            const double band2 = 1.092548 * 1.092548 / 4.0;
+            const double scales[COEFFICIENTS] = {band0, band1, band1, band1, band2, band2,
+                                                 0.315392 * 0.315392 / 4.0, band2, 0.546274 * 0.546274 / 4.0};
+            // the weights add up to the whole sphere
+            const double solidAngle = 4.0 * pi / weightSum;
+            for (int k = 0; k < COEFFICIENTS; k++)
+                for (int c = 0; c < 3; c++)
+                    sky.coefficients[k][c] = (float) (sums[k][c] * scales[k] * solidAngle);
+            return sky;
+        }
+
+    private:
+        double sums[COEFFICIENTS][3] = {};
+        double weightSum = 0.0;
+    };
+};
+
+#endif //PROJECT_BASE_SPHERICALHARMONICS_H
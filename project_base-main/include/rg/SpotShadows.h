@@ -0,0 +1,285 @@
+//
+// Shadows of the lamps' spot lights, one tile per lamp in a depth atlas. Every lamp points straight
+// down with the same cone, so they share one projection and the lighting shaders rebuild a lamp's
+// view from its position alone. Static casters are rendered once per lamp into a cached atlas; the
+// atlas the shaders sample is that copy with the dynamic casters drawn on top, within per-frame
+// budgets for both.
+//
+
+#ifndef PROJECT_BASE_SPOTSHADOWS_H
+#define PROJECT_BASE_SPOTSHADOWS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/shader.h>
+
+#include <rg/LightClusters.h>
+#include <rg/ShaderPermutations.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+class SpotShadows {
+public:
+    // right after the light cluster buffers
+    static const int TEXTURE_UNIT = LightClusters::TEXTURE_UNIT + 3;
+    static const int TILE_SIZE = 512;
+    static const int TILES_PER_ROW = 6;
+    static const int TILE_COUNT = TILES_PER_ROW * TILES_PER_ROW;
+    static const int ATLAS_SIZE = TILE_SIZE * TILES_PER_ROW;
+
+    // Draws the casters of one lamp's shadow, static or dynamic ones, and returns how many it drew.
+    // Both shaders have projection and view set; the alpha-tested one is for the bushes and reads
+    // texture unit 0.
+    using DrawCasters = std::function<unsigned int(uint32_t light, Shader &solid, Shader &alphaTested, bool dynamic)>;
+
+    // lamps whose static casters are rendered per frame, and lamps whose dynamic casters are redrawn
+    int StaticBudget = 2;
+    int DynamicBudget = 4;
+
+    // coneDegrees is the spot's outer cut-off, range how far its light reaches
+    SpotShadows(float coneDegrees, float range)
+            : casterShaders("resources/shaders/depth_prepass.vs", "resources/shaders/depth_prepass.fs",
+                            SHADER_ALPHA_TEST, [](Shader &shader) {
+                                shader.setInt("texture1", 0);
+                            }) {
+        // a little wider than the cone, so its edge is not clipped by the tile
+        projection = glm::perspective(glm::radians(2.0f * coneDegrees + 6.0f), 1.0f, 0.1f, range);
+        cachedAtlas = atlasTexture(false);
+        atlas = atlasTexture(true);
+        cachedFramebuffer = depthFramebuffer(cachedAtlas);
+        framebuffer = depthFramebuffer(atlas);
+    }
+
+    ~SpotShadows() {
+        glDeleteFramebuffers(1, &cachedFramebuffer);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &cachedAtlas);
+        glDeleteTextures(1, &atlas);
+    }
+
+    SpotShadows(const SpotShadows &) = delete;
+    SpotShadows &operator=(const SpotShadows &) = delete;
+
+    // the same look-at for every lamp: straight down, so that the shaders' (x, -z, y) swap matches it
+    static glm::mat4 LampView(const glm::vec3 &lamp) {
+        return glm::lookAt(lamp, lamp - glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+    }
+
+    // Gives the wanted lamps a tile, most important first, and renders what the budgets allow.
+    // lights are the positions of all the scene's lamps; a lamp whose static casters are still
+    // waiting for their turn stays unshadowed until then.
+    void Update(const std::vector<glm::vec3> &lights, const std::vector<uint32_t> &wanted, const DrawCasters &draw) {
+        frame++;
+        if (lightTile.size() != lights.size()) {
+            lightTile.assign(lights.size(), -1);
+            Invalidate();
+        }
+        staticRendered = dynamicRendered = 0;
+
+        // lamps keep their tile while they are wanted; the others take a free or the stalest one
+        size_t count = std::min<size_t>(wanted.size(), TILE_COUNT);
+        for (size_t i = 0; i < count; i++)
+            if (lightTile[wanted[i]] >= 0)
+                tiles[lightTile[wanted[i]]].lastUsed = frame;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t light = wanted[i];
+            if (lightTile[light] >= 0)
+                continue;
+            int tile = -1;
+            for (int t = 0; t < TILE_COUNT; t++)
+                if (tiles[t].lastUsed < frame && (tile < 0 || tiles[t].lastUsed < tiles[tile].lastUsed))
+                    tile = t;
+            if (tile < 0)
+                break;
+            if (tiles[tile].light >= 0)
+                lightTile[tiles[tile].light] = -1;
+            tiles[tile] = Tile();
+            tiles[tile].light = light;
+            tiles[tile].lastUsed = frame;
+            lightTile[light] = tile;
+        }
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+
+        for (size_t i = 0; i < count && staticRendered < StaticBudget; i++) {
+            int tile = lightTile[wanted[i]];
+            if (tile < 0 || tiles[tile].cached)
+                continue;
+            renderTile(tile, cachedFramebuffer, lights[wanted[i]], draw, false);
+            restoreTile(tile);
+            tiles[tile].cached = true;
+            staticRendered++;
+        }
+
+        // the dynamic casters of the lamps that waited the longest; a tile only goes back to its cached
+        // depth when something dynamic was drawn into it before
+        std::vector<int> order;
+        for (size_t i = 0; i < count; i++)
+            if (lightTile[wanted[i]] >= 0 && tiles[lightTile[wanted[i]]].cached)
+                order.push_back(lightTile[wanted[i]]);
+        std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+            return tiles[a].dynamicFrame < tiles[b].dynamicFrame;
+        });
+        for (size_t i = 0; i < order.size() && dynamicRendered < DynamicBudget; i++) {
+            Tile &tile = tiles[order[i]];
+            bool wasDirty = tile.dirty;
+            if (wasDirty)
+                restoreTile(order[i]);
+            tile.dirty = renderTile(order[i], framebuffer, lights[tile.light], draw, true) > 0;
+            tile.dynamicFrame = frame;
+            if (wasDirty || tile.dirty)
+                dynamicRendered++;
+        }
+
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glDisable(GL_SCISSOR_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+        lampTiles.assign(lights.size(), -1.0f);
+        for (int t = 0; t < TILE_COUNT; t++)
+            if (tiles[t].light >= 0 && tiles[t].cached)
+                lampTiles[tiles[t].light] = (float) t;
+    }
+
+    // drops every cached tile, for when the static casters changed
+    void Invalidate() {
+        for (Tile &tile : tiles)
+            tile = Tile();
+        std::fill(lightTile.begin(), lightTile.end(), -1);
+        lampTiles.assign(lightTile.size(), -1.0f);
+    }
+
+    // the atlas tile of each scene lamp, -1 without a ready one; goes into the lamp buffers' w
+    const std::vector<float> &LampTiles() const {
+        return lampTiles;
+    }
+
+    // binds the atlas and sets the uniforms of spot_shadows.glsl; the shader must be in use
+    void Bind(Shader &shader) const {
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("spotShadowAtlas", TEXTURE_UNIT);
+        shader.setMat4("spotShadowProjection", projection);
+        shader.setFloat("spotShadowTilesPerRow", (float) TILES_PER_ROW);
+        shader.setFloat("spotShadowTileTexel", 1.0f / TILE_SIZE);
+    }
+
+    // tiles with their static casters in, and the renders of the last Update
+    unsigned int CachedCount() const {
+        unsigned int cached = 0;
+        for (const Tile &tile : tiles)
+            cached += tile.cached;
+        return cached;
+    }
+
+    unsigned int StaticRendered() const {
+        return staticRendered;
+    }
+
+    unsigned int DynamicRendered() const {
+        return dynamicRendered;
+    }
+
+    unsigned int ShaderCount() const {
+        return casterShaders.Count();
+    }
+
+private:
+    struct Tile {
+        int32_t light = -1;
+        unsigned long long lastUsed = 0;
+        unsigned long long dynamicFrame = 0;
+        // static casters rendered into the cached atlas
+        bool cached = false;
+        // dynamic casters drawn over the cached depth in the sampled atlas
+        bool dirty = false;
+    };
+
+    ShaderPermutations casterShaders;
+    glm::mat4 projection;
+    unsigned int cachedAtlas = 0, atlas = 0;
+    unsigned int cachedFramebuffer = 0, framebuffer = 0;
+    Tile tiles[TILE_COUNT];
+    std::vector<int> lightTile;
+    std::vector<float> lampTiles;
+    unsigned long long frame = 0;
+    int staticRendered = 0, dynamicRendered = 0;
+
+    unsigned int renderTile(int tile, unsigned int target, const glm::vec3 &lamp, const DrawCasters &draw,
+                            bool dynamic) {
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        int x = tile % TILES_PER_ROW * TILE_SIZE, y = tile / TILES_PER_ROW * TILE_SIZE;
+        glViewport(x, y, TILE_SIZE, TILE_SIZE);
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(x, y, TILE_SIZE, TILE_SIZE);
+        if (!dynamic)
+            glClear(GL_DEPTH_BUFFER_BIT);
+        glm::mat4 view = LampView(lamp);
+        Shader &alphaTested = casterShaders.Use(SHADER_ALPHA_TEST);
+        alphaTested.setMat4("projection", projection);
+        alphaTested.setMat4("view", view);
+        Shader &solid = casterShaders.Use(0);
+        solid.setMat4("projection", projection);
+        solid.setMat4("view", view);
+        unsigned int drawn = draw((uint32_t) tiles[tile].light, solid, alphaTested, dynamic);
+        glDisable(GL_SCISSOR_TEST);
+        return drawn;
+    }
+
+    // copies a tile's cached depth into the sampled atlas
+    void restoreTile(int tile) {
+        int x = tile % TILES_PER_ROW * TILE_SIZE, y = tile / TILES_PER_ROW * TILE_SIZE;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, cachedFramebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+        glBlitFramebuffer(x, y, x + TILE_SIZE, y + TILE_SIZE, x, y, x + TILE_SIZE, y + TILE_SIZE,
+                          GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // the sampled atlas compares in hardware, which PCF filters bilinearly per tap
+    static unsigned int atlasTexture(bool compare) {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, ATLAS_SIZE, ATLAS_SIZE, 0, GL_DEPTH_COMPONENT,
+                     GL_UNSIGNED_INT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if (compare) {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    static unsigned int depthFramebuffer(unsigned int texture) {
+        unsigned int framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::SPOT_SHADOWS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        // both atlases start out at the far plane
+        glClear(GL_DEPTH_BUFFER_BIT);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return framebuffer;
+    }
+};
+
+#endif //PROJECT_BASE_SPOTSHADOWS_H
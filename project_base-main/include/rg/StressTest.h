@@ -0,0 +1,124 @@
+//
+// Renders the replicated neighborhood at growing grid sizes and reports how frame time,
+// draw calls and memory scale.
+//
+
+#ifndef PROJECT_BASE_STRESSTEST_H
+#define PROJECT_BASE_STRESSTEST_H
+
+#include <rg/FrameStats.h>
+#include <rg/SceneReplicator.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+struct StressTestResult {
+    int columns;
+    int rows;
+    size_t instances;
+    size_t lights;
+    size_t vegetation;
+    double averageFrameMs;
+    double worstFrameMs;
+    double p95FrameMs;
+    unsigned int drawCalls;
+    unsigned long long triangles;
+    size_t sceneBytes;
+    unsigned long long residentBytes;
+};
+
+class StressTest {
+public:
+    // grids of 1x1, 2x2, 4x4, ... up to maxGrid x maxGrid
+    StressTest(const Scene &village, int maxGrid, uint32_t seed, unsigned int warmupFrames = 30,
+               unsigned int measuredFrames = 120)
+            : m_Village(village), m_WarmupFrames(warmupFrames), m_MeasuredFrames(measuredFrames) {
+        m_Settings.seed = seed;
+        for (int size = 1; size <= maxGrid; size *= 2)
+            m_GridSizes.push_back(size);
+    }
+
+    bool Finished() const {
+        return m_Current >= m_GridSizes.size();
+    }
+
+    // replaces the scene with the next grid size; returns false when every size has been measured
+    bool NextScene(Scene &scene) {
+        if (Finished())
+            return false;
+        m_Settings.columns = m_Settings.rows = m_GridSizes[m_Current];
+        scene = SceneReplicator::Replicate(m_Village, m_Settings);
+        m_Frame = 0;
+        m_FrameTimes.clear();
+        return true;
+    }
+
+    // records a finished frame; returns true when the scene has to be replaced by the next grid size
+    bool EndFrame(double frameSeconds, const Scene &scene) {
+        m_Frame++;
+        if (m_Frame <= m_WarmupFrames)
+            return false;
+        m_FrameTimes.push_back(frameSeconds * 1000.0);
+        if (m_FrameTimes.size() < m_MeasuredFrames)
+            return false;
+
+        StressTestResult result;
+        result.columns = m_Settings.columns;
+        result.rows = m_Settings.rows;
+        result.instances = scene.instances.size();
+        result.lights = scene.lights.size();
+        result.vegetation = scene.vegetation.size();
+        double sum = 0.0;
+        for (double ms : m_FrameTimes)
+            sum += ms;
+        std::sort(m_FrameTimes.begin(), m_FrameTimes.end());
+        result.averageFrameMs = sum / m_FrameTimes.size();
+        result.worstFrameMs = m_FrameTimes.back();
+        result.p95FrameMs = m_FrameTimes[(m_FrameTimes.size() * 95) / 100];
+        result.drawCalls = rg::frameStats().drawCalls;
+        result.triangles = rg::frameStats().triangles;
+        result.sceneBytes = scene.MemoryBytes();
+        result.residentBytes = rg::residentMemoryBytes();
+        m_Results.push_back(result);
+        printResult(stdout, result);
+
+        m_Current++;
+        return true;
+    }
+
+    bool WriteReport(const std::string &path) const {
+        FILE *file = std::fopen(path.c_str(), "w");
+        if (!file)
+            return false;
+        std::fprintf(file, "grid,instances,lights,vegetation,avg_ms,p95_ms,max_ms,draw_calls,triangles,scene_kb,resident_mb\n");
+        for (const StressTestResult &r : m_Results)
+            std::fprintf(file, "%dx%d,%zu,%zu,%zu,%.3f,%.3f,%.3f,%u,%llu,%.1f,%.1f\n", r.columns, r.rows,
+                         r.instances, r.lights, r.vegetation, r.averageFrameMs, r.p95FrameMs, r.worstFrameMs,
+                         r.drawCalls, r.triangles, r.sceneBytes / 1024.0, r.residentBytes / (1024.0 * 1024.0));
+        std::fclose(file);
+        return true;
+    }
+
+private:
+    Scene m_Village;
+    ReplicatorSettings m_Settings;
+    std::vector<int> m_GridSizes;
+    unsigned int m_WarmupFrames;
+    unsigned int m_MeasuredFrames;
+    size_t m_Current = 0;
+    unsigned int m_Frame = 0;
+    std::vector<double> m_FrameTimes;
+    std::vector<StressTestResult> m_Results;
+
+    static void printResult(FILE *out, const StressTestResult &r) {
+        std::fprintf(out, "[stress] %3dx%-3d instances %7zu lights %6zu plants %6zu | frame avg %7.3f ms p95 %7.3f ms"
+                          " max %7.3f ms | draw calls %7u triangles %10llu | scene %8.1f KB resident %7.1f MB\n",
+                     r.columns, r.rows, r.instances, r.lights, r.vegetation, r.averageFrameMs, r.p95FrameMs,
+                     r.worstFrameMs, r.drawCalls, r.triangles, r.sceneBytes / 1024.0,
+                     r.residentBytes / (1024.0 * 1024.0));
+        std::fflush(out);
+    }
+};
+
+#endif //PROJECT_BASE_STRESSTEST_H
@@ -0,0 +1,419 @@
+//
+// Cascaded shadow maps of the sun. Every cascade is a square window of light space centered near the
+// camera, one layer of a depth texture array. The layers are addressed toroidally: light-space texel k
+// always lands in texel k mod size, so when a window scrolls only the strips it uncovers are
+// rendered and the rest stays where it is. Static casters are kept in a cached array; the sampled
+// array is that copy with the dynamic casters drawn on top. Farther cascades refresh less often.
+//
+
+#ifndef PROJECT_BASE_SUNSHADOWS_H
+#define PROJECT_BASE_SUNSHADOWS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/shader.h>
+
+#include <rg/Bounds.h>
+#include <rg/Frustum.h>
+#include <rg/ShaderPermutations.h>
+#include <rg/SpotShadows.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <string>
+
+class SunShadows {
+public:
+    // right after the lamps' spot shadows
+    static const int TEXTURE_UNIT = SpotShadows::TEXTURE_UNIT + 1;
+    static const int CASCADES = 4;
+    static const int MAP_SIZE = 1024;
+    // GPU times are read a few updates late so the CPU never waits for them
+    static const int QUERIES = 3;
+
+    // Draws the static or dynamic casters inside region, a light-space box, and returns how many it
+    // drew. Both shaders have projection and view set; the alpha-tested one is for the bushes and reads
+    // texture unit 0.
+    using DrawCasters = std::function<unsigned int(const Frustum &region, Shader &solid, Shader &alphaTested,
+                                                   bool dynamic)>;
+
+    // frames between two refreshes of each cascade; a cascade the camera is about to leave is
+    // refreshed anyway
+    int UpdateInterval[CASCADES] = {1, 2, 4, 8};
+
+    // the last refresh of a cascade: static texels rendered, casters drawn, and its GPU time, a few
+    // refreshes old
+    struct CascadeStats {
+        unsigned int texels = 0;
+        unsigned int casters = 0;
+        float milliseconds = 0.0f;
+        bool updated = false;
+    };
+
+    // The cascades split distance between the camera and maxDistance, closer to logarithmic than
+    // uniform. Each one covers the sphere around the camera holding its part of the widest view
+    // frustum, so turning around never re-renders anything.
+    SunShadows(float maxFovY, float aspect, float maxDistance)
+            : casterShaders("resources/shaders/depth_prepass.vs", "resources/shaders/depth_prepass.fs",
+                            SHADER_ALPHA_TEST, [](Shader &shader) {
+                                shader.setInt("texture1", 0);
+                            }) {
+        const float nearSplit = 1.0f, lambda = 0.8f;
+        float tanY = std::tan(maxFovY * 0.5f), tanX = tanY * aspect;
+        float cornerScale = std::sqrt(1.0f + tanX * tanX + tanY * tanY);
+        // the window is this much wider than the sphere it has to hold
+        const float windowSlack = 1.25f;
+        for (int c = 0; c < CASCADES; c++) {
+            float t = (float) (c + 1) / CASCADES;
+            float split = lambda * nearSplit * std::pow(maxDistance / nearSplit, t) + (1.0f - lambda) * maxDistance * t;
+            cascades[c].size = 2.0f * split * cornerScale * windowSlack;
+            cascades[c].texel = cascades[c].size / MAP_SIZE;
+        }
+        cachedMap = mapTexture(false);
+        map = mapTexture(true);
+        for (int c = 0; c < CASCADES; c++) {
+            cachedFramebuffers[c] = depthFramebuffer(cachedMap, c);
+            framebuffers[c] = depthFramebuffer(map, c);
+        }
+        glGenQueries(CASCADES * QUERIES, &queries[0][0]);
+        SetDirection(glm::vec3(0.0f, -1.0f, 0.0f));
+    }
+
+    ~SunShadows() {
+        glDeleteQueries(CASCADES * QUERIES, &queries[0][0]);
+        glDeleteFramebuffers(CASCADES, cachedFramebuffers);
+        glDeleteFramebuffers(CASCADES, framebuffers);
+        glDeleteTextures(1, &cachedMap);
+        glDeleteTextures(1, &map);
+    }
+
+    SunShadows(const SunShadows &) = delete;
+    SunShadows &operator=(const SunShadows &) = delete;
+
+    // direction the sunlight travels in; a new one drops every cascade
+    void SetDirection(const glm::vec3 &direction) {
+        glm::vec3 d = glm::normalize(direction);
+        if (d == this->direction)
+            return;
+        this->direction = d;
+        glm::vec3 up = std::fabs(d.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        view = glm::lookAt(glm::vec3(0.0f), d, up);
+        updateDepthRange();
+        Invalidate();
+    }
+
+    // everything that can cast or receive, for the depth range; new bounds drop every cascade
+    void SetSceneBounds(const AABB &bounds) {
+        sceneBounds = bounds;
+        updateDepthRange();
+        Invalidate();
+    }
+
+    // drops every cascade, for when the static casters changed
+    void Invalidate() {
+        for (Cascade &cascade : cascades)
+            cascade.valid = false;
+    }
+
+    void Update(const glm::vec3 &eye, const DrawCasters &draw) {
+        frame++;
+        glm::vec3 center = glm::vec3(view * glm::vec4(eye, 1.0f));
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        glEnable(GL_SCISSOR_TEST);
+
+        for (int c = 0; c < CASCADES; c++) {
+            Cascade &cascade = cascades[c];
+            CascadeStats &stats = cascadeStats[c];
+            stats.texels = stats.casters = 0;
+            stats.updated = false;
+            // The window snaps to whole texels and only follows once the camera is 1/32 of it off center,
+            // so a slow walk re-renders a strip now and then instead of a sliver every frame. The
+            // camera's sphere still fits up to 1/10 off center; past 1/16 the cascade follows at once.
+            int x = (int) std::floor(center.x / cascade.texel) - MAP_SIZE / 2;
+            int y = (int) std::floor(center.y / cascade.texel) - MAP_SIZE / 2;
+            int drift = std::max(std::abs(x - cascade.x), std::abs(y - cascade.y));
+            bool due = (frame + c) % std::max(UpdateInterval[c], 1) == 0;
+            if (cascade.valid && !due && drift <= MAP_SIZE / 16)
+                continue;
+            if (!cascade.valid || drift > MAP_SIZE / 32)
+                scroll(c, x, y, draw);
+            else
+                redrawDynamic(c, draw);
+        }
+
+        glDisable(GL_SCISSOR_TEST);
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    // the sampled map and the cascade windows; cascades not rendered yet are skipped by the shader
+    void Bind(Shader &shader) const {
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, map);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("sunShadowMap", TEXTURE_UNIT);
+        shader.setMat4("sunShadowView", view);
+        shader.setVec2("sunShadowDepth", glm::vec2(depthNear, depthFar));
+        shader.setFloat("sunShadowMapSize", (float) MAP_SIZE);
+        shader.setInt("sunShadowCascades", CASCADES);
+        for (int c = 0; c < CASCADES; c++) {
+            const Cascade &cascade = cascades[c];
+            // inset by the filter's reach, so no tap lands in texels of the other side of the torus
+            glm::vec4 window(1.0f, 1.0f, -1.0f, -1.0f);
+            if (cascade.valid)
+                window = glm::vec4(cascade.x + 2, cascade.y + 2, cascade.x + MAP_SIZE - 2,
+                                   cascade.y + MAP_SIZE - 2) * cascade.texel;
+            std::string index = "[" + std::to_string(c) + "]";
+            shader.setVec4("sunShadowWindow" + index, window);
+            shader.setFloat("sunShadowTexel" + index, cascade.texel);
+        }
+    }
+
+    // for shaders compiled with SUN_SHADOWS while the shadows are off
+    static void Disable(Shader &shader) {
+        shader.setInt("sunShadowMap", TEXTURE_UNIT);
+        shader.setInt("sunShadowCascades", 0);
+    }
+
+    const CascadeStats &Stats(int cascade) const {
+        return cascadeStats[cascade];
+    }
+
+    // world size of one texel of a cascade
+    float TexelSize(int cascade) const {
+        return cascades[cascade].texel;
+    }
+
+    unsigned int ShaderCount() const {
+        return casterShaders.Count();
+    }
+
+private:
+    struct Cascade {
+        float size = 0.0f, texel = 0.0f;
+        // light-space texel at the window's lower left corner
+        int x = 0, y = 0;
+        bool valid = false;
+        // dynamic casters were drawn over the cached depth at the last refresh
+        bool dirty = false;
+        unsigned long long updates = 0;
+    };
+
+    // a rectangle of light-space texels, [x0, x1) x [y0, y1)
+    struct Rect {
+        int x0, y0, x1, y1;
+    };
+
+    ShaderPermutations casterShaders;
+    Cascade cascades[CASCADES];
+    CascadeStats cascadeStats[CASCADES];
+    glm::vec3 direction = glm::vec3(0.0f);
+    glm::mat4 view = glm::mat4(1.0f);
+    AABB sceneBounds;
+    // light-space distance along the sunlight of the map's depth 0 and 1
+    float depthNear = 0.1f, depthFar = 1000.0f;
+    unsigned int cachedMap = 0, map = 0;
+    unsigned int cachedFramebuffers[CASCADES] = {}, framebuffers[CASCADES] = {};
+    GLuint queries[CASCADES][QUERIES];
+    unsigned long long frame = 0;
+
+    void updateDepthRange() {
+        if (sceneBounds.Empty())
+            return;
+        float nearest = FLT_MAX, farthest = -FLT_MAX;
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner(i & 1 ? sceneBounds.max.x : sceneBounds.min.x,
+                             i & 2 ? sceneBounds.max.y : sceneBounds.min.y,
+                             i & 4 ? sceneBounds.max.z : sceneBounds.min.z);
+            float distance = -glm::vec3(view * glm::vec4(corner, 1.0f)).z;
+            nearest = std::min(nearest, distance);
+            farthest = std::max(farthest, distance);
+        }
+        depthNear = nearest - 1.0f;
+        depthFar = farthest + 1.0f;
+    }
+
+    // moves a cascade's window to (x, y): static casters into the uncovered strips, or the whole window
+    // when nothing of the old one is left, then the dynamic casters over all of it
+    void scroll(int c, int x, int y, const DrawCasters &draw) {
+        Cascade &cascade = cascades[c];
+        Rect strips[2];
+        int stripCount = 0;
+        int dx = x - cascade.x, dy = y - cascade.y;
+        if (!cascade.valid || std::abs(dx) >= MAP_SIZE || std::abs(dy) >= MAP_SIZE) {
+            strips[stripCount++] = Rect{x, y, x + MAP_SIZE, y + MAP_SIZE};
+        } else {
+            // columns the window gained over its full new height, then rows it gained over the old columns
+            if (dx > 0)
+                strips[stripCount++] = Rect{cascade.x + MAP_SIZE, y, x + MAP_SIZE, y + MAP_SIZE};
+            else if (dx < 0)
+                strips[stripCount++] = Rect{x, y, cascade.x, y + MAP_SIZE};
+            int columns0 = std::max(x, cascade.x), columns1 = std::min(x, cascade.x) + MAP_SIZE;
+            if (dy > 0)
+                strips[stripCount++] = Rect{columns0, cascade.y + MAP_SIZE, columns1, y + MAP_SIZE};
+            else if (dy < 0)
+                strips[stripCount++] = Rect{columns0, y, columns1, cascade.y};
+        }
+        cascade.x = x;
+        cascade.y = y;
+
+        beginMeasure(c);
+        CascadeStats &stats = cascadeStats[c];
+        for (int i = 0; i < stripCount; i++) {
+            forEachPiece(strips[i], [&](const Rect &world, int tx, int ty) {
+                int w = world.x1 - world.x0, h = world.y1 - world.y0;
+                glBindFramebuffer(GL_FRAMEBUFFER, cachedFramebuffers[c]);
+                glViewport(tx, ty, w, h);
+                glScissor(tx, ty, w, h);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                stats.casters += drawPiece(c, world, draw, false);
+                stats.texels += w * h;
+                // the sampled layer has dynamic casters to get rid of anyway when the cascade is dirty
+                if (!cascade.dirty)
+                    copy(c, tx, ty, w, h);
+            });
+        }
+        if (cascade.dirty)
+            copy(c, 0, 0, MAP_SIZE, MAP_SIZE);
+        drawDynamic(c, draw);
+        endMeasure(c);
+        cascade.valid = true;
+    }
+
+    // the window stays, only the dynamic casters are drawn again over the cached depth
+    void redrawDynamic(int c, const DrawCasters &draw) {
+        beginMeasure(c);
+        if (cascades[c].dirty)
+            copy(c, 0, 0, MAP_SIZE, MAP_SIZE);
+        drawDynamic(c, draw);
+        endMeasure(c);
+    }
+
+    void drawDynamic(int c, const DrawCasters &draw) {
+        Cascade &cascade = cascades[c];
+        unsigned int drawn = 0;
+        forEachPiece(Rect{cascade.x, cascade.y, cascade.x + MAP_SIZE, cascade.y + MAP_SIZE},
+                     [&](const Rect &world, int tx, int ty) {
+                         int w = world.x1 - world.x0, h = world.y1 - world.y0;
+                         glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[c]);
+                         glViewport(tx, ty, w, h);
+                         glScissor(tx, ty, w, h);
+                         drawn += drawPiece(c, world, draw, true);
+                     });
+        cascade.dirty = drawn > 0;
+        cascadeStats[c].casters += drawn;
+    }
+
+    // splits a rectangle of light-space texels where it wraps around the layer; the callback gets each
+    // piece and where it starts in the layer
+    template<typename Callback>
+    static void forEachPiece(const Rect &rect, Callback callback) {
+        int x = rect.x0;
+        while (x < rect.x1) {
+            int tx = wrap(x);
+            int x1 = std::min(rect.x1, x + MAP_SIZE - tx);
+            int y = rect.y0;
+            while (y < rect.y1) {
+                int ty = wrap(y);
+                int y1 = std::min(rect.y1, y + MAP_SIZE - ty);
+                callback(Rect{x, y, x1, y1}, tx, ty);
+                y = y1;
+            }
+            x = x1;
+        }
+    }
+
+    static int wrap(int texel) {
+        int m = texel % MAP_SIZE;
+        return m < 0 ? m + MAP_SIZE : m;
+    }
+
+    unsigned int drawPiece(int c, const Rect &world, const DrawCasters &draw, bool dynamic) {
+        float texel = cascades[c].texel;
+        glm::mat4 projection = glm::ortho(world.x0 * texel, world.x1 * texel, world.y0 * texel, world.y1 * texel,
+                                          depthNear, depthFar);
+        Shader &alphaTested = casterShaders.Use(SHADER_ALPHA_TEST);
+        alphaTested.setMat4("projection", projection);
+        alphaTested.setMat4("view", view);
+        Shader &solid = casterShaders.Use(0);
+        solid.setMat4("projection", projection);
+        solid.setMat4("view", view);
+        return draw(Frustum::FromMatrix(projection * view), solid, alphaTested, dynamic);
+    }
+
+    // cached depth into the sampled layer
+    void copy(int c, int x, int y, int w, int h) {
+        glDisable(GL_SCISSOR_TEST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, cachedFramebuffers[c]);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[c]);
+        glBlitFramebuffer(x, y, x + w, y + h, x, y, x + w, y + h, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glEnable(GL_SCISSOR_TEST);
+    }
+
+    void beginMeasure(int c) {
+        Cascade &cascade = cascades[c];
+        GLuint query = queries[c][cascade.updates % QUERIES];
+        if (cascade.updates >= QUERIES) {
+            GLuint available = 0;
+            glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+                cascadeStats[c].milliseconds = nanoseconds / 1.0e6f;
+            }
+        }
+        glBeginQuery(GL_TIME_ELAPSED, query);
+    }
+
+    void endMeasure(int c) {
+        glEndQuery(GL_TIME_ELAPSED);
+        cascades[c].updates++;
+        cascadeStats[c].updated = true;
+    }
+
+    // the sampled map compares in hardware, and both wrap around for the toroidal addressing
+    static unsigned int mapTexture(bool compare) {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, MAP_SIZE, MAP_SIZE, CASCADES, 0,
+                     GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        if (compare) {
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return texture;
+    }
+
+    static unsigned int depthFramebuffer(unsigned int texture, int layer) {
+        unsigned int framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::SUN_SHADOWS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glClear(GL_DEPTH_BUFFER_BIT);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return framebuffer;
+    }
+};
+
+#endif //PROJECT_BASE_SUNSHADOWS_H
@@ -0,0 +1,414 @@
+//
+// Landscape around the village, after Strugar's CDLOD ("Continuous Distance-Dependent Level of Detail for
+// Rendering Heightmaps"). The terrain is a quadtree of square chunks; every chunk is the same grid mesh,
+// scaled to its size. Each frame picks the coarsest chunks whose level's range still reaches them, frustum
+// culls them, and the vertex shader morphs every grid towards the next coarser one as it nears the end
+// of its range, so neighbouring levels meet without cracks or popping.
+// Nothing past the camera's far plane is selected, so the drawn extent and the tiles streamed stop there.
+// Heights come from a procedural heightfield, flattened under the village, in one small tile per chunk.
+// Tiles are generated on demand, a budget per frame on every core, and kept in the layers of one texture
+// array, the least recently used going first. A chunk whose tile isn't there yet borrows its parent's.
+//
+
+#ifndef PROJECT_BASE_TERRAIN_H
+#define PROJECT_BASE_TERRAIN_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+
+#include <rg/Bounds.h>
+#include <rg/FrameStats.h>
+#include <rg/Frustum.h>
+#include <rg/JobSystem.h>
+#include <rg/ShaderPermutations.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+class Terrain {
+public:
+    // quads along a chunk's side; a chunk's tile has one height per grid vertex
+    static const int GRID = 32;
+    static const int TILE_TEXELS = GRID + 1;
+    // the finest chunks are LEAF_SIZE units across, every level up doubles them; the root covers 8 km, of
+    // which only what lies within FarDistance of the camera is ever selected
+    static constexpr float LEAF_SIZE = 32.0f;
+    static const int LEVELS = 9;
+    // layers of the tile cache; about 9 MB of RGBA32F
+    static const int CACHE_TILES = 512;
+    // the heightfield: hills up to HEIGHT high, flat for FLAT_MARGIN around the village, rising over RISE
+    static constexpr float HEIGHT = 160.0f;
+    static constexpr float FLAT_MARGIN = 20.0f;
+    static constexpr float RISE = 250.0f;
+    // under the village ground, which is drawn over it
+    static constexpr float VILLAGE_DEPTH = -0.5f;
+
+    // lit by the sun and the sky; SHADER_SUN_SHADOWS is the only feature
+    ShaderPermutations shaders;
+
+    // the finest level reaches this far, every coarser one twice as far as the last
+    float DetailDistance = 96.0f;
+    // the camera's far plane: chunks past it are neither drawn nor streamed, and no range reaches beyond it
+    float FarDistance = 3000.0f;
+    // tiles generated and uploaded per frame at most
+    int StreamBudget = 16;
+
+    explicit Terrain(JobSystem &jobs)
+            : shaders("resources/shaders/terrain.vs", "resources/shaders/terrain.fs", SHADER_SUN_SHADOWS,
+                      [](Shader &shader) {
+                          shader.setInt("heightTiles", 0);
+                          shader.setInt("groundTexture", 1);
+                      }),
+              jobs(jobs) {
+        // the grid's vertices at their position over the chunk, 0 to 1
+        std::vector<glm::vec2> vertices;
+        for (int z = 0; z <= GRID; z++)
+            for (int x = 0; x <= GRID; x++)
+                vertices.push_back(glm::vec2(x, z) / (float) GRID);
+        // the quads quadrant by quadrant, so a chunk can draw only some of its quarters
+        std::vector<unsigned int> indices;
+        const int half = GRID / 2;
+        for (int quadrant = 0; quadrant < 4; quadrant++)
+            for (int z = (quadrant >> 1) * half; z < ((quadrant >> 1) + 1) * half; z++)
+                for (int x = (quadrant & 1) * half; x < ((quadrant & 1) + 1) * half; x++) {
+                    unsigned int corner = z * (GRID + 1) + x;
+                    unsigned int quad[6] = {corner, corner + GRID + 1, corner + 1,
+                                            corner + 1, corner + GRID + 1, corner + GRID + 2};
+                    indices.insert(indices.end(), quad, quad + 6);
+                }
+        quadrantIndices = indices.size() / 4;
+
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2), vertices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void *) 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        glBindVertexArray(0);
+
+        glGenTextures(1, &tiles);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, tiles);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA32F, TILE_TEXELS, TILE_TEXELS, CACHE_TILES, 0, GL_RGBA, GL_FLOAT,
+                     NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    ~Terrain() {
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ebo);
+        glDeleteTextures(1, &tiles);
+    }
+
+    Terrain(const Terrain &) = delete;
+    Terrain &operator=(const Terrain &) = delete;
+
+    // Centers the terrain on the village and flattens it under the village's ground, which stays drawn by
+    // the scene. Drops every tile; the root's is generated right away, so there is always one to borrow.
+    void SetVillage(const AABB &bounds) {
+        village = bounds;
+        glm::vec2 center = bounds.Empty() ? glm::vec2(0.0f) : glm::vec2(bounds.Center().x, bounds.Center().z);
+        origin = glm::floor(center / LEAF_SIZE) * LEAF_SIZE - glm::vec2(NodeSize(LEVELS - 1) * 0.5f);
+        cache.clear();
+        freeLayers.clear();
+        for (int layer = CACHE_TILES - 1; layer >= 0; layer--)
+            freeLayers.push_back(layer);
+        frame = 0;
+        requests.assign(1, TileKey(LEVELS - 1, 0, 0));
+        stream(1);
+    }
+
+    // Picks this frame's chunks for the camera at eye, culled against frustum unless it is null, then
+    // streams in up to StreamBudget of the missing tiles they need, coarsest and nearest first.
+    void Select(const Frustum *frustum, const glm::vec3 &eye) {
+        frame++;
+        ranges[0] = std::min(std::max(DetailDistance, 2.0f * LEAF_SIZE), FarDistance);
+        for (int level = 1; level < LEVELS; level++)
+            ranges[level] = std::min(ranges[level - 1] * 2.0f, FarDistance);
+        chunks.clear();
+        requests.clear();
+        selectNode(LEVELS - 1, 0, 0, frustum, eye);
+
+        std::sort(requests.begin(), requests.end(), [&](uint64_t a, uint64_t b) {
+            int levelA = (int) (a >> 48), levelB = (int) (b >> 48);
+            if (levelA != levelB)
+                return levelA > levelB;
+            return distanceSquared(a, eye) < distanceSquared(b, eye);
+        });
+        requests.erase(std::unique(requests.begin(), requests.end()), requests.end());
+        stream(StreamBudget);
+        rg::frameStats().terrainTilesResident = cache.size();
+    }
+
+    // Draws the chunks Select picked with shader, which is in use with its view, projection and lights set.
+    void Draw(Shader &shader, const glm::vec3 &eye, unsigned int groundTexture) {
+        shader.setVec3("viewPosition", eye);
+        shader.setFloat("gridSize", (float) GRID);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, tiles);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, groundTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindVertexArray(vao);
+        for (const Chunk &chunk : chunks) {
+            float size = NodeSize(chunk.level);
+            glm::vec2 corner = origin + glm::vec2(chunk.x, chunk.z) * size;
+            shader.setVec4("chunk", glm::vec4(corner, size, 0.0f));
+            // morphing into the next level over the last 30% of this level's range
+            float previous = chunk.level > 0 ? ranges[chunk.level - 1] : 0.0f;
+            float end = ranges[chunk.level];
+            shader.setVec2("morphRange", glm::vec2(previous + (end - previous) * 0.7f, end));
+            shader.setVec4("tile", tileFor(chunk));
+            if (chunk.quadrants == 0xF) {
+                glDrawElements(GL_TRIANGLES, quadrantIndices * 4, GL_UNSIGNED_INT, (void *) 0);
+                rg::countDrawCall(quadrantIndices * 4 / 3);
+            } else
+                for (int quadrant = 0; quadrant < 4; quadrant++)
+                    if (chunk.quadrants & (1 << quadrant)) {
+                        glDrawElements(GL_TRIANGLES, quadrantIndices, GL_UNSIGNED_INT,
+                                       (void *) (quadrant * quadrantIndices * sizeof(unsigned int)));
+                        rg::countDrawCall(quadrantIndices / 3);
+                    }
+        }
+        glBindVertexArray(0);
+        rg::frameStats().terrainChunks = chunks.size();
+    }
+
+    // side of the chunks of a level, 0 being the finest
+    static float NodeSize(int level) {
+        return LEAF_SIZE * (float) (1 << level);
+    }
+
+    // the heightfield at a point: rolling hills of a few octaves of value noise, flat around the village
+    float Height(float x, float z) const {
+        float hills = 0.0f, amplitude = 0.5f, frequency = 1.0f / 900.0f;
+        for (int octave = 0; octave < 6; octave++) {
+            hills += amplitude * valueNoise(x * frequency, z * frequency, octave);
+            amplitude *= 0.5f;
+            frequency *= 2.1f;
+        }
+        float rise = 1.0f;
+        if (!village.Empty()) {
+            float dx = std::max(std::max(village.min.x - x, x - village.max.x), 0.0f);
+            float dz = std::max(std::max(village.min.z - z, z - village.max.z), 0.0f);
+            float t = std::min(std::max((std::sqrt(dx * dx + dz * dz) - FLAT_MARGIN) / RISE, 0.0f), 1.0f);
+            rise = t * t * (3.0f - 2.0f * t);
+        }
+        return VILLAGE_DEPTH + (hills * HEIGHT - VILLAGE_DEPTH) * rise;
+    }
+
+private:
+    struct Chunk {
+        int level, x, z;
+        // bit q set for each quarter drawn: x half in bit 0, z half in bit 1
+        unsigned int quadrants;
+    };
+
+    struct CachedTile {
+        int layer;
+        unsigned int lastUsed;
+    };
+
+    JobSystem &jobs;
+    unsigned int vao = 0, vbo = 0, ebo = 0, tiles = 0;
+    unsigned int quadrantIndices = 0;
+    AABB village;
+    glm::vec2 origin = glm::vec2(0.0f);
+    float ranges[LEVELS] = {};
+    std::vector<Chunk> chunks;
+    std::map<uint64_t, CachedTile> cache;
+    std::vector<int> freeLayers;
+    std::vector<uint64_t> requests;
+    unsigned int frame = 0;
+
+    static uint64_t TileKey(int level, int x, int z) {
+        return (uint64_t) level << 48 | (uint64_t) (uint32_t) x << 24 | (uint64_t) (uint32_t) z;
+    }
+
+    static void keyParts(uint64_t key, int &level, int &x, int &z) {
+        level = (int) (key >> 48);
+        x = (int) ((key >> 24) & 0xFFFFFF);
+        z = (int) (key & 0xFFFFFF);
+    }
+
+    float distanceSquared(uint64_t key, const glm::vec3 &eye) const {
+        int level, x, z;
+        keyParts(key, level, x, z);
+        glm::vec2 center = origin + (glm::vec2(x, z) + 0.5f) * NodeSize(level);
+        glm::vec2 offset = center - glm::vec2(eye.x, eye.z);
+        return glm::dot(offset, offset);
+    }
+
+    AABB nodeBounds(int level, int x, int z) const {
+        float size = NodeSize(level);
+        glm::vec2 corner = origin + glm::vec2(x, z) * size;
+        AABB box;
+        box.min = glm::vec3(corner.x, VILLAGE_DEPTH, corner.y);
+        box.max = glm::vec3(corner.x + size, HEIGHT, corner.y + size);
+        return box;
+    }
+
+    static bool reaches(const glm::vec3 &eye, float range, const AABB &box) {
+        glm::vec3 offset = eye - glm::clamp(eye, box.min, box.max);
+        return glm::dot(offset, offset) <= range * range;
+    }
+
+    // False when the node is out of its level's range, so its parent covers that quarter itself.
+    bool selectNode(int level, int x, int z, const Frustum *frustum, const glm::vec3 &eye) {
+        AABB box = nodeBounds(level, x, z);
+        // past the far plane: nothing of it can be seen, at any level
+        if (!reaches(eye, FarDistance, box))
+            return true;
+        if (level < LEVELS - 1 && !reaches(eye, ranges[level], box))
+            return false;
+        if (frustum && !frustum->IntersectsAABB(box)) {
+            rg::frameStats().terrainChunksCulled++;
+            return true;
+        }
+        if (level == 0 || !reaches(eye, ranges[level - 1], box)) {
+            addChunk(level, x, z, 0xF);
+            return true;
+        }
+        unsigned int quadrants = 0;
+        for (int child = 0; child < 4; child++)
+            if (!selectNode(level - 1, x * 2 + (child & 1), z * 2 + (child >> 1), frustum, eye))
+                quadrants |= 1u << child;
+        if (quadrants)
+            addChunk(level, x, z, quadrants);
+        return true;
+    }
+
+    void addChunk(int level, int x, int z, unsigned int quadrants) {
+        chunks.push_back(Chunk{level, x, z, quadrants});
+        auto cached = cache.find(TileKey(level, x, z));
+        if (cached == cache.end())
+            requests.push_back(TileKey(level, x, z));
+        else
+            cached->second.lastUsed = frame;
+    }
+
+    // The chunk's own tile or its nearest ancestor's, as the layer and where the chunk sits in it:
+    // offset in xy, scale in z, layer in w. Marks the tiles used this frame.
+    glm::vec4 tileFor(const Chunk &chunk) {
+        int level = chunk.level, x = chunk.x, z = chunk.z;
+        glm::vec2 offset(0.0f);
+        float scale = 1.0f;
+        while (true) {
+            auto cached = cache.find(TileKey(level, x, z));
+            if (cached != cache.end()) {
+                cached->second.lastUsed = frame;
+                return glm::vec4(offset, scale, (float) cached->second.layer);
+            }
+            // a quarter of the parent, the root's tile is always there
+            scale *= 0.5f;
+            offset = offset * 0.5f + glm::vec2(x & 1, z & 1) * 0.5f;
+            level++;
+            x >>= 1;
+            z >>= 1;
+        }
+    }
+
+    // generates the first budget requested tiles on every core and uploads them
+    void stream(int budget) {
+        std::vector<uint64_t> batch;
+        for (uint64_t key : requests) {
+            if ((int) batch.size() >= budget)
+                break;
+            int layer = allocateLayer();
+            if (layer < 0)
+                break;
+            cache[key] = CachedTile{layer, frame};
+            batch.push_back(key);
+        }
+        if (batch.empty())
+            return;
+        const size_t texels = TILE_TEXELS * TILE_TEXELS;
+        std::vector<glm::vec4> data(batch.size() * texels);
+        jobs.ParallelFor(batch.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                generateTile(batch[i], &data[i * texels]);
+        });
+        glBindTexture(GL_TEXTURE_2D_ARRAY, tiles);
+        for (size_t i = 0; i < batch.size(); i++)
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, cache[batch[i]].layer, TILE_TEXELS, TILE_TEXELS, 1, GL_RGBA,
+                            GL_FLOAT, &data[i * texels]);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        rg::frameStats().terrainTilesStreamed += batch.size();
+    }
+
+    // a free layer, or the least recently used tile's other than the root's and this frame's ones
+    int allocateLayer() {
+        if (!freeLayers.empty()) {
+            int layer = freeLayers.back();
+            freeLayers.pop_back();
+            return layer;
+        }
+        auto oldest = cache.end();
+        for (auto entry = cache.begin(); entry != cache.end(); ++entry) {
+            if ((int) (entry->first >> 48) == LEVELS - 1 || entry->second.lastUsed >= frame)
+                continue;
+            if (oldest == cache.end() || entry->second.lastUsed < oldest->second.lastUsed)
+                oldest = entry;
+        }
+        if (oldest == cache.end())
+            return -1;
+        int layer = oldest->second.layer;
+        cache.erase(oldest);
+        return layer;
+    }
+
+    // per grid vertex of the tile's chunk: the height, then the normal's x and z
+    void generateTile(uint64_t key, glm::vec4 *texels) const {
+        int level, x, z;
+        keyParts(key, level, x, z);
+        const float size = NodeSize(level), spacing = size / GRID;
+        const glm::vec2 corner = origin + glm::vec2(x, z) * size;
+        // one extra height around the grid for the central differences of the normals
+        const int side = TILE_TEXELS + 2;
+        std::vector<float> heights(side * side);
+        for (int j = 0; j < side; j++)
+            for (int i = 0; i < side; i++)
+                heights[j * side + i] = Height(corner.x + (i - 1) * spacing, corner.y + (j - 1) * spacing);
+        for (int j = 0; j < TILE_TEXELS; j++)
+            for (int i = 0; i < TILE_TEXELS; i++) {
+                const float *h = &heights[(j + 1) * side + i + 1];
+                glm::vec3 normal = glm::normalize(glm::vec3(h[-1] - h[1], 2.0f * spacing, h[-side] - h[side]));
+                texels[j * TILE_TEXELS + i] = glm::vec4(h[0], normal.x, normal.z, 0.0f);
+            }
+    }
+
+    // smoothly interpolated random values on the integer lattice, a different lattice per octave
+    static float valueNoise(float x, float z, int octave) {
+        float fx = std::floor(x), fz = std::floor(z);
+        int ix = (int) fx, iz = (int) fz;
+        float tx = x - fx, tz = z - fz;
+        tx = tx * tx * (3.0f - 2.0f * tx);
+        tz = tz * tz * (3.0f - 2.0f * tz);
+        float a = lattice(ix, iz, octave), b = lattice(ix + 1, iz, octave);
+        float c = lattice(ix, iz + 1, octave), d = lattice(ix + 1, iz + 1, octave);
+        return (a + (b - a) * tx) + ((c + (d - c) * tx) - (a + (b - a) * tx)) * tz;
+    }
+
+    static float lattice(int x, int z, int octave) {
+        uint32_t h = (uint32_t) x * 73856093u ^ (uint32_t) z * 19349663u ^ (uint32_t) octave * 83492791u;
+        h ^= h >> 13;
+        h *= 1274126177u;
+        h ^= h >> 16;
+        return (h & 0xFFFFFF) * (1.0f / 16777216.0f);
+    }
+};
+
+#endif //PROJECT_BASE_TERRAIN_H
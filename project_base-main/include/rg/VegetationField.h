@@ -0,0 +1,385 @@
+//
+// Vegetation scattered over the ground tiles from a density map: bushes and tufts of grass blades, one
+// crossed quad each. The instances live in one GPU buffer, sorted into square cells; every cell is
+// frustum culled as a whole and drawn with one instanced draw. Grass thins out with distance: a
+// cell's tufts are in random order, so drawing only the first share of them thins it evenly.
+//
+
+#ifndef PROJECT_BASE_VEGETATIONFIELD_H
+#define PROJECT_BASE_VEGETATIONFIELD_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <stb_image.h>
+
+#include <learnopengl/shader.h>
+
+#include <rg/Bounds.h>
+#include <rg/Culling.h>
+#include <rg/FrameStats.h>
+#include <rg/Frustum.h>
+#include <rg/ObjectLights.h>
+#include <rg/Scene.h>
+#include <rg/ShaderPermutations.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+class VegetationField {
+public:
+    // the ground tile grassTransform draws, centered on the scene's tile offsets
+    static constexpr float TILE_SIZE = 100.0f;
+    static constexpr float CELL_SIZE = 10.0f;
+    // plants per square unit where the density map's channel is white: red for grass, green for bushes
+    static constexpr float GRASS_DENSITY = 48.0f;
+    static constexpr float BUSH_DENSITY = 0.3f;
+    // grass is thinned out evenly over large replicated scenes to stay under this many tufts
+    static const unsigned int MAX_GRASS = 2000000;
+
+    enum Kind {
+        BUSH = 0,
+        GRASS = 1
+    };
+
+    // the forward lighting shaders, per set of lighting features, and the depth pre-pass's; the
+    // G-buffer's is DeferredRenderer::vegetationShader
+    ShaderPermutations shaders;
+    Shader depthShader;
+
+    // grass starts thinning out at the first distance and is gone at the second
+    float GrassFullDistance = 25.0f;
+    float GrassMaxDistance = 90.0f;
+
+    // the cells' world bounds and which of them the last Cull kept, for ObjectLights::Build
+    BoundsArray cellBounds;
+    std::vector<uint8_t> cellVisible;
+
+    // densityMapPath covers one ground tile, its first row at the tile's smallest z
+    explicit VegetationField(const char *densityMapPath)
+            : shaders("resources/shaders/vegetation.vs", "resources/shaders/blending.fs",
+                      SHADER_LAMPS | SHADER_OBJECT_LIGHT_LISTS | SHADER_SPOT_SHADOWS | SHADER_SUN_SHADOWS,
+                      [](Shader &shader) {
+                          shader.setInt("texture1", 0);
+                      }),
+              depthShader("resources/shaders/vegetation.vs", "resources/shaders/depth_prepass.fs",
+                          std::vector<std::string>{"SCATTERED"}) {
+        depthShader.use();
+        depthShader.setInt("texture1", 0);
+
+        int components;
+        unsigned char *data = stbi_load(densityMapPath, &densityWidth, &densityHeight, &components, 3);
+        if (!data) {
+            std::cout << "ERROR::VEGETATION::DENSITY_MAP_LOAD_FAILED " << densityMapPath << std::endl;
+            densityWidth = densityHeight = 0;
+        } else {
+            density.assign(data, data + densityWidth * densityHeight * 3);
+            stbi_image_free(data);
+        }
+
+        // two quads crossing at right angles, standing on the origin, one unit wide and tall; texture
+        // coordinates flipped like the bushes' quad
+        const float quads[] = {
+                -0.5f, 1.0f, 0.0f, 0.0f, 0.0f,   -0.5f, 0.0f, 0.0f, 0.0f, 1.0f,   0.5f, 0.0f, 0.0f, 1.0f, 1.0f,
+                -0.5f, 1.0f, 0.0f, 0.0f, 0.0f,   0.5f, 0.0f, 0.0f, 1.0f, 1.0f,    0.5f, 1.0f, 0.0f, 1.0f, 0.0f,
+                0.0f, 1.0f, -0.5f, 0.0f, 0.0f,   0.0f, 0.0f, -0.5f, 0.0f, 1.0f,   0.0f, 0.0f, 0.5f, 1.0f, 1.0f,
+                0.0f, 1.0f, -0.5f, 0.0f, 0.0f,   0.0f, 0.0f, 0.5f, 1.0f, 1.0f,    0.0f, 1.0f, 0.5f, 1.0f, 0.0f};
+        glGenBuffers(1, &quadVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(quads), quads, GL_STATIC_DRAW);
+        glGenBuffers(1, &instanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // alpha to coverage needs samples to cover, the default framebuffer may have none
+        GLint sampleBuffers = 0;
+        glGetIntegerv(GL_SAMPLE_BUFFERS, &sampleBuffers);
+        multisampled = sampleBuffers > 0;
+    }
+
+    ~VegetationField() {
+        clearCells();
+        glDeleteBuffers(1, &quadVBO);
+        glDeleteBuffers(1, &instanceVBO);
+        glDeleteProgram(depthShader.ID);
+    }
+
+    VegetationField(const VegetationField &) = delete;
+    VegetationField &operator=(const VegetationField &) = delete;
+
+    // Scatters plants over every ground tile, away from the road and the instances standing on the
+    // ground, and adds the scene's hand-placed bushes. The same scene always gets the same plants.
+    void Scatter(const Scene &scene, const SceneCulling &culling) {
+        std::map<std::pair<int, int>, CellPlants> plants;
+        float grassDensity = GRASS_DENSITY;
+        float expected = scene.tiles.size() * TILE_SIZE * TILE_SIZE * GRASS_DENSITY * meanDensity(0);
+        if (expected > MAX_GRASS)
+            grassDensity *= MAX_GRASS / expected;
+
+        const int cellsPerTile = (int) std::lround(TILE_SIZE / CELL_SIZE);
+        std::vector<AABB> obstacles;
+        for (const glm::vec2 &tile : scene.tiles) {
+            const glm::vec2 tileMin = tile - glm::vec2(TILE_SIZE * 0.5f);
+            for (int cz = 0; cz < cellsPerTile; cz++)
+                for (int cx = 0; cx < cellsPerTile; cx++) {
+                    glm::vec2 cellMin = tileMin + glm::vec2(cx, cz) * CELL_SIZE;
+                    std::pair<int, int> key = cellKey(cellMin + glm::vec2(CELL_SIZE * 0.5f));
+                    groundObstacles(culling, cellMin, obstacles);
+                    std::mt19937 random(cellSeed(key.first, key.second));
+                    CellPlants &cell = plants[key];
+                    scatter(random, cell.bushes, BUSH, BUSH_DENSITY, 1, cellMin, tileMin, obstacles);
+                    scatter(random, cell.grass, GRASS, grassDensity, 0, cellMin, tileMin, obstacles);
+                }
+        }
+        // the hand-placed bushes were quads with their left edge and middle at position
+        for (const SceneVegetation &plant : scene.vegetation) {
+            glm::vec3 base = plant.position + glm::vec3(0.5f, -0.5f, 0.0f) * plant.scale;
+            plants[cellKey(glm::vec2(base.x, base.z))].bushes.push_back(Instance{glm::vec4(base, plant.scale), glm::vec4(1.0f, 0.0f, BUSH, 0.0f)});
+        }
+        upload(plants);
+    }
+
+    // Picks the cells in the frustum, all of them without one, and how much of their grass is drawn
+    // from eye. Cells whose grass is all thinned out and that have no bushes are dropped as well.
+    void Cull(const Frustum *frustum, const glm::vec3 &eye) {
+        if (frustum)
+            frustum->CullBoxes(cellBounds, cellVisible);
+        else
+            cellVisible.assign(cells.size(), 1);
+        visible.clear();
+        for (unsigned int c = 0; c < cells.size(); c++) {
+            const Cell &cell = cells[c];
+            if (cellVisible[c]) {
+                glm::vec3 nearest = glm::clamp(eye, cell.bounds.min, cell.bounds.max);
+                float share = grassShare(glm::length(nearest - eye));
+                unsigned int count = cell.bushes + (unsigned int) std::ceil(cell.grass * share);
+                if (count > 0) {
+                    visible.push_back(VisibleCell{c, count});
+                    rg::frameStats().vegetationCells++;
+                    rg::frameStats().vegetationInstances += count;
+                    continue;
+                }
+                cellVisible[c] = 0;
+            }
+            rg::frameStats().vegetationCulled += cell.bushes + cell.grass;
+        }
+    }
+
+    // Draws the cells Cull picked with shader, which is in use with its view, projection and lights
+    // set; lists, when given, are the cells' lamps from ObjectLights, set at the shader's listLocation.
+    // alphaToCoverage asks for alpha to coverage, it is only used when the target is multisampled.
+    void Draw(Shader &shader, const glm::vec3 &eye, unsigned int bushTexture, bool alphaToCoverage,
+              const std::vector<LightList> *lists = nullptr, GLint listLocation = -1) {
+        bool coverage = alphaToCoverage && multisampled;
+        shader.setVec3("viewPosition", eye);
+        shader.setVec2("grassFade", glm::vec2(GrassFullDistance, std::max(GrassMaxDistance, GrassFullDistance + 1.0f)));
+        shader.setBool("alphaToCoverage", coverage);
+        if (coverage)
+            glEnable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, bushTexture);
+        for (const VisibleCell &draw : visible) {
+            if (lists)
+                ObjectLights::Use(listLocation, (*lists)[draw.cell]);
+            glBindVertexArray(cells[draw.cell].vao);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 12, draw.count);
+            rg::countDrawCall(4ull * draw.count);
+        }
+        glBindVertexArray(0);
+        if (coverage)
+            glDisable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+    }
+
+    unsigned int InstanceCount() const {
+        return instanceCount;
+    }
+
+    unsigned int CellCount() const {
+        return cells.size();
+    }
+
+    bool Multisampled() const {
+        return multisampled;
+    }
+
+private:
+    // 32 bytes per plant, the layout of vegetation.vs's instance attributes
+    struct Instance {
+        glm::vec4 positionScale;
+        // cosine and sine of the yaw, kind, and for grass its place in the cell's order over [0, 1)
+        glm::vec4 rotationKind;
+    };
+
+    struct CellPlants {
+        std::vector<Instance> bushes, grass;
+    };
+
+    // bushes first, then grass in random order
+    struct Cell {
+        AABB bounds;
+        unsigned int bushes = 0, grass = 0;
+        unsigned int vao = 0;
+    };
+
+    struct VisibleCell {
+        unsigned int cell;
+        unsigned int count;
+    };
+
+    std::vector<unsigned char> density;
+    int densityWidth = 0, densityHeight = 0;
+    std::vector<Cell> cells;
+    std::vector<VisibleCell> visible;
+    unsigned int instanceCount = 0;
+    unsigned int quadVBO = 0, instanceVBO = 0;
+    bool multisampled = false;
+
+    float grassShare(float distance) const {
+        float range = std::max(GrassMaxDistance - GrassFullDistance, 1.0f);
+        return 1.0f - std::min(std::max((distance - GrassFullDistance) / range, 0.0f), 1.0f);
+    }
+
+    // the map's channel at a point of a tile, 0 without a map
+    float densityAt(const glm::vec2 &point, const glm::vec2 &tileMin, int channel) const {
+        if (density.empty())
+            return 0.0f;
+        int x = std::min(std::max((int) ((point.x - tileMin.x) / TILE_SIZE * densityWidth), 0), densityWidth - 1);
+        int y = std::min(std::max((int) ((point.y - tileMin.y) / TILE_SIZE * densityHeight), 0), densityHeight - 1);
+        return density[(y * densityWidth + x) * 3 + channel] * (1.0f / 255.0f);
+    }
+
+    float meanDensity(int channel) const {
+        if (density.empty())
+            return 0.0f;
+        double sum = 0.0;
+        for (size_t i = channel; i < density.size(); i += 3)
+            sum += density[i];
+        return (float) (sum / (255.0 * densityWidth * densityHeight));
+    }
+
+    // the instances standing on the ground over a cell; plants are kept out of their footprint
+    static void groundObstacles(const SceneCulling &culling, const glm::vec2 &cellMin, std::vector<AABB> &obstacles) {
+        obstacles.clear();
+        for (size_t i = 0; i < culling.instanceBounds.Size(); i++) {
+            AABB box = culling.instanceBounds.Get(i);
+            if (box.Empty() || box.min.y > 0.5f || box.max.x < cellMin.x || box.min.x > cellMin.x + CELL_SIZE ||
+                box.max.z < cellMin.y || box.min.z > cellMin.y + CELL_SIZE)
+                continue;
+            obstacles.push_back(box);
+        }
+    }
+
+    // Candidates fall uniformly over the cell and are kept with the map's density there, so the kept
+    // ones come in random order.
+    void scatter(std::mt19937 &random, std::vector<Instance> &out, Kind kind, float perSquareUnit, int channel,
+                 const glm::vec2 &cellMin, const glm::vec2 &tileMin, const std::vector<AABB> &obstacles) const {
+        int candidates = (int) (perSquareUnit * CELL_SIZE * CELL_SIZE);
+        // the fraction left over is one more candidate that often
+        if (unit(random) < perSquareUnit * CELL_SIZE * CELL_SIZE - candidates)
+            candidates++;
+        for (int i = 0; i < candidates; i++) {
+            glm::vec2 point = cellMin + glm::vec2(unit(random), unit(random)) * CELL_SIZE;
+            float keep = unit(random), yaw = unit(random) * 6.2831853f, size = unit(random);
+            if (keep >= densityAt(point, tileMin, channel))
+                continue;
+            bool blocked = false;
+            for (const AABB &box : obstacles)
+                if (point.x >= box.min.x && point.x <= box.max.x && point.y >= box.min.z && point.y <= box.max.z)
+                    blocked = true;
+            if (blocked)
+                continue;
+            float scale = kind == GRASS ? 0.25f + 0.2f * size : 1.2f + 0.8f * size;
+            out.push_back(Instance{glm::vec4(point.x, 0.0f, point.y, scale),
+                                   glm::vec4(std::cos(yaw), std::sin(yaw), kind, 0.0f)});
+        }
+    }
+
+    void upload(std::map<std::pair<int, int>, CellPlants> &plants) {
+        clearCells();
+        std::vector<Instance> instances;
+        for (auto &entry : plants) {
+            CellPlants &cellPlants = entry.second;
+            if (cellPlants.bushes.empty() && cellPlants.grass.empty())
+                continue;
+            Cell cell;
+            cell.bushes = cellPlants.bushes.size();
+            cell.grass = cellPlants.grass.size();
+            for (unsigned int i = 0; i < cell.grass; i++)
+                cellPlants.grass[i].rotationKind.w = (float) i / cell.grass;
+            unsigned int first = instances.size();
+            instances.insert(instances.end(), cellPlants.bushes.begin(), cellPlants.bushes.end());
+            instances.insert(instances.end(), cellPlants.grass.begin(), cellPlants.grass.end());
+            for (unsigned int i = first; i < instances.size(); i++) {
+                glm::vec3 base(instances[i].positionScale);
+                float scale = instances[i].positionScale.w;
+                cell.bounds.Expand(base - glm::vec3(0.5f * scale, 0.0f, 0.5f * scale));
+                cell.bounds.Expand(base + glm::vec3(0.5f * scale, scale, 0.5f * scale));
+            }
+            cell.vao = instanceArray(first);
+            cells.push_back(cell);
+        }
+        cellBounds.Resize(cells.size());
+        for (size_t c = 0; c < cells.size(); c++)
+            cellBounds.Set(c, cells[c].bounds);
+        cellVisible.assign(cells.size(), 0);
+        instanceCount = instances.size();
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Without base instances (GL 4.2) each cell gets a vertex array whose instance attributes start at
+    // its first plant.
+    unsigned int instanceArray(unsigned int first) {
+        unsigned int vao;
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *) 0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *) (3 * sizeof(float)));
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (int column = 0; column < 2; column++) {
+            glEnableVertexAttribArray(2 + column);
+            glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                                  (void *) (first * sizeof(Instance) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(2 + column, 1);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return vao;
+    }
+
+    void clearCells() {
+        for (const Cell &cell : cells)
+            glDeleteVertexArrays(1, &cell.vao);
+        cells.clear();
+        visible.clear();
+        cellBounds.Resize(0);
+        cellVisible.clear();
+        instanceCount = 0;
+    }
+
+    // the cell a point lies in; scattered cells are keyed by their center, away from the float error at
+    // their edges, so a hand-placed bush joins the cell it stands in
+    static std::pair<int, int> cellKey(const glm::vec2 &point) {
+        return std::pair<int, int>((int) std::floor(point.x / CELL_SIZE), (int) std::floor(point.y / CELL_SIZE));
+    }
+
+    static uint32_t cellSeed(int x, int z) {
+        return 2654435761u ^ (uint32_t) x * 73856093u ^ (uint32_t) z * 19349663u;
+    }
+
+    static float unit(std::mt19937 &random) {
+        return (random() >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+#endif //PROJECT_BASE_VEGETATIONFIELD_H
@@ -0,0 +1,149 @@
+//
+// Weighted blended order-independent transparency, after McGuire and Bavoil: translucent surfaces are
+// drawn unsorted into an accumulation target (premultiplied color and alpha, weighted by distance)
+// and a revealage target, then composited over the opaque image in one full-screen pass. GL 3.3 has
+// one blend function for all draw buffers, so revealage is summed as optical depth, -log(1 - alpha),
+// with the same additive blending as the colors (resources/shaders/include/weighted_oit.glsl). The targets
+// follow the default framebuffer's size, see Resize.
+//
+
+#ifndef PROJECT_BASE_WEIGHTEDBLENDEDOIT_H
+#define PROJECT_BASE_WEIGHTEDBLENDEDOIT_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/shader.h>
+
+#include <rg/FrameStats.h>
+
+#include <iostream>
+
+class WeightedBlendedOIT {
+public:
+    WeightedBlendedOIT(int width, int height)
+            : compositeShader("resources/shaders/oit_composite.vs", "resources/shaders/oit_composite.fs"),
+              width(width), height(height) {
+        glGenFramebuffers(1, &framebuffer);
+        allocateTargets();
+
+        // the full-screen triangle is generated from gl_VertexID, the core profile still wants a VAO
+        glGenVertexArrays(1, &emptyVAO);
+
+        compositeShader.use();
+        compositeShader.setInt("accumulation", 0);
+        compositeShader.setInt("revealage", 1);
+    }
+
+    ~WeightedBlendedOIT() {
+        deleteTargets();
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteVertexArrays(1, &emptyVAO);
+        glDeleteProgram(compositeShader.ID);
+    }
+
+    // false when the targets can't be rendered to; the caller then draws translucent surfaces with
+    // SHADER_ALPHA_TEST into the default framebuffer instead
+    bool Supported() const {
+        return supported;
+    }
+
+    // reallocates the targets for a default framebuffer of width x height pixels
+    void Resize(int newWidth, int newHeight) {
+        if (newWidth == width && newHeight == height)
+            return;
+        width = newWidth;
+        height = newHeight;
+        deleteTargets();
+        allocateTargets();
+    }
+
+    // Copies the depth of the opaque scene from the default framebuffer, clears the targets and binds
+    // them for additive blending without depth writes. Translucent meshes follow, in any order, drawn
+    // with shaders compiled with SHADER_TRANSLUCENT.
+    void Begin() {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glGetIntegerv(GL_VIEWPORT, savedViewport);
+        glViewport(0, 0, width, height);
+        // no color and no optical depth yet
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+    }
+
+    // blends the translucent layers over the default framebuffer
+    void End() {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+        glDisable(GL_DEPTH_TEST);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        compositeShader.use();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, accumulation);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, revealage);
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        rg::countDrawCall(1);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_TRUE);
+    }
+
+private:
+    Shader compositeShader;
+    unsigned int accumulation = 0, revealage = 0, depth = 0;
+    unsigned int framebuffer = 0;
+    unsigned int emptyVAO = 0;
+    int width, height;
+    bool supported = false;
+    GLint savedViewport[4] = {};
+
+    void allocateTargets() {
+        accumulation = target(GL_RGBA16F, GL_RGBA, GL_FLOAT);
+        revealage = target(GL_R16F, GL_RED, GL_FLOAT);
+        // the opaque depth is copied in every frame, the same format as the default framebuffer's
+        depth = target(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumulation, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, revealage, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        GLenum buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glDrawBuffers(2, buffers);
+        // contexts that can't render to both float targets draw translucent surfaces dithered instead
+        GLint drawBuffers = 0;
+        glGetIntegerv(GL_MAX_DRAW_BUFFERS, &drawBuffers);
+        supported = drawBuffers >= 2 && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!supported)
+            std::cout << "ERROR::OIT::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void deleteTargets() {
+        glDeleteTextures(1, &accumulation);
+        glDeleteTextures(1, &revealage);
+        glDeleteTextures(1, &depth);
+    }
+
+    unsigned int target(GLint internalFormat, GLenum format, GLenum type) const {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+};
+
+#endif //PROJECT_BASE_WEIGHTEDBLENDEDOIT_H
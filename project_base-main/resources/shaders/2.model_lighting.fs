@@ -1,40 +1,15 @@
 #version 330 core
-out vec4 FragColor;
-
-struct PointLight {
-    vec3 position;
-
-    vec3 specular;
-    vec3 diffuse;
-    vec3 ambient;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct DirLight {
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
+layout (location = 0) out vec4 FragColor;
+#if defined(TRANSLUCENT) && !defined(ALPHA_TEST)
+// the optical depth of the translucent surfaces in front of the opaque ones, FragColor accumulates
+#include "include/weighted_oit.glsl"
+#endif
+
+#include "include/lights.glsl"
+#include "include/sky_ambient.glsl"
+#include "include/lamp_lists.glsl"
+#include "include/spot_shadows.glsl"
+#include "include/sun_shadows.glsl"
 
 struct Material {
     sampler2D texture_diffuse1;
@@ -45,13 +20,21 @@ struct Material {
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
+#ifdef LIGHTMAP
+in vec2 LightmapCoords;
+// ambient, diffuse light and first bounce of every light, baked
+uniform sampler2D lightmap;
+#endif
 
-#define NUM_LIGHTS 6
-uniform PointLight pointLight[NUM_LIGHTS];
-uniform SpotLight spotLight[NUM_LIGHTS];
 uniform DirLight dirLight;
 uniform Material material;
 uniform vec3 viewPosition;
+#ifdef TRANSLUCENT
+// the mesh's material opacity
+uniform float opacity;
+#endif
+
+#include "include/lod_fade.glsl"
 
 // calculates the color when using a point light.
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
@@ -64,7 +47,7 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // attenuation
     float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    float attenuation = Attenuation(light, distance);
     // combine results
     vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
@@ -85,11 +68,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
      float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
      // attenuation
      float distance = length(light.position - fragPos);
-     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+     float attenuation = Attenuation(light, distance);
      // spotlight intensity
-     float theta = dot(lightDir, normalize(-light.direction));
-     float epsilon = light.cutOff - light.outerCutOff;
-     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+     float intensity = SpotIntensity(light, lightDir);
      // combine results
      vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
      vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
@@ -100,7 +81,8 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
      return (ambient + diffuse + specular);
  }
 
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+// shadow scales everything but the ambient term
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shadow)
 {
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
@@ -111,22 +93,49 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     // vec3 reflectDir = reflect(-lightDir, normal);
     // float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
+    vec3 ambient = SkyAmbient(normal) * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
-    return (ambient + diffuse + specular);
+    return (ambient + (diffuse + specular) * shadow);
 }
 
 void main()
 {
+    if (LodFadedOut())
+        discard;
+#if defined(TRANSLUCENT) && defined(ALPHA_TEST)
+    // without the OIT targets: a dithered share of the pixels, as many as the surface is opaque
+    if (opacity <= DitherThreshold())
+        discard;
+#endif
     vec3 normal = normalize(Normal);
     vec3 viewDir = normalize(viewPosition - FragPos);
-    vec3 result = CalcDirLight(dirLight, normal, viewDir);
-    for(int i = 0; i < NUM_LIGHTS; i++)
+#ifdef LIGHTMAP
+    // static: only the sun's highlight is still lit live
+    vec3 halfwayDir = normalize(normalize(-dirLight.direction) + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
+    vec3 specular = dirLight.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
+    vec3 result = texture(lightmap, LightmapCoords).rgb * vec3(texture(material.texture_diffuse1, TexCoords))
+                + specular * SunShadow(FragPos, normal);
+#else
+    vec3 result = CalcDirLight(dirLight, normal, viewDir, SunShadow(FragPos, normal));
+#ifdef LAMPS
+    uvec2 lamps = LampList();
+    for(uint i = 0u; i < lamps.y; i++)
     {
-        result +=  CalcPointLight(pointLight[i], normal, FragPos, viewDir);
-        result += CalcSpotLight(spotLight[i], normal, FragPos, viewDir);
+        PointLight point = pointLight;
+        SpotLight spot = spotLight;
+        vec4 lamp = LampData(lamps, i);
+        point.position = spot.position = lamp.xyz;
+        result += CalcPointLight(point, normal, FragPos, viewDir);
+        result += CalcSpotLight(spot, normal, FragPos, viewDir) * SpotShadow(lamp.w, lamp.xyz, FragPos, normal);
     }
+#endif
+#endif
 
+#if defined(TRANSLUCENT) && !defined(ALPHA_TEST)
+    WriteTranslucent(result, opacity, distance(viewPosition, FragPos));
+#else
     FragColor = vec4(result, 1.0);
+#endif
 }
\ No newline at end of file
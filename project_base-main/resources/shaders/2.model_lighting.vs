@@ -6,15 +6,27 @@ layout (location = 2) in vec2 aTexCoords;
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
+#ifdef LIGHTMAP
+// baked lighting (Lightmaps.h): the draw's rectangle of the atlas, scale in xy and offset in zw
+layout (location = 5) in vec2 aLightmapCoords;
+uniform vec4 lightmapRect;
+out vec2 LightmapCoords;
+#endif
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// the depth pre-pass computes the same position, shading tests against it with GL_EQUAL
+invariant gl_Position;
+
 void main()
 {
     FragPos = vec3(model * vec4(aPos, 1.0));
     Normal = aNormal;
     TexCoords = aTexCoords;    
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+#ifdef LIGHTMAP
+    LightmapCoords = aLightmapCoords * lightmapRect.xy + lightmapRect.zw;
+#endif
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
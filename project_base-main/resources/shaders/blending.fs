@@ -3,50 +3,20 @@ out vec4 FragColor;
 
 in vec2 TexCoords;
 in vec3 FragPos;
+flat in float Kind;
 
-struct PointLight {
-    vec3 position;
+#include "include/lights.glsl"
+#include "include/sky_ambient.glsl"
+#include "include/lamp_lists.glsl"
+#include "include/spot_shadows.glsl"
+#include "include/sun_shadows.glsl"
+#include "include/vegetation.glsl"
 
-    vec3 specular;
-    vec3 diffuse;
-    vec3 ambient;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct DirLight {
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-#define NUM_LIGHTS 6
 uniform sampler2D texture1;
 uniform vec3 viewPosition;
-uniform PointLight pointLight[NUM_LIGHTS];
-uniform SpotLight spotLight[NUM_LIGHTS];
 uniform DirLight dirLight;
 
-vec4 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec4 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec4 texColor)
 {
     vec3 lightDir = normalize(light.position - fragPos);
     // diffuse shading
@@ -58,11 +28,7 @@ vec4 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     // float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
     // attenuation
     float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-    // blending
-    vec4 texColor = vec4(texture(texture1, TexCoords));
-    if(texColor.a < 0.1)
-        discard;
+    float attenuation = Attenuation(light, distance);
     // combine results
     vec4 ambient = vec4(light.ambient, 1.0) * texColor;
     vec4 diffuse = vec4(light.diffuse, 1.0) * diff * texColor;
@@ -73,7 +39,7 @@ vec4 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     return (ambient + diffuse + specular);
 }
 
-vec4 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec4 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec4 texColor)
  {
      vec3 lightDir = normalize(light.position - fragPos);
      // diffuse shading
@@ -83,15 +49,9 @@ vec4 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
      float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
      // attenuation
      float distance = length(light.position - fragPos);
-     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+     float attenuation = Attenuation(light, distance);
      // spotlight intensity
-     float theta = dot(lightDir, normalize(-light.direction));
-     float epsilon = light.cutOff - light.outerCutOff;
-     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
-     // blending
-     vec4 texColor = vec4(texture(texture1, TexCoords));
-     if(texColor.a < 0.1)
-         discard;
+     float intensity = SpotIntensity(light, lightDir);
      // combine results
      vec4 ambient = vec4(light.ambient, 1.0) * texColor;
      vec4 diffuse = vec4(light.diffuse, 1.0) * diff * texColor;
@@ -102,7 +62,8 @@ vec4 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
      return (ambient + diffuse + specular);
  }
 
-vec4 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+// shadow scales the color of everything but the ambient term
+vec4 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec4 texColor, float shadow)
 {
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
@@ -112,27 +73,40 @@ vec4 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
     // vec3 reflectDir = reflect(-lightDir, normal);
     // float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-    vec4 texColor = vec4(texture(texture1, TexCoords));
-    if(texColor.a < 0.1)
-        discard;
     // combine results
-    vec4 ambient = vec4(light.ambient, 1.0) * texColor;
+    vec4 ambient = vec4(SkyAmbient(normal), 1.0) * texColor;
     vec4 diffuse = vec4(light.diffuse, 1.0) * diff * texColor;
     vec4 specular = vec4(light.specular, 1.0) * spec * texColor;
-    return (ambient + diffuse + specular);
+    vec4 direct = diffuse + specular;
+    direct.rgb *= shadow;
+    return (ambient + direct);
 }
 
 
 void main()
 {
+    // the plant's color is looked up and alpha tested once, before any of the lights
+    vec4 texColor = VegetationColor(texture1, TexCoords, Kind);
+    if (VegetationClear(texColor.a))
+        discard;
     vec3 normal = vec3(0.0f, 1.0f, 0.0f);
     vec3 viewDir = normalize(viewPosition - FragPos);
-    vec4 result = CalcDirLight(dirLight, normal, viewDir);
-    for(int i = 0; i < 6; i++)
+    vec4 result = CalcDirLight(dirLight, normal, viewDir, texColor, SunShadow(FragPos, normal));
+#ifdef LAMPS
+    uvec2 lamps = LampList();
+    for(uint i = 0u; i < lamps.y; i++)
     {
-        result += CalcPointLight(pointLight[i], normal, FragPos, viewDir);
-        result += CalcSpotLight(spotLight[i], normal, FragPos, viewDir);
+        PointLight point = pointLight;
+        SpotLight spot = spotLight;
+        vec4 lamp = LampData(lamps, i);
+        point.position = spot.position = lamp.xyz;
+        result += CalcPointLight(point, normal, FragPos, viewDir, texColor);
+        result += CalcSpotLight(spot, normal, FragPos, viewDir, texColor) *
+                  SpotShadow(lamp.w, lamp.xyz, FragPos, normal);
     }
+#endif
 
+    // the coverage alpha to coverage turns into samples
+    result.a = texColor.a;
     FragColor = result;
 }
\ No newline at end of file
@@ -0,0 +1,101 @@
+#version 330 core
+out vec4 FragColor;
+
+#include "include/lights.glsl"
+#include "include/sky_ambient.glsl"
+// always compiled in, sunShadowCascades is 0 while the shadows are off
+#include "include/sun_shadows.glsl"
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormalTint;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+uniform vec3 viewPosition;
+// the sun pass, otherwise one lamp: the point and spot light at its position
+uniform bool sun;
+uniform DirLight dirLight;
+uniform PointLight pointLight;
+uniform SpotLight spotLight;
+
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, vec3 specularColor)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = Attenuation(light, distance);
+    // combine results
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * diff * albedo;
+    vec3 specular = light.specular * spec * specularColor;
+    return (ambient + diffuse + specular) * attenuation;
+}
+
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, vec3 specularColor)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = Attenuation(light, distance);
+    // spotlight intensity
+    float intensity = SpotIntensity(light, lightDir);
+    // combine results
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * diff * albedo;
+    vec3 specular = light.specular * spec * specularColor;
+    return (ambient + diffuse + specular) * attenuation * intensity;
+}
+
+// shadow scales everything but the ambient term
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 albedo, vec3 specularColor, float shadow)
+{
+    vec3 lightDir = normalize(-light.direction);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
+    // combine results
+    vec3 ambient = SkyAmbient(normal) * albedo;
+    vec3 diffuse = light.diffuse * diff * albedo;
+    vec3 specular = light.specular * spec * specularColor;
+    return (ambient + (diffuse + specular) * shadow);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    // nothing was drawn here, the sky fills it later
+    if (depth == 1.0)
+        discard;
+    // world position back from the depth buffer
+    vec2 uv = gl_FragCoord.xy / vec2(textureSize(gDepth, 0));
+    vec4 position = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec3 fragPos = position.xyz / position.w;
+
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    vec4 normalTint = texelFetch(gNormalTint, pixel, 0);
+    vec3 albedo = albedoSpecular.rgb;
+    // the specular map's intensity, or the albedo itself for the road and the bushes
+    vec3 specularColor = mix(vec3(albedoSpecular.a), albedo, normalTint.w);
+    vec3 normal = normalize(normalTint.xyz);
+    vec3 viewDir = normalize(viewPosition - fragPos);
+
+    vec3 result;
+    if (sun)
+        result = CalcDirLight(dirLight, normal, viewDir, albedo, specularColor, SunShadow(fragPos, normal));
+    else
+        result = CalcPointLight(pointLight, normal, fragPos, viewDir, albedo, specularColor)
+               + CalcSpotLight(spotLight, normal, fragPos, viewDir, albedo, specularColor);
+    FragColor = vec4(result, 1.0);
+}
@@ -0,0 +1,32 @@
+#version 330 core
+
+in vec2 TexCoords;
+#ifdef SCATTERED
+flat in float Kind;
+// only its alpha is used, as coverage; color writes are off
+out vec4 FragColor;
+#endif
+
+// ALPHA_TEST: the variant for the bushes' shadows; SCATTERED: the plants of a VegetationField, drawn with
+// vegetation.vs
+uniform sampler2D texture1;
+#include "include/lod_fade.glsl"
+#ifdef SCATTERED
+// the same alpha test as their shading
+#include "include/vegetation.glsl"
+#endif
+
+void main()
+{
+    if (LodFadedOut())
+        discard;
+#ifdef SCATTERED
+    float alpha = VegetationColor(texture1, TexCoords, Kind).a;
+    if (VegetationClear(alpha))
+        discard;
+    FragColor = vec4(0.0, 0.0, 0.0, alpha);
+#elif defined(ALPHA_TEST)
+    if (texture(texture1, TexCoords).a < 0.1)
+        discard;
+#endif
+}
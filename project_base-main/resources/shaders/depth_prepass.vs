@@ -1,17 +1,19 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+// only the bushes' quad provides texture coordinates, in the slot blending.vs reads them from
 layout (location = 1) in vec2 aTexCoords;
 
 out vec2 TexCoords;
-out vec3 FragPos;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// must match the lighting shaders exactly, they test against this depth with GL_EQUAL
+invariant gl_Position;
+
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
     TexCoords = aTexCoords;
     gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+}
@@ -0,0 +1,24 @@
+#version 330 core
+layout (location = 0) out vec4 AlbedoSpecular;
+layout (location = 1) out vec4 NormalTint;
+
+struct Material {
+    sampler2D texture_diffuse1;
+    sampler2D texture_specular1;
+};
+
+in vec2 TexCoords;
+in vec3 Normal;
+
+uniform Material material;
+#include "include/lod_fade.glsl"
+
+void main()
+{
+    if (LodFadedOut())
+        discard;
+    AlbedoSpecular = vec4(texture(material.texture_diffuse1, TexCoords).rgb,
+                          texture(material.texture_specular1, TexCoords).r);
+    // specular from the specular map, not tinted by the albedo
+    NormalTint = vec4(normalize(Normal), 0.0);
+}
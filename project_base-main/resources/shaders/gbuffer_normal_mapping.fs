@@ -0,0 +1,38 @@
+#version 330 core
+layout (location = 0) out vec4 AlbedoSpecular;
+layout (location = 1) out vec4 NormalTint;
+
+// drawn with normal_mapping.vs, the same tangent frame as the forward road
+in VS_OUT {
+    vec3 FragPos;
+    vec2 TexCoords;
+    vec3 Tangent;
+    vec3 Normal;
+} fs_in;
+
+#include "include/parallax.glsl"
+
+uniform sampler2D diffuseMap;
+uniform sampler2D normalMap;
+uniform vec3 viewPos;
+
+void main()
+{
+    vec3 N = normalize(fs_in.Normal);
+    vec3 T = normalize(fs_in.Tangent - dot(fs_in.Tangent, N) * N);
+    mat3 TBN = mat3(T, cross(N, T), N);
+
+    vec2 texCoords = fs_in.TexCoords;
+#ifdef PARALLAX
+    // the parallax march wants the view direction in tangent space
+    vec3 toView = viewPos - fs_in.FragPos;
+    texCoords = Parallax(fs_in.TexCoords, transpose(TBN) * normalize(toView), length(toView));
+#endif
+
+    vec2 dx = dFdx(fs_in.TexCoords);
+    vec2 dy = dFdy(fs_in.TexCoords);
+    vec3 normal = normalize(textureGrad(normalMap, texCoords, dx, dy).rgb * 2.0 - 1.0);
+    // lit like normal_mapping.fs: the specular is tinted by the diffuse map
+    AlbedoSpecular = vec4(textureGrad(diffuseMap, texCoords, dx, dy).rgb, 1.0);
+    NormalTint = vec4(normalize(TBN * normal), 1.0);
+}
@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) out vec4 AlbedoSpecular;
+layout (location = 1) out vec4 NormalTint;
+
+in vec2 TexCoords;
+in vec3 FragPos;
+flat in float Kind;
+
+uniform sampler2D texture1;
+// drawn with alphaToCoverage off, the G-buffer is not multisampled
+#include "include/vegetation.glsl"
+
+void main()
+{
+    vec4 texColor = VegetationColor(texture1, TexCoords, Kind);
+    if (VegetationClear(texColor.a))
+        discard;
+    // lit like blending.fs: an upward normal and the specular tinted by the texture
+    AlbedoSpecular = vec4(texColor.rgb, 1.0);
+    NormalTint = vec4(0.0, 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,16 @@
+#version 330 core
+
+// the finer level, bound as the texture's only level
+uniform sampler2D depthLevel;
+
+// every texel keeps the farthest depth of the 2x2 texels below it
+void main()
+{
+    ivec2 last = textureSize(depthLevel, 0) - 1;
+    ivec2 texel = ivec2(gl_FragCoord.xy) * 2;
+    float d0 = texelFetch(depthLevel, min(texel, last), 0).r;
+    float d1 = texelFetch(depthLevel, min(texel + ivec2(1, 0), last), 0).r;
+    float d2 = texelFetch(depthLevel, min(texel + ivec2(0, 1), last), 0).r;
+    float d3 = texelFetch(depthLevel, min(texel + ivec2(1, 1), last), 0).r;
+    gl_FragDepth = max(max(d0, d1), max(d2, d3));
+}
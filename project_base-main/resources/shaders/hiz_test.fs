@@ -0,0 +1,6 @@
+#version 330 core
+
+// never runs, the test draws with rasterization discarded
+void main()
+{
+}
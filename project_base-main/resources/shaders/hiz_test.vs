@@ -0,0 +1,51 @@
+#version 330 core
+layout (location = 0) in vec3 aCenter;
+layout (location = 1) in vec3 aExtents;
+
+uniform mat4 viewProjection;
+uniform sampler2D hiZ;
+uniform int hiZLevels;
+
+// captured with transform feedback, 1 when the box may be visible
+flat out int visible;
+
+void main()
+{
+    gl_Position = vec4(0.0);
+
+    // screen rectangle and nearest depth of the box
+    vec3 ndcMin = vec3(1e30);
+    vec3 ndcMax = vec3(-1e30);
+    for (int i = 0; i < 8; i++)
+    {
+        vec3 corner = aCenter + aExtents * vec3((i & 1) != 0 ? 1.0 : -1.0,
+                                                (i & 2) != 0 ? 1.0 : -1.0,
+                                                (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = viewProjection * vec4(corner, 1.0);
+        // boxes reaching behind the camera are never occluded
+        if (clip.w <= 0.0)
+        {
+            visible = 1;
+            return;
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc);
+        ndcMax = max(ndcMax, ndc);
+    }
+    vec2 uvMin = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0);
+    vec2 uvMax = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0);
+    float nearest = ndcMin.z * 0.5 + 0.5;
+
+    // the level at which the rectangle spans at most 2x2 texels
+    vec2 size = (uvMax - uvMin) * vec2(textureSize(hiZ, 0));
+    int level = clamp(int(ceil(log2(max(max(size.x, size.y), 1.0)))), 0, hiZLevels - 1);
+    ivec2 levelSize = textureSize(hiZ, level);
+    ivec2 texelMin = clamp(ivec2(uvMin * vec2(levelSize)), ivec2(0), levelSize - 1);
+    ivec2 texelMax = clamp(ivec2(uvMax * vec2(levelSize)), ivec2(0), levelSize - 1);
+
+    float farthest = 0.0;
+    for (int y = texelMin.y; y <= texelMax.y; y++)
+        for (int x = texelMin.x; x <= texelMax.x; x++)
+            farthest = max(farthest, texelFetch(hiZ, ivec2(x, y), level).r);
+    visible = nearest <= farthest ? 1 : 0;
+}
@@ -0,0 +1,45 @@
+#version 330 core
+out vec4 FragColor;
+
+#include "include/lights.glsl"
+#include "include/sky_ambient.glsl"
+
+in vec2 TexCoords;
+in vec3 Normal;
+in vec3 FragPos;
+flat in vec4 Tile;
+
+#define NUM_LIGHTS 6
+uniform PointLight pointLight[NUM_LIGHTS];
+uniform SpotLight spotLight[NUM_LIGHTS];
+uniform DirLight dirLight;
+uniform sampler2D atlas;
+
+// repeat inside the source texture's tile; gradients come from the unwrapped coordinates so the
+// wrap does not jump to the smallest mip level
+vec3 Albedo()
+{
+    // half a texel of a 256 texel tile keeps bilinear taps inside it
+    float inset = 0.5 / 256.0;
+    vec2 uv = Tile.xy + Tile.zw * (inset + fract(TexCoords) * (1.0 - 2.0 * inset));
+    return textureGrad(atlas, uv, dFdx(TexCoords) * Tile.zw, dFdy(TexCoords) * Tile.zw).rgb;
+}
+
+// proxies only show up far away: ambient and diffuse only, like the impostors
+void main()
+{
+    vec3 normal = normalize(Normal);
+    vec3 light = SkyAmbient(normal) + dirLight.diffuse * max(dot(normal, normalize(-dirLight.direction)), 0.0);
+    for (int i = 0; i < NUM_LIGHTS; i++)
+    {
+        vec3 lightDir = normalize(pointLight[i].position - FragPos);
+        float attenuation = Attenuation(pointLight[i], length(pointLight[i].position - FragPos));
+        light += (pointLight[i].ambient + pointLight[i].diffuse * max(dot(normal, lightDir), 0.0)) * attenuation;
+
+        lightDir = normalize(spotLight[i].position - FragPos);
+        attenuation = Attenuation(spotLight[i], length(spotLight[i].position - FragPos)) *
+                      SpotIntensity(spotLight[i], lightDir);
+        light += (spotLight[i].ambient + spotLight[i].diffuse * max(dot(normal, lightDir), 0.0)) * attenuation;
+    }
+    FragColor = vec4(light * Albedo(), 1.0);
+}
@@ -0,0 +1,28 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec4 aTile;
+
+out vec2 TexCoords;
+out vec3 Normal;
+out vec3 FragPos;
+flat out vec4 Tile;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// the depth pre-pass computes the same position, shading tests against it with GL_EQUAL
+invariant gl_Position;
+
+// proxies are merged in world space; model stays the identity and only keeps the position
+// expression identical to the pre-pass
+void main()
+{
+    FragPos = aPos;
+    Normal = aNormal;
+    TexCoords = aTexCoords;
+    Tile = aTile;
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
@@ -0,0 +1,48 @@
+#version 330 core
+out vec4 FragColor;
+
+#include "include/lights.glsl"
+#include "include/sky_ambient.glsl"
+
+in vec2 TexCoords;
+in vec3 FragPos;
+in vec3 FrameOffset;
+
+#define NUM_LIGHTS 6
+uniform PointLight pointLight[NUM_LIGHTS];
+uniform SpotLight spotLight[NUM_LIGHTS];
+uniform DirLight dirLight;
+uniform mat4 viewProjection;
+uniform sampler2D albedoAtlas;
+uniform sampler2D normalDepthAtlas;
+
+// impostors are far away: ambient and diffuse only, specular highlights are below a pixel anyway
+void main()
+{
+    // clear outside the baked silhouette and in the model's cut-out texels
+    vec4 albedo = texture(albedoAtlas, TexCoords);
+    if (albedo.a < 0.5)
+        discard;
+    vec4 normalDepth = texture(normalDepthAtlas, TexCoords);
+    // same convention as the model shader: model-space normals are used as they are
+    vec3 normal = normalize(normalDepth.xyz * 2.0 - 1.0);
+    vec3 surface = FragPos + FrameOffset * (normalDepth.a * 2.0 - 1.0);
+
+    vec3 light = SkyAmbient(normal) + dirLight.diffuse * max(dot(normal, normalize(-dirLight.direction)), 0.0);
+    for (int i = 0; i < NUM_LIGHTS; i++)
+    {
+        vec3 lightDir = normalize(pointLight[i].position - surface);
+        float attenuation = Attenuation(pointLight[i], length(pointLight[i].position - surface));
+        light += (pointLight[i].ambient + pointLight[i].diffuse * max(dot(normal, lightDir), 0.0)) * attenuation;
+
+        lightDir = normalize(spotLight[i].position - surface);
+        attenuation = Attenuation(spotLight[i], length(spotLight[i].position - surface)) *
+                      SpotIntensity(spotLight[i], lightDir);
+        light += (spotLight[i].ambient + spotLight[i].diffuse * max(dot(normal, lightDir), 0.0)) * attenuation;
+    }
+
+    // the baked depth puts the surface back where the mesh was, so impostors sit in the ground properly
+    vec4 clip = viewProjection * vec4(surface, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+    FragColor = vec4(light * albedo.rgb, 1.0);
+}
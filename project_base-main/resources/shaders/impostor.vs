@@ -0,0 +1,48 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;
+layout (location = 1) in mat4 aModel;
+
+out vec2 TexCoords;
+out vec3 FragPos;
+out vec3 FrameOffset;
+
+uniform mat4 viewProjection;
+uniform vec3 viewPosition;
+// model-space bounding sphere and the frames per side of the hemi-octahedral atlas
+uniform vec3 center;
+uniform float radius;
+uniform float frames;
+
+vec2 HemiOctEncode(vec3 d)
+{
+    d /= abs(d.x) + abs(d.y) + abs(d.z);
+    return vec2(d.x + d.z, d.x - d.z);
+}
+
+vec3 HemiOctDecode(vec2 e)
+{
+    vec2 xz = vec2(e.x + e.y, e.x - e.y) * 0.5;
+    return normalize(vec3(xz.x, 1.0 - abs(xz.x) - abs(xz.y), xz.y));
+}
+
+void main()
+{
+    // the frame baked closest to the viewing direction, seen from above the ground only
+    vec3 toViewer = (inverse(aModel) * vec4(viewPosition, 1.0)).xyz - center;
+    toViewer.y = max(toViewer.y, 0.0);
+    vec2 grid = clamp(floor((HemiOctEncode(normalize(toViewer + vec3(0.0, 1e-4, 0.0))) * 0.5 + 0.5) * frames),
+                      0.0, frames - 1.0);
+    vec3 frameDirection = HemiOctDecode((grid + 0.5) / frames * 2.0 - 1.0);
+
+    // the quad lies in the frame camera's image plane, so it faces the viewer to within one frame
+    vec3 forward = -frameDirection;
+    vec3 up = abs(frameDirection.y) > 0.999 ? vec3(0.0, 0.0, -1.0) : vec3(0.0, 1.0, 0.0);
+    vec3 side = normalize(cross(forward, up));
+    up = cross(side, forward);
+    vec3 local = center + (side * aCorner.x + up * aCorner.y) * radius;
+
+    TexCoords = (grid + aCorner * 0.5 + 0.5) / frames;
+    FragPos = vec3(aModel * vec4(local, 1.0));
+    FrameOffset = mat3(aModel) * frameDirection * radius;
+    gl_Position = viewProjection * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,24 @@
+#version 330 core
+layout (location = 0) out vec4 Albedo;
+layout (location = 1) out vec4 NormalDepth;
+
+struct Material {
+    sampler2D texture_diffuse1;
+    sampler2D texture_specular1;
+};
+
+in vec2 TexCoords;
+in vec3 Normal;
+in float Depth;
+
+uniform Material material;
+
+void main()
+{
+    // cut-out texels stay clear, at the alpha test's threshold of one half, so the atlas keeps the silhouette
+    vec4 albedo = texture(material.texture_diffuse1, TexCoords);
+    if (albedo.a < 0.5)
+        discard;
+    Albedo = albedo;
+    NormalDepth = vec4(normalize(Normal) * 0.5 + 0.5, clamp(Depth * 0.5 + 0.5, 0.0, 1.0));
+}
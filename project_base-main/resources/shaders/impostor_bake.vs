@@ -0,0 +1,24 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec2 TexCoords;
+out vec3 Normal;
+out float Depth;
+
+// orthographic camera of one atlas frame, in model space
+uniform mat4 projection;
+uniform mat4 view;
+uniform vec3 center;
+uniform vec3 frameDirection;
+uniform float radius;
+
+void main()
+{
+    Normal = aNormal;
+    TexCoords = aTexCoords;
+    // signed distance in front of the bounding sphere's center plane, in radii
+    Depth = dot(aPos - center, frameDirection) / radius;
+    gl_Position = projection * view * vec4(aPos, 1.0);
+}
@@ -0,0 +1,88 @@
+// The atmosphere of Atmosphere.h for the sky's passes (Sky.h): Rayleigh and Mie scattering and ozone
+// absorption, distances in kilometres from the planet's centre, a sun of unit illuminance.
+const float PI = 3.14159265;
+const float GROUND_RADIUS = 6360.0;
+const float TOP_RADIUS = 6460.0;
+const float VIEW_ALTITUDE = 0.2;
+const vec3 RAYLEIGH_SCATTERING = vec3(5.802e-3, 13.558e-3, 33.1e-3);
+const float RAYLEIGH_HEIGHT = 8.0;
+const float MIE_SCATTERING = 3.996e-3;
+const float MIE_EXTINCTION = 4.40e-3;
+const float MIE_HEIGHT = 1.2;
+const float MIE_G = 0.8;
+const vec3 OZONE_ABSORPTION = vec3(0.650e-3, 1.881e-3, 0.085e-3);
+const float GROUND_ALBEDO = 0.1;
+
+// scattering and extinction coefficients at an altitude
+void Medium(float altitude, out vec3 rayleigh, out float mie, out vec3 extinction)
+{
+    float mieDensity = exp(-altitude / MIE_HEIGHT);
+    float ozoneDensity = max(0.0, 1.0 - abs(altitude - 25.0) / 15.0);
+    rayleigh = RAYLEIGH_SCATTERING * exp(-altitude / RAYLEIGH_HEIGHT);
+    mie = MIE_SCATTERING * mieDensity;
+    extinction = rayleigh + MIE_EXTINCTION * mieDensity + OZONE_ABSORPTION * ozoneDensity;
+}
+
+float RayleighPhase(float cosTheta)
+{
+    return 3.0 / (16.0 * PI) * (1.0 + cosTheta * cosTheta);
+}
+
+// Cornette-Shanks
+float MiePhase(float cosTheta)
+{
+    float g2 = MIE_G * MIE_G;
+    float k = 3.0 / (8.0 * PI) * (1.0 - g2) / (2.0 + g2);
+    return k * (1.0 + cosTheta * cosTheta) / pow(1.0 + g2 - 2.0 * MIE_G * cosTheta, 1.5);
+}
+
+// along the ray from inside the atmosphere to its top
+float TopDistance(vec3 origin, vec3 direction)
+{
+    float b = dot(origin, direction);
+    float c = dot(origin, origin) - TOP_RADIUS * TOP_RADIUS;
+    return -b + sqrt(max(b * b - c, 0.0));
+}
+
+// along the ray to the ground, -1 when it misses
+float GroundDistance(vec3 origin, vec3 direction)
+{
+    float b = dot(origin, direction);
+    float c = dot(origin, origin) - GROUND_RADIUS * GROUND_RADIUS;
+    float discriminant = b * b - c;
+    if (discriminant < 0.0)
+        return -1.0;
+    float t = -b - sqrt(discriminant);
+    return t > 0.0 ? t : -1.0;
+}
+
+// Transmittance table coordinates (Bruneton's) of a point at radius r looking up at cos(zenith) mu:
+// x follows the distance to the top between its least and greatest, y the altitude
+vec2 TransmittanceUV(float r, float mu)
+{
+    float H = sqrt(TOP_RADIUS * TOP_RADIUS - GROUND_RADIUS * GROUND_RADIUS);
+    float rho = sqrt(max(r * r - GROUND_RADIUS * GROUND_RADIUS, 0.0));
+    float discriminant = r * r * (mu * mu - 1.0) + TOP_RADIUS * TOP_RADIUS;
+    float d = max(0.0, -r * mu + sqrt(max(discriminant, 0.0)));
+    float dMin = TOP_RADIUS - r;
+    float dMax = rho + H;
+    return vec2((d - dMin) / (dMax - dMin), rho / H);
+}
+
+// Sky-view table coordinates of a world direction: x the azimuth, y the elevation with the texels
+// bunched up at the horizon
+vec2 SkyViewUV(vec3 direction)
+{
+    float azimuth = atan(direction.z, direction.x);
+    float elevation = asin(clamp(direction.y, -1.0, 1.0));
+    float v = sign(elevation) * sqrt(abs(elevation) / (0.5 * PI));
+    return vec2(azimuth / (2.0 * PI) + 0.5, 0.5 * v + 0.5);
+}
+
+vec3 SkyViewDirection(vec2 uv)
+{
+    float azimuth = (uv.x - 0.5) * 2.0 * PI;
+    float v = uv.y * 2.0 - 1.0;
+    float elevation = sign(v) * v * v * 0.5 * PI;
+    return vec3(cos(elevation) * cos(azimuth), sin(elevation), cos(elevation) * sin(azimuth));
+}
@@ -0,0 +1,50 @@
+// Lamps of the forward shaders, compiled in with LAMPS (at night). Every lamp is the same point and
+// spot light at its own position; the positions come from the fragment's cluster (LightClusters.h)
+// or, with OBJECT_LIGHT_LISTS, from the list of the object being drawn (ObjectLights.h).
+// Needs lights.glsl.
+#ifdef LAMPS
+uniform PointLight pointLight;
+uniform SpotLight spotLight;
+uniform samplerBuffer clusterLamps;
+uniform usamplerBuffer clusterIndices;
+
+#ifdef OBJECT_LIGHT_LISTS
+// offset and count of the draw's list
+uniform uvec2 objectLights;
+#else
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 12
+#define CLUSTER_SLICES 24
+uniform usamplerBuffer clusterGrid;
+uniform vec2 clusterTileSize;
+uniform float clusterNear;
+uniform float clusterFar;
+uniform float clusterSliceScale;
+uniform float clusterSliceBias;
+#endif
+
+// offset and count of this fragment's lamp list
+uvec2 LampList()
+{
+#ifdef OBJECT_LIGHT_LISTS
+    return objectLights;
+#else
+    float ndcDepth = gl_FragCoord.z * 2.0 - 1.0;
+    float depth = 2.0 * clusterNear * clusterFar / (clusterFar + clusterNear - ndcDepth * (clusterFar - clusterNear));
+    int slice = clamp(int(floor(log(depth) * clusterSliceScale + clusterSliceBias)), 0, CLUSTER_SLICES - 1);
+    ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTileSize), ivec2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+    return texelFetch(clusterGrid, (slice * CLUSTER_TILES_Y + tile.y) * CLUSTER_TILES_X + tile.x).xy;
+#endif
+}
+
+// position in xyz, the lamp's spot shadow tile in w (-1 without one, see spot_shadows.glsl)
+vec4 LampData(uvec2 lamps, uint i)
+{
+    return texelFetch(clusterLamps, int(texelFetch(clusterIndices, int(lamps.x + i)).r));
+}
+
+vec3 LampPosition(uvec2 lamps, uint i)
+{
+    return LampData(lamps, i).xyz;
+}
+#endif
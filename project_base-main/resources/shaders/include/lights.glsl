@@ -0,0 +1,53 @@
+// light sources of the lighting shaders, set by setDirLight/setPointLight/setSpotLight/setLampLight
+struct DirLight {
+    vec3 direction;
+
+    // its ambient comes from the sky, include/sky_ambient.glsl
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+
+    vec3 specular;
+    vec3 diffuse;
+    vec3 ambient;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+float Attenuation(PointLight light, float distance)
+{
+    return 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+}
+
+float Attenuation(SpotLight light, float distance)
+{
+    return 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+}
+
+// soft edge between the inner and outer cone, lightDir points from the surface to the light
+float SpotIntensity(SpotLight light, vec3 lightDir)
+{
+    float theta = dot(lightDir, normalize(-light.direction));
+    float epsilon = light.cutOff - light.outerCutOff;
+    return clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+}
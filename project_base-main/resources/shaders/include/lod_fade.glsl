@@ -0,0 +1,19 @@
+// level of detail cross-fade: below 1 only a dithered share of the pixels is kept, the outgoing
+// level keeps the complement so the two never overlap
+uniform float lodFade = 1.0;
+uniform bool lodFadeIn = true;
+
+// 4x4 ordered dither threshold in (0, 1)
+float DitherThreshold()
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0,
+                                      3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[p.y * 4 + p.x] + 0.5) / 16.0;
+}
+
+// true for the pixels the other level of a cross-fade draws
+bool LodFadedOut()
+{
+    return lodFade < 1.0 && (DitherThreshold() < lodFade) != lodFadeIn;
+}
@@ -0,0 +1,79 @@
+// Parallax for the road, in the texture's tangent space. PARALLAX alone shifts the texture coordinates
+// once by the depth under them. PARALLAX_OCCLUSION marches the view ray down through the depth map,
+// in layers or, with CONE_STEP, in steps read from ConeStepMap.h. Fewer steps are taken the more
+// head-on the view and the farther the fragment, and past parallaxFade.y it is plain normal mapping.
+// The march is clamped to parallaxBounds, the quad's own texture rectangle, instead of discarding
+// what leaves it, so early depth testing stays on.
+
+uniform sampler2D depthMap;
+#ifdef CONE_STEP
+uniform sampler2D coneStepMap;
+#endif
+uniform float heightScale;
+// layers looking straight down and at grazing angles
+uniform vec2 parallaxLayers;
+// distance where the relief starts to flatten and where it is gone
+uniform vec2 parallaxFade;
+uniform vec4 parallaxBounds;
+
+// the depth map is a height map, white is high
+float ParallaxDepth(vec2 texCoords, vec2 dx, vec2 dy)
+{
+    return 1.0 - textureGrad(depthMap, texCoords, dx, dy).r;
+}
+
+// viewDir towards the eye in tangent space, normalized
+vec2 Parallax(vec2 texCoords, vec3 viewDir, float viewDistance)
+{
+    // before any branch, the gradients would be undefined inside one
+    vec2 dx = dFdx(texCoords);
+    vec2 dy = dFdy(texCoords);
+    float fade = 1.0 - smoothstep(parallaxFade.x, parallaxFade.y, viewDistance);
+    float scale = heightScale * fade;
+    if (scale <= 0.0)
+        return texCoords;
+
+#ifdef PARALLAX_OCCLUSION
+    // texture coordinates travelled per unit of depth along the ray
+    vec2 slope = viewDir.xy / max(viewDir.z, 0.05) * scale;
+    int steps = int(ceil(mix(parallaxLayers.y, parallaxLayers.x, clamp(viewDir.z, 0.0, 1.0)) * fade));
+    vec2 uv = texCoords;
+#ifdef CONE_STEP
+    // each step stays outside the cone of the texel under the ray, so it never ends up past the surface
+    float speed = length(slope);
+    float rayDepth = 0.0;
+    for (int i = 0; i < steps; i++)
+    {
+        vec2 cone = textureGrad(coneStepMap, uv, dx, dy).rg;
+        float advance = cone.y * max(cone.x - rayDepth, 0.0) / (speed + cone.y);
+        if (advance < 0.0005)
+            break;
+        uv -= slope * advance;
+        rayDepth += advance;
+    }
+#else
+    float layerDepth = 1.0 / float(max(steps, 1));
+    vec2 layerStep = slope * layerDepth;
+    float rayDepth = 0.0;
+    float surface = ParallaxDepth(uv, dx, dy);
+    float previous = surface;
+    for (int i = 0; i < steps && rayDepth < surface; i++)
+    {
+        uv -= layerStep;
+        rayDepth += layerDepth;
+        previous = surface;
+        surface = ParallaxDepth(uv, dx, dy);
+    }
+    // the surface crosses the ray between the last two layers, interpolate where
+    if (rayDepth > 0.0)
+    {
+        float after = surface - rayDepth;
+        float before = previous - (rayDepth - layerDepth);
+        uv += layerStep * clamp(after / min(after - before, -1e-5), 0.0, 1.0);
+    }
+#endif
+#else
+    vec2 uv = texCoords - viewDir.xy * (ParallaxDepth(texCoords, dx, dy) * scale);
+#endif
+    return clamp(uv, parallaxBounds.xy, parallaxBounds.zw);
+}
@@ -0,0 +1,13 @@
+// Ambient light from the sky (SphericalHarmonics.h): the atmosphere's order-2 spherical harmonics, convolved
+// with the cosine lobe and premultiplied on the CPU, set by setDirLight.
+uniform vec3 skyAmbient[9];
+
+// light reaching a surface facing the unit normal
+vec3 SkyAmbient(vec3 n)
+{
+    vec3 light = skyAmbient[0]
+               + skyAmbient[1] * n.y + skyAmbient[2] * n.z + skyAmbient[3] * n.x
+               + skyAmbient[4] * (n.x * n.y) + skyAmbient[5] * (n.y * n.z) + skyAmbient[6] * (3.0 * n.z * n.z - 1.0)
+               + skyAmbient[7] * (n.x * n.z) + skyAmbient[8] * (n.x * n.x - n.y * n.y);
+    return max(light, vec3(0.0));
+}
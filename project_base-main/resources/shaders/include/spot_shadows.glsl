@@ -0,0 +1,44 @@
+// Shadows of the lamps' spot lights (SpotShadows.h), compiled in with SPOT_SHADOWS. Every lamp looks
+// straight down through the same projection, so its view is the offset from the lamp with y and z
+// swapped; the tile comes with the lamp's position from LampData.
+#ifdef SPOT_SHADOWS
+uniform sampler2DShadow spotShadowAtlas;
+uniform mat4 spotShadowProjection;
+uniform float spotShadowTilesPerRow;
+// one texel of a tile, in the tile's own [0, 1] coordinates
+uniform float spotShadowTileTexel;
+
+// world units the receiver is pushed along its normal against acne, on top of the casters' polygon offset
+const float SPOT_SHADOW_NORMAL_OFFSET = 0.03;
+
+// share of the spot light that reaches the fragment, 3x3 hardware-filtered taps
+float SpotShadow(float tile, vec3 lampPosition, vec3 fragPos, vec3 normal)
+{
+    if (tile < 0.0)
+        return 1.0;
+    vec3 offset = fragPos + normal * SPOT_SHADOW_NORMAL_OFFSET - lampPosition;
+    vec4 clip = spotShadowProjection * vec4(offset.x, -offset.z, offset.y, 1.0);
+    if (clip.w <= 0.0)
+        return 1.0;
+    vec3 ndc = clip.xyz / clip.w;
+    if (abs(ndc.x) > 1.0 || abs(ndc.y) > 1.0 || ndc.z > 1.0)
+        return 1.0;
+    // the taps stay inside the tile, the neighbours belong to other lamps
+    vec2 uv = clamp(ndc.xy * 0.5 + 0.5, vec2(1.5 * spotShadowTileTexel), vec2(1.0 - 1.5 * spotShadowTileTexel));
+    vec2 cell = vec2(mod(tile, spotShadowTilesPerRow), floor(tile / spotShadowTilesPerRow));
+    float depth = ndc.z * 0.5 + 0.5;
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++)
+        for (int x = -1; x <= 1; x++)
+        {
+            vec2 tap = (cell + uv + vec2(x, y) * spotShadowTileTexel) / spotShadowTilesPerRow;
+            lit += texture(spotShadowAtlas, vec3(tap, depth));
+        }
+    return lit / 9.0;
+}
+#else
+float SpotShadow(float tile, vec3 lampPosition, vec3 fragPos, vec3 normal)
+{
+    return 1.0;
+}
+#endif
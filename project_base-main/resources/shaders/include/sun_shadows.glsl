@@ -0,0 +1,45 @@
+// Shadows of the sun (SunShadows.h), compiled in with SUN_SHADOWS. Each cascade is a window of light
+// space stored toroidally in one layer of the map: light-space texel k sits in texel k mod size, so the
+// repeat wrap does the addressing. The first cascade whose window holds the fragment is sampled.
+#ifdef SUN_SHADOWS
+const int SUN_SHADOW_CASCADES = 4;
+
+uniform sampler2DArrayShadow sunShadowMap;
+// the sun's view, a rotation only
+uniform mat4 sunShadowView;
+// light-space distance along the sunlight of the map's depth 0 and 1
+uniform vec2 sunShadowDepth;
+uniform float sunShadowMapSize;
+// cascades with a window, 0 while the shadows are off
+uniform int sunShadowCascades;
+// per cascade: the window in light space (min xy, max xy) and the world size of one texel
+uniform vec4 sunShadowWindow[SUN_SHADOW_CASCADES];
+uniform float sunShadowTexel[SUN_SHADOW_CASCADES];
+
+// share of the sunlight that reaches the fragment, 2x2 hardware-filtered taps
+float SunShadow(vec3 fragPos, vec3 normal)
+{
+    for (int i = 0; i < sunShadowCascades; i++)
+    {
+        // pushed along the normal by a texel and a half of this cascade against acne
+        vec3 light = (sunShadowView * vec4(fragPos + normal * (1.5 * sunShadowTexel[i]), 1.0)).xyz;
+        vec4 window = sunShadowWindow[i];
+        if (any(lessThan(light.xy, window.xy)) || any(greaterThan(light.xy, window.zw)))
+            continue;
+        vec2 uv = light.xy / (sunShadowTexel[i] * sunShadowMapSize);
+        float depth = (-light.z - sunShadowDepth.x) / (sunShadowDepth.y - sunShadowDepth.x);
+        float texel = 0.5 / sunShadowMapSize;
+        float lit = texture(sunShadowMap, vec4(uv + vec2(-texel, -texel), float(i), depth))
+                  + texture(sunShadowMap, vec4(uv + vec2(texel, -texel), float(i), depth))
+                  + texture(sunShadowMap, vec4(uv + vec2(-texel, texel), float(i), depth))
+                  + texture(sunShadowMap, vec4(uv + vec2(texel, texel), float(i), depth));
+        return lit * 0.25;
+    }
+    return 1.0;
+}
+#else
+float SunShadow(vec3 fragPos, vec3 normal)
+{
+    return 1.0;
+}
+#endif
@@ -0,0 +1,37 @@
+// Scattered plants (VegetationField.h): a bush from the bush texture or a procedural tuft of grass
+// blades, with one alpha test for the whole fragment shader.
+
+// drawn with GL_SAMPLE_ALPHA_TO_COVERAGE into a multisampled target, otherwise alpha tested at one half
+uniform bool alphaToCoverage;
+
+// uv.x across the quad, uv.y from its top (0) to the ground (1)
+vec4 GrassBlades(vec2 uv)
+{
+    const float BLADES = 5.0;
+    float height = 1.0 - uv.y;
+    float across = uv.x * BLADES;
+    float blade = floor(across);
+    float tip = 0.55 + 0.45 * fract(sin(blade * 12.9898 + 4.1) * 43758.5453);
+    // each blade narrows from its root to its tip, with an antialiased edge
+    float halfWidth = 0.45 * max(1.0 - height / tip, 0.0);
+    float alpha = clamp(0.5 + (halfWidth - abs(fract(across) - 0.5)) / max(fwidth(across), 1e-4), 0.0, 1.0);
+    vec3 color = mix(vec3(0.09, 0.2, 0.04), vec3(0.36, 0.46, 0.13), height / tip);
+    return vec4(color, alpha);
+}
+
+vec4 VegetationColor(sampler2D bushTexture, vec2 uv, float kind)
+{
+    return kind > 0.5 ? GrassBlades(uv) : texture(bushTexture, uv);
+}
+
+// The alpha test: true for a fragment to discard. With alpha to coverage the edge is sharpened to about
+// a pixel, so the samples covered follow it, and only clear fragments are dropped.
+bool VegetationClear(inout float alpha)
+{
+    if (alphaToCoverage)
+    {
+        alpha = clamp((alpha - 0.5) / max(fwidth(alpha), 1e-4) + 0.5, 0.0, 1.0);
+        return alpha <= 0.0;
+    }
+    return alpha < 0.5;
+}
@@ -0,0 +1,20 @@
+// Weighted blended order-independent transparency (WeightedBlendedOIT.h). Every translucent fragment
+// adds its premultiplied color and alpha, weighted, to FragColor and its optical depth to Revealage;
+// both targets blend with GL_ONE, GL_ONE.
+layout (location = 1) out float Revealage;
+
+// McGuire and Bavoil's weight by view distance: near surfaces win over far ones where they overlap,
+// and an opaque one almost hides what it covers
+float TranslucentWeight(float alpha, float viewDistance)
+{
+    float d = viewDistance;
+    return alpha * clamp(10.0 / (1e-5 + pow(d / 5.0, 2.0) + pow(d / 200.0, 6.0)), 1e-2, 3e3);
+}
+
+void WriteTranslucent(vec3 color, float alpha, float viewDistance)
+{
+    alpha = min(alpha, 0.999);
+    FragColor = vec4(color * alpha, alpha) * TranslucentWeight(alpha, viewDistance);
+    // summed, -log(1 - a) turns back into the product of (1 - a) through exp when compositing
+    Revealage = -log(1.0 - alpha);
+}
@@ -1,75 +1,37 @@
 #version 330 core
 out vec4 FragColor;
 
-#define NUM_LIGHTS 6
 in VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
-    vec3 TangentLightPos[NUM_LIGHTS];
-    vec3 TangentViewPos[NUM_LIGHTS];
-    vec3 TangentFragPos[NUM_LIGHTS];
+    vec3 Tangent;
+    vec3 Normal;
+#ifdef LIGHTMAP
+    vec2 LightmapCoords;
+#endif
 } fs_in;
 
-struct LightsPos {
-    vec3 direction[NUM_LIGHTS];
-};
-
-struct DirLight {
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct PointLight {
-    vec3 position;
-
-    vec3 specular;
-    vec3 diffuse;
-    vec3 ambient;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
+#include "include/lights.glsl"
+#include "include/sky_ambient.glsl"
+#include "include/lamp_lists.glsl"
+#include "include/spot_shadows.glsl"
+#include "include/sun_shadows.glsl"
+#include "include/parallax.glsl"
 
 uniform sampler2D diffuseMap;
 uniform sampler2D normalMap;
-uniform sampler2D depthMap;
 uniform DirLight dirLight;
-uniform PointLight pointLight[NUM_LIGHTS];
-uniform SpotLight spotLight[NUM_LIGHTS];
-uniform LightsPos lightPos;
 uniform vec3 viewPos;
-uniform float heightScale;
-
+#ifdef LIGHTMAP
+// ambient, diffuse light and first bounce of every light, baked for the surface without its normal map
+uniform sampler2D lightmap;
+#endif
 
-vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
-{
-    float height =  texture(depthMap, texCoords).r;
-    return texCoords - viewDir.xy * (height * heightScale);
-}
-
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 viewDir, int i, vec2 texCoords)
+// every light is evaluated in world space, with the normal map's normal moved there once
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 viewDir, vec3 color)
 {
     // diffuse
-    vec3 lightDir = normalize(fs_in.TangentLightPos[i] - fs_in.TangentFragPos[i]);
+    vec3 lightDir = normalize(light.position - fs_in.FragPos);
     float diff = max(dot(lightDir, normal), 0.0);
 
     // specular shading
@@ -77,10 +39,8 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 viewDir, int i, vec2 tex
     float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
 
     // attenuation
-    float distance = length(light.position - fs_in.TangentFragPos[i]);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-    // vec3 color = texture(diffuseMap, fs_in.TexCoords).rgb;
-    vec3 color = texture(diffuseMap, texCoords).rgb;
+    float distance = length(light.position - fs_in.FragPos);
+    float attenuation = Attenuation(light, distance);
 
     // combine results
     vec3 ambient = light.ambient * color;
@@ -92,28 +52,24 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 viewDir, int i, vec2 tex
     return (ambient + diffuse + specular);
 }
 
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 viewDir, int i, vec2 texCoords)
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 viewDir, vec3 color)
  {
-     vec3 lightDir = normalize(fs_in.TangentLightPos[i] - fs_in.TangentFragPos[i]);
+     vec3 lightDir = normalize(light.position - fs_in.FragPos);
      // diffuse shading
      float diff = max(dot(normal, lightDir), 0.0);
      // specular shading
      vec3 halfwayDir = normalize(lightDir + viewDir);
      float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
      // attenuation
-     float distance = length(light.position - fs_in.TangentFragPos[i]);
-     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+     float distance = length(light.position - fs_in.FragPos);
+     float attenuation = Attenuation(light, distance);
      // spotlight intensity
-     float theta = dot(lightDir, normalize(-light.direction));
-     float epsilon = light.cutOff - light.outerCutOff;
-     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
-     // vec3 texColor = vec3(texture(diffuseMap, fs_in.TexCoords));
-     vec3 texColor = texture(diffuseMap, texCoords).rgb;
+     float intensity = SpotIntensity(light, lightDir);
 
      // combine results
-     vec3 ambient = light.ambient * texColor;
-     vec3 diffuse = light.diffuse * diff * texColor;
-     vec3 specular = light.specular * spec * texColor;
+     vec3 ambient = light.ambient * color;
+     vec3 diffuse = light.diffuse * diff * color;
+     vec3 specular = light.specular * spec * color;
      ambient *= attenuation * intensity;
      diffuse *= attenuation * intensity;
      specular *= attenuation * intensity;
@@ -121,7 +77,8 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 viewDir, int i, vec2 texCo
  }
 
 
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec2 texCoords)
+// shadow scales everything but the ambient term
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 color, float shadow)
 {
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
@@ -131,40 +88,61 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec2 texCoords)
     vec3 halfwayDir = normalize(lightDir + viewDir);
     float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
 
-    // get diffuse color
-    // vec3 color = texture(diffuseMap, fs_in.TexCoords).rgb;
-    vec3 color = texture(diffuseMap, texCoords).rgb;
     // ambient
-    vec3 ambient = light.ambient * color;
+    vec3 ambient = SkyAmbient(normal) * color;
     vec3 diffuse = light.diffuse * diff * color;
     vec3 specular = light.specular * spec * color;
 
-    return (ambient + diffuse + specular);
+    return (ambient + (diffuse + specular) * shadow);
 }
 
 void main()
 {
-     // obtain normal from normal map in range [0,1]
-    vec3 normal = texture(normalMap, fs_in.TexCoords).rgb;
-    // transform normal vector to range [-1,1]
-    normal = normalize(normal * 2.0 - 1.0);  // this normal is in tangent space
-    // result
-    vec3 viewDir = normalize(viewPos - fs_in.FragPos);
-
+    // tangent space to world space, the bitangent rebuilt from the interpolated tangent and normal
+    vec3 N = normalize(fs_in.Normal);
+    vec3 T = normalize(fs_in.Tangent - dot(fs_in.Tangent, N) * N);
+    mat3 TBN = mat3(T, cross(N, T), N);
+    vec3 toView = viewPos - fs_in.FragPos;
+    vec3 viewDir = normalize(toView);
 
     vec2 texCoords = fs_in.TexCoords;
-    texCoords = ParallaxMapping(fs_in.TexCoords,  viewDir);
-    if(texCoords.x > 7.5 || texCoords.y > 7.5 || texCoords.x < 0.0 || texCoords.y < 0.0)
-        discard;
-
-    vec3 result = CalcDirLight(dirLight, normal, viewDir, texCoords);
-    for(int i = 0; i < NUM_LIGHTS; i++)
+#ifdef PARALLAX
+    // the parallax march wants the view direction in tangent space
+    texCoords = Parallax(fs_in.TexCoords, transpose(TBN) * viewDir, length(toView));
+#endif
+
+    // with the gradients of the unshifted coordinates, the march's steps would show as mip seams
+    vec2 dx = dFdx(fs_in.TexCoords);
+    vec2 dy = dFdy(fs_in.TexCoords);
+     // obtain normal from normal map in range [0,1]
+    vec3 normal = textureGrad(normalMap, texCoords, dx, dy).rgb;
+    // transform normal vector to range [-1,1], then from tangent to world space
+    normal = normalize(TBN * (normal * 2.0 - 1.0));
+    vec3 color = textureGrad(diffuseMap, texCoords, dx, dy).rgb;
+
+#ifdef LIGHTMAP
+    // static: only the sun's highlight is still lit live, over the mapped normal
+    vec3 halfwayDir = normalize(normalize(-dirLight.direction) + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
+    vec3 result = texture(lightmap, fs_in.LightmapCoords).rgb * color
+                + dirLight.specular * spec * color * SunShadow(fs_in.FragPos, N);
+#else
+    vec3 result = CalcDirLight(dirLight, normal, viewDir, color, SunShadow(fs_in.FragPos, N));
+#ifdef LAMPS
+    uvec2 lamps = LampList();
+    for(uint i = 0u; i < lamps.y; i++)
     {
-        viewDir = normalize(fs_in.TangentViewPos[i] - fs_in.TangentFragPos[i]);
-
-        result += CalcPointLight(pointLight[i], normal, viewDir, i, texCoords);
-        result +=  CalcSpotLight(spotLight[i], normal, viewDir, i, texCoords);
+        PointLight point = pointLight;
+        SpotLight spot = spotLight;
+        vec4 lamp = LampData(lamps, i);
+        point.position = spot.position = lamp.xyz;
+
+        result += CalcPointLight(point, normal, viewDir, color);
+        // offset along the surface's own normal, the mapped one wobbles
+        result +=  CalcSpotLight(spot, normal, viewDir, color) * SpotShadow(lamp.w, lamp.xyz, fs_in.FragPos, N);
     }
+#endif
+#endif
 
     FragColor = vec4(result, 1.0);
-}
\ No newline at end of file
+}
@@ -5,45 +5,41 @@ layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aTangent;
 layout (location = 4) in vec3 aBitangent;
 
-#define NUM_LIGHTS 6
+// one world-space tangent frame, the fragment shader rebuilds the bitangent and lights in world space
 out VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
-    vec3 TangentLightPos[NUM_LIGHTS];
-    vec3 TangentViewPos[NUM_LIGHTS];
-    vec3 TangentFragPos[NUM_LIGHTS];
+    vec3 Tangent;
+    vec3 Normal;
+#ifdef LIGHTMAP
+    vec2 LightmapCoords;
+#endif
 } vs_out;
 
-
-struct LightsPos {
-    vec3 direction[NUM_LIGHTS];
-};
+#ifdef LIGHTMAP
+// baked lighting (Lightmaps.h): the draw's rectangle of the atlas, scale in xy and offset in zw
+layout (location = 5) in vec2 aLightmapCoords;
+uniform vec4 lightmapRect;
+#endif
 
 uniform mat4 projection;
 uniform mat4 view;
 uniform mat4 model;
 
-uniform LightsPos lightPos;
-uniform vec3 viewPos;
+// the depth pre-pass computes the same position, shading tests against it with GL_EQUAL
+invariant gl_Position;
 
 void main()
 {
     vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
     vs_out.TexCoords = aTexCoords;
+#ifdef LIGHTMAP
+    vs_out.LightmapCoords = aLightmapCoords * lightmapRect.xy + lightmapRect.zw;
+#endif
 
     mat3 normalMatrix = transpose(inverse(mat3(model)));
-    vec3 T = normalize(normalMatrix * aTangent);
-    vec3 N = normalize(normalMatrix * aNormal);
-    T = normalize(T - dot(T, N) * N);
-    vec3 B = cross(N, T);
-
-    mat3 TBN = transpose(mat3(T, B, N));
-    for(int i = 0; i < NUM_LIGHTS; i++)
-    {
-        vs_out.TangentLightPos[i] = TBN * lightPos.direction[i];
-        vs_out.TangentViewPos[i]  = TBN * viewPos;
-        vs_out.TangentFragPos[i]  = TBN * vs_out.FragPos;
-    }
+    vs_out.Tangent = normalMatrix * aTangent;
+    vs_out.Normal = normalMatrix * aNormal;
 
     gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+}
@@ -0,0 +1,21 @@
+#version 330 core
+out vec4 FragColor;
+
+// weighted premultiplied color and alpha, and the summed optical depth of the translucent surfaces
+uniform sampler2D accumulation;
+uniform sampler2D revealage;
+
+// blended over the opaque image with GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    // the share of the opaque image that still shows through all the layers
+    float revealed = exp(-texelFetch(revealage, texel, 0).r);
+    if (revealed > 0.999)
+        discard;
+    vec4 accumulated = texelFetch(accumulation, texel, 0);
+    // the weighted average color of the layers; a huge sum overflows half floats to infinity
+    if (isinf(max(max(accumulated.r, accumulated.g), max(accumulated.b, accumulated.a))))
+        accumulated.rgb = vec3(accumulated.a);
+    FragColor = vec4(accumulated.rgb / max(accumulated.a, 1e-5), 1.0 - revealed);
+}
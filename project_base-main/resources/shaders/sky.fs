@@ -0,0 +1,46 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 ScreenUV;
+
+#include "include/atmosphere.glsl"
+
+uniform sampler2D skyViewTable;
+uniform sampler2D transmittanceTable;
+// of the view without its translation
+uniform mat4 inverseViewProjection;
+// towards the sun, the moon is opposite
+uniform vec3 sunDirection;
+uniform float exposure;
+// how far into the night it is, for the moon, the stars and the moonlit sky's color
+uniform float night;
+uniform vec3 nightColor;
+
+void main()
+{
+    vec4 world = inverseViewProjection * vec4(ScreenUV * 2.0 - 1.0, 1.0, 1.0);
+    vec3 direction = normalize(world.xyz / world.w);
+    vec3 light = texture(skyViewTable, SkyViewUV(direction)).rgb;
+
+    // the sun's disc, dimmed by the air in front of it
+    float r = GROUND_RADIUS + VIEW_ALTITUDE;
+    vec3 origin = vec3(0.0, r, 0.0);
+    bool aboveGround = GroundDistance(origin, direction) < 0.0;
+    float disc = smoothstep(0.99996, 0.99998, dot(direction, sunDirection));
+    if (aboveGround)
+        light += disc * 20.0 * texture(transmittanceTable, TransmittanceUV(r, direction.y)).rgb;
+
+    // a simple exponential curve keeps the bright horizon and the sun from clipping
+    vec3 color = 1.0 - exp(-light * exposure);
+
+    if (night > 0.0 && aboveGround)
+    {
+        float moon = smoothstep(0.99990, 0.99993, dot(direction, -sunDirection));
+        // a star in a few cells of a grid over the sphere
+        vec3 cell = floor(direction * 400.0);
+        float hash = fract(sin(dot(cell, vec3(12.9898, 78.233, 45.164))) * 43758.5453);
+        float star = step(0.998, hash) * fract(hash * 613.0);
+        color += night * (nightColor + vec3(0.9, 0.9, 0.8) * moon + vec3(star) * smoothstep(0.0, 0.2, direction.y));
+    }
+    FragColor = vec4(color, 1.0);
+}
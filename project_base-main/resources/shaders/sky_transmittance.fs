@@ -0,0 +1,34 @@
+#version 330 core
+out vec4 FragColor;
+
+#include "include/atmosphere.glsl"
+
+uniform vec2 tableSize;
+
+// share of the light that crosses the atmosphere from every altitude and zenith angle, rendered once
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / tableSize;
+    // TransmittanceUV backwards
+    float H = sqrt(TOP_RADIUS * TOP_RADIUS - GROUND_RADIUS * GROUND_RADIUS);
+    float rho = H * uv.y;
+    float r = sqrt(rho * rho + GROUND_RADIUS * GROUND_RADIUS);
+    float dMin = TOP_RADIUS - r;
+    float dMax = rho + H;
+    float d = dMin + uv.x * (dMax - dMin);
+    float mu = d == 0.0 ? 1.0 : clamp((H * H - rho * rho - d * d) / (2.0 * r * d), -1.0, 1.0);
+
+    const int STEPS = 40;
+    vec3 origin = vec3(0.0, r, 0.0);
+    vec3 direction = vec3(sqrt(1.0 - mu * mu), mu, 0.0);
+    float dt = TopDistance(origin, direction) / float(STEPS);
+    vec3 depth = vec3(0.0);
+    for (int i = 0; i < STEPS; i++)
+    {
+        vec3 rayleigh, extinction;
+        float mie;
+        Medium(length(origin + direction * ((float(i) + 0.5) * dt)) - GROUND_RADIUS, rayleigh, mie, extinction);
+        depth += extinction;
+    }
+    FragColor = vec4(exp(-depth * dt), 1.0);
+}
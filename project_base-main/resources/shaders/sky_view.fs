@@ -0,0 +1,52 @@
+#version 330 core
+out vec4 FragColor;
+
+#include "include/atmosphere.glsl"
+
+uniform sampler2D transmittanceTable;
+uniform vec2 tableSize;
+// towards the sun
+uniform vec3 sunDirection;
+
+// light scattered towards the viewer from every direction, single scattering; rendered again
+// whenever the sun moves
+void main()
+{
+    vec3 direction = SkyViewDirection(gl_FragCoord.xy / tableSize);
+    vec3 origin = vec3(0.0, GROUND_RADIUS + VIEW_ALTITUDE, 0.0);
+    float ground = GroundDistance(origin, direction);
+    float distance = ground > 0.0 ? ground : TopDistance(origin, direction);
+    float cosTheta = dot(direction, sunDirection);
+    float rayleighPhase = RayleighPhase(cosTheta);
+    float miePhase = MiePhase(cosTheta);
+
+    const int STEPS = 32;
+    float dt = distance / float(STEPS);
+    vec3 light = vec3(0.0);
+    vec3 throughput = vec3(1.0);
+    for (int i = 0; i < STEPS; i++)
+    {
+        vec3 point = origin + direction * ((float(i) + 0.5) * dt);
+        float r = length(point);
+        vec3 rayleigh, extinction;
+        float mie;
+        Medium(r - GROUND_RADIUS, rayleigh, mie, extinction);
+        // sunlight reaching the point, none in the planet's shadow
+        vec3 sun = GroundDistance(point, sunDirection) > 0.0 ? vec3(0.0)
+                 : texture(transmittanceTable, TransmittanceUV(r, dot(point / r, sunDirection))).rgb;
+        vec3 scattering = (rayleigh * rayleighPhase + mie * miePhase) * sun;
+        vec3 stepTransmittance = exp(-extinction * dt);
+        // integrated over the step rather than taken at its middle, the large steps stay energy-conserving
+        light += throughput * (scattering - scattering * stepTransmittance) / max(extinction, vec3(1e-9));
+        throughput *= stepTransmittance;
+    }
+    if (ground > 0.0)
+    {
+        vec3 point = origin + direction * ground;
+        vec3 up = normalize(point);
+        float cosSun = dot(up, sunDirection);
+        vec3 sun = texture(transmittanceTable, TransmittanceUV(GROUND_RADIUS, cosSun)).rgb;
+        light += throughput * sun * max(cosSun, 0.0) * GROUND_ALBEDO / PI;
+    }
+    FragColor = vec4(light, 1.0);
+}
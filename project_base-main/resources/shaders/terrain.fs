@@ -0,0 +1,30 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 FragPos;
+in vec3 Normal;
+
+#include "include/lights.glsl"
+#include "include/sky_ambient.glsl"
+#include "include/sun_shadows.glsl"
+
+uniform sampler2D groundTexture;
+uniform vec3 viewPosition;
+uniform DirLight dirLight;
+
+// world units one repeat of the ground texture covers
+const float GROUND_REPEAT = 8.0;
+const vec3 ROCK_COLOR = vec3(0.42, 0.39, 0.35);
+
+void main()
+{
+    vec3 normal = normalize(Normal);
+    // grass on the flats, bare rock on the slopes
+    vec3 grass = texture(groundTexture, FragPos.xz / GROUND_REPEAT).rgb;
+    vec3 albedo = mix(grass, ROCK_COLOR, 1.0 - smoothstep(0.6, 0.75, normal.y));
+
+    vec3 lightDir = normalize(-dirLight.direction);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 result = SkyAmbient(normal) * albedo + dirLight.diffuse * diff * albedo * SunShadow(FragPos, normal);
+    FragColor = vec4(result, 1.0);
+}
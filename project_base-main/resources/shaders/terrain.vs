@@ -0,0 +1,42 @@
+#version 330 core
+// one chunk of the terrain (Terrain.h): the shared grid, placed, lifted by the height tile and morphed
+// into the next coarser level's grid as it nears the end of its level's range
+layout (location = 0) in vec2 aGrid;
+
+out vec3 FragPos;
+out vec3 Normal;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 viewPosition;
+
+// rgb: height, normal x and normal z per grid vertex of each cached tile
+uniform sampler2DArray heightTiles;
+uniform float gridSize;
+// the chunk's corner in xy and its size in z
+uniform vec4 chunk;
+// where the chunk sits in its tile, its own or an ancestor's: offset in xy, scale in z, layer in w
+uniform vec4 tile;
+// distances from the camera where the morph starts and ends
+uniform vec2 morphRange;
+
+vec3 sampleTile(vec2 grid)
+{
+    // texel centers, the grid's corners sit on the first and last texel
+    vec2 uv = ((tile.xy + grid * tile.z) * gridSize + 0.5) / (gridSize + 1.0);
+    return texture(heightTiles, vec3(uv, tile.w)).rgb;
+}
+
+void main()
+{
+    vec2 grid = aGrid;
+    vec3 position = vec3(chunk.x + grid.x * chunk.z, sampleTile(grid).r, chunk.y + grid.y * chunk.z);
+    float morph = clamp((distance(viewPosition, position) - morphRange.x) / (morphRange.y - morphRange.x), 0.0, 1.0);
+    // odd vertices slide onto the midpoint of their even neighbours, the coarser grid's edge
+    grid -= fract(grid * gridSize * 0.5) * 2.0 / gridSize * morph;
+
+    vec3 height = sampleTile(grid);
+    FragPos = vec3(chunk.x + grid.x * chunk.z, height.r, chunk.y + grid.y * chunk.z);
+    Normal = vec3(height.g, sqrt(max(1.0 - dot(height.gb, height.gb), 0.0)), height.b);
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,39 @@
+#version 330 core
+// one crossed quad, shared by every scattered plant (VegetationField.h)
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoords;
+// per instance: the base of the plant and its size, then the cosine and sine of its yaw, its kind
+// (0 bush, 1 grass) and, for grass, its place in the cell's random order
+layout (location = 2) in vec4 aPositionScale;
+layout (location = 3) in vec4 aRotationKind;
+
+out vec2 TexCoords;
+out vec3 FragPos;
+flat out float Kind;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 viewPosition;
+// distances at which grass starts thinning out and is gone
+uniform vec2 grassFade;
+
+// the depth pre-pass runs this same shader, shading tests against it with GL_EQUAL
+invariant gl_Position;
+
+void main()
+{
+    float scale = aPositionScale.w;
+    Kind = aRotationKind.z;
+    if (Kind > 0.5)
+    {
+        // the cell's draw already left out the tufts past its nearest point's share, this thins the
+        // rest per tuft and shrinks each one away instead of popping it
+        float share = 1.0 - clamp((distance(viewPosition, aPositionScale.xyz) - grassFade.x) /
+                                  (grassFade.y - grassFade.x), 0.0, 1.0);
+        scale *= clamp((share - aRotationKind.w) * 20.0, 0.0, 1.0);
+    }
+    vec2 rotated = mat2(aRotationKind.x, aRotationKind.y, -aRotationKind.y, aRotationKind.x) * aPos.xz;
+    FragPos = aPositionScale.xyz + vec3(rotated.x, aPos.y, rotated.y) * scale;
+    TexCoords = aTexCoords;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -13,37 +13,167 @@
 #include <learnopengl/shader.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
-
+#include <rg/Atmosphere.h>
+#include <rg/Culling.h>
+#include <rg/ConeStepMap.h>
+#include <rg/DeferredRenderer.h>
+#include <rg/DepthPrepass.h>
+#include <rg/FramePacer.h>
+#include <rg/Frustum.h>
+#include <rg/HLOD.h>
+#include <rg/Impostor.h>
+#include <rg/LightClusters.h>
+#include <rg/LightmapBaker.h>
+#include <rg/Lightmaps.h>
+#include <rg/LodSelector.h>
+#include <rg/NormalMappingBenchmark.h>
+#include <rg/ObjectLights.h>
+#include <rg/Occlusion.h>
+#include <rg/OcclusionBenchmark.h>
+#include <rg/Scene.h>
+#include <rg/SceneReplicator.h>
+#include <rg/ShaderPermutations.h>
+#include <rg/Sky.h>
+#include <rg/SphericalHarmonics.h>
+#include <rg/SpotShadows.h>
+#include <rg/SunShadows.h>
+#include <rg/SoftwareOcclusion.h>
+#include <rg/StressTest.h>
+#include <rg/Terrain.h>
+#include <rg/VegetationField.h>
+#include <rg/WeightedBlendedOIT.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <string>
 #include <vector>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
 void processInput(GLFWwindow *window);
+
+void moveCamera(GLFWwindow *window, float step);
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
 
 unsigned int loadTexture(char const* path);
-unsigned int loadCubemap(vector<std::string> faces);
 void renderQuad();
 
+void loadSceneModels(const Scene &scene, std::vector<Model *> &sceneModels);
+void prepareScene(const Scene &scene, std::vector<Model *> &sceneModels, SceneCulling &culling, float lightRadius,
+                  HierarchicalLod &hlod);
+void selectLights(const Scene &scene, const SceneCulling &culling, const glm::vec3 &viewPosition,
+                  glm::vec3 lightPositions[]);
+void drawModel(Model &model, Shader &shader, const glm::mat4 &transform, const Frustum *frustum,
+               unsigned int lod = 0, bool depthOnly = false, bool translucent = false);
+// an instance that passed culling this frame and the level of detail it is drawn at
+struct InstanceDraw {
+    unsigned int instance;
+    InstanceLod lod;
+};
+void drawInstance(const Scene &scene, const std::vector<Model *> &sceneModels, OcclusionCulling &occlusion,
+                  Shader &shader, const InstanceDraw &draw, const Frustum *frustum, bool depthOnly,
+                  bool translucent = false);
+glm::mat4 vegetationTransform(const SceneVegetation &plant);
+glm::mat4 grassTransform(const glm::vec2 &tile);
+glm::mat4 roadTransform(const glm::vec2 &tile);
+void cullOccludedOnCPU(const Scene &scene, const std::vector<Model *> &sceneModels, SceneCulling &culling,
+                       SoftwareOcclusion &occlusion, const glm::mat4 &viewProjection);
+glm::vec3 pickRay(const glm::mat4 &projection, const glm::mat4 &view, double x, double y);
+
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// the default framebuffer's size in pixels, twice the window's on HiDPI displays; the offscreen targets
+// follow it through onFramebufferResize
+int framebufferWidth = SCR_WIDTH, framebufferHeight = SCR_HEIGHT;
+std::function<void(int, int)> onFramebufferResize;
+// the camera's far plane: nothing farther is drawn, and the terrain selects no chunks past it
+const float cameraFar = 3000.0f;
+// depth of the road's relief in texture coordinates, Q/E
 float heightScale = 0.0;
+// the road quad's texture rectangle, parallax rays are clamped to it
+const glm::vec4 roadTextureBounds(0.0f, 0.0f, 1.0f, 7.5f);
+// the road quad's corners in the xz plane of its tile, and its height above the grass
+const glm::vec2 roadMin(-6.3f, -50.0f), roadMax(3.8f, 49.97f);
+const float roadHeight = 0.05f;
 
 // camera
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
-// timing
+// timing: the last frame's length, paced by framePacer
 float deltaTime = 0.0f;
-float lastFrame = 0.0f;
-
-// day or night
-bool isDay = true;
+FramePacer framePacer;
+
+// time of day in hours, 12 being noon; the N key jumps between noon and midnight
+float timeOfDay = 12.0f;
+// direction of the noon sunlight; the sun and the moon opposite it circle the sky from there
+const glm::vec3 sunDirection(0.7f, -1.5f, -0.5f);
+const Atmosphere atmosphere(-sunDirection);
+// the noon sun and the full moon overhead; the atmosphere tints and dims the sun's diffuse and specular
+// light as it sets, and ambient only sets the average luminance of the sky's light
+struct DirLightSettings {
+    glm::vec3 ambient, diffuse, specular;
+};
+const DirLightSettings sunLight = {glm::vec3(0.23f, 0.24f, 0.14f), glm::vec3(0.65f, 0.42f, 0.26f), glm::vec3(0.5f)};
+const DirLightSettings moonLight = {glm::vec3(0.05f, 0.034f, 0.024f), glm::vec3(0.05f, 0.052f, 0.036f),
+                                    glm::vec3(0.04f)};
+// the light of one time of day, what setDirLight gives the shaders and the lightmaps are baked with
+struct DayLighting {
+    // towards the sun
+    glm::vec3 sun = glm::vec3(0.0f, 1.0f, 0.0f);
+    // the sun rather than the moon is the dir light, and casts the cascaded shadows
+    bool sunUp = true;
+    // the dir light's, pointing away from the sun or the moon
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f), diffuse = glm::vec3(0.0f), specular = glm::vec3(0.0f);
+    SphericalHarmonics ambient;
+    // brightness of the lamps, 0 by day and 1 at night
+    float lamps = 0.0f;
+    // from 0 by day to 1 at night, for the moon and the stars
+    float night = 0.0f;
+};
+DayLighting dayLightingAt(float hours);
+// this frame's, worked out again when the time of day moves on
+DayLighting lighting;
+// the lamps' spot lights, pointing down (setLampLight): colour and inner and outer cone in degrees
+const glm::vec3 lampSpotDiffuse(0.8f, 0.8f, 0.0f);
+const float lampSpotInner = 7.0f, lampSpotOuter = 26.0f;
+
+// picking: a click stores the cursor position, the next frame casts the ray
+bool pickRequested = false;
+double pickX = 0.0, pickY = 0.0;
+
+// scene
+const char *VILLAGE_SCENE_PATH = "resources/scenes/village.scene";
+// number of point and spot lights the impostor and HLOD proxy shaders are compiled for (NUM_LIGHTS in
+// those shaders); the forward shaders read every lamp of their cluster instead
+const unsigned int NUM_LIGHTS = 6;
+
+// rendering paths, switchable at runtime for A/B comparisons
+enum RenderPath {
+    RENDER_FORWARD,
+    RENDER_FORWARD_PREPASS,
+    RENDER_DEFERRED,
+    RENDER_PATH_COUNT
+};
+// running average GPU time of each path's opaque passes, in milliseconds; the frame time itself is bound
+// by vsync or the frame-rate cap and would be the same for all of them
+float renderPathGpuTime[RENDER_PATH_COUNT] = {};
+
+// how the road's relief is drawn once the height scale is above zero
+enum ParallaxMode {
+    PARALLAX_OFFSET,
+    PARALLAX_OCCLUSION,
+    PARALLAX_CONE_STEP
+};
 
 
 struct PointLight {
@@ -69,11 +199,67 @@ void setDirLight(Shader shader);
 
 void setSpotLight(Shader shader, PointLight pointLight, glm::vec3 lightPositions[]);
 
+void setLampLight(Shader shader, PointLight pointLight);
+
+void bindLampLists(Shader &shader, const LightClusters &clusters, const ObjectLights &objectLights,
+                   const SpotShadows *spotShadows);
+
+void bindSunShadows(Shader &shader, const SunShadows *sunShadows);
+
+void setParallax(Shader &shader, const ConeStepMap *coneStepMap);
+
+bool loadLightmaps(const Scene &scene, const std::vector<Model *> &sceneModels, Lightmaps &lightmaps,
+                   const std::string &path);
+void bakeLightmaps(const Scene &scene, const std::vector<Model *> &sceneModels, const SceneCulling &culling,
+                   Lightmaps &lightmaps, JobSystem &jobs, const PointLight &pointLight, float lightRadius,
+                   unsigned int grassTexture, unsigned int roadTexture, const std::string &path);
+
 struct ProgramState {
     glm::vec3 clearColor = glm::vec3(0);
     bool ImGuiEnabled = false;
     Camera camera;
     bool CameraMouseMovementUpdateEnabled = true;
+    bool FrustumCullingEnabled = true;
+    bool BVHCullingEnabled = true;
+    int OcclusionCullingMode = OCCLUSION_OFF;
+    int PickedInstance = -1;
+    bool LodEnabled = true;
+    float LodPixelError = 1.0f;
+    bool LodCrossFade = true;
+    bool ImpostorsEnabled = true;
+    float ImpostorPixels = 64.0f;
+    bool HLODEnabled = true;
+    float HLODDistance = 150.0f;
+    int RenderPath = RENDER_FORWARD;
+    // forward shaders loop over per-object lamp lists instead of the clusters
+    bool ObjectLightLists = false;
+    int ParallaxMode = PARALLAX_OCCLUSION;
+    // layers at grazing angles, a quarter of them looking straight down
+    int ParallaxLayers = 32;
+    // the relief flattens out up to this distance and is plain normal mapping past it
+    float ParallaxDistance = 40.0f;
+    bool LampShadows = true;
+    // spot shadows rendered per frame, see SpotShadows::StaticBudget
+    int LampShadowsStatic = 2;
+    int LampShadowsDynamic = 4;
+    bool SunShadowsEnabled = true;
+    // frames between two refreshes of each sun shadow cascade
+    int SunShadowIntervals[SunShadows::CASCADES] = {1, 2, 4, 8};
+    // static geometry lit from the baked lightmaps when they are loaded
+    bool LightmapsEnabled = true;
+    // the clock runs at HoursPerSecond instead of standing still
+    bool TimeAnimated = false;
+    float HoursPerSecond = 0.25f;
+    // translucent meshes through the OIT targets rather than dithered
+    bool OrderIndependentTransparency = true;
+    // frame pacing: the swap interval, frames per second at most (0 for no cap) and simulation steps per second
+    int SwapMode = SWAP_VSYNC;
+    int FrameRateCap = 0;
+    bool FixedStepSimulation = true;
+    int SimulationRate = 120;
+    // the landscape around the village, and how far its finest level reaches
+    bool TerrainEnabled = true;
+    float TerrainDetailDistance = 96.0f;
 //    glm::vec3 backpackPosition = glm::vec3(0.0f);
 //    float backpackRotate = 0.0f;
 //    float backpackScale = 1.0f;
@@ -118,9 +304,62 @@ void ProgramState::LoadFromFile(std::string filename) {
 
 ProgramState *programState;
 
-void DrawImGui(ProgramState *programState);
+void DrawImGui(ProgramState *programState, const Scene &scene);
+
+int main(int argc, char **argv) {
+    // scene compiler: project_base --compile-scene <scene text> <scene binary>
+    // -----------------------------------------------------------------------
+    if (argc == 4 && std::string(argv[1]) == "--compile-scene") {
+        Scene scene;
+        if (!scene.LoadFromFile(argv[2]) || !scene.SaveBinary(argv[3]))
+            return -1;
+        std::cout << "Compiled " << scene.instances.size() << " instances, " << scene.lights.size()
+                  << " lights and " << scene.vegetation.size() << " plants into " << argv[3] << std::endl;
+        return 0;
+    }
+    // replicator: project_base --replicate <columns> <rows> <seed> <output scene>
+    // ----------------------------------------------------------------------------
+    if (argc == 6 && std::string(argv[1]) == "--replicate") {
+        Scene village;
+        if (!village.LoadFromFile(VILLAGE_SCENE_PATH))
+            return -1;
+        ReplicatorSettings settings;
+        settings.columns = std::max(1, std::atoi(argv[2]));
+        settings.rows = std::max(1, std::atoi(argv[3]));
+        settings.seed = (uint32_t) std::strtoul(argv[4], nullptr, 10);
+        Scene replicated = SceneReplicator::Replicate(village, settings);
+        if (!replicated.SaveText(argv[5]))
+            return -1;
+        std::cout << "Wrote " << replicated.instances.size() << " instances to " << argv[5] << std::endl;
+        return 0;
+    }
+    // software occlusion benchmark: project_base --occlusion-benchmark [seed]
+    // -----------------------------------------------------------------------
+    if (argc >= 2 && std::string(argv[1]) == "--occlusion-benchmark") {
+        OcclusionBenchmark::Run(argc >= 3 ? (uint32_t) std::strtoul(argv[2], nullptr, 10) : 1);
+        return 0;
+    }
+
+    // project_base [--scene <path>] [--stress <max grid> <seed>] [--normal-mapping-benchmark] [--bake-lightmaps]
+    std::string scenePath = VILLAGE_SCENE_PATH;
+    int stressGrid = 0;
+    uint32_t stressSeed = 1;
+    bool normalMappingBenchmark = false;
+    bool lightmapBake = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--scene" && i + 1 < argc)
+            scenePath = argv[++i];
+        else if (arg == "--stress" && i + 2 < argc) {
+            stressGrid = std::max(1, std::atoi(argv[++i]));
+            stressSeed = (uint32_t) std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--normal-mapping-benchmark")
+            normalMappingBenchmark = true;
+        else if (arg == "--bake-lightmaps")
+            lightmapBake = true;
+    }
 
-int main() {
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -145,6 +384,7 @@ int main() {
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetKeyCallback(window, key_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
     // tell GLFW to capture our mouse
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
@@ -181,46 +421,48 @@ int main() {
 
     // build and compile shaders
     // -------------------------
-    Shader ourShader("resources/shaders/2.model_lighting.vs", "resources/shaders/2.model_lighting.fs");
-    Shader skyboxShader("resources/shaders/skybox.vs", "resources/shaders/skybox.fs");
     Shader lightCubeShader("resources/shaders/light_source.vs", "resources/shaders/light_source.fs");
-    Shader blendingShader("resources/shaders/blending.vs", "resources/shaders/blending.fs");
-    Shader normalMappingShader("resources/shaders/normal_mapping.vs", "resources/shaders/normal_mapping.fs");
-
-
-    // load models
-    // -----------
-    // farm house
-    Model ourModelHouse("resources/objects/house/Farm_house.obj");
-    ourModelHouse.SetShaderTextureNamePrefix("material.");
-    // old company
-    Model oldCompany("resources/objects/oldHouse/house_01.obj");
-    oldCompany.SetShaderTextureNamePrefix("material.");
-    // brick house
-    Model brickHouse("resources/objects/BrickHouse/Brick_House.obj");
-    brickHouse.SetShaderTextureNamePrefix("material.");
-    // blue house
-    Model blueHouse("resources/objects/blueHouse/HouseSuburban.obj");
-    blueHouse.SetShaderTextureNamePrefix("material.");
-    // pol house
-    Model polHouse("resources/objects/polHouse1/polHouse1.obj");
-    polHouse.SetShaderTextureNamePrefix("material.");
-
-   // tree
-    Model tree("resources/objects/tree1/Tree_V2_Final.obj");
-    tree.SetShaderTextureNamePrefix("material.");
-
-    // street lamp
-    Model streetLamp("resources/objects/streetLamp/Street Lamp.obj");
-    streetLamp.SetShaderTextureNamePrefix("material.");
-
-    // lada
-    Model lada("resources/objects/lada/Vazz.obj");
-    lada.SetShaderTextureNamePrefix("material.");
-
-    // well
-    Model well("resources/objects/well/Well_OBJ.obj");
-    well.SetShaderTextureNamePrefix("material.");
+    // the lighting shaders are compiled per combination of features (ShaderPermutations.h) and
+    // picked every frame: lamps only at night, per-object lists or clusters, parallax on the road
+    // when the height scale is up
+    std::unique_ptr<ShaderPermutations> modelShaders(new ShaderPermutations(
+            "resources/shaders/2.model_lighting.vs", "resources/shaders/2.model_lighting.fs",
+            SHADER_LAMPS | SHADER_OBJECT_LIGHT_LISTS | SHADER_SPOT_SHADOWS | SHADER_SUN_SHADOWS | SHADER_LIGHTMAP |
+                    SHADER_TRANSLUCENT | SHADER_ALPHA_TEST,
+            [](Shader &shader) {
+                shader.setInt("material.texture_diffuse1", 0);
+                //shader.setInt("material.texture_specular1", 1);
+            }));
+    std::unique_ptr<ShaderPermutations> normalMappingShaders(new ShaderPermutations(
+            "resources/shaders/normal_mapping.vs", "resources/shaders/normal_mapping.fs",
+            SHADER_LAMPS | SHADER_OBJECT_LIGHT_LISTS | SHADER_SPOT_SHADOWS | SHADER_SUN_SHADOWS | SHADER_PARALLAX |
+                    SHADER_PARALLAX_OCCLUSION | SHADER_CONE_STEP | SHADER_LIGHTMAP,
+            [](Shader &shader) {
+                shader.setInt("diffuseMap", 0);
+                shader.setInt("normalMap", 1);
+                shader.setInt("depthMap", 2);
+                shader.setInt("coneStepMap", 3);
+            }));
+    // baked the first time cone stepping is picked
+    std::unique_ptr<ConeStepMap> coneStepMap;
+
+
+    // load scene and the models it places
+    // -----------------------------------
+    Scene scene;
+    scene.LoadCompiled(scenePath);
+    long long sceneModificationTime = Scene::FileModificationTime(scenePath);
+    double lastSceneCheck = 0.0;
+
+    // stress test: replicate the village into growing grids, measured from a fixed camera without vsync
+    std::unique_ptr<StressTest> stressTest;
+    if (stressGrid > 0) {
+        stressTest.reset(new StressTest(scene, stressGrid, stressSeed));
+        stressTest->NextScene(scene);
+        programState->camera = Camera(glm::vec3(-1.25f, 5.0f, 50.0f));
+        programState->SwapMode = SWAP_IMMEDIATE;
+        programState->FrameRateCap = 0;
+    }
 
 
     // pointlight
@@ -232,17 +474,57 @@ int main() {
     pointLight.constant = 1.0f;
     pointLight.linear = 0.09f;
     pointLight.quadratic = 0.032f;
+    float lightRadius = SceneCulling::AttenuationRadius(pointLight.constant, pointLight.linear, pointLight.quadratic);
+
+    std::vector<Model *> sceneModels;
+    SceneCulling culling;
+    std::unique_ptr<HierarchicalLod> hlod(new HierarchicalLod);
+    prepareScene(scene, sceneModels, culling, lightRadius, *hlod);
+    std::unique_ptr<OcclusionCulling> occlusion(new OcclusionCulling);
+    JobSystem jobs;
+    SoftwareOcclusion softwareOcclusion(jobs);
+    LodSelector lodSelector;
+    std::unique_ptr<ImpostorRenderer> impostors(new ImpostorRenderer);
+    std::vector<uint8_t> hlodCovered;
+    std::unique_ptr<DepthPrepass> depthPrepass(new DepthPrepass);
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    std::unique_ptr<DeferredRenderer> deferredRenderer(new DeferredRenderer(framebufferWidth, framebufferHeight));
+    // translucent meshes of every path, composited over the opaque image
+    std::unique_ptr<WeightedBlendedOIT> translucency(new WeightedBlendedOIT(framebufferWidth, framebufferHeight));
+    // the screen-sized targets follow the window
+    onFramebufferResize = [&](int width, int height) {
+        deferredRenderer->Resize(width, height);
+        translucency->Resize(width, height);
+    };
+    // lamps lit this frame, for the light clusters and the deferred lighting pass
+    std::vector<glm::vec3> visibleLamps;
+    std::unique_ptr<LightClusters> lightClusters(new LightClusters);
+    std::unique_ptr<ObjectLights> objectLights(new ObjectLights);
+    // shadows of the lamps' spot lights, static casters cached
+    std::unique_ptr<SpotShadows> spotShadows(new SpotShadows(lampSpotOuter, lightRadius));
+    std::vector<uint32_t> shadowedLamps, shadowCasterInstances, shadowCasterPlants;
+    // spot shadow tile of each lamp in visibleLamps
+    std::vector<float> visibleLampTiles;
+    // sun shadows over the first 200 units of the widest view (45 degrees, see Camera::ProcessMouseScroll)
+    std::unique_ptr<SunShadows> sunShadows(new SunShadows(glm::radians(45.0f), (float) SCR_WIDTH / (float) SCR_HEIGHT,
+                                                          200.0f));
+    lighting = dayLightingAt(timeOfDay);
+    sunShadows->SetDirection(lighting.direction);
+    sunShadows->SetSceneBounds(culling.SceneBounds());
+    std::vector<InstanceDraw> instanceDraws;
+    // the ones with translucent meshes
+    std::vector<InstanceDraw> translucentDraws;
 
     // vertices
     float planeVertices[] = {
-            // positions         //normals         // texture Coords
-            5.0f,  -0.5f,  5.0f, 0.0f, 1.0f, 0.0f, 16.0f, 0.0f,
-            -5.0f, -0.5f,  5.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f,
-            -5.0f, -0.5f, -5.0f, 0.0f, 1.0f, 0.0f, 0.0f, 16.0f,
-
-            5.0f, -0.5f,  5.0f, 0.0f, 1.0f, 0.0f, 16.0f, 0.0f,
-            -5.0f, -0.5f, -5.0f, 0.0f, 1.0f, 0.0f, 0.0f, 16.0f,
-            5.0f, -0.5f, -5.0f, 0.0f, 1.0f, 0.0f, 16.0f, 16.0f
+            // positions         //normals         // texture Coords // lightmap coords
+            5.0f,  -0.5f,  5.0f, 0.0f, 1.0f, 0.0f, 16.0f, 0.0f,      1.0f, 1.0f,
+            -5.0f, -0.5f,  5.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f,       0.0f, 1.0f,
+            -5.0f, -0.5f, -5.0f, 0.0f, 1.0f, 0.0f, 0.0f, 16.0f,      0.0f, 0.0f,
+
+            5.0f, -0.5f,  5.0f, 0.0f, 1.0f, 0.0f, 16.0f, 0.0f,       1.0f, 1.0f,
+            -5.0f, -0.5f, -5.0f, 0.0f, 1.0f, 0.0f, 0.0f, 16.0f,      0.0f, 0.0f,
+            5.0f, -0.5f, -5.0f, 0.0f, 1.0f, 0.0f, 16.0f, 16.0f,      1.0f, 0.0f
     };
     float transparentVertices[] = {
             // positions         // texture Coords (swapped y coordinates because texture is flipped upside down)
@@ -297,64 +579,10 @@ int main() {
             -0.5f,  0.5f,  0.5f,
             -0.5f,  0.5f, -0.5f
     };
-    float skyboxVertices[] = {
-            // positions
-            -1.0f,  1.0f, -1.0f,
-            -1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-            1.0f,  1.0f, -1.0f,
-            -1.0f,  1.0f, -1.0f,
-
-            -1.0f, -1.0f,  1.0f,
-            -1.0f, -1.0f, -1.0f,
-            -1.0f,  1.0f, -1.0f,
-            -1.0f,  1.0f, -1.0f,
-            -1.0f,  1.0f,  1.0f,
-            -1.0f, -1.0f,  1.0f,
-
-            1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-
-            -1.0f, -1.0f,  1.0f,
-            -1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f, -1.0f,  1.0f,
-            -1.0f, -1.0f,  1.0f,
-
-            -1.0f,  1.0f, -1.0f,
-            1.0f,  1.0f, -1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            -1.0f,  1.0f,  1.0f,
-            -1.0f,  1.0f, -1.0f,
-
-            -1.0f, -1.0f, -1.0f,
-            -1.0f, -1.0f,  1.0f,
-            1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-            -1.0f, -1.0f,  1.0f,
-            1.0f, -1.0f,  1.0f
-    };
 
 
     // VAO, VBO
     //----------
-    // skybox
-    unsigned int skyboxVAO, skyboxVBO;
-    glGenVertexArrays(1, &skyboxVAO);
-    glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-
     // plane
     unsigned int planeVAO, planeVBO;
     glGenVertexArrays(1, &planeVAO);
@@ -363,11 +591,13 @@ int main() {
     glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), &planeVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 10 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 10 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 10 * sizeof(float), (void*)(6 * sizeof(float)));
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, 10 * sizeof(float), (void*)(8 * sizeof(float)));
 
     // transparent
     unsigned int transparentVAO, transparentVBO;
@@ -393,15 +623,8 @@ int main() {
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    // light positions
-    glm::vec3 lightPositions[] = {
-            glm::vec3(-4.85f, 7.6f, -35.0f),
-            glm::vec3(-4.85f, 7.6f, -3.0f),
-            glm::vec3(-4.85f, 7.6f, 29.0f),
-            glm::vec3(2.35f, 7.6f, -20.0f),
-            glm::vec3(2.35f, 7.6f, 12.0f),
-            glm::vec3(2.35f, 7.6f, 44.0f)
-    };
+    // positions of the lamps uploaded to the lighting shaders, chosen every frame
+    glm::vec3 lightPositions[NUM_LIGHTS];
 
 
 
@@ -413,291 +636,744 @@ int main() {
     unsigned int roadDispTexture =  loadTexture(FileSystem::getPath("resources/textures/road/cobblestone_large_01_disp_4k.png").c_str());
     unsigned int transparentTexture = loadTexture(FileSystem::getPath("resources/textures/bush.png").c_str());
 
-    // skybox
-    vector<std::string> day
-          {
-                    FileSystem::getPath("resources/textures/skyboxDay/right.png"),
-                    FileSystem::getPath("resources/textures/skyboxDay/left.png"),
-                    FileSystem::getPath("resources/textures/skyboxDay/top.png"),
-                    FileSystem::getPath("resources/textures/skyboxDay/bottom.png"),
-                    FileSystem::getPath("resources/textures/skyboxDay/front.png"),
-                    FileSystem::getPath("resources/textures/skyboxDay/back.png")
-          };
-    unsigned int cubemapTextureDay = loadCubemap(day);
-    // --------------------------
-    vector<std::string> night
-            {
-                    FileSystem::getPath("resources/textures/skyboxNight/right.jpg"),
-                    FileSystem::getPath("resources/textures/skyboxNight/left.jpg"),
-                    FileSystem::getPath("resources/textures/skyboxNight/top.jpg"),
-                    FileSystem::getPath("resources/textures/skyboxNight/bottom.jpg"),
-                    FileSystem::getPath("resources/textures/skyboxNight/front.jpg"),
-                    FileSystem::getPath("resources/textures/skyboxNight/back.jpg")
-            };
-    unsigned int cubemapTextureNight = loadCubemap(night);
-
-
-    // shader configuration
-    skyboxShader.use();
-    skyboxShader.setInt("skybox", 0);
-
-    blendingShader.use();
-    blendingShader.setInt("texture1", 0);
+    // bushes and grass scattered over the ground tiles, with the scene's own bushes, drawn per cell
+    std::unique_ptr<VegetationField> vegetationField(new VegetationField(
+            FileSystem::getPath("resources/textures/vegetation_density.png").c_str()));
+    vegetationField->Scatter(scene, culling);
+
+    // the hills around the village, flattened under it
+    std::unique_ptr<Terrain> terrain(new Terrain(jobs));
+    terrain->FarDistance = cameraFar;
+    terrain->SetVillage(culling.SceneBounds());
+
+    // the sky of the atmosphere; the lighting is worked out again, and the sky-view table rendered, each
+    // time the clock moves on by SOLAR_STEP hours
+    std::unique_ptr<Sky> sky(new Sky);
+    sky->Update(lighting.sun);
+    const float SOLAR_STEP = 0.05f;
+    int solarStep = (int) std::floor(timeOfDay / SOLAR_STEP);
+
+    // times both normal-mapping pipelines and quits through the usual cleanup
+    if (normalMappingBenchmark) {
+        NormalMappingBenchmark::Run(roadTexture, roadNormalTexture, roadDispTexture, SCR_WIDTH, SCR_HEIGHT);
+        glfwSetWindowShouldClose(window, true);
+    }
 
-    normalMappingShader.use();
-    normalMappingShader.setInt("diffuseMap", 0);
-    normalMappingShader.setInt("normalMap", 1);
+    // baked light of the static scene, loaded from next to the scene when it was baked for this layout;
+    // --bake-lightmaps bakes it on every core, writes it there and quits
+    std::unique_ptr<Lightmaps> lightmaps(new Lightmaps);
+    const std::string lightmapPath = Lightmaps::PathFor(scenePath);
+    if (lightmapBake) {
+        if (lightmaps->Layout(scene, sceneModels))
+            bakeLightmaps(scene, sceneModels, culling, *lightmaps, jobs, pointLight, lightRadius, grassTexture,
+                          roadTexture, lightmapPath);
+        glfwSetWindowShouldClose(window, true);
+    }
+    else if (!stressTest)
+        loadLightmaps(scene, sceneModels, *lightmaps, lightmapPath);
+
+    // the casters of one lamp's spot shadow: instances and bushes in its range, except the lamp's own
+    // model, which encloses the light and would shadow everything
+    SpotShadows::DrawCasters drawShadowCasters = [&](uint32_t light, Shader &solid, Shader &alphaTested,
+                                                     bool dynamic) {
+        const glm::vec3 &lamp = scene.lights[light];
+        culling.CastersInSphere(lamp, lightRadius, shadowCasterInstances, shadowCasterPlants);
+        unsigned int drawn = 0;
+        solid.use();
+        for (uint32_t i : shadowCasterInstances) {
+            bool isDynamic = scene.models[scene.instances[i].model].flags & SCENE_MODEL_DYNAMIC;
+            if (isDynamic != dynamic || culling.instanceBounds.Get(i).Contains(lamp))
+                continue;
+            solid.setMat4("model", scene.transforms[i]);
+            drawModel(*sceneModels[scene.instances[i].model], solid, scene.transforms[i], nullptr, 0, true);
+            drawn++;
+        }
+        // the bushes never move
+        if (!dynamic && !shadowCasterPlants.empty()) {
+            alphaTested.use();
+            glBindVertexArray(transparentVAO);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, transparentTexture);
+            for (uint32_t i : shadowCasterPlants) {
+                alphaTested.setMat4("model", vegetationTransform(scene.vegetation[i]));
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                rg::countDrawCall(2);
+                drawn++;
+            }
+            glBindVertexArray(0);
+        }
+        return drawn;
+    };
 
-    ourShader.use();
-    ourShader.setInt("material.texture_diffuse1", 0);
-    //ourShader.setInt("material.texture_specular1", 1);
+    // the sun's casters inside one light-space region of a cascade, the same models and bushes
+    SunShadows::DrawCasters drawSunShadowCasters = [&](const Frustum &region, Shader &solid, Shader &alphaTested,
+                                                       bool dynamic) {
+        if (dynamic && std::none_of(scene.models.begin(), scene.models.end(), [](const SceneModel &model) {
+            return (model.flags & SCENE_MODEL_DYNAMIC) != 0;
+        }))
+            return 0u;
+        culling.CastersInFrustum(region, shadowCasterInstances, shadowCasterPlants);
+        unsigned int drawn = 0;
+        solid.use();
+        for (uint32_t i : shadowCasterInstances) {
+            bool isDynamic = scene.models[scene.instances[i].model].flags & SCENE_MODEL_DYNAMIC;
+            if (isDynamic != dynamic)
+                continue;
+            solid.setMat4("model", scene.transforms[i]);
+            drawModel(*sceneModels[scene.instances[i].model], solid, scene.transforms[i], nullptr, 0, true);
+            drawn++;
+        }
+        if (!dynamic && !shadowCasterPlants.empty()) {
+            alphaTested.use();
+            glBindVertexArray(transparentVAO);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, transparentTexture);
+            for (uint32_t i : shadowCasterPlants) {
+                alphaTested.setMat4("model", vegetationTransform(scene.vegetation[i]));
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                rg::countDrawCall(2);
+                drawn++;
+            }
+            glBindVertexArray(0);
+        }
+        return drawn;
+    };
 
+    // the camera's position at the last two simulation steps and where it was last drawn, between them;
+    // a camera moved from outside the simulation starts over from where it was put
+    glm::vec3 previousPosition = programState->camera.Position;
+    glm::vec3 simulatedPosition = previousPosition, renderedPosition = previousPosition;
 
     // render loop
     // -----------
     while (!glfwWindowShouldClose(window)) {
         // per-frame time logic
         // --------------------
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        double frameStart = glfwGetTime();
+        framePacer.SetSwapMode(programState->SwapMode);
+        framePacer.SetFrameRateCap(programState->FrameRateCap);
+        framePacer.SetSimulationRate(programState->SimulationRate);
+        framePacer.FixedStep = programState->FixedStepSimulation;
+        deltaTime = (float) framePacer.BeginFrame();
+        double currentFrame = framePacer.Now();
+        rg::frameStats().Reset();
+
+        // hot-reload the scene when its text form changes on disk
+        if (!stressTest && currentFrame - lastSceneCheck > 0.5f) {
+            lastSceneCheck = currentFrame;
+            long long modificationTime = Scene::FileModificationTime(scenePath);
+            if (modificationTime != sceneModificationTime) {
+                sceneModificationTime = modificationTime;
+                Scene reloaded;
+                if (reloaded.LoadFromFile(scenePath)) {
+                    reloaded.SaveBinary(scenePath + ".bin");
+                    scene = reloaded;
+                    prepareScene(scene, sceneModels, culling, lightRadius, *hlod);
+                    vegetationField->Scatter(scene, culling);
+                    terrain->SetVillage(culling.SceneBounds());
+                    spotShadows->Invalidate();
+                    sunShadows->SetSceneBounds(culling.SceneBounds());
+                    loadLightmaps(scene, sceneModels, *lightmaps, lightmapPath);
+                }
+            }
+        }
 
         // input
         // -----
         processInput(window);
 
+        // simulation: walking and the clock advance in fixed steps, and the camera is drawn between its
+        // last two positions; looking around follows the mouse every frame
+        if (programState->camera.Position != renderedPosition)
+            previousPosition = simulatedPosition = programState->camera.Position;
+        programState->camera.Position = simulatedPosition;
+        while (framePacer.NextStep()) {
+            const float step = (float) framePacer.Step();
+            previousPosition = simulatedPosition;
+            moveCamera(window, step);
+            simulatedPosition = programState->camera.Position;
+            if (programState->TimeAnimated && !stressTest)
+                timeOfDay = std::fmod(timeOfDay + step * programState->HoursPerSecond, 24.0f);
+        }
+        programState->camera.Position = glm::mix(previousPosition, simulatedPosition, framePacer.Alpha());
+        renderedPosition = programState->camera.Position;
+
+        // time of day: the sun's course, its shadows, the sky and the lights that go with it
+        if ((int) std::floor(timeOfDay / SOLAR_STEP) != solarStep) {
+            solarStep = (int) std::floor(timeOfDay / SOLAR_STEP);
+            lighting = dayLightingAt(solarStep * SOLAR_STEP);
+            sky->Update(lighting.sun);
+            if (lighting.sunUp)
+                sunShadows->SetDirection(lighting.direction);
+        }
+        // lamps burn from dusk to dawn
+        const bool lampsLit = lighting.lamps > 0.0f;
+
         // render
         // ------
         glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 
+        // view/projection transformations
+        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),
+                                                (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, cameraFar);
+        glm::mat4 view = programState->camera.GetViewMatrix();
+
+        // visibility: skip whatever is outside the view frustum and upload the nearest visible lamps
+        Frustum frustum = Frustum::FromMatrix(projection * view);
+        const Frustum *meshFrustum = nullptr;
+        if (programState->FrustumCullingEnabled)
+        {
+            if (programState->BVHCullingEnabled) {
+                culling.Cull(frustum);
+                rg::frameStats().bvhNodesVisited = culling.tree.nodesVisited;
+            } else
+                culling.CullLinear(frustum);
+            meshFrustum = &frustum;
+        }
+        else
+            culling.ShowAll();
+        vegetationField->Cull(programState->FrustumCullingEnabled ? &frustum : nullptr,
+                              programState->camera.Position);
+        if (programState->TerrainEnabled) {
+            terrain->DetailDistance = programState->TerrainDetailDistance;
+            terrain->Select(programState->FrustumCullingEnabled ? &frustum : nullptr, programState->camera.Position);
+        }
+
+        // occlusion: hide instances and lamps behind the houses
+        glm::mat4 viewProjection = projection * view;
+        if (programState->OcclusionCullingMode == OCCLUSION_HIZ)
+            occlusion->CullHiZ(scene, sceneModels, culling, viewProjection, programState->camera.Position);
+        else if (programState->OcclusionCullingMode == OCCLUSION_QUERIES)
+            occlusion->IssueQueries(scene, sceneModels, culling, viewProjection, programState->camera.Position);
+        else if (programState->OcclusionCullingMode == OCCLUSION_SOFTWARE)
+            cullOccludedOnCPU(scene, sceneModels, culling, softwareOcclusion, viewProjection);
+        if (programState->OcclusionCullingMode != OCCLUSION_QUERIES)
+            occlusion->ClearQueries();
+        selectLights(scene, culling, programState->camera.Position, lightPositions);
+        rg::frameStats().lightsCulled = scene.lights.size() - culling.visibleLights;
+        // the nearest visible lamps get a spot shadow tile, rendered before any of this frame's passes
+        const bool lampShadows = lampsLit && programState->LampShadows;
+        if (lampShadows) {
+            shadowedLamps.clear();
+            for (unsigned int i = 0; i < scene.lights.size(); i++)
+                if (culling.lightVisible[i])
+                    shadowedLamps.push_back(i);
+            const glm::vec3 eye = programState->camera.Position;
+            std::sort(shadowedLamps.begin(), shadowedLamps.end(), [&](uint32_t a, uint32_t b) {
+                return glm::dot(scene.lights[a] - eye, scene.lights[a] - eye) <
+                       glm::dot(scene.lights[b] - eye, scene.lights[b] - eye);
+            });
+            spotShadows->StaticBudget = programState->LampShadowsStatic;
+            spotShadows->DynamicBudget = programState->LampShadowsDynamic;
+            spotShadows->Update(scene.lights, shadowedLamps, drawShadowCasters);
+            rg::frameStats().spotShadowsCached = spotShadows->CachedCount();
+            rg::frameStats().spotShadowsStatic = spotShadows->StaticRendered();
+            rg::frameStats().spotShadowsDynamic = spotShadows->DynamicRendered();
+        }
+        const SpotShadows *lampShadowMaps = lampShadows ? spotShadows.get() : nullptr;
+        // the cascades follow the camera while the sun is up, each at its own pace
+        const bool sunShadowsOn = lighting.sunUp && programState->SunShadowsEnabled;
+        if (sunShadowsOn) {
+            std::copy(programState->SunShadowIntervals, programState->SunShadowIntervals + SunShadows::CASCADES,
+                      sunShadows->UpdateInterval);
+            sunShadows->Update(programState->camera.Position, drawSunShadowCasters);
+            for (int c = 0; c < SunShadows::CASCADES; c++) {
+                const SunShadows::CascadeStats &cascade = sunShadows->Stats(c);
+                rg::frameStats().sunCascadeTexels[c] = cascade.texels;
+                rg::frameStats().sunCascadeCasters[c] = cascade.casters;
+                rg::frameStats().sunCascadeMilliseconds[c] = cascade.milliseconds;
+                rg::frameStats().sunCascadesUpdated += cascade.updated;
+            }
+        }
+        const SunShadows *sunShadowMaps = sunShadowsOn ? sunShadows.get() : nullptr;
+        // lamps are only lit from dusk to dawn, and none of them is capped by NUM_LIGHTS in the clusters
+        visibleLamps.clear();
+        visibleLampTiles.clear();
+        if (lampsLit)
+            for (unsigned int i = 0; i < scene.lights.size(); i++)
+                if (culling.lightVisible[i]) {
+                    visibleLamps.push_back(scene.lights[i]);
+                    visibleLampTiles.push_back(lampShadows ? spotShadows->LampTiles()[i] : -1.0f);
+                }
+        const bool objectLightLists = programState->ObjectLightLists;
+        if (objectLightLists) {
+            objectLights->Build(scene, culling, lightRadius, lampsLit,
+                                lampShadows ? &spotShadows->LampTiles() : nullptr, &vegetationField->cellBounds,
+                                &vegetationField->cellVisible);
+            rg::frameStats().objectLightIndices = objectLights->IndexCount();
+            rg::frameStats().objectLightObjects = objectLights->ObjectCount();
+            rg::frameStats().objectLightMax = objectLights->MaxPerObject();
+        } else {
+            lightClusters->Build(visibleLamps, lightRadius, view, glm::radians(programState->camera.Zoom),
+                                 (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, cameraFar,
+                                 lampShadows ? &visibleLampTiles : nullptr);
+            rg::frameStats().clusterLamps = lightClusters->LampCount();
+            rg::frameStats().clusterIndices = lightClusters->IndexCount();
+            rg::frameStats().clusterMaxLamps = lightClusters->MaxPerCluster();
+        }
+
+        if (pickRequested) {
+            pickRequested = false;
+            glm::vec3 direction = pickRay(projection, view, pickX, pickY);
+            programState->PickedInstance = culling.PickInstance(programState->camera.Position, direction, cameraFar);
+        }
+        if (programState->PickedInstance >= (int) scene.instances.size())
+            programState->PickedInstance = -1;
+
+        // this frame's permutations of the lighting shaders
+        const unsigned int lightingFeatures = (lampsLit ? SHADER_LAMPS : 0) |
+                                              (objectLightLists ? SHADER_OBJECT_LIGHT_LISTS : 0) |
+                                              (lampShadows ? SHADER_SPOT_SHADOWS : 0) |
+                                              (sunShadowsOn ? SHADER_SUN_SHADOWS : 0);
+        Shader &ourShader = modelShaders->Get(lightingFeatures);
+        Shader &blendingShader = vegetationField->shaders.Get(lightingFeatures);
+        // parallax only once Q/E raised the height scale above zero
+        unsigned int parallaxFeatures = 0;
+        if (heightScale > 0.0f) {
+            parallaxFeatures = SHADER_PARALLAX;
+            if (programState->ParallaxMode != PARALLAX_OFFSET)
+                parallaxFeatures |= SHADER_PARALLAX_OCCLUSION;
+            if (programState->ParallaxMode == PARALLAX_CONE_STEP) {
+                parallaxFeatures |= SHADER_CONE_STEP;
+                if (!coneStepMap)
+                    coneStepMap.reset(new ConeStepMap(FileSystem::getPath(
+                            "resources/textures/road/cobblestone_large_01_disp_4k.png").c_str(), jobs));
+            }
+        }
+        // static geometry with its baked light instead of the dir light's diffuse term and the lamp loop,
+        // on the forward paths; the road then always is, the models with a rectangle in the atlas. The
+        // light is baked at noon and at midnight and used within a quarter of an hour of them.
+        const float hoursFromNoon = std::fabs(timeOfDay - 12.0f);
+        const bool bakedTime = hoursFromNoon <= 0.25f || hoursFromNoon >= 11.75f;
+        const bool lightmapped = programState->LightmapsEnabled && lightmaps->Loaded() && bakedTime &&
+                                 programState->RenderPath != RENDER_DEFERRED;
+        const unsigned int lightmapFeatures = SHADER_LIGHTMAP | (sunShadowsOn ? SHADER_SUN_SHADOWS : 0);
+        const Lightmaps::LightSet lightSet = hoursFromNoon < 6.0f ? Lightmaps::LIGHTMAP_DAY : Lightmaps::LIGHTMAP_NIGHT;
+        Shader &lightmapShader = modelShaders->Get(lightmapped ? lightmapFeatures : lightingFeatures);
+        Shader &normalMappingShader = normalMappingShaders->Get((lightmapped ? lightmapFeatures : lightingFeatures) |
+                                                                parallaxFeatures);
+        rg::frameStats().lightmapWidth = lightmaps->Loaded() ? lightmaps->Width() : 0;
+        rg::frameStats().lightmapHeight = lightmaps->Loaded() ? lightmaps->Height() : 0;
+        rg::frameStats().shaderPermutations = modelShaders->Count() + vegetationField->shaders.Count() +
+                                              normalMappingShaders->Count() + depthPrepass->shaders.Count() +
+                                              deferredRenderer->roadShaders.Count() + spotShadows->ShaderCount() +
+                                              sunShadows->ShaderCount() + terrain->shaders.Count();
+
         // don't forget to enable shader before setting uniforms
         ourShader.use();
         ourShader.setVec3("viewPosition", programState->camera.Position);
         ourShader.setFloat("material.shininess", 32.0f);
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),
-                                                (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 3000.0f);
-        glm::mat4 view = programState->camera.GetViewMatrix();
         ourShader.setMat4("projection", projection);
         ourShader.setMat4("view", view);
 
         setDirLight(ourShader);
-        setPointLight(ourShader, pointLight, lightPositions);
-        setSpotLight(ourShader, pointLight, lightPositions);
+        setLampLight(ourShader, pointLight);
+        bindLampLists(ourShader, *lightClusters, *objectLights, lampShadowMaps);
+        bindSunShadows(ourShader, sunShadowMaps);
+        if (lightmapped) {
+            lightmapShader.use();
+            lightmapShader.setVec3("viewPosition", programState->camera.Position);
+            lightmapShader.setFloat("material.shininess", 32.0f);
+            lightmapShader.setMat4("projection", projection);
+            lightmapShader.setMat4("view", view);
+            setDirLight(lightmapShader);
+            bindSunShadows(lightmapShader, sunShadowMaps);
+            lightmaps->Bind(lightmapShader, lightSet);
+        }
 
-        // render the loaded model
+        // render the scene's models, each at the coarsest level of detail whose error stays below
+        // LodPixelError on screen; a level change cross-fades the old and new level with a dither.
+        // Instances whose bounding sphere is smaller than ImpostorPixels become impostors.
+        impostors->Prepare(sceneModels);
+        // whole clusters beyond HLODDistance are drawn as their merged proxies instead
+        hlodCovered.resize(scene.instances.size());
+        hlod->switchDistance = programState->HLODDistance;
+        if (programState->HLODEnabled)
+            hlod->Select(programState->camera.Position, meshFrustum, hlodCovered);
+        else
+            hlodCovered.assign(scene.instances.size(), 0);
         glm::mat4 model = glm::mat4(1.0f); //inicijalizacija
+        lodSelector.pixelError = programState->LodPixelError;
+        lodSelector.crossFade = programState->LodCrossFade;
+        if (lodSelector.instances.size() != scene.instances.size())
+            lodSelector.Resize(scene.instances.size());
+        float projectionScale = LodSelector::ProjectionScale(glm::radians(programState->camera.Zoom), (float) SCR_HEIGHT);
+        instanceDraws.clear();
+        for (unsigned int i = 0; i < scene.instances.size(); i++) {
+            if (!culling.instanceVisible[i]) {
+                rg::frameStats().instancesCulled++;
+                continue;
+            }
+            if (hlodCovered[i]) {
+                rg::frameStats().instancesHLOD++;
+                continue;
+            }
+            Model &instanceModel = *sceneModels[scene.instances[i].model];
+            if (programState->ImpostorsEnabled && impostors->Has(&instanceModel)) {
+                const ImpostorAtlas &atlas = impostors->Atlas(&instanceModel);
+                glm::vec3 center = glm::vec3(scene.transforms[i] * glm::vec4(atlas.center, 1.0f));
+                float radius = atlas.radius * LodSelector::MaxScale(scene.transforms[i]);
+                float distance = glm::distance(center, programState->camera.Position);
+                if (distance > radius && radius * projectionScale / distance < programState->ImpostorPixels) {
+                    impostors->Add(&instanceModel, scene.transforms[i]);
+                    rg::frameStats().instancesImpostor++;
+                    continue;
+                }
+            }
+            InstanceLod lod;
+            if (programState->LodEnabled) {
+                AABB bounds = culling.instanceBounds.Get(i);
+                glm::vec3 nearest = glm::clamp(programState->camera.Position, bounds.min, bounds.max);
+                lod = lodSelector.Update(i, instanceModel.lodErrors, LodSelector::MaxScale(scene.transforms[i]),
+                                         glm::distance(nearest, programState->camera.Position), projectionScale,
+                                         deltaTime);
+            }
+            instanceDraws.push_back(InstanceDraw{i, lod});
+            rg::frameStats().instancesDrawn++;
+            rg::frameStats().instancesPerLod[std::min<unsigned int>(lod.level, rg::FrameStats::LOD_LEVELS - 1)]++;
+        }
 
-        // house
-        model = glm::mat4(1.0f);
-        model = glm::translate(model,glm::vec3(22.0f, 9.8f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.2, 0.2, 0.2));
-        ourShader.setMat4("model", model);
-        ourModelHouse.Draw(ourShader);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(22.0f, 0.0f, -26.0f));
-        model = glm::rotate(model, 1.60f, glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.125f, 0.125f, 0.125f));
-        ourShader.setMat4("model", model);
-        oldCompany.Draw(ourShader);
-
-        model = glm::mat4(1.0f);
-        model  = glm::translate(model, glm::vec3(-23.5f, 0, -22.0));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.013f, 0.013f, 0.013f));
-        ourShader.setMat4("model", model);
-        blueHouse.Draw(ourShader);
-
-        model = glm::mat4(1.0f);
-        model = model = glm::translate(model, glm::vec3(-24.0f, 0, 5.0f));
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(1.33f, 1.33f, 1.33f));
-        ourShader.setMat4("model", model);
-        brickHouse.Draw(ourShader);
-
-        model = glm::mat4(1.0f);
-        model = model = glm::translate(model, glm::vec3(-20.0f, 0, 24.0));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        model = glm::scale(model, glm::vec3(0.23f, 0.23f, 0.23f));
-        ourShader.setMat4("model", model);
-        polHouse.Draw(ourShader);
-
-        // lada
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(19.0f, 0.0f, 27.0f));
-        model = glm::scale(model, glm::vec3(0.07f));
-        ourShader.setMat4("model", model);
-        lada.Draw(ourShader);
-
-        // well
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-10.0f, 0.0F, -8.0f)); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(0.023f));
-        ourShader.setMat4("model", model);
-        well.Draw(ourShader);
-
-        // tree
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(24.0f, 0.0f, 25.0f));
-        model = glm::scale(model, glm::vec3(1.62f));
-        ourShader.setMat4("model", model);
-        tree.Draw(ourShader);
-
-        // street lamp
-        glm::vec3 lampPositions[] = {
-                glm::vec3(-7.0f, 2.2f, -35.0f),
-                glm::vec3(-7.0f, 2.2f, -3.0f),
-                glm::vec3(-7.0f, 2.2f, 29.0f),
-                glm::vec3(4.5f, 2.2f, -20.0f),
-                glm::vec3(4.5f, 2.2f, 12.0f),
-                glm::vec3(4.5f, 2.2f, 44.0f)
-        };
-        for(int i = 0; i < 6; i++)
-        {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, lampPositions[i]);
-            if(i > 2)
-                model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-            model = glm::scale(model, glm::vec3(0.005f, 0.005f, 0.005f));
-            ourShader.setMat4("model", model);
-            streetLamp.Draw(ourShader);
+        const bool deferred = programState->RenderPath == RENDER_DEFERRED;
+        const bool prepass = programState->RenderPath == RENDER_FORWARD_PREPASS;
+
+        // GPU time of the opaque passes, to compare the rendering paths
+        depthPrepass->BeginTiming(programState->RenderPath);
+
+        // deferred: models, grass, bushes and road are written into the G-buffer, then lit once by the
+        // sun and once by every visible lamp inside the lamp's screen rectangle
+        if (deferred) {
+            depthPrepass->BeginMeasure();
+            deferredRenderer->BeginGeometry(projection, view);
+            Shader &geometryShader = deferredRenderer->geometryShader;
+            geometryShader.use();
+            for (const InstanceDraw &draw : instanceDraws)
+                drawInstance(scene, sceneModels, *occlusion, geometryShader, draw, meshFrustum, false);
+            geometryShader.setInt("material.texture_diffuse1", 0);
+            geometryShader.setInt("material.texture_specular1", 1);
+            glEnable(GL_CULL_FACE);
+            glBindVertexArray(planeVAO);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, grassTexture);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, grassSpecTexture);
+            for (unsigned int i = 0; i < scene.tiles.size(); i++)
+            {
+                if (!culling.tileVisible[i])
+                    continue;
+                geometryShader.setMat4("model", grassTransform(scene.tiles[i]));
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                rg::countDrawCall(2);
+            }
+            glDisable(GL_CULL_FACE);
+            deferredRenderer->vegetationShader.use();
+            vegetationField->Draw(deferredRenderer->vegetationShader, programState->camera.Position,
+                                  transparentTexture, false);
+            Shader &roadShader = deferredRenderer->roadShaders.Use(parallaxFeatures);
+            roadShader.setMat4("projection", projection);
+            roadShader.setMat4("view", view);
+            roadShader.setVec3("viewPos", programState->camera.Position);
+            setParallax(roadShader, coneStepMap.get());
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, roadTexture);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, roadNormalTexture);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, roadDispTexture);
+            for (unsigned int i = 0; i < scene.tiles.size(); i++)
+            {
+                if (!culling.tileVisible[i])
+                    continue;
+                roadShader.setMat4("model", roadTransform(scene.tiles[i]));
+                renderQuad();
+                rg::countDrawCall(2);
+            }
+            glActiveTexture(GL_TEXTURE0);
+            deferredRenderer->EndGeometry();
+            depthPrepass->EndMeasure(framebufferWidth * framebufferHeight);
+
+            deferredRenderer->lightShader.use();
+            setDirLight(deferredRenderer->lightShader);
+            setLampLight(deferredRenderer->lightShader, pointLight);
+            bindSunShadows(deferredRenderer->lightShader, sunShadowMaps);
+            deferredRenderer->Light(viewProjection, programState->camera.Position, visibleLamps, lightRadius);
+            rg::frameStats().lampsShaded = deferredRenderer->LampsLit();
         }
 
-        // tree
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(24.0f, 0.0f, 25.0f));
-        model = glm::scale(model, glm::vec3(1.62f));
-        ourShader.setMat4("model", model);
-        tree.Draw(ourShader);
-
-        // vegetation
-        vector<glm::vec3> vegetationPositions = {
-                glm::vec3(4.1f, 0.82f, -19.7f),
-                glm::vec3(-10.0f, 0.82f, -6.0f),
-                glm::vec3(-14.0f, 0.8f, -10.0f),
-                glm::vec3(14.0f, 0.8f, -11.0f),
-                glm::vec3(15.2f, 0.8f, -11.5f),
-                glm::vec3(6.2f, 0.8f, 38.0f),
-                glm::vec3(-14.0f, 0.8f, 24.0f),
-                glm::vec3(-8.88f, 0.8f, 31.383f),
-        };
-        blendingShader.use();
-        setDirLight(blendingShader);
-        setPointLight(blendingShader, pointLight, lightPositions);
-        setSpotLight(blendingShader, pointLight, lightPositions);
-        blendingShader.setMat4("projection", projection);
-        blendingShader.setMat4("view", view);
-        glBindVertexArray(transparentVAO);
-        glBindTexture(GL_TEXTURE_2D, transparentTexture);
-        for (unsigned int i = 0; i < vegetationPositions.size(); i++)
-        {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, vegetationPositions[i]);
-            model = glm::scale(model, glm::vec3(1.7f));
-            blendingShader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
+        // depth pre-pass: the opaque geometry below goes into the depth buffer first (the bushes alpha
+        // tested, fading instances with the same dither), so each pixel is lit only once
+        if (prepass) {
+            Shader &depthShader = depthPrepass->Begin(projection, view);
+            for (const InstanceDraw &draw : instanceDraws)
+                drawInstance(scene, sceneModels, *occlusion, depthShader, draw, meshFrustum, true);
+            if (programState->HLODEnabled)
+                hlod->DrawDepth(depthShader);
+            Shader &plantDepthShader = vegetationField->depthShader;
+            plantDepthShader.use();
+            plantDepthShader.setMat4("projection", projection);
+            plantDepthShader.setMat4("view", view);
+            vegetationField->Draw(plantDepthShader, programState->camera.Position, transparentTexture, true);
+            depthShader.use();
+            glEnable(GL_CULL_FACE);
+            glBindVertexArray(planeVAO);
+            for (unsigned int i = 0; i < scene.tiles.size(); i++)
+            {
+                if (!culling.tileVisible[i])
+                    continue;
+                depthShader.setMat4("model", grassTransform(scene.tiles[i]));
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                rg::countDrawCall(2);
+            }
+            glDisable(GL_CULL_FACE);
+            for (unsigned int i = 0; i < scene.tiles.size(); i++)
+            {
+                if (!culling.tileVisible[i])
+                    continue;
+                depthShader.setMat4("model", roadTransform(scene.tiles[i]));
+                renderQuad();
+                rg::countDrawCall(2);
+            }
+            depthPrepass->BeginShading();
+        }
+        if (!deferred) {
+            // samples shaded per pixel, to compare the overdraw of the rendering paths
+            depthPrepass->BeginMeasure();
+            ourShader.use();
+            GLint instanceListLocation = objectLights->ListLocation(ourShader);
+            for (const InstanceDraw &draw : instanceDraws) {
+                if (lightmapped && !lightmaps->instanceRects[draw.instance].Empty())
+                    continue;
+                if (objectLightLists)
+                    ObjectLights::Use(instanceListLocation, objectLights->instanceLists[draw.instance]);
+                drawInstance(scene, sceneModels, *occlusion, ourShader, draw, meshFrustum, false);
+            }
+            if (lightmapped) {
+                lightmapShader.use();
+                for (const InstanceDraw &draw : instanceDraws) {
+                    const LightmapRect &rect = lightmaps->instanceRects[draw.instance];
+                    if (rect.Empty())
+                        continue;
+                    lightmaps->Use(lightmapShader, rect);
+                    drawInstance(scene, sceneModels, *occlusion, lightmapShader, draw, meshFrustum, false);
+                    rg::frameStats().instancesLightmapped++;
+                }
+            }
+        }
+        if (programState->HLODEnabled) {
+            hlod->shader.use();
+            setDirLight(hlod->shader);
+            setPointLight(hlod->shader, pointLight, lightPositions);
+            setSpotLight(hlod->shader, pointLight, lightPositions);
+            hlod->Draw(projection, view);
+            rg::frameStats().hlodProxiesDrawn = hlod->SelectedCount();
+        }
+        // impostors write their own depth per pixel, they can't match the pre-pass
+        if (prepass)
+            depthPrepass->End();
+        impostors->shader.use();
+        setDirLight(impostors->shader);
+        setPointLight(impostors->shader, pointLight, lightPositions);
+        setSpotLight(impostors->shader, pointLight, lightPositions);
+        impostors->Draw(viewProjection, programState->camera.Position);
+        if (prepass)
+            depthPrepass->BeginShading();
+
+        // forward shading of the rest
+        if (!deferred) {
+            // vegetation, one instanced draw per visible cell
+            blendingShader.use();
+            setDirLight(blendingShader);
+            setLampLight(blendingShader, pointLight);
+            blendingShader.setVec3("viewPosition", programState->camera.Position);
+            bindLampLists(blendingShader, *lightClusters, *objectLights, lampShadowMaps);
+            bindSunShadows(blendingShader, sunShadowMaps);
+            blendingShader.setMat4("projection", projection);
+            blendingShader.setMat4("view", view);
+            vegetationField->Draw(blendingShader, programState->camera.Position, transparentTexture, true,
+                                  objectLightLists ? &objectLights->vegetationCellLists : nullptr,
+                                  objectLights->ListLocation(blendingShader));
+
+            // grass and face culling
+            Shader &grassShader = lightmapped ? lightmapShader : ourShader;
+            grassShader.use();
+            GLint tileListLocation = objectLights->ListLocation(ourShader);
+            glEnable(GL_CULL_FACE);
+            glBindVertexArray(planeVAO);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, grassTexture);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, grassSpecTexture);
+            for (unsigned int i = 0; i < scene.tiles.size(); i++)
+            {
+                if (!culling.tileVisible[i])
+                    continue;
+                grassShader.setMat4("model", grassTransform(scene.tiles[i]));
+                if (lightmapped)
+                    lightmaps->Use(grassShader, lightmaps->groundRects[i]);
+                else if (objectLightLists)
+                    ObjectLights::Use(tileListLocation, objectLights->tileLists[i]);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                rg::countDrawCall(2);
+            }
+            glDisable(GL_CULL_FACE);
+
+
+            // road, normal mapping and parallax mapping
+            // configure view/projection matrices
+            projection = glm::perspective(glm::radians(programState->camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, cameraFar);
+            view = programState->camera.GetViewMatrix();
+            normalMappingShader.use();
+            normalMappingShader.setMat4("projection", projection);
+            normalMappingShader.setMat4("view", view);
+            normalMappingShader.setVec3("viewPos", programState->camera.Position);
+            setParallax(normalMappingShader, coneStepMap.get());
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, roadTexture);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, roadNormalTexture);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, roadDispTexture);
+
+            setDirLight(normalMappingShader);
+            setLampLight(normalMappingShader, pointLight);
+            bindLampLists(normalMappingShader, *lightClusters, *objectLights, lampShadowMaps);
+            bindSunShadows(normalMappingShader, sunShadowMaps);
+            if (lightmapped)
+                lightmaps->Bind(normalMappingShader, lightSet);
+
+            // render one normal-mapped road segment per tile
+            GLint roadListLocation = objectLights->ListLocation(normalMappingShader);
+            for (unsigned int i = 0; i < scene.tiles.size(); i++)
+            {
+                if (!culling.tileVisible[i])
+                    continue;
+                normalMappingShader.setMat4("model", roadTransform(scene.tiles[i]));
+                if (lightmapped)
+                    lightmaps->Use(normalMappingShader, lightmaps->roadRects[i]);
+                else if (objectLightLists)
+                    ObjectLights::Use(roadListLocation, objectLights->tileLists[i]);
+                renderQuad();
+                rg::countDrawCall(2);
+            }
         }
 
-        // grass and face culling
-        ourShader.use();
-        glEnable(GL_CULL_FACE);
-        glBindVertexArray(planeVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, grassTexture);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, grassSpecTexture);
-        model = glm::mat4(1.0f);
-        model = glm::scale(model, glm::vec3(10, 0, 10));
-        ourShader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        glDisable(GL_CULL_FACE);
+        // end of the opaque shading passes
+        if (!deferred)
+            depthPrepass->EndMeasure(framebufferWidth * framebufferHeight);
+        if (prepass)
+            depthPrepass->End();
+        depthPrepass->EndTiming();
+        rg::frameStats().overdraw = depthPrepass->Overdraw();
+        int timedPath;
+        float gpuMilliseconds;
+        if (depthPrepass->Timing(timedPath, gpuMilliseconds)) {
+            float &gpuTime = renderPathGpuTime[timedPath];
+            gpuTime = gpuTime > 0.0f ? gpuTime + (gpuMilliseconds - gpuTime) * 0.05f : gpuMilliseconds;
+        }
 
+        // the terrain, on every path after the village: the depth test keeps it out from under the ground
+        // tiles and houses, so only the hills around them are shaded
+        if (programState->TerrainEnabled) {
+            Shader &terrainShader = terrain->shaders.Use(lightingFeatures);
+            terrainShader.setMat4("projection", projection);
+            terrainShader.setMat4("view", view);
+            setDirLight(terrainShader);
+            bindSunShadows(terrainShader, sunShadowMaps);
+            terrain->Draw(terrainShader, programState->camera.Position, grassTexture);
+        }
 
         // light
         lightCubeShader.use();
         lightCubeShader.setMat4("projection", projection);
         lightCubeShader.setMat4("view", view);
         glBindVertexArray(lightCubeVAO);
-        for(int i = 0; i < 6; i++)
+        for(unsigned int i = 0; i < scene.lights.size(); i++)
         {
-            if(!isDay)
+            if(lampsLit && culling.lightVisible[i])
             {
                 model = glm::mat4(1.0f);
-                model = glm::translate(model, lightPositions[i]);
+                model = glm::translate(model, scene.lights[i]);
                 model = glm::scale(model, glm::vec3(0.25f, 0.01f, 0.082f));
-                lightCubeShader.setVec3("lightColor", glm::vec3(0.9f, 0.8f, 0.5f));
+                lightCubeShader.setVec3("lightColor", glm::vec3(0.9f, 0.8f, 0.5f) * lighting.lamps);
                 lightCubeShader.setMat4("model", model);
                 glDrawArrays(GL_TRIANGLES, 0, 36);
+                rg::countDrawCall(12);
             }
         }
 
-        // road, normal mapping and parallax mapping
-        // configure view/projection matrices
-        projection = glm::perspective(glm::radians(programState->camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 3000.0f);
-        view = programState->camera.GetViewMatrix();
-        normalMappingShader.use();
-        normalMappingShader.setMat4("projection", projection);
-        normalMappingShader.setMat4("view", view);
-        // render normal-mapped quad
-        model = glm::mat4(1.0f);
-        normalMappingShader.setMat4("model", model);
-        normalMappingShader.setVec3("viewPos", programState->camera.Position);
-        normalMappingShader.setFloat("heightScale", heightScale);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, roadTexture);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, roadNormalTexture);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, roadDispTexture);
-
-        normalMappingShader.setVec3("lightPos.direction[0]", lightPositions[0]);
-        normalMappingShader.setVec3("lightPos.direction[1]", lightPositions[1]);
-        normalMappingShader.setVec3("lightPos.direction[2]", lightPositions[2]);
-        normalMappingShader.setVec3("lightPos.direction[3]", lightPositions[3]);
-        normalMappingShader.setVec3("lightPos.direction[4]", lightPositions[4]);
-        normalMappingShader.setVec3("lightPos.direction[5]", lightPositions[5]);
-        setDirLight(normalMappingShader);
-        setPointLight(normalMappingShader, pointLight, lightPositions);
-        setSpotLight(normalMappingShader, pointLight, lightPositions);
-
-        renderQuad();
-
-
-        // draw skybox as last
-        glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-        skyboxShader.use();
-        skyboxShader.setInt("skybox", 0);
-        view = glm::mat4(glm::mat3(programState->camera.GetViewMatrix())); // remove translation from the view matrix
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-
-        // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        if(isDay)
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTextureDay);
-        else
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTextureNight);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS); // set depth function back to default
+        // draw the sky as last, where nothing covers the far plane; a dark blue night sky under the moon
+        sky->Draw(projection, view, lighting.night, glm::vec3(0.01f, 0.015f, 0.035f));
+        rg::countDrawCall(1);
+
+        // translucent meshes over everything, unsorted: weighted and blended in the OIT targets, or a
+        // dithered share of their pixels where those can't be used
+        translucentDraws.clear();
+        for (const InstanceDraw &draw : instanceDraws)
+            if (sceneModels[scene.instances[draw.instance].model]->Translucent())
+                translucentDraws.push_back(draw);
+        if (!translucentDraws.empty()) {
+            const bool orderIndependent = programState->OrderIndependentTransparency && translucency->Supported();
+            Shader &translucentShader = modelShaders->Use(lightingFeatures | SHADER_TRANSLUCENT |
+                                                          (orderIndependent ? 0 : SHADER_ALPHA_TEST));
+            translucentShader.setVec3("viewPosition", programState->camera.Position);
+            translucentShader.setFloat("material.shininess", 32.0f);
+            translucentShader.setMat4("projection", projection);
+            translucentShader.setMat4("view", view);
+            setDirLight(translucentShader);
+            setLampLight(translucentShader, pointLight);
+            bindLampLists(translucentShader, *lightClusters, *objectLights, lampShadowMaps);
+            bindSunShadows(translucentShader, sunShadowMaps);
+            if (orderIndependent)
+                translucency->Begin();
+            GLint translucentListLocation = objectLights->ListLocation(translucentShader);
+            for (const InstanceDraw &draw : translucentDraws) {
+                if (objectLightLists)
+                    ObjectLights::Use(translucentListLocation, objectLights->instanceLists[draw.instance]);
+                drawInstance(scene, sceneModels, *occlusion, translucentShader, draw, meshFrustum, false, true);
+            }
+            if (orderIndependent)
+                translucency->End();
+            rg::frameStats().instancesTranslucent = translucentDraws.size();
+            rg::frameStats().translucentDithered = !orderIndependent;
+        }
 
 
         if (programState->ImGuiEnabled)
-            DrawImGui(programState);
+            DrawImGui(programState, scene);
 
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
+        // waits out the frame-rate cap before polling, so the next frame starts from fresh input
+        framePacer.EndFrame();
         glfwPollEvents();
+
+        if (stressTest)
+        {
+            glFinish();
+            if (stressTest->EndFrame(glfwGetTime() - frameStart, scene))
+            {
+                if (stressTest->NextScene(scene))
+                {
+                    prepareScene(scene, sceneModels, culling, lightRadius, *hlod);
+                    vegetationField->Scatter(scene, culling);
+                    terrain->SetVillage(culling.SceneBounds());
+                    spotShadows->Invalidate();
+                    sunShadows->SetSceneBounds(culling.SceneBounds());
+                }
+                else
+                {
+                    stressTest->WriteReport("stress_stats.csv");
+                    glfwSetWindowShouldClose(window, true);
+                }
+            }
+        }
     }
 
-    programState->SaveToFile("resources/program_state.txt");
+    if (!stressTest)
+        programState->SaveToFile("resources/program_state.txt");
     delete programState;
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -705,11 +1381,27 @@ int main() {
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
-    glDeleteVertexArrays(1, &skyboxVAO);
+    onFramebufferResize = nullptr;
+    occlusion.reset();
+    impostors.reset();
+    hlod.reset();
+    depthPrepass.reset();
+    deferredRenderer.reset();
+    translucency.reset();
+    lightClusters.reset();
+    spotShadows.reset();
+    sunShadows.reset();
+    sky.reset();
+    lightmaps.reset();
+    modelShaders.reset();
+    vegetationField.reset();
+    terrain.reset();
+    normalMappingShaders.reset();
+    coneStepMap.reset();
+    objectLights.reset();
     glDeleteVertexArrays(1, &planeVAO);
     glDeleteVertexArrays(1, &transparentVAO);
     glDeleteVertexArrays(1, &lightCubeVAO);
-    glDeleteBuffers(1, &skyboxVAO);
     glDeleteBuffers(1, &planeVAO);
     glDeleteBuffers(1, &lightCubeVAO);
     glDeleteBuffers(1, &transparentVAO);
@@ -724,15 +1416,19 @@ int main() {
 void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
+}
 
+// one simulation step of walking with the keys held down
+// -------------------------------------------------------
+void moveCamera(GLFWwindow *window, float step) {
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        programState->camera.ProcessKeyboard(FORWARD, deltaTime);
+        programState->camera.ProcessKeyboard(FORWARD, step);
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        programState->camera.ProcessKeyboard(BACKWARD, deltaTime);
+        programState->camera.ProcessKeyboard(BACKWARD, step);
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        programState->camera.ProcessKeyboard(LEFT, deltaTime);
+        programState->camera.ProcessKeyboard(LEFT, step);
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        programState->camera.ProcessKeyboard(RIGHT, deltaTime);
+        programState->camera.ProcessKeyboard(RIGHT, step);
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -741,6 +1437,11 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    framebufferWidth = width;
+    framebufferHeight = height;
+    // a minimized window has no pixels, the targets keep their size until it comes back
+    if (onFramebufferResize && width > 0 && height > 0)
+        onFramebufferResize(width, height);
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -768,7 +1469,23 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
     programState->camera.ProcessMouseScroll(yoffset);
 }
 
-void DrawImGui(ProgramState *programState) {
+// glfw: a left click picks the instance under the cursor, or in the screen center while the camera has the mouse
+// -----------------------------------------------------------------------------------------------------------
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods) {
+    if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS)
+        return;
+    if (programState->ImGuiEnabled) {
+        if (ImGui::GetIO().WantCaptureMouse)
+            return;
+        glfwGetCursorPos(window, &pickX, &pickY);
+    } else {
+        pickX = SCR_WIDTH / 2.0;
+        pickY = SCR_HEIGHT / 2.0;
+    }
+    pickRequested = true;
+}
+
+void DrawImGui(ProgramState *programState, const Scene &scene) {
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
@@ -789,6 +1506,129 @@ void DrawImGui(ProgramState *programState) {
         ImGui::End();
     }
 
+    {
+        const rg::FrameStats &stats = rg::frameStats();
+        ImGui::Begin("Frame stats");
+        const FramePacer::Stats &pacing = framePacer.Statistics();
+        ImGui::Text("Frame time: %.2f ms (work %.2f, sleep %.2f), %d simulation steps", pacing.frameMilliseconds,
+                    pacing.workMilliseconds, pacing.sleepMilliseconds, pacing.simulationSteps);
+        ImGui::Text("Last %d frames: %.2f ms average, %.2f ms 99th percentile, %.2f ms worst, %.2f ms jitter",
+                    FramePacer::HISTORY, pacing.averageMilliseconds, pacing.percentile99Milliseconds,
+                    pacing.worstMilliseconds, pacing.jitterMilliseconds);
+        ImGui::PlotLines("Frame times", framePacer.History(), FramePacer::HISTORY, framePacer.HistoryOffset(),
+                         nullptr, 0.0f, 50.0f, ImVec2(0.0f, 60.0f));
+        ImGui::Combo("Swap", &programState->SwapMode, "Immediate\0Vsync\0Adaptive vsync\0");
+        if (framePacer.AdaptiveFallback()) {
+            ImGui::SameLine();
+            ImGui::Text("(unsupported, vsync)");
+        }
+        ImGui::SliderInt("Frame rate cap", &programState->FrameRateCap, 0, 240,
+                         programState->FrameRateCap > 0 ? "%d fps" : "off");
+        ImGui::Text("Missed deadlines: %u, simulation dropped: %.2f s", pacing.missedDeadlines,
+                    pacing.droppedSimulationSeconds);
+        ImGui::Checkbox("Fixed-step simulation", &programState->FixedStepSimulation);
+        ImGui::SameLine();
+        ImGui::SliderInt("Steps per second", &programState->SimulationRate, 20, 240);
+        ImGui::Text("Draw calls: %u", stats.drawCalls);
+        ImGui::Text("Triangles: %llu", stats.triangles);
+        ImGui::Checkbox("Frustum culling", &programState->FrustumCullingEnabled);
+        ImGui::Checkbox("BVH culling", &programState->BVHCullingEnabled);
+        ImGui::Text("BVH nodes visited: %u", stats.bvhNodesVisited);
+        ImGui::Combo("Occlusion culling", &programState->OcclusionCullingMode, "Off\0Hi-Z\0Queries\0Software\0");
+        ImGui::Text("Instances/lights occluded: %u / %u", stats.instancesOccluded, stats.lightsOccluded);
+        ImGui::Text("Instances drawn/culled: %u / %u", stats.instancesDrawn, stats.instancesCulled);
+        ImGui::Text("Meshes culled: %u", stats.meshesCulled);
+        ImGui::Checkbox("Mesh LOD", &programState->LodEnabled);
+        ImGui::SameLine();
+        ImGui::Checkbox("Cross-fade", &programState->LodCrossFade);
+        ImGui::DragFloat("LOD error (px)", &programState->LodPixelError, 0.05f, 0.1f, 20.0f);
+        ImGui::Text("Instances per LOD: %u / %u / %u / %u", stats.instancesPerLod[0], stats.instancesPerLod[1],
+                    stats.instancesPerLod[2], stats.instancesPerLod[3]);
+        ImGui::Checkbox("Impostors", &programState->ImpostorsEnabled);
+        ImGui::DragFloat("Impostor below (px)", &programState->ImpostorPixels, 1.0f, 4.0f, 512.0f);
+        ImGui::Text("Instances as impostors: %u", stats.instancesImpostor);
+        ImGui::Checkbox("HLOD", &programState->HLODEnabled);
+        ImGui::DragFloat("HLOD distance", &programState->HLODDistance, 1.0f, 10.0f, 2000.0f);
+        ImGui::Text("HLOD proxies drawn: %u, instances replaced: %u", stats.hlodProxiesDrawn, stats.instancesHLOD);
+        ImGui::Text("Plants drawn/culled: %u / %u in %u cells", stats.vegetationInstances, stats.vegetationCulled,
+                    stats.vegetationCells);
+        ImGui::Checkbox("Terrain", &programState->TerrainEnabled);
+        ImGui::DragFloat("Terrain detail distance", &programState->TerrainDetailDistance, 1.0f,
+                         2.0f * Terrain::LEAF_SIZE, 1000.0f);
+        ImGui::Text("Terrain chunks drawn/culled: %u / %u", stats.terrainChunks, stats.terrainChunksCulled);
+        ImGui::Text("Terrain tiles streamed/cached: %u / %u", stats.terrainTilesStreamed, stats.terrainTilesResident);
+        ImGui::Combo("Rendering", &programState->RenderPath, "Forward\0Forward + depth pre-pass\0Deferred\0");
+        ImGui::Text("Overdraw: %.2fx", stats.overdraw);
+        ImGui::Text("Opaque GPU time forward / pre-pass / deferred: %.2f / %.2f / %.2f ms",
+                    renderPathGpuTime[RENDER_FORWARD], renderPathGpuTime[RENDER_FORWARD_PREPASS],
+                    renderPathGpuTime[RENDER_DEFERRED]);
+        if (programState->RenderPath == RENDER_DEFERRED)
+            ImGui::Text("Lamps shaded: %u", stats.lampsShaded);
+        ImGui::Text("Lights culled: %u", stats.lightsCulled);
+        ImGui::Text("Shader permutations compiled: %u", stats.shaderPermutations);
+        ImGui::Checkbox("Per-object lamp lists", &programState->ObjectLightLists);
+        ImGui::SliderFloat("Time of day (N)", &timeOfDay, 0.0f, 24.0f, "%.2f h");
+        ImGui::Checkbox("Animate", &programState->TimeAnimated);
+        ImGui::SameLine();
+        ImGui::DragFloat("Hours per second", &programState->HoursPerSecond, 0.01f, 0.0f, 4.0f);
+        ImGui::Checkbox("Order-independent transparency", &programState->OrderIndependentTransparency);
+        ImGui::Text("Translucent instances: %u%s", stats.instancesTranslucent,
+                    stats.translucentDithered ? " (dithered)" : "");
+        ImGui::Checkbox("Sun shadows", &programState->SunShadowsEnabled);
+        if (programState->SunShadowsEnabled) {
+            for (int c = 0; c < SunShadows::CASCADES; c++) {
+                ImGui::PushID(c);
+                ImGui::SliderInt("Refresh every (frames)", &programState->SunShadowIntervals[c], 1, 16);
+                ImGui::SameLine();
+                ImGui::Text("cascade %d: %.2f ms, %u casters, %u texels", c, stats.sunCascadeMilliseconds[c],
+                            stats.sunCascadeCasters[c], stats.sunCascadeTexels[c]);
+                ImGui::PopID();
+            }
+            ImGui::Text("Cascades refreshed this frame: %u", stats.sunCascadesUpdated);
+        }
+        if (stats.lightmapWidth) {
+            ImGui::Checkbox("Lightmaps", &programState->LightmapsEnabled);
+            ImGui::SameLine();
+            ImGui::Text("%u x %u atlas, instances lit from it: %u", stats.lightmapWidth, stats.lightmapHeight,
+                        stats.instancesLightmapped);
+        }
+        else
+            ImGui::Text("Lightmaps: none for this scene, bake with --bake-lightmaps");
+        ImGui::Checkbox("Lamp shadows", &programState->LampShadows);
+        if (programState->LampShadows) {
+            ImGui::SliderInt("Static shadows per frame", &programState->LampShadowsStatic, 1, 8);
+            ImGui::SliderInt("Dynamic shadows per frame", &programState->LampShadowsDynamic, 0, 16);
+            ImGui::Text("Shadow tiles cached: %u, rendered static / dynamic: %u / %u", stats.spotShadowsCached,
+                        stats.spotShadowsStatic, stats.spotShadowsDynamic);
+        }
+        ImGui::SliderFloat("Road height scale (Q/E)", &heightScale, 0.0f, 0.1f);
+        ImGui::Combo("Parallax", &programState->ParallaxMode, "Offset\0Occlusion\0Cone step (baked on first use)\0");
+        ImGui::SliderInt("Parallax layers", &programState->ParallaxLayers, 4, 128);
+        ImGui::DragFloat("Parallax distance", &programState->ParallaxDistance, 1.0f, 1.0f, 500.0f);
+        if (programState->ObjectLightLists)
+            ImGui::Text("Objects lit: %u, list entries: %u, most per object: %u", stats.objectLightObjects,
+                        stats.objectLightIndices, stats.objectLightMax);
+        else
+            ImGui::Text("Clustered lamps: %u, list entries: %u, most per cluster: %u", stats.clusterLamps,
+                        stats.clusterIndices, stats.clusterMaxLamps);
+        ImGui::Text("Resident memory: %.1f MB", rg::residentMemoryBytes() / (1024.0 * 1024.0));
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("Picking");
+        ImGui::Text("Left click an object to pick it");
+        int picked = programState->PickedInstance;
+        if (picked >= 0) {
+            const SceneInstance &instance = scene.instances[picked];
+            ImGui::Text("Instance %d: %s", picked, scene.models[instance.model].name.c_str());
+            ImGui::Text("Position: (%.2f, %.2f, %.2f)", instance.position.x, instance.position.y, instance.position.z);
+        } else {
+            ImGui::Text("Nothing picked");
+        }
+        ImGui::End();
+    }
+
     {
         ImGui::Begin("Camera info");
         const Camera& c = programState->camera;
@@ -814,22 +1654,23 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
         }
     }
 
+    // jumps between noon and midnight
     if (key == GLFW_KEY_N && action == GLFW_PRESS)
-        isDay = !isDay;
+        timeOfDay = std::fabs(timeOfDay - 12.0f) < 6.0f ? 0.0f : 12.0f;
 
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
     {
-        if (heightScale > 0.0f)
-            heightScale -= 0.5f;
+        if (heightScale > 0.005f)
+            heightScale -= 0.005f;
         else
             heightScale = 0.0f;
     }
     else if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
     {
-        if (heightScale < 7.5f)
-            heightScale += 0.5f;
+        if (heightScale < 0.1f)
+            heightScale += 0.005f;
         else
-            heightScale = 7.5f;
+            heightScale = 0.1f;
     }
 }
 
@@ -870,68 +1711,51 @@ unsigned int loadTexture(char const * path)
     return textureID;
 }
 
-// loads a cubemap texture from 6 individual texture faces
-// order:
-// +X (right)
-// -X (left)
-// +Y (top)
-// -Y (bottom)
-// +Z (front)
-// -Z (back)
-// -------------------------------------------------------
-unsigned int loadCubemap(vector<std::string> faces)
+// The sun's light tinted by the air it crosses, relative to noon, and fading out at sunset; then the
+// moon's, opposite it. The sky's light is the atmosphere's, as bright at noon as sunLight.ambient, with
+// the flat moonlit ambient under it at night.
+DayLighting dayLightingAt(float hours)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
+    static const glm::vec3 noonTransmittance = glm::max(atmosphere.Transmittance(-sunDirection), glm::vec3(1e-6f));
+    static const float ambientScale = SphericalHarmonics::Luminance(sunLight.ambient) /
+                                      std::max(atmosphere.Ambient(-sunDirection).AverageLuminance(), 1e-9f);
+    DayLighting day;
+    day.sun = atmosphere.SunAt(hours);
+    // sine of the sun's elevation
+    const float elevation = day.sun.y;
+    const float sunFade = glm::smoothstep(0.0f, 0.1f, elevation);
+    const float moonFade = glm::smoothstep(0.0f, 0.1f, -elevation);
+    day.sunUp = elevation > 0.0f;
+    if (day.sunUp) {
+        glm::vec3 tint = atmosphere.Transmittance(day.sun) / noonTransmittance * sunFade;
+        day.direction = -day.sun;
+        day.diffuse = sunLight.diffuse * tint;
+        day.specular = sunLight.specular * tint;
+    } else {
+        day.direction = day.sun;
+        day.diffuse = moonLight.diffuse * moonFade;
+        day.specular = moonLight.specular * moonFade;
     }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
+    day.ambient = atmosphere.Ambient(day.sun).Scaled(ambientScale);
+    day.ambient.Add(SphericalHarmonics::Uniform(moonLight.ambient * (1.0f - sunFade)));
+    day.lamps = 1.0f - glm::smoothstep(-0.05f, 0.1f, elevation);
+    day.night = 1.0f - glm::smoothstep(-0.1f, 0.05f, elevation);
+    return day;
 }
 
+// the sun's or the moon's light and the sky's at the current time of day
 void setDirLight(Shader shader)
 {
-    if(isDay)
-    {
-        // light on day
-        shader.setVec3("dirLight.direction", 0.7f, -1.5f, -0.5f);
-        shader.setVec3("dirLight.ambient", 0.23f, 0.24f, 0.14f);
-        shader.setVec3("dirLight.diffuse", 0.65f, 0.42f, 0.26f);
-        shader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-    }
-    else
-    {
-        // Light on night
-        shader.setVec3("dirLight.direction", -0.5f, -1.5f, -0.2f);
-        shader.setVec3("dirLight.ambient", 0.05f, 0.034f, 0.024f);
-        shader.setVec3("dirLight.diffuse", 0.05f, 0.052f, 0.036f);
-        shader.setVec3("dirLight.specular", 0.04f, 0.04f, 0.04f);
-    }
+    shader.setVec3("dirLight.direction", lighting.direction);
+    for (int i = 0; i < SphericalHarmonics::COEFFICIENTS; i++)
+        shader.setVec3("skyAmbient[" + std::to_string(i) + "]", lighting.ambient.coefficients[i]);
+    shader.setVec3("dirLight.diffuse", lighting.diffuse);
+    shader.setVec3("dirLight.specular", lighting.specular);
 }
 
 void setPointLight(Shader shader, PointLight pointLight, glm::vec3 lightPositions[])
 {
-    if(isDay)
+    if(lighting.lamps <= 0.0f)
     {
         // light on day
         shader.setVec3("pointLight[0].position", lightPositions[0]);
@@ -996,6 +1820,10 @@ void setPointLight(Shader shader, PointLight pointLight, glm::vec3 lightPosition
     }
     else
     {
+        // dimmed while the lamps warm up at dusk
+        pointLight.ambient *= lighting.lamps;
+        pointLight.diffuse *= lighting.lamps;
+        pointLight.specular *= lighting.lamps;
         shader.setVec3("pointLight[0].position", lightPositions[0]);
         shader.setVec3("pointLight[0].ambient", pointLight.ambient);
         shader.setVec3("pointLight[0].diffuse", pointLight.diffuse);
@@ -1060,7 +1888,7 @@ void setPointLight(Shader shader, PointLight pointLight, glm::vec3 lightPosition
 
 void setSpotLight(Shader shader, PointLight pointLight, glm::vec3 lightPositions[])
 {
-    if(isDay)
+    if(lighting.lamps <= 0.0f)
     {
         shader.setVec3("spotLight[0].position", lightPositions[0]);
         shader.setVec3("spotLight[0].direction", glm::vec3(0, 0.0, 0));
@@ -1133,8 +1961,8 @@ void setSpotLight(Shader shader, PointLight pointLight, glm::vec3 lightPositions
         shader.setVec3("spotLight[0].position", lightPositions[0]);
         shader.setVec3("spotLight[0].direction", glm::vec3(0.0, -1.0, 0));
         shader.setVec3("spotLight[0].ambient", glm::vec3(0.0, 0.0, 0.0));
-        shader.setVec3("spotLight[0].diffuse", glm::vec3(0.8, 0.8, 0.0));
-        shader.setVec3("spotLight[0].specular", glm::vec3(0.6, 0.6, 0.0));
+        shader.setVec3("spotLight[0].diffuse", glm::vec3(0.8, 0.8, 0.0) * lighting.lamps);
+        shader.setVec3("spotLight[0].specular", glm::vec3(0.6, 0.6, 0.0) * lighting.lamps);
         shader.setFloat("spotLight[0].constant", pointLight.constant);
         shader.setFloat("spotLight[0].linear", pointLight.linear);
         shader.setFloat("spotLight[0].quadratic", pointLight.quadratic);
@@ -1144,8 +1972,8 @@ void setSpotLight(Shader shader, PointLight pointLight, glm::vec3 lightPositions
         shader.setVec3("spotLight[1].position", lightPositions[1]);
         shader.setVec3("spotLight[1].direction", glm::vec3(0.0, -1.0, 0));
         shader.setVec3("spotLight[1].ambient", glm::vec3(0.0, 0.0, 0.0));
-        shader.setVec3("spotLight[1].diffuse", glm::vec3(0.8, 0.8, 0.0));
-        shader.setVec3("spotLight[1].specular", glm::vec3(0.6, 0.6, 0.0));
+        shader.setVec3("spotLight[1].diffuse", glm::vec3(0.8, 0.8, 0.0) * lighting.lamps);
+        shader.setVec3("spotLight[1].specular", glm::vec3(0.6, 0.6, 0.0) * lighting.lamps);
         shader.setFloat("spotLight[1].constant", pointLight.constant);
         shader.setFloat("spotLight[1].linear", pointLight.linear);
         shader.setFloat("spotLight[1].quadratic", pointLight.quadratic);
@@ -1155,8 +1983,8 @@ void setSpotLight(Shader shader, PointLight pointLight, glm::vec3 lightPositions
         shader.setVec3("spotLight[2].position", lightPositions[2]);
         shader.setVec3("spotLight[2].direction", glm::vec3(0.0, -1.0, 0));
         shader.setVec3("spotLight[2].ambient", glm::vec3(0.0, 0.0, 0.0));
-        shader.setVec3("spotLight[2].diffuse", glm::vec3(0.8, 0.8, 0.0));
-        shader.setVec3("spotLight[2].specular", glm::vec3(0.6, 0.6, 0.0));
+        shader.setVec3("spotLight[2].diffuse", glm::vec3(0.8, 0.8, 0.0) * lighting.lamps);
+        shader.setVec3("spotLight[2].specular", glm::vec3(0.6, 0.6, 0.0) * lighting.lamps);
         shader.setFloat("spotLight[2].constant", pointLight.constant);
         shader.setFloat("spotLight[2].linear", pointLight.linear);
         shader.setFloat("spotLight[2].quadratic", pointLight.quadratic);
@@ -1166,8 +1994,8 @@ void setSpotLight(Shader shader, PointLight pointLight, glm::vec3 lightPositions
         shader.setVec3("spotLight[3].position", lightPositions[3]);
         shader.setVec3("spotLight[3].direction", glm::vec3(0.0, -1.0, 0));
         shader.setVec3("spotLight[3].ambient", glm::vec3(0.0, 0.0, 0.0));
-        shader.setVec3("spotLight[3].diffuse", glm::vec3(0.8, 0.8, 0.0));
-        shader.setVec3("spotLight[3].specular", glm::vec3(0.6, 0.6, 0.0));
+        shader.setVec3("spotLight[3].diffuse", glm::vec3(0.8, 0.8, 0.0) * lighting.lamps);
+        shader.setVec3("spotLight[3].specular", glm::vec3(0.6, 0.6, 0.0) * lighting.lamps);
         shader.setFloat("spotLight[3].constant", pointLight.constant);
         shader.setFloat("spotLight[3].linear", pointLight.linear);
         shader.setFloat("spotLight[3].quadratic", pointLight.quadratic);
@@ -1177,8 +2005,8 @@ void setSpotLight(Shader shader, PointLight pointLight, glm::vec3 lightPositions
         shader.setVec3("spotLight[4].position", lightPositions[4]);
         shader.setVec3("spotLight[4].direction", glm::vec3(0.0, -1.0, 0));
         shader.setVec3("spotLight[4].ambient", glm::vec3(0.0, 0.0, 0.0));
-        shader.setVec3("spotLight[4].diffuse", glm::vec3(0.8, 0.8, 0.0));
-        shader.setVec3("spotLight[4].specular", glm::vec3(0.6, 0.6, 0.0));
+        shader.setVec3("spotLight[4].diffuse", glm::vec3(0.8, 0.8, 0.0) * lighting.lamps);
+        shader.setVec3("spotLight[4].specular", glm::vec3(0.6, 0.6, 0.0) * lighting.lamps);
         shader.setFloat("spotLight[4].constant", pointLight.constant);
         shader.setFloat("spotLight[4].linear", pointLight.linear);
         shader.setFloat("spotLight[4].quadratic", pointLight.quadratic);
@@ -1188,8 +2016,8 @@ void setSpotLight(Shader shader, PointLight pointLight, glm::vec3 lightPositions
         shader.setVec3("spotLight[5].position", lightPositions[5]);
         shader.setVec3("spotLight[5].direction", glm::vec3(0.0, -1.0, 0));
         shader.setVec3("spotLight[5].ambient", glm::vec3(0.0, 0.0, 0.0));
-        shader.setVec3("spotLight[5].diffuse", glm::vec3(0.8, 0.8, 0.0));
-        shader.setVec3("spotLight[5].specular", glm::vec3(0.6, 0.6, 0.0));
+        shader.setVec3("spotLight[5].diffuse", glm::vec3(0.8, 0.8, 0.0) * lighting.lamps);
+        shader.setVec3("spotLight[5].specular", glm::vec3(0.6, 0.6, 0.0) * lighting.lamps);
         shader.setFloat("spotLight[5].constant", pointLight.constant);
         shader.setFloat("spotLight[5].linear", pointLight.linear);
         shader.setFloat("spotLight[5].quadratic", pointLight.quadratic);
@@ -1198,6 +2026,337 @@ void setSpotLight(Shader shader, PointLight pointLight, glm::vec3 lightPositions
     }
 }
 
+// the point and spot light every lamp shines with at night, dimmed at dusk and dawn, for the deferred
+// lighting pass and the clustered forward shaders; the positions come per lamp from DeferredRenderer::Light
+// or the clusters
+void setLampLight(Shader shader, PointLight pointLight)
+{
+    shader.setVec3("pointLight.ambient", pointLight.ambient * lighting.lamps);
+    shader.setVec3("pointLight.diffuse", pointLight.diffuse * lighting.lamps);
+    shader.setVec3("pointLight.specular", pointLight.specular * lighting.lamps);
+    shader.setFloat("pointLight.constant", pointLight.constant);
+    shader.setFloat("pointLight.linear", pointLight.linear);
+    shader.setFloat("pointLight.quadratic", pointLight.quadratic);
+
+    shader.setVec3("spotLight.direction", glm::vec3(0.0, -1.0, 0));
+    shader.setVec3("spotLight.ambient", glm::vec3(0.0, 0.0, 0.0));
+    shader.setVec3("spotLight.diffuse", lampSpotDiffuse * lighting.lamps);
+    shader.setVec3("spotLight.specular", glm::vec3(0.6, 0.6, 0.0) * lighting.lamps);
+    shader.setFloat("spotLight.constant", pointLight.constant);
+    shader.setFloat("spotLight.linear", pointLight.linear);
+    shader.setFloat("spotLight.quadratic", pointLight.quadratic);
+    shader.setFloat("spotLight.cutOff", glm::cos(glm::radians(lampSpotInner)));
+    shader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(lampSpotOuter)));
+}
+
+// binds the lamp lists the forward shaders loop over, per cluster or per object; the shader must be in use
+void bindLampLists(Shader &shader, const LightClusters &clusters, const ObjectLights &objectLights,
+                   const SpotShadows *spotShadows)
+{
+    if (programState->ObjectLightLists)
+        objectLights.Bind(shader);
+    else
+        clusters.Bind(shader);
+    if (spotShadows)
+        spotShadows->Bind(shader);
+}
+
+// the cascades, or none for shaders compiled with SUN_SHADOWS while the shadows are off
+void bindSunShadows(Shader &shader, const SunShadows *sunShadows)
+{
+    if (sunShadows)
+        sunShadows->Bind(shader);
+    else
+        SunShadows::Disable(shader);
+}
+
+// the road's relief for the permutation picked this frame; binds the cone step map when there is one
+void setParallax(Shader &shader, const ConeStepMap *coneStepMap)
+{
+    shader.setFloat("heightScale", heightScale);
+    shader.setVec2("parallaxLayers", glm::vec2(programState->ParallaxLayers / 4, programState->ParallaxLayers));
+    shader.setVec2("parallaxFade", glm::vec2(programState->ParallaxDistance * 0.5f, programState->ParallaxDistance));
+    shader.setVec4("parallaxBounds", roadTextureBounds);
+    if (coneStepMap)
+    {
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, coneStepMap->Texture());
+        glActiveTexture(GL_TEXTURE0);
+    }
+}
+
+// lays the scene out in the lightmap atlas and loads what was baked for it, if anything was; without a
+// lightmap the static geometry is lit live
+bool loadLightmaps(const Scene &scene, const std::vector<Model *> &sceneModels, Lightmaps &lightmaps,
+                   const std::string &path)
+{
+    lightmaps.Clear();
+    if (!Lightmaps::Exists(path) || !lightmaps.Layout(scene, sceneModels))
+        return false;
+    if (lightmaps.Load(path))
+        return true;
+    lightmaps.Clear();
+    return false;
+}
+
+// the average colour of a texture, read from its smallest mipmap
+glm::vec3 textureAverage(unsigned int texture)
+{
+    int width = 0, height = 0;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    int level = (int) std::floor(std::log2((float) std::max(1, std::max(width, height))));
+    float texel[4] = {0.5f, 0.5f, 0.5f, 1.0f};
+    glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_FLOAT, texel);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return glm::vec3(texel[0], texel[1], texel[2]);
+}
+
+// a light set as setDirLight and setLampLight give it to the shaders: at noon the sun, at midnight the
+// moon and every lamp
+LightmapBaker::Lights lightmapLights(bool day, const Scene &scene, const SceneCulling &culling,
+                                     const PointLight &pointLight, float lightRadius)
+{
+    const DayLighting dirLight = dayLightingAt(day ? 12.0f : 0.0f);
+    LightmapBaker::Lights lights;
+    lights.sunDirection = dirLight.direction;
+    lights.sky = dirLight.ambient;
+    lights.sunDiffuse = dirLight.diffuse;
+    if (day)
+        return lights;
+    lights.lamps = scene.lights;
+    // the lamp post a lamp sits in doesn't shadow it
+    for (const glm::vec3 &lamp : scene.lights)
+    {
+        int owner = -1;
+        for (unsigned int i = 0; i < scene.instances.size() && owner < 0; i++)
+            if (culling.instanceBounds.Get(i).Contains(lamp))
+                owner = (int) i;
+        lights.lampOwners.push_back(owner);
+    }
+    lights.pointAmbient = pointLight.ambient;
+    lights.pointDiffuse = pointLight.diffuse;
+    lights.spotDiffuse = lampSpotDiffuse;
+    lights.constant = pointLight.constant;
+    lights.linear = pointLight.linear;
+    lights.quadratic = pointLight.quadratic;
+    lights.cutOff = glm::cos(glm::radians(lampSpotInner));
+    lights.outerCutOff = glm::cos(glm::radians(lampSpotOuter));
+    lights.radius = lightRadius;
+    return lights;
+}
+
+// bakes the day and the night light of the laid-out lightmaps and writes them to path; dynamic models
+// neither get a lightmap nor cast shadows into one, instances left out of the atlas still do
+void bakeLightmaps(const Scene &scene, const std::vector<Model *> &sceneModels, const SceneCulling &culling,
+                   Lightmaps &lightmaps, JobSystem &jobs, const PointLight &pointLight, float lightRadius,
+                   unsigned int grassTexture, unsigned int roadTexture, const std::string &path)
+{
+    LightmapBaker baker(jobs, lightmaps.Width(), lightmaps.Height());
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> texels;
+    std::map<unsigned int, glm::vec3> albedos;
+    for (unsigned int i = 0; i < scene.instances.size(); i++)
+    {
+        if (scene.models[scene.instances[i].model].flags & SCENE_MODEL_DYNAMIC)
+            continue;
+        const glm::mat4 &transform = scene.transforms[i];
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+        const LightmapRect &rect = lightmaps.instanceRects[i];
+        for (const Mesh &mesh : sceneModels[scene.instances[i].model]->meshes)
+        {
+            positions.clear();
+            normals.clear();
+            texels.clear();
+            for (const Vertex &vertex : mesh.vertices)
+            {
+                positions.push_back(glm::vec3(transform * glm::vec4(vertex.Position, 1.0f)));
+                normals.push_back(glm::normalize(normalMatrix * vertex.Normal));
+                if (!rect.Empty())
+                    texels.push_back(rect.Texel(vertex.LightmapCoords));
+            }
+            glm::vec3 albedo(0.5f);
+            for (const Texture &texture : mesh.textures)
+                if (texture.type == "texture_diffuse")
+                {
+                    if (!albedos.count(texture.id))
+                        albedos[texture.id] = textureAverage(texture.id);
+                    albedo = albedos[texture.id];
+                    break;
+                }
+            baker.AddTriangles(positions, normals, texels, mesh.indices, albedo, (int) i);
+        }
+    }
+
+    // the grass plane (planeVertices) and the road quad of every tile, both facing up
+    const std::vector<unsigned int> quad = {0, 1, 2, 0, 2, 3};
+    const std::vector<glm::vec2> corners = {glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(1.0f, 1.0f),
+                                            glm::vec2(0.0f, 1.0f)};
+    const std::vector<glm::vec3> up(4, glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::vec3 grassAlbedo = textureAverage(grassTexture), roadAlbedo = textureAverage(roadTexture);
+    for (unsigned int i = 0; i < scene.tiles.size(); i++)
+    {
+        positions.clear();
+        texels.clear();
+        for (const glm::vec2 &corner : corners)
+        {
+            glm::vec3 local(glm::mix(-5.0f, 5.0f, corner.x), -0.5f, glm::mix(-5.0f, 5.0f, corner.y));
+            positions.push_back(glm::vec3(grassTransform(scene.tiles[i]) * glm::vec4(local, 1.0f)));
+            texels.push_back(lightmaps.groundRects[i].Texel(corner));
+        }
+        baker.AddTriangles(positions, up, texels, quad, grassAlbedo, -1);
+        positions.clear();
+        texels.clear();
+        for (const glm::vec2 &corner : corners)
+        {
+            glm::vec2 local = glm::mix(roadMin, roadMax, corner);
+            positions.push_back(glm::vec3(roadTransform(scene.tiles[i]) * glm::vec4(local.x, roadHeight, local.y, 1.0f)));
+            texels.push_back(lightmaps.roadRects[i].Texel(corner));
+        }
+        baker.AddTriangles(positions, up, texels, quad, roadAlbedo, -1);
+    }
+
+    std::vector<glm::vec3> irradiance;
+    const char *names[Lightmaps::LIGHTMAP_SETS] = {"day", "night"};
+    for (int set = 0; set < Lightmaps::LIGHTMAP_SETS; set++)
+    {
+        double start = glfwGetTime();
+        baker.Bake(lightmapLights(set == Lightmaps::LIGHTMAP_DAY, scene, culling, pointLight, lightRadius),
+                   irradiance);
+        lightmaps.Store((Lightmaps::LightSet) set, irradiance);
+        std::cout << "Baked the " << names[set] << " lightmap: " << baker.TexelCount() << " texels of "
+                  << lightmaps.Width() << " x " << lightmaps.Height() << ", " << baker.TriangleCount()
+                  << " triangles, " << (glfwGetTime() - start) << " s on " << jobs.ThreadCount() << " threads"
+                  << std::endl;
+    }
+    if (lightmaps.Save(path))
+        std::cout << "Wrote " << path << std::endl;
+}
+
+// resolves the scene's model table to loaded models; each path is loaded once and kept
+// across scene reloads, so hot-reloading only pays for models that were not used before
+// --------------------------------------------------------------------------------------
+void loadSceneModels(const Scene &scene, std::vector<Model *> &sceneModels)
+{
+    static std::map<std::string, std::unique_ptr<Model>> loadedModels;
+
+    sceneModels.clear();
+    for (const SceneModel &sceneModel : scene.models)
+    {
+        std::unique_ptr<Model> &model = loadedModels[sceneModel.path];
+        if (!model)
+        {
+            model.reset(new Model(sceneModel.path));
+            model->SetShaderTextureNamePrefix("material.");
+        }
+        sceneModels.push_back(model.get());
+    }
+}
+
+// loads the scene's models, computes the world-space bounds used for culling and builds the HLOD proxies
+// ------------------------------------------------------------------------------------------------------
+void prepareScene(const Scene &scene, std::vector<Model *> &sceneModels, SceneCulling &culling, float lightRadius,
+                  HierarchicalLod &hlod)
+{
+    loadSceneModels(scene, sceneModels);
+    std::vector<AABB> modelBounds;
+    for (Model *model : sceneModels)
+        modelBounds.push_back(model->bounds);
+    culling.Build(scene, modelBounds, lightRadius);
+    hlod.Build(scene, sceneModels);
+}
+
+// the lighting shaders take a fixed number of lamps: upload the visible ones closest to the viewer,
+// and park the unused slots far below the ground
+// --------------------------------------------------------------------------------------------------
+void selectLights(const Scene &scene, const SceneCulling &culling, const glm::vec3 &viewPosition,
+                  glm::vec3 lightPositions[])
+{
+    std::vector<std::pair<float, unsigned int>> candidates;
+    for (unsigned int i = 0; i < scene.lights.size(); i++)
+    {
+        if (!culling.lightVisible[i])
+            continue;
+        glm::vec3 offset = scene.lights[i] - viewPosition;
+        candidates.push_back(std::make_pair(glm::dot(offset, offset), i));
+    }
+    unsigned int count = std::min<size_t>(candidates.size(), NUM_LIGHTS);
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+
+    for (unsigned int i = 0; i < NUM_LIGHTS; i++)
+        lightPositions[i] = i < count ? scene.lights[candidates[i].second] : glm::vec3(0.0f, -10000.0f, 0.0f);
+}
+
+// draws the meshes of a model whose bounding spheres intersect the frustum (all of them when frustum is null)
+// at the given level of detail; the opaque ones, or with translucent the translucent ones
+// ------------------------------------------------------------------------------------------------------------
+void drawModel(Model &model, Shader &shader, const glm::mat4 &transform, const Frustum *frustum, unsigned int lod,
+               bool depthOnly, bool translucent)
+{
+    for (Mesh &mesh : model.meshes)
+    {
+        // the opaque passes leave translucent meshes out, the translucent pass draws only those
+        if ((mesh.opacity < 1.0f) != translucent)
+            continue;
+        if (frustum && model.meshes.size() > 1)
+        {
+            BoundingSphere sphere = mesh.sphere.Transformed(transform);
+            if (!frustum->IntersectsSphere(sphere.center, sphere.radius))
+            {
+                if (!depthOnly)
+                    rg::frameStats().meshesCulled++;
+                continue;
+            }
+        }
+        if (translucent)
+            shader.setFloat("opacity", mesh.opacity);
+        if (depthOnly)
+            mesh.DrawDepth(lod);
+        else
+            mesh.Draw(shader, lod);
+    }
+}
+
+// draws one selected instance, both levels with complementary dithers while it cross-fades; the
+// depth pre-pass and the shading pass go through here so they produce the same fragments
+void drawInstance(const Scene &scene, const std::vector<Model *> &sceneModels, OcclusionCulling &occlusion,
+                  Shader &shader, const InstanceDraw &draw, const Frustum *frustum, bool depthOnly,
+                  bool translucent)
+{
+    Model &instanceModel = *sceneModels[scene.instances[draw.instance].model];
+    const glm::mat4 &transform = scene.transforms[draw.instance];
+    shader.setMat4("model", transform);
+    occlusion.BeginConditional(draw.instance);
+    if (draw.lod.Fading()) {
+        shader.setFloat("lodFade", draw.lod.fade);
+        shader.setBool("lodFadeIn", false);
+        drawModel(instanceModel, shader, transform, frustum, draw.lod.previous, depthOnly, translucent);
+        shader.setBool("lodFadeIn", true);
+    }
+    drawModel(instanceModel, shader, transform, frustum, draw.lod.level, depthOnly, translucent);
+    if (draw.lod.Fading())
+        shader.setFloat("lodFade", 1.0f);
+    occlusion.EndConditional(draw.instance);
+}
+
+glm::mat4 vegetationTransform(const SceneVegetation &plant)
+{
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), plant.position);
+    return glm::scale(model, glm::vec3(plant.scale));
+}
+
+glm::mat4 grassTransform(const glm::vec2 &tile)
+{
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(tile.x, 0.0f, tile.y));
+    return glm::scale(model, glm::vec3(10, 0, 10));
+}
+
+glm::mat4 roadTransform(const glm::vec2 &tile)
+{
+    return glm::translate(glm::mat4(1.0f), glm::vec3(tile.x, 0.0f, tile.y));
+}
+
 // renders a 1x1 quad in NDC with manually calculated tangent vectors
 // ------------------------------------------------------------------
 unsigned int quadVAO = 0;
@@ -1207,17 +2366,22 @@ void renderQuad()
     if (quadVAO == 0)
     {
         // positions
-        glm::vec3 pos1(3.8f,  0.05f,  49.97f);
-        glm::vec3 pos2(-6.3f, 0.05f,  49.97f);
-        glm::vec3 pos3( -6.3f, 0.05f, -50.0f);
-        glm::vec3 pos4( 3.8f, 0.05f, -50.0f);
+        glm::vec3 pos1(roadMax.x, roadHeight, roadMax.y);
+        glm::vec3 pos2(roadMin.x, roadHeight, roadMax.y);
+        glm::vec3 pos3(roadMin.x, roadHeight, roadMin.y);
+        glm::vec3 pos4(roadMax.x, roadHeight, roadMin.y);
         // texture coordinates
         glm::vec2 uv1(1.0f, 0.0f);
         glm::vec2 uv2(0.0f, 0.0f);
         glm::vec2 uv3(0.0f, 7.5);
         glm::vec2 uv4(1.0f, 7.5f);
-        // normal vector
-        glm::vec3 nm(0.0f, 0.0f, 1.0f);
+        // lightmap coordinates, the tile's road rectangle of the atlas
+        glm::vec2 lm1(1.0f, 1.0f);
+        glm::vec2 lm2(0.0f, 1.0f);
+        glm::vec2 lm3(0.0f, 0.0f);
+        glm::vec2 lm4(1.0f, 0.0f);
+        // normal vector, the road lies in the xz plane
+        glm::vec3 nm(0.0f, 1.0f, 0.0f);
 
         // calculate tangent/bitangent vectors of both triangles
         glm::vec3 tangent1, bitangent1;
@@ -1259,14 +2423,14 @@ void renderQuad()
 
 
         float quadVertices[] = {
-                // positions            // normal         // texcoords  // tangent                          // bitangent
-                pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-                pos2.x, pos2.y, pos2.z, nm.x, nm.y, nm.z, uv2.x, uv2.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-                pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-
-                pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z,
-                pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z,
-                pos4.x, pos4.y, pos4.z, nm.x, nm.y, nm.z, uv4.x, uv4.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z
+                // positions            // normal         // texcoords  // tangent                          // bitangent                                // lightmap coords
+                pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z, lm1.x, lm1.y,
+                pos2.x, pos2.y, pos2.z, nm.x, nm.y, nm.z, uv2.x, uv2.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z, lm2.x, lm2.y,
+                pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z, lm3.x, lm3.y,
+
+                pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z, lm1.x, lm1.y,
+                pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z, lm3.x, lm3.y,
+                pos4.x, pos4.y, pos4.z, nm.x, nm.y, nm.z, uv4.x, uv4.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z, lm4.x, lm4.y
         };
         // configure plane VAO
         glGenVertexArrays(1, &quadVAO);
@@ -1275,17 +2439,50 @@ void renderQuad()
         glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(3 * sizeof(float)));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(3 * sizeof(float)));
         glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(6 * sizeof(float)));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(6 * sizeof(float)));
         glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(8 * sizeof(float)));
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(8 * sizeof(float)));
         glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(11 * sizeof(float)));
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(11 * sizeof(float)));
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(14 * sizeof(float)));
     }
     glBindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLES, 0, 6);
     glBindVertexArray(0);
-}
\ No newline at end of file
+}
+// rasterizes proxies of the visible occluders on the CPU and hides the instances and lights behind them
+void cullOccludedOnCPU(const Scene &scene, const std::vector<Model *> &sceneModels, SceneCulling &culling,
+                       SoftwareOcclusion &occlusion, const glm::mat4 &viewProjection)
+{
+    occlusion.Clear();
+    for (unsigned int i = 0; i < scene.instances.size(); i++)
+    {
+        uint32_t model = scene.instances[i].model;
+        if (culling.instanceVisible[i] && (scene.models[model].flags & SCENE_MODEL_OCCLUDER))
+            occlusion.AddOccluderBox(SoftwareOcclusion::ProxyBox(sceneModels[model]->bounds), scene.transforms[i]);
+    }
+    occlusion.Rasterize(viewProjection);
+
+    size_t hiddenInstances = occlusion.Cull(culling.instanceBounds, culling.instanceVisible);
+    size_t hiddenLights = occlusion.Cull(culling.lightBounds, culling.lightVisible);
+    culling.visibleInstances -= hiddenInstances;
+    culling.visibleLights -= hiddenLights;
+    rg::frameStats().instancesOccluded += hiddenInstances;
+    rg::frameStats().lightsOccluded += hiddenLights;
+}
+
+// world-space direction of the ray through a window pixel
+glm::vec3 pickRay(const glm::mat4 &projection, const glm::mat4 &view, double x, double y)
+{
+    float ndcX = (float) (2.0 * x / SCR_WIDTH - 1.0);
+    float ndcY = (float) (1.0 - 2.0 * y / SCR_HEIGHT);
+    glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+    return glm::normalize(glm::vec3(farPoint) / farPoint.w - glm::vec3(nearPoint) / nearPoint.w);
+}